@@ -0,0 +1,5 @@
+// Host stand-in for mbed::I2C, the simulator never talks to the eeprom
+#pragma once
+namespace mbed {
+    class I2C {};
+}
@@ -0,0 +1,3 @@
+// Host stand-in, see libs/LPC17xx/sLPC17xx.h
+#pragma once
+#include "libs/LPC17xx/sLPC17xx.h"
@@ -0,0 +1,13 @@
+// Host stand-in for mbed::PwmOut, the duty cycle is just remembered so the simulator can check what was written
+#pragma once
+namespace mbed {
+    class PwmOut {
+        public:
+            PwmOut() : duty(0) {}
+            void write(float value) { duty = value; }
+            float read() { return duty; }
+            void period_us(int us) {}
+        private:
+            float duty;
+    };
+}
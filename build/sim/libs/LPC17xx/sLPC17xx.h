@@ -0,0 +1,120 @@
+/*
+      Host stand-in for the LPC17xx peripheral header, used only by the motion simulator (rake simulator=1).
+      The registers touched by the motion code are backed by plain memory so Pin, StepTicker etc compile unchanged.
+*/
+
+#ifndef __LPC17xx_H__
+#define __LPC17xx_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define __I  volatile
+#define __O  volatile
+#define __IO volatile
+
+typedef enum IRQn {
+    PendSV_IRQn  = -2,
+    SysTick_IRQn = -1,
+    TIMER0_IRQn  = 1,
+    TIMER1_IRQn  = 2,
+    TIMER2_IRQn  = 3,
+    TIMER3_IRQn  = 4,
+    UART0_IRQn   = 5,
+    PWM1_IRQn    = 9,
+    EINT3_IRQn   = 21,
+    RIT_IRQn     = 29,
+} IRQn_Type;
+
+typedef struct {
+    __IO uint32_t FIODIR;
+    uint32_t RESERVED0[3];
+    __IO uint32_t FIOMASK;
+    __IO uint32_t FIOPIN;
+    __IO uint32_t FIOSET;
+    __O  uint32_t FIOCLR;
+} LPC_GPIO_TypeDef;
+
+typedef struct {
+    __IO uint32_t IR;
+    __IO uint32_t TCR;
+    __IO uint32_t TC;
+    __IO uint32_t PR;
+    __IO uint32_t PC;
+    __IO uint32_t MCR;
+    __IO uint32_t MR0;
+    __IO uint32_t MR1;
+    __IO uint32_t MR2;
+    __IO uint32_t MR3;
+    __IO uint32_t CCR;
+    __I  uint32_t CR0;
+    __I  uint32_t CR1;
+    __IO uint32_t EMR;
+    __IO uint32_t CTCR;
+} LPC_TIM_TypeDef;
+
+typedef struct {
+    __IO uint32_t PCONP;
+    __IO uint32_t PCLKSEL0;
+    __IO uint32_t PCLKSEL1;
+} LPC_SC_TypeDef;
+
+typedef struct {
+    __IO uint32_t WDMOD;
+    __IO uint32_t WDTC;
+    __O  uint32_t WDFEED;
+    __I  uint32_t WDTV;
+    __IO uint32_t WDCLKSEL;
+} LPC_WDT_TypeDef;
+
+// the cycle counter does not count on the host, the simulator times the step ticker with the host clock itself
+typedef struct {
+    __IO uint32_t CTRL;
+    __IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+extern LPC_WDT_TypeDef sim_wdt;
+extern DWT_Type sim_dwt;
+extern CoreDebug_Type sim_core_debug;
+extern LPC_GPIO_TypeDef sim_gpio[5];
+extern LPC_TIM_TypeDef sim_tim[4];
+extern LPC_SC_TypeDef sim_sc;
+extern uint32_t SystemCoreClock;
+
+static inline void NVIC_EnableIRQ(IRQn_Type) {}
+static inline void NVIC_DisableIRQ(IRQn_Type) {}
+static inline void NVIC_SetPriority(IRQn_Type, uint32_t) {}
+static inline void NVIC_SetPendingIRQ(IRQn_Type) {}
+static inline void NVIC_SetPriorityGrouping(uint32_t) {}
+static inline void NVIC_SystemReset(void) { exit(1); }
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+#ifdef __cplusplus
+}
+#endif
+
+#define LPC_GPIO0 (&sim_gpio[0])
+#define LPC_GPIO1 (&sim_gpio[1])
+#define LPC_GPIO2 (&sim_gpio[2])
+#define LPC_GPIO3 (&sim_gpio[3])
+#define LPC_GPIO4 (&sim_gpio[4])
+#define LPC_TIM0  (&sim_tim[0])
+#define LPC_TIM1  (&sim_tim[1])
+#define LPC_TIM2  (&sim_tim[2])
+#define LPC_TIM3  (&sim_tim[3])
+#define LPC_SC    (&sim_sc)
+#define LPC_WDT   (&sim_wdt)
+#define DWT       (&sim_dwt)
+#define CoreDebug (&sim_core_debug)
+
+#endif
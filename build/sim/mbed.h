@@ -0,0 +1,20 @@
+// Host stand-in for the mbed library, used only by the motion simulator (rake simulator=1)
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <vector>
+#include <string>
+#include "libs/LPC17xx/sLPC17xx.h"
+#include "I2C.h"
+
+// the real mbed headers leak this and the firmware relies on it
+using namespace std;
+
+// simulated time in microseconds, advanced by the simulator as it runs the step ticker
+extern "C" uint32_t us_ticker_read(void);
+extern "C" void wait_us(int us);
+extern "C" void wait_ms(int ms);
+extern "C" void wait(float s);
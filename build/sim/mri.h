@@ -0,0 +1,4 @@
+// Host stand-in for the MRI debug monitor
+#pragma once
+#include <stdlib.h>
+static inline void __debugbreak(void) { abort(); }
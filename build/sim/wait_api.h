@@ -0,0 +1,3 @@
+// Host stand-in, see mbed.h
+#pragma once
+#include "mbed.h"
@@ -20,6 +20,7 @@
 #include "libs/PublicData.h"
 #include "modules/communication/SerialConsole.h"
 #include "modules/communication/GcodeDispatch.h"
+#include "modules/communication/utils/Gcode.h"
 #include "modules/robot/Planner.h"
 #include "modules/robot/Robot.h"
 #include "modules/robot/Conveyor.h"
@@ -91,6 +92,9 @@ Kernel::Kernel()
     cachewait = false;
 
     instance = this; // setup the Singleton instance of the kernel    
+
+    // before anything else takes AHB SRAM, a Gcode is created for every command
+    bool gcode_pool = Gcode::pool.reserve();
     
     // init I2C
     this->i2c = new mbed::I2C(P0_27, P0_28);
@@ -167,6 +171,7 @@ Kernel::Kernel()
     this->ok_per_line = this->config->value( ok_per_line_checksum )->by_default(true)->as_bool();
 
     this->add_module( this->serial );
+    if(!gcode_pool) this->streams->printf("WARNING: no AHB SRAM for the Gcode pool, every Gcode is allocated on the heap\n");
 
     // HAL stuff
     add_module( this->slow_ticker = new(AHB0) SlowTicker());
@@ -0,0 +1,72 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ObjectPool.h"
+
+#include "MemoryPool.h"
+#include "platform_memory.h"
+
+ObjectPool::ObjectPool(size_t slot_size, uint16_t n)
+{
+    // keep every slot aligned for whatever goes in it
+    this->slot_size = (slot_size + 7) & ~7;
+    this->n = n;
+    base = NULL;
+    free_list = NULL;
+    in_use = 0;
+    peak = 0;
+    allocs = 0;
+    misses = 0;
+    allocs_last_sec = 0;
+    allocs_per_sec = 0;
+}
+
+bool ObjectPool::reserve()
+{
+    if(base != NULL) return true;
+    void *v = AHB1.alloc(slot_size * n);
+    if(v == NULL) v = AHB0.alloc(slot_size * n);
+    if(v == NULL) return false;
+
+    base = (char *)v;
+    for (uint16_t i = 0; i < n; ++i) {
+        void **slot = (void **)(base + i * slot_size);
+        *slot = free_list;
+        free_list = slot;
+    }
+    return true;
+}
+
+void* ObjectPool::alloc()
+{
+    allocs++;
+    if(free_list == NULL) {
+        misses++;
+        return NULL;
+    }
+
+    void **slot = (void **)free_list;
+    free_list = *slot;
+    if(++in_use > peak) peak = in_use;
+    return slot;
+}
+
+bool ObjectPool::dealloc(void* p)
+{
+    if(base == NULL || (char *)p < base || (char *)p >= base + slot_size * n) return false;
+
+    *(void **)p = free_list;
+    free_list = p;
+    in_use--;
+    return true;
+}
+
+void ObjectPool::second_tick()
+{
+    allocs_per_sec = allocs - allocs_last_sec;
+    allocs_last_sec = allocs;
+}
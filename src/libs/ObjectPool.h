@@ -0,0 +1,56 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _OBJECTPOOL_H
+#define _OBJECTPOOL_H
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * A fixed number of equal sized slots for objects that are created and destroyed all the time (like a Gcode per
+ * command) so they do not fragment the heap. The slots are taken from AHB SRAM in one go by reserve(), which the
+ * Kernel calls at boot before the modules take the rest of it, after that alloc and dealloc just pop and push a
+ * free list.
+ * alloc returns NULL when all slots are in use, or none could be reserved, the caller then uses the heap.
+ */
+class ObjectPool
+{
+public:
+    ObjectPool(size_t slot_size, uint16_t n);
+
+    // false if there is no room for the slots in AHB SRAM
+    bool reserve();
+    bool is_reserved() const { return base != NULL; }
+    void* alloc();
+    // false if p is not one of our slots
+    bool  dealloc(void* p);
+
+    // counters, call second_tick once a second for the rate
+    void second_tick();
+
+    uint16_t get_size() const { return n; }
+    uint16_t get_in_use() const { return in_use; }
+    uint16_t get_peak() const { return peak; }
+    uint32_t get_allocs() const { return allocs; }
+    uint32_t get_misses() const { return misses; }
+    uint32_t get_allocs_per_sec() const { return allocs_per_sec; }
+
+private:
+    char *base;
+    void *free_list;
+    size_t slot_size;
+    uint16_t n;
+    uint16_t in_use;
+    uint16_t peak;
+    uint32_t allocs;            // from the pool and the heap
+    uint32_t misses;            // had to use the heap
+    uint32_t allocs_last_sec;
+    uint32_t allocs_per_sec;
+};
+
+#endif /* _OBJECTPOOL_H */
@@ -15,6 +15,7 @@
 #include "StreamOutputPool.h"
 #include "Block.h"
 #include "Conveyor.h"
+#include "Planner.h"
 
 #include "system_LPC17xx.h" // mbed.h lib
 #include <math.h>
@@ -54,6 +55,22 @@ StepTicker::StepTicker()
 
     this->running = false;
     this->current_block = nullptr;
+    this->jerk = 0;
+    this->jerk_decel = false;
+    this->jerk_phase = 0;
+    this->next_jerk_event = 0;
+    this->num_active = 0;
+    this->cycle_stats.ticks = 0;
+    this->cycle_stats.min = UINT32_MAX;
+    this->cycle_stats.max = 0;
+    this->cycle_stats.total = 0;
+    this->cycle_stats.starts = 0;
+    this->cycle_stats.max_start = 0;
+    this->step_sync_fnc = nullptr;
+    this->step_sync_object = nullptr;
+    this->sync_steps = 0;
+    this->next_sync_step = 0;
+    this->primary_motor = 0;
 
     #ifdef STEPTICKER_DEBUG_PIN
     // setup debug pin if defined
@@ -69,6 +86,11 @@ StepTicker::~StepTicker()
 //called when everything is setup and interrupts can start
 void StepTicker::start()
 {
+    // the cycle counter times the step tick ISR
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
     NVIC_EnableIRQ(TIMER0_IRQn);     // Enable interrupt handler
     NVIC_EnableIRQ(TIMER1_IRQn);     // Enable interrupt handler
     current_tick= 0;
@@ -113,9 +135,66 @@ extern "C" void TIMER1_IRQHandler (void)
 // The actual interrupt handler where we do all the work
 extern "C" void TIMER0_IRQHandler (void)
 {
+    uint32_t start = DWT->CYCCNT;
     // Reset interrupt register
     LPC_TIM0->IR |= 1 << 0;
-    StepTicker::getInstance()->step_tick();
+    StepTicker *st = StepTicker::getInstance();
+    bool idle = st->is_idle();
+    const Block *block = st->get_current_block();
+    st->step_tick();
+    // ticks with nothing to do would only hide what the ones running blocks take
+    if(!idle || !st->is_idle()) st->record_cycles(DWT->CYCCNT - start, st->get_current_block() != block && !st->is_idle());
+}
+
+uint32_t StepTicker::get_ticks_left() const
+{
+    // a snapshot, the ISR can move on to the next block while this looks
+    const Block *b = current_block;
+    uint32_t tick = current_tick;
+    if(!running || b == nullptr || tick >= b->total_move_ticks) return 0;
+    return b->total_move_ticks - tick;
+}
+
+// only called from the step tick ISR
+void StepTicker::record_cycles(uint32_t cycles, bool started)
+{
+    ++cycle_stats.ticks;
+    cycle_stats.total += cycles;
+    if(cycles < cycle_stats.min) cycle_stats.min = cycles;
+    if(cycles > cycle_stats.max) cycle_stats.max = cycles;
+    if(started) {
+        ++cycle_stats.starts;
+        if(cycles > cycle_stats.max_start) cycle_stats.max_start = cycles;
+    }
+}
+
+StepTicker::CycleStats StepTicker::get_cycle_stats() const
+{
+    __disable_irq();
+    CycleStats cs = cycle_stats;
+    __enable_irq();
+    return cs;
+}
+
+void StepTicker::reset_cycle_stats()
+{
+    __disable_irq();
+    cycle_stats.ticks = 0;
+    cycle_stats.min = UINT32_MAX;
+    cycle_stats.max = 0;
+    cycle_stats.total = 0;
+    cycle_stats.starts = 0;
+    cycle_stats.max_start = 0;
+    __enable_irq();
+}
+
+void StepTicker::set_step_sync(step_sync_t fnc, void *object, uint32_t sync_steps)
+{
+    __disable_irq();
+    this->step_sync_object = object;
+    this->sync_steps = sync_steps > 0 ? sync_steps : 1;
+    this->step_sync_fnc = fnc;
+    __enable_irq();
 }
 
 extern "C" void PendSV_Handler(void)
@@ -130,79 +209,122 @@ void StepTicker::handle_finish (void)
     if(finished_fnc) finished_fnc();
 }
 
-// step clock
-void StepTicker::step_tick (void)
+// issue the steps that are due this tick for the active motors, returns false when none of them are moving any more.
+// Built for trapezoid, S-curve and input shaped blocks separately so the trapezoid one does not check for jerk or
+// shaping per motor
+template<bool s_curve, bool shaped>
+inline bool StepTicker::tick_motors()
 {
-    //SET_STEPTICKER_DEBUG_PIN(running ? 1 : 0);
-
-    // if nothing has been setup we ignore the ticks
-    if(!running){
-        // check if anything new available
-        if(THECONVEYOR->get_next_block(&current_block)) { // returns false if no new block is available
-            running= start_next_block(); // returns true if there is at least one motor with steps to issue
-            if(!running) return;
-        }else{
-            return;
+    bool still_moving= false;
+    for (uint8_t i = 0; i < num_active; ) {
+        uint8_t m = active_motor[i];
+        Block::tickinfo_t& ti = current_block->tick_info[m];
+
+        if(s_curve && jerk != 0) {
+            const Block::rampinfo_t& ri = current_block->ramp_info[m];
+            int64_t j = jerk_decel ? ri.decel_jerk : ri.accel_jerk;
+            ti.acceleration_change += (jerk > 0) ? j : -j;
         }
-    }
 
-    if(THEKERNEL->is_halted()) {
-        running= false;
-        current_tick = 0;
-        current_block= nullptr;
-        return;
-    }
-
-    bool still_moving= false;
-    // foreach motor, if it is active see if time to issue a step to that motor
-    for (uint8_t m = 0; m < num_motors; m++) {
-        if(current_block->tick_info[m].steps_to_move == 0) continue; // not active
+        if(shaped && current_tick == current_block->ramp_info[m].next_shape_event) next_shape_event(current_block, m);
 
-        current_block->tick_info[m].steps_per_tick += current_block->tick_info[m].acceleration_change;
+        ti.steps_per_tick += ti.acceleration_change;
 
-        if(current_tick == current_block->tick_info[m].next_accel_event) {
+        if(current_tick == ti.next_accel_event) {
             if(current_tick == current_block->accelerate_until) { // We are done accelerating, deceleration becomes 0 : plateau
-                current_block->tick_info[m].acceleration_change = 0;
+                ti.acceleration_change = 0;
                 if(current_block->decelerate_after < current_block->total_move_ticks) {
-                    current_block->tick_info[m].next_accel_event = current_block->decelerate_after;
+                    ti.next_accel_event = current_block->decelerate_after;
                     if(current_tick != current_block->decelerate_after) { // We are plateauing
                         // steps/sec / tick frequency to get steps per tick
-                        current_block->tick_info[m].steps_per_tick = current_block->tick_info[m].plateau_rate;
+                        ti.steps_per_tick = ti.plateau_rate;
                     }
                 }
             }
 
             if(current_tick == current_block->decelerate_after) { // We start decelerating
-                current_block->tick_info[m].acceleration_change = current_block->tick_info[m].deceleration_change;
+                ti.acceleration_change = ti.deceleration_change;
             }
         }
 
         // protect against rounding errors and such
-        if(current_block->tick_info[m].steps_per_tick <= 0) {
-            current_block->tick_info[m].counter = STEPTICKER_FPSCALE; // we force completion this step by setting to 1.0
-            current_block->tick_info[m].steps_per_tick = 0;
+        if(ti.steps_per_tick <= 0) {
+            // unless a shaped acceleration from a stop is waiting for its staircase to start
+            if(!shaped || current_block->ramp_info[m].shape_rise != 0 || !(current_block->ramp_info[m].shape_ramps & Block::SHAPE_ACCEL)) {
+                ti.counter = STEPTICKER_FPSCALE; // we force completion this step by setting to 1.0
+            }
+            ti.steps_per_tick = 0;
         }
 
-        current_block->tick_info[m].counter += current_block->tick_info[m].steps_per_tick;
+        ti.counter += ti.steps_per_tick;
 
-        if(current_block->tick_info[m].counter >= STEPTICKER_FPSCALE) { // >= 1.0 step time
-            current_block->tick_info[m].counter -= STEPTICKER_FPSCALE; // -= 1.0F;
-            ++current_block->tick_info[m].step_count;
+        if(ti.counter >= STEPTICKER_FPSCALE) { // >= 1.0 step time
+            ti.counter -= STEPTICKER_FPSCALE; // -= 1.0F;
+            ++ti.step_count;
 
             // step the motor
             bool ismoving= motor[m]->step(); // returns false if the moving flag was set to false externally (probes, endstops etc)
             // we stepped so schedule an unstep
             unstep.set(m);
 
-            if(!ismoving || current_block->tick_info[m].step_count == current_block->tick_info[m].steps_to_move) {
-                // done
-                current_block->tick_info[m].steps_to_move = 0;
+            if(!ismoving || ti.step_count == ti.steps_to_move) {
+                // done, the last motor in the list takes its place and is looked at next
+                ti.steps_to_move = 0;
                 motor[m]->stop_moving(); // let motor know it is no longer moving
+                active_motor[i]= active_motor[--num_active];
+                continue;
             }
         }
 
         // see if any motors are still moving after this tick
-        if(motor[m]->is_moving()) still_moving= true;
+        still_moving |= motor[m]->is_moving();
+        ++i;
+    }
+
+    return still_moving;
+}
+
+// step clock
+void StepTicker::step_tick (void)
+{
+    //SET_STEPTICKER_DEBUG_PIN(running ? 1 : 0);
+
+    // if nothing has been setup we ignore the ticks
+    if(!running){
+        // check if anything new available
+        if(THECONVEYOR->get_next_block(&current_block)) { // returns false if no new block is available
+            running= start_next_block(); // returns true if there is at least one motor with steps to issue
+            if(!running) return;
+        }else{
+            return;
+        }
+    }
+
+    if(THEKERNEL->is_halted()) {
+        running= false;
+        current_tick = 0;
+        current_block= nullptr;
+        return;
+    }
+
+    bool still_moving;
+    if(current_block->s_curve) {
+        // several phases can start on the same tick when a ramp is short
+        while(current_tick == next_jerk_event) next_jerk_phase();
+        still_moving= tick_motors<true, false>();
+    } else if(current_block->shaped) {
+        still_moving= tick_motors<false, true>();
+    } else {
+        still_moving= tick_motors<false, false>();
+    }
+
+    if(step_sync_fnc != nullptr) {
+        // the rate the primary actuator is at now holds until the next event, or changes by a little each tick when ramping
+        const Block::tickinfo_t& ti = current_block->tick_info[primary_motor];
+        if(ti.step_count >= next_sync_step || current_tick == current_block->accelerate_until || current_tick == current_block->decelerate_after) {
+            uint32_t n= step_sync_fnc(step_sync_object, current_block, primary_motor);
+            next_sync_step= ti.step_count + (n > 0 && n < sync_steps ? n : sync_steps);
+        }
     }
 
     // do this after so we start at tick 0
@@ -237,6 +359,8 @@ void StepTicker::step_tick (void)
             running= false;
         }
 
+        if(!running && step_sync_fnc != nullptr) step_sync_fnc(step_sync_object, nullptr, 0);
+
         // all moves finished
         // we delegate the slow stuff to the pendsv handler which will run as soon as this interrupt exits
         //NVIC_SetPendingIRQ(PendSV_IRQn); this doesn't work
@@ -247,24 +371,38 @@ void StepTicker::step_tick (void)
 // only called from the step tick ISR (single consumer)
 bool StepTicker::start_next_block()
 {
+    // synchronized actions run as soon as the moves before them are done, the move after them starts on the same tick
+    // if it is ready, see Planner::append_action()
+    while(current_block != nullptr && current_block->is_action()) {
+        current_block->action(current_block->action_object, current_block->action_value);
+        THECONVEYOR->block_finished();
+        if(!THECONVEYOR->get_next_block(&current_block)) current_block= nullptr;
+    }
+
     if(current_block == nullptr) return false;
 
-    bool ok= false;
     // need to prepare each active motor
+    num_active= 0;
     for (uint8_t m = 0; m < num_motors; m++) {
         if(current_block->tick_info[m].steps_to_move == 0) continue;
+        if(current_block->tick_info[m].steps_to_move == current_block->steps_event_count) primary_motor= m;
 
-        ok= true; // mark at least one motor is moving
+        active_motor[num_active++]= m; // mark at least one motor is moving
         // set direction bit here
         // NOTE this would be at least 10us before first step pulse.
         // TODO does this need to be done sooner, if so how without delaying next tick
-        motor[m]->set_direction(current_block->direction_bits[m]);
+        motor[m]->set_direction((current_block->direction_bits >> m) & 1);
         motor[m]->start_moving(); // also let motor know it is moving now
     }
 
     current_tick= 0;
+    jerk= 0;
+    jerk_decel= false;
+    jerk_phase= 0;
+    next_jerk_event= 0;
+    next_sync_step= 0; // synced on the first tick
 
-    if(ok) {
+    if(num_active > 0) {
         //SET_STEPTICKER_DEBUG_PIN(1);
         return true;
 
@@ -278,6 +416,64 @@ bool StepTicker::start_next_block()
 }
 
 
+// S-curve ramps, see Block::prepare(). The acceleration goes up by the jerk every tick at the start of the acceleration
+// ramp, stays at its peak, then comes back down to zero at its end, and the same for the deceleration ramp.
+// Each call starts the next phase, which is due at next_jerk_event, and sets when the one after it is due.
+void StepTicker::next_jerk_phase()
+{
+    const Block *b = current_block;
+    uint32_t decel_start = b->decelerate_after + 1; // the first tick deceleration is added
+    uint32_t decel_end = b->total_move_ticks + 1;
+
+    // a ramp without jerk ticks is either not there or constant acceleration, its phases are skipped
+    if(jerk_phase == 0 && b->accel_jerk_ticks == 0) jerk_phase= 3;
+    if(jerk_phase == 3 && b->decel_jerk_ticks == 0) jerk_phase= 7;
+
+    switch(jerk_phase++) {
+        case 0: jerk= 1;  jerk_decel= false; next_jerk_event= b->accel_jerk_ticks; break;
+        case 1: jerk= 0;  next_jerk_event= b->accelerate_until - b->accel_jerk_ticks; break;
+        case 2: jerk= -1; next_jerk_event= b->accelerate_until; break;
+        case 3: jerk= 0;  next_jerk_event= decel_start; break;
+        case 4: jerk= -1; jerk_decel= true; next_jerk_event= decel_start + b->decel_jerk_ticks; break;
+        case 5: jerk= 0;  next_jerk_event= decel_end - b->decel_jerk_ticks; break;
+        case 6: jerk= 1;  next_jerk_event= decel_end; break;
+        // if steps are left after the ramp the rate it ended at could be next to nothing, keep slowing down so they are
+        // forced out, like the deceleration of a trapezoid does
+        case 7: jerk= jerk_decel ? -1 : 0; next_jerk_event= UINT32_MAX; break;
+        default: jerk= 0; next_jerk_event= UINT32_MAX; break; // nothing more for this block
+    }
+}
+
+// Input shaped ramps, see Block::prepare() and InputShaper. Motor m is at the next step of the staircase of the ramp it
+// is shaping, set the acceleration for it and when the one after it is due. The staircase starts the shaper's delay
+// into the ramp. Once the acceleration ramp is done it waits for the deceleration ramp if that is shaped too
+void StepTicker::next_shape_event(Block *b, uint8_t m)
+{
+    Block::tickinfo_t& ti = b->tick_info[m];
+    Block::rampinfo_t& ri = b->ramp_info[m];
+    const InputShaper& shaper = THEKERNEL->planner->get_input_shaper(m);
+    uint32_t level;
+
+    // the peak is scaled down first so the product fits, its low bits are well below the rounding of the rate
+    if(ri.shape_ramps & Block::SHAPE_ACCEL) {
+        uint32_t start = shaper.get_delay();
+        ri.next_shape_event= shaper.advance(current_tick, start, b->accelerate_until - start, ri.shape_rise, ri.shape_fall, level);
+        ti.acceleration_change= (ri.accel_peak >> 16) * level;
+        if(ri.next_shape_event == UINT32_MAX) {
+            ri.shape_ramps &= ~Block::SHAPE_ACCEL;
+            ri.shape_rise= ri.shape_fall= 0;
+            if(ri.shape_ramps & Block::SHAPE_DECEL) ri.next_shape_event= b->decelerate_after + 1 + shaper.get_delay();
+        }
+
+    } else if(ri.shape_ramps & Block::SHAPE_DECEL) {
+        // like for the S-curve the first tick deceleration is added is the one after decelerate_after
+        uint32_t start = b->decelerate_after + 1 + shaper.get_delay();
+        ri.next_shape_event= shaper.advance(current_tick, start, b->total_move_ticks + 1 - start, ri.shape_rise, ri.shape_fall, level);
+        // the last step is held, if steps are left after the ramp they are forced out like for a trapezoid
+        ti.acceleration_change= -(ri.decel_peak >> 16) * level;
+    }
+}
+
 // returns index of the stepper motor in the array and bitset
 int StepTicker::register_motor(StepperMotor* m)
 {
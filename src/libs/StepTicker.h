@@ -27,6 +27,17 @@ class Block;
 
 class StepTicker{
     public:
+        // time spent in the step tick ISR in core cycles (DWT CYCCNT), over the ticks that had a block to run, since the
+        // played file started or the last reset
+        struct CycleStats {
+            uint32_t ticks;
+            uint32_t min;
+            uint32_t max;
+            uint64_t total;
+            uint32_t starts;        // ticks that started the next block
+            uint32_t max_start;
+        };
+
         StepTicker();
         ~StepTicker();
         void set_frequency( float frequency );
@@ -35,20 +46,37 @@ class StepTicker{
         float get_frequency() const { return frequency; }
         void unstep_tick();
         const Block *get_current_block() const { return current_block; }
+        // ticks the block being run has left, 0 when there is none
+        uint32_t get_ticks_left() const;
 
         void step_tick (void);
         void handle_finish (void);
         void start();
+        bool is_idle() const { return !running; }
+
+        void record_cycles(uint32_t cycles, bool started);
+        CycleStats get_cycle_stats() const;
+        void reset_cycle_stats();
 
         // whatever setup the block should register this to know when it is done
         std::function<void()> finished_fnc{nullptr};
 
+        // called from the step tick ISR when a block starts, when it stops or starts accelerating or decelerating and
+        // every sync_steps steps of its primary actuator in between, and with a null block when motion stops.
+        // For outputs that have to follow the speed of the moves, eg laser power. It can return the steps to the
+        // next change of its own, sooner than sync_steps, or 0
+        typedef uint32_t (*step_sync_t)(void *object, const Block *block, uint8_t primary);
+        void set_step_sync(step_sync_t fnc, void *object, uint32_t sync_steps);
+
         static StepTicker *getInstance() { return instance; }
 
     private:
         static StepTicker *instance;
 
         bool start_next_block();
+        void next_jerk_phase();
+        void next_shape_event(Block *block, uint8_t m);
+        template<bool s_curve, bool shaped> bool tick_motors();
 
         float frequency;
         uint32_t period;
@@ -58,6 +86,25 @@ class StepTicker{
         Block *current_block;
         uint32_t current_tick{0};
 
+        // the motors of the current block that still have steps to issue, a motor is dropped when it is done
+        // so the tick only loops over the ones that are moving
+        uint8_t active_motor[k_max_actuators];
+        uint8_t num_active;
+
+        CycleStats cycle_stats;
+
+        step_sync_t step_sync_fnc;
+        void *step_sync_object;
+        uint32_t sync_steps;
+        uint32_t next_sync_step;    // step count of the primary actuator the next step sync is due at
+        uint8_t primary_motor;      // of the current block, the one with the most steps
+
+        // S-curve blocks, where the current block is in its ramps
+        uint32_t next_jerk_event;
+        uint8_t jerk_phase;
+        int8_t jerk;                // the direction the acceleration is changing in, 0 for none
+        bool jerk_decel;            // use the deceleration ramp jerk
+
         struct {
             volatile bool running:1;
             uint8_t num_motors:4;
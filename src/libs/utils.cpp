@@ -125,7 +125,7 @@ string shift_parameter( string &parameters )
     if ( beginning == string::npos ) {
         string temp = parameters;
         parameters = "";
-        for (int i = 0; i < temp.length(); i ++) {
+        for (size_t i = 0; i < temp.length(); i ++) {
         	if (temp[i] == 0x01) {
         		temp[i] = ' ';
         	} else if (temp[i] == 0x02) {
@@ -142,7 +142,7 @@ string shift_parameter( string &parameters )
     }
     string temp = parameters.substr( 0, beginning );
     parameters = parameters.substr(beginning + 1, parameters.size());
-    for (int i = 0; i < temp.length(); i ++) {
+    for (size_t i = 0; i < temp.length(); i ++) {
     	if (temp[i] == 0x01) {
     		temp[i] = ' ';
     	} else if (temp[i] == 0x02) {
@@ -274,6 +274,42 @@ std::string change_to_lz_path( std::string origin )
 	return "/sd/gcodes/.lz/" + filename;
 }
 
+// Change from origin path to line index file sub path
+std::string change_to_idx_path( std::string origin )
+{
+	unsigned found = origin.find("gcodes/");
+	string filename = origin.substr(found + 7);
+	string path = "/sd/gcodes/.idx";
+	DIR * d = opendir(path.c_str());
+	if(NULL == d )
+	{
+		mkdir(path.c_str(), 0);
+	}
+	else
+	{
+		closedir(d);
+	}
+	return "/sd/gcodes/.idx/" + filename;
+}
+
+// Change from origin path to compiled gcode file sub path
+std::string change_to_gcb_path( std::string origin )
+{
+	unsigned found = origin.find("gcodes/");
+	string filename = origin.substr(found + 7);
+	string path = "/sd/gcodes/.gcb";
+	DIR * d = opendir(path.c_str());
+	if(NULL == d )
+	{
+		mkdir(path.c_str(), 0);
+	}
+	else
+	{
+		closedir(d);
+	}
+	return "/sd/gcodes/.gcb/" + filename;
+}
+
 
 // Check the quicklz/md5 file path
 #define	FR_OK 0
@@ -282,8 +318,6 @@ void check_and_make_path( std::string origin )
 {
 	size_t pos = 0;
     std::string dir;
-    int res;
-    int ret = 0;
 
     while ((pos = origin.find_first_of('/', pos)) != std::string::npos) {
         dir = origin.substr(0, pos++);
@@ -393,3 +427,31 @@ void ltrim(std::string& s, const char* t)
     s.erase(0, s.find_first_not_of(t));
 }
 
+
+static int base64_value(char c)
+{
+    if(c >= 'A' && c <= 'Z') return c - 'A';
+    if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if(c >= '0' && c <= '9') return c - '0' + 52;
+    if(c == '+') return 62;
+    if(c == '/') return 63;
+    return -1;
+}
+
+size_t base64_decode(const char *src, size_t len, uint8_t *dst, size_t max)
+{
+    size_t n = 0;
+    uint32_t bits = 0;
+    int nbits = 0;
+    for (size_t i = 0; i < len && n < max; ++i) {
+        int v = base64_value(src[i]);
+        if(v < 0) break; // = padding or the end of the data
+        bits = (bits << 6) | v;
+        nbits += 6;
+        if(nbits >= 8) {
+            nbits -= 8;
+            dst[n++] = (bits >> nbits) & 0xFF;
+        }
+    }
+    return n;
+}
@@ -35,8 +35,13 @@ void system_reset( bool dfu= false );
 std::string absolute_from_relative( std::string path );
 std::string change_to_md5_path( std::string origin );
 std::string change_to_lz_path( std::string origin );
+std::string change_to_idx_path( std::string origin );
+std::string change_to_gcb_path( std::string origin );
 void check_and_make_path( std::string origin );
 
+// decodes base64 from src until len characters or one that is not base64, returns the bytes written to dst (up to max)
+size_t base64_decode(const char *src, size_t len, uint8_t *dst, size_t max);
+
 int append_parameters(char *buf, std::vector<std::pair<char,float>> params, size_t bufsize);
 std::string wcs2gcode(int wcs);
 void safe_delay_us(uint32_t delay);
@@ -39,6 +39,15 @@ static bool is_allowed_mcode(int m) {
     return false;
 }
 
+// G7, G07 or g7 but not G70, a raster line is dispatched even when written in lower case
+static bool is_raster_line(const string& s)
+{
+    if(s.empty() || toupper(s[0]) != 'G') return false;
+    size_t i = 1;
+    while(i < s.size() && s[i] == '0') ++i;
+    return i < s.size() && s[i] == '7' && (i + 1 == s.size() || !isdigit(s[i + 1]));
+}
+
 GcodeDispatch::GcodeDispatch()
 {
     uploading = false;
@@ -54,7 +63,7 @@ void GcodeDispatch::on_module_loaded()
 // When a command is received, if it is a Gcode, dispatch it as an object via an event
 void GcodeDispatch::on_console_line_received(void *line)
 {
-    SerialMessage new_message = *static_cast<SerialMessage *>(line);
+    const SerialMessage& new_message = *static_cast<SerialMessage *>(line);
     string possible_command = new_message.message;
 
     // just reply ok to empty lines
@@ -75,10 +84,11 @@ try_again:
         // ignore as simpleshell will handle it
         return;
 
-    } else if(islower(first_char)) {
+    } else if(islower(first_char) && !is_raster_line(possible_command)) {
         // ignore all lowercase as they are simpleshell commands
         return;
     }
+    first_char = toupper(first_char);
 
     if ( first_char == 'G' || first_char == 'M' || first_char == 'T' || first_char == 'S' || first_char == 'N' || first_char == '#') {
 
@@ -87,13 +97,26 @@ try_again:
             //Strip line number value from possible_command
 			size_t lnsize = possible_command.find_first_not_of("N0123456789.,- ");
 			if(lnsize != string::npos) {
-				possible_command = possible_command.substr(lnsize);
+				possible_command.erase(0, lnsize);
 			}else{
 				// it is a blank line
 				possible_command.clear();
 			}
         }
 
+        // the pixels of a G7 raster line are base64 which can hold any letter, so they are cut off before the line is
+        // split, an upload puts them back on the end of the line it saves
+        string raster_data;
+        if(is_raster_line(possible_command)) {
+            size_t d = possible_command.find_first_of("Dd");
+            if(d != string::npos) {
+                raster_data = possible_command.substr(d + 1);
+                possible_command.resize(d);
+                while(!raster_data.empty() && isspace(raster_data.back())) raster_data.pop_back();
+            }
+            for (char& c : possible_command) c = toupper(c);
+        }
+
         if ( first_char == 'G'){
 			//check if has G90/G91
 			std::string g90_g91_command;
@@ -115,52 +138,57 @@ try_again:
         //Remove comments
         size_t comment = possible_command.find_first_of(";(");
         if( comment != string::npos ) {
-            possible_command = possible_command.substr(0, comment);
+            possible_command.resize(comment);
         }
 
 		bool sent_ok= false; // used for G1 optimization
-		string single_command;
+		// the line is split in place, each command is [cmd_start, cmd_end) and the rest of the line follows it
+		size_t cmd_start;
+		size_t cmd_end = 0;
 		size_t cmd_pos = string::npos;
-		while (possible_command.size() > 0) {
+		const size_t line_size = possible_command.size();
+		while (cmd_end < line_size) {
+			cmd_start = cmd_end;
+			cmd_pos = string::npos;
 			// assumes G or M are always the first on the line
 			// -> G or M are in the line but not always the first char
 			// -> S or T could be in front of or after M
-			first_char = possible_command[0];
+			first_char = possible_command[cmd_start];
 			if (first_char == 'G') {
 				// find next G/M/S/T
-				if (possible_command.find_first_of("S", 2) != string::npos
-						&& possible_command.find_first_of("M", 2) != string::npos) {
-					cmd_pos = possible_command.find_first_of("GMST", 2);
+				if (possible_command.find_first_of("S", cmd_start + 2) != string::npos
+						&& possible_command.find_first_of("M", cmd_start + 2) != string::npos) {
+					cmd_pos = possible_command.find_first_of("GMST", cmd_start + 2);
 				} else {
-					cmd_pos = possible_command.find_first_of("GMT", 2);
+					cmd_pos = possible_command.find_first_of("GMT", cmd_start + 2);
 				}
 			} else if (first_char == 'M') {
 				// find next G/M
-				cmd_pos = possible_command.find_first_of("GM", 2);
+				cmd_pos = possible_command.find_first_of("GM", cmd_start + 2);
 			} else if (first_char == 'T' || first_char == 'S') {
 				// find first M
-				cmd_pos = possible_command.find_first_of("M", 2);
+				cmd_pos = possible_command.find_first_of("M", cmd_start + 2);
 				if (cmd_pos == string::npos) {
 					// find first G/S/T
-					cmd_pos = possible_command.find_first_of("GST", 2);
+					cmd_pos = possible_command.find_first_of("GST", cmd_start + 2);
 				} else {
 					// M found, find second G/M/S/T
 					cmd_pos = possible_command.find_first_of("GMST", cmd_pos + 2);
 				}
 			}
 
-			if (cmd_pos == string::npos) {
-				single_command = possible_command;
-				possible_command = "";
-			} else {
-				single_command = possible_command.substr(0, cmd_pos);
-				possible_command = possible_command.substr(cmd_pos);
-			}
+			cmd_end = cmd_pos == string::npos ? line_size : cmd_pos;
+			const char *single_command = possible_command.data() + cmd_start;
+			size_t single_len = cmd_end - cmd_start;
 
 			if(!uploading || upload_stream != new_message.stream) {
 				// Prepare gcode for dispatch
-				// new_message.stream->printf("GCode1: %s!\n", single_command.c_str());
-				Gcode *gcode = new Gcode(single_command, new_message.stream, false, new_message.line);
+				// new_message.stream->printf("GCode1: %s!\n", single_command);
+				Gcode *gcode = new Gcode(single_command, single_len, new_message.stream, false, new_message.line);
+				if(!raster_data.empty() && gcode->has_g && gcode->g == 7) {
+					gcode->data = raster_data.data();
+					gcode->data_len = raster_data.size();
+				}
 
 				if ( first_char == '#'){
 					gcode->set_variable_value();
@@ -194,7 +222,7 @@ try_again:
 					if(gcode->g == 53) { // G53 makes next movement command use machine coordinates
 						// this is ugly to implement as there may or may not be a G0/G1 on the same line
 						// valid version seem to include G53 G0 X1 Y2 Z3 G53 X1 Y2
-						if(possible_command.empty()) {
+						if(cmd_end >= line_size) {
 							// use last gcode G1 or G0 if none on the line, and pass through as if it was a G0/G1
 							// TODO it is really an error if the last is not G0 thru G3
 							if(modal_group_1 > 3) {
@@ -208,8 +236,8 @@ try_again:
 						}else{
 							delete gcode;
 							// extract next G0/G1 from the rest of the line, ignore if it is not one of these
-							gcode = new Gcode(possible_command, new_message.stream);
-							possible_command= "";
+							gcode = new Gcode(possible_command.data() + cmd_end, line_size - cmd_end, new_message.stream);
+							cmd_end = line_size;
 							if(!gcode->has_g || gcode->g > 1) {
 								// not G0 or G1 so ignore it as it is invalid
 								delete gcode;
@@ -239,7 +267,12 @@ try_again:
 						case 28: // start upload command
 							delete gcode;
 
-							this->upload_filename = "/sd/" + single_command.substr(4); // rest of line is filename
+							this->upload_filename = "/sd/" + possible_command.substr(cmd_start + 4, cmd_end - cmd_start - 4); // rest of line is filename
+							// the file gets replaced, a compiled version or line index of the old one must not be used for it
+							if(this->upload_filename.compare(0, 11, "/sd/gcodes/") == 0) {
+								remove(change_to_gcb_path(this->upload_filename).c_str());
+								remove(change_to_idx_path(this->upload_filename).c_str());
+							}
 							// open file
 							upload_fd = fopen(this->upload_filename.c_str(), "w");
 							if(upload_fd != NULL) {
@@ -257,7 +290,7 @@ try_again:
 
 						case 30: // end of program
 							if(!THEKERNEL->is_grbl_mode()) break; // Special case M30 as it is also delete sd card file so only do this if in grbl mode
-							// fall through to M2
+							// fall through - to M2
 						case 2:
 							{
 								modal_group_1= 1; // set to G1
@@ -281,7 +314,7 @@ try_again:
 						case 115: { // M115 Get firmware version and capabilities
 							Version vers;
 
-							new_message.stream->printf("FIRMWARE_NAME:Smoothieware, FIRMWARE_URL:http%%3A//smoothieware.org, X-SOURCE_CODE_URL:https://github.com/Smoothieware/Smoothieware, FIRMWARE_VERSION:%s, X-FIRMWARE_BUILD_DATE:%s, X-SYSTEM_CLOCK:%ldMHz, X-AXES:%d, X-GRBL_MODE:%d", vers.get_build(), vers.get_build_date(), SystemCoreClock / 1000000, MAX_ROBOT_ACTUATORS, THEKERNEL->is_grbl_mode());
+							new_message.stream->printf("FIRMWARE_NAME:Smoothieware, FIRMWARE_URL:http%%3A//smoothieware.org, X-SOURCE_CODE_URL:https://github.com/Smoothieware/Smoothieware, FIRMWARE_VERSION:%s, X-FIRMWARE_BUILD_DATE:%s, X-SYSTEM_CLOCK:%luMHz, X-AXES:%d, X-GRBL_MODE:%d", vers.get_build(), vers.get_build_date(), (unsigned long)(SystemCoreClock / 1000000), MAX_ROBOT_ACTUATORS, THEKERNEL->is_grbl_mode());
 
 							#ifdef CNC
 							new_message.stream->printf(", X-CNC:1");
@@ -304,7 +337,7 @@ try_again:
 
 						case 117: // M117 is a special non compliant Gcode as it allows arbitrary text on the line following the command
 						{    // concatenate the command again and send to panel if enabled
-							string str= single_command.substr(4) + possible_command;
+							string str= possible_command.substr(cmd_start + 4);
 							PublicData::set_value( panel_checksum, panel_display_message_checksum, &str );
 							delete gcode;
 							new_message.stream->printf("ok\r\n");
@@ -321,7 +354,7 @@ try_again:
 								}
 							}
 							
-							string str= single_command.substr(4) + possible_command;
+							string str= possible_command.substr(cmd_start + 4);
 							delete gcode;
 							THEKERNEL->streams->printf("%s \r\n", str.c_str());
 							return;
@@ -330,7 +363,7 @@ try_again:
 						case 1000: // M1000 is a special command that will pass thru the raw lowercased command to the simpleshell (for hosts that do not allow such things)
 						{
 							// reconstruct entire command line again
-							string str= single_command.substr(5) + possible_command;
+							string str= possible_command.substr(cmd_start + 5);
 							while(is_whitespace(str.front())){ str= str.substr(1); } // strip leading whitespace
 
 							delete gcode;
@@ -373,7 +406,7 @@ try_again:
 						case 501: // load config override
 						case 504: // save to specific config override file
 							{
-								string arg= get_arguments(single_command + possible_command); // rest of line is filename
+								string arg= get_arguments(possible_command.substr(cmd_start)); // rest of line is filename
 								if(arg.empty()) arg= "/sd/config-override";
 								else arg= "/sd/config-override." + arg;
 								//new_message.stream->printf("args: <%s>\n", arg.c_str());
@@ -441,7 +474,7 @@ try_again:
 					} else {
 						if(THEKERNEL->is_ok_per_line() || THEKERNEL->is_grbl_mode()) {
 							// only send ok once per line if this is a multi g code line send ok on the last one
-							if(possible_command.empty())
+							if(cmd_end >= line_size)
 								new_message.stream->printf("ok\r\n");
 						} else {
 							// maybe should do the above for all hosts?
@@ -454,7 +487,7 @@ try_again:
 
 			} else {
 				// we are uploading and it is the upload stream so so save it
-				if(single_command.substr(0, 3) == "M29") {
+				if(possible_command.compare(cmd_start, 3, "M29") == 0) {
 					// done uploading, close file
 					fclose(upload_fd);
 					upload_fd = NULL;
@@ -471,8 +504,10 @@ try_again:
 					continue;
 				}
 
-				single_command.append("\n");
-				if(fwrite(single_command.c_str(), 1, single_command.size(), upload_fd) != single_command.size()) {
+				bool with_raster = cmd_end == line_size && !raster_data.empty();
+				if(fwrite(single_command, 1, single_len, upload_fd) != single_len ||
+				   (with_raster && (fputc('D', upload_fd) == EOF || fwrite(raster_data.data(), 1, raster_data.size(), upload_fd) != raster_data.size())) ||
+				   fputc('\n', upload_fd) == EOF) {
 					// error writing to file
 					new_message.stream->printf("Error:error writing to file.\r\n");
 					fclose(upload_fd);
@@ -23,6 +23,8 @@ public:
     virtual void on_console_line_received(void *line);
 
     uint8_t get_modal_command() const { return modal_group_1<4 ? modal_group_1 : 0; }
+    // for commands that bypass the dispatcher, like compiled files being played
+    void set_modal_command(uint8_t g) { modal_group_1= g; }
 private:
     std::string upload_filename;
     FILE *upload_fd;
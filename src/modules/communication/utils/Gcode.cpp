@@ -11,6 +11,7 @@
 #include "libs/StreamOutputPool.h"
 #include "utils.h"
 #include <stdlib.h>
+#include <string.h>
 #include <algorithm>
 
 
@@ -24,46 +25,97 @@
 
 // This is a gcode object. It represents a GCode string/command, and caches some important values about that command for the sake of performance.
 // It gets passed around in events, and attached to the queue ( that'll change )
-Gcode::Gcode(const string &command, StreamOutput *stream, bool strip, unsigned int line)
+Gcode::Gcode(const string &command, StreamOutput *stream, bool strip, unsigned int line) : Gcode(command.data(), command.size(), stream, strip, line)
 {
-    this->command= strdup(command.c_str());
+}
+
+// the command is the first len characters of command, which does not have to be terminated
+Gcode::Gcode(const char *command, size_t len, StreamOutput *stream, bool strip, unsigned int line)
+{
+    this->command= buf;
+    set_command(command, len);
     this->m= 0;
     this->g= 0;
     this->subcode= 0;
     this->add_nl= false;
     this->is_error= false;
+    this->pre_parsed= false;
     this->stream= stream;
+    this->data= nullptr;
+    this->data_len= 0;
     prepare_cached_values(strip);
     this->stripped= strip;
     this->line = line;
 }
 
+// Used to play pre-parsed (compiled) files, there is no text to parse so the values are looked up by letter
+Gcode::Gcode(unsigned int g, uint32_t letters, const float *values, StreamOutput *stream, unsigned int line)
+{
+    this->command= buf;
+    this->buf[0]= '\0';
+    this->m= 0;
+    this->g= g;
+    this->has_g= true;
+    this->has_m= false;
+    this->subcode= 0;
+    this->add_nl= false;
+    this->is_error= false;
+    this->stripped= false;
+    this->pre_parsed= true;
+    this->stream= stream;
+    this->data= nullptr;
+    this->data_len= 0;
+    this->line = line;
+    for (int i = 0, n = 0; i < 26; ++i) {
+        if(letters & (1 << i)) this->values[i]= values[n++];
+    }
+    // G is a word like the others, as for a command that was not stripped
+    this->values['G' - 'A']= g;
+    this->letters= letters | (1 << ('G' - 'A'));
+    this->parsed= this->letters;
+}
+
 Gcode::~Gcode()
 {
-    if(command != nullptr) {
-        // TODO we can reference count this so we share copies, may save more ram than the extra count we need to store
+    if(command != buf) {
         free(command);
     }
 }
 
+ObjectPool Gcode::pool(sizeof(Gcode), GCODE_POOL_SIZE);
+
+void *Gcode::operator new(size_t size)
+{
+    void *p= pool.alloc();
+    return p != nullptr ? p : ::operator new(size);
+}
+
+void Gcode::operator delete(void *p)
+{
+    if(!pool.dealloc(p)) ::operator delete(p);
+}
+
 Gcode::Gcode(const Gcode &to_copy)
 {
-    this->command               = strdup(to_copy.command); // TODO we can reference count this so we share copies, may save more ram than the extra count we need to store
-    this->has_m                 = to_copy.has_m;
-    this->has_g                 = to_copy.has_g;
-    this->m                     = to_copy.m;
-    this->g                     = to_copy.g;
-    this->subcode               = to_copy.subcode;
-    this->add_nl                = to_copy.add_nl;
-    this->is_error              = to_copy.is_error;
-    this->stream                = to_copy.stream;
-    this->txt_after_ok.assign( to_copy.txt_after_ok );
+    this->command= buf;
+    *this= to_copy;
 }
 
 Gcode &Gcode::operator= (const Gcode &to_copy)
 {
     if( this != &to_copy ) {
-        this->command               = strdup(to_copy.command); // TODO we can reference count this so we share copies, may save more ram than the extra count we need to store
+        if(command != buf) free(command);
+        if(to_copy.command == to_copy.buf) {
+            this->command= buf;
+            memcpy(this->buf, to_copy.buf, sizeof(this->buf));
+        }else{
+            // TODO we can reference count this so we share copies, may save more ram than the extra count we need to store
+            this->command= strdup(to_copy.command);
+        }
+        this->letters               = to_copy.letters;
+        this->parsed                = to_copy.parsed;
+        memcpy(this->values, to_copy.values, sizeof(this->values));
+        this->pre_parsed            = to_copy.pre_parsed;
         this->has_m                 = to_copy.has_m;
         this->has_g                 = to_copy.has_g;
         this->m                     = to_copy.m;
@@ -71,22 +123,74 @@ Gcode &Gcode::operator= (const Gcode &to_copy)
         this->subcode               = to_copy.subcode;
         this->add_nl                = to_copy.add_nl;
         this->is_error              = to_copy.is_error;
+        this->stripped              = to_copy.stripped;
+        this->line                  = to_copy.line;
         this->stream                = to_copy.stream;
+        this->data                  = to_copy.data;
+        this->data_len              = to_copy.data_len;
         this->txt_after_ok.assign( to_copy.txt_after_ok );
     }
     return *this;
 }
 
+// copy the command in, only commands that do not fit in buf are allocated
+void Gcode::set_command(const char *cmd, size_t len)
+{
+    if(command != buf) free(command);
+    command= len < sizeof(buf) ? buf : (char *)malloc(len + 1);
+    memcpy(command, cmd, len);
+    command[len]= '\0';
+    index_letters();
+}
+
+// Find the letters in the command and the value of each one that is followed by a plain number.
+// get_value() uses the first occurrence of a letter it can evaluate, so only the first occurrence is looked at here,
+// a value is only taken if evaluating it would just read the number, anything else is left for get_value() to evaluate
+void Gcode::index_letters()
+{
+    letters= 0;
+    parsed= 0;
+
+    for (char *cs = command; *cs; cs++) {
+        if(*cs < 'A' || *cs > 'Z') continue;
+        uint32_t bit= 1 << (*cs - 'A');
+        if(letters & bit) continue;
+        letters |= bit;
+
+        // [+-]digits[.digits], with at least one digit
+        char *p= cs + 1;
+        while(isspace(*p)) p++;
+        char *num= p;
+        if(*p == '-' || *p == '+') p++;
+        bool digits= false;
+        while(isdigit(*p)) { p++; digits= true; }
+        if(*p == '.') {
+            p++;
+            while(isdigit(*p)) { p++; digits= true; }
+        }
+        if(!digits) continue;
+
+        // followed by another word, a comment or nothing, not by an operator
+        char *q= p;
+        while(isspace(*q)) q++;
+        if(*q != '\0' && !(*q >= 'A' && *q <= 'Z') && *q != ';' && *q != '(') continue;
+
+        // same as the expression evaluator, which does not parse exponents
+        char c= *p;
+        *p= '\0';
+        values[*cs - 'A']= strtof(num, nullptr);
+        *p= c;
+        parsed |= bit;
+    }
+}
 
 // Whether or not a Gcode has a letter
 bool Gcode::has_letter( char letter ) const
 {
-    for (size_t i = 0; i < strlen(this->command); ++i) {
-        if( command[i] == letter ) {
-            return true;
-        }
+    if(letter >= 'A' && letter <= 'Z') {
+        return letters & (1 << (letter - 'A'));
     }
-    return false;
+    return strchr(command, letter) != nullptr;
 }
 
 //2024
@@ -153,7 +257,7 @@ float Gcode::set_variable_value() const {
                 return value;
             }
             else{
-                this->stream->printf("Probe tip input out of range, aborting \n", var_num);
+                this->stream->printf("Probe tip input out of range, aborting \n");
                 return NAN;
             }
         } else if (var_num >= 501 && var_num <= 520) {
@@ -216,7 +320,7 @@ float Gcode::get_variable_value(const char* expr, char** endptr) const{
             return NAN;
         }else //system variables
         {
-            float mpos[3];
+            float mpos[5]; // mcs2wcs() reads A and B as well
             bool ok;
             Robot::wcs_t pos;
             switch (var_num){
@@ -586,6 +690,19 @@ float Gcode::evaluate_expression(const char* expr, char** endptr) const {
 // Retrieve the value for a given letter
 float Gcode::get_value( char letter, char **ptr ) const
 {
+    if(letter >= 'A' && letter <= 'Z') {
+        uint32_t bit= 1 << (letter - 'A');
+        if(ptr == nullptr && (parsed & bit)) return values[letter - 'A'];
+        if(!(letters & bit)) {
+            if(ptr != nullptr) *ptr = nullptr;
+            return 0;
+        }
+    }
+    if(pre_parsed) {
+        if(ptr != nullptr) *ptr = nullptr;
+        return has_letter(letter) ? values[letter - 'A'] : 0;
+    }
+
     const char *cs = command;
     char *cn = NULL;
     for (; *cs; cs++) {
@@ -620,6 +737,8 @@ float Gcode::get_value_at_index( int index ) const
 
 int Gcode::get_int( char letter, char **ptr ) const
 {
+    if(pre_parsed) return get_value(letter, ptr);
+
     const char *cs = command;
     char *cn = NULL;
     for (; *cs; cs++) {
@@ -637,6 +756,8 @@ int Gcode::get_int( char letter, char **ptr ) const
 
 uint32_t Gcode::get_uint( char letter, char **ptr ) const
 {
+    if(pre_parsed) return get_value(letter, ptr);
+
     const char *cs = command;
     char *cn = NULL;
     for (; *cs; cs++) {
@@ -655,9 +776,16 @@ uint32_t Gcode::get_uint( char letter, char **ptr ) const
 int Gcode::get_num_args() const
 {
     int count = 0;
-    for(size_t i = stripped?0:1; i < strlen(command); i++) {
-        if( this->command[i] >= 'A' && this->command[i] <= 'Z' ) {
-            if(this->command[i] == 'T') continue;
+    if(pre_parsed) {
+        for (int i = 0; i < 26; ++i) {
+            if((letters & (1 << i)) && i != 'T' - 'A' && i != 'G' - 'A') count++;
+        }
+        return count;
+    }
+    if(!stripped && command[0] == '\0') return 0;
+    for(const char *c = stripped ? command : command + 1; *c; c++) {
+        if( *c >= 'A' && *c <= 'Z' ) {
+            if(*c == 'T') continue;
             count++;
         }
     }
@@ -667,8 +795,15 @@ int Gcode::get_num_args() const
 std::map<char,float> Gcode::get_args() const
 {
     std::map<char,float> m;
-    for(size_t i = stripped?0:1; i < strlen(command); i++) {
-        char c= this->command[i];
+    if(pre_parsed) {
+        for (int i = 0; i < 26; ++i) {
+            if((letters & (1 << i)) && i != 'T' - 'A' && i != 'G' - 'A') m['A' + i]= values[i];
+        }
+        return m;
+    }
+    if(!stripped && command[0] == '\0') return m;
+    for(const char *cs = stripped ? command : command + 1; *cs; cs++) {
+        char c= *cs;
         if( c >= 'A' && c <= 'Z' ) {
             if(c == 'T') continue;
             m[c]= get_value(c);
@@ -680,8 +815,15 @@ std::map<char,float> Gcode::get_args() const
 std::map<char,int> Gcode::get_args_int() const
 {
     std::map<char,int> m;
-    for(size_t i = stripped?0:1; i < strlen(command); i++) {
-        char c= this->command[i];
+    if(pre_parsed) {
+        for (int i = 0; i < 26; ++i) {
+            if((letters & (1 << i)) && i != 'T' - 'A' && i != 'G' - 'A') m['A' + i]= values[i];
+        }
+        return m;
+    }
+    if(!stripped && command[0] == '\0') return m;
+    for(const char *cs = stripped ? command : command + 1; *cs; cs++) {
+        char c= *cs;
         if( c >= 'A' && c <= 'Z' ) {
             if(c == 'T') continue;
             m[c]= get_int(c);
@@ -726,25 +868,33 @@ void Gcode::prepare_cached_values(bool strip)
 
     // remove the Gxxx or Mxxx from string
     if (p != nullptr) {
-        char *n= strdup(p); // create new string starting at end of the numeric value
-        free(command);
-        command= n;
+        // move the rest of the command down to the start, this also drops the G or M from the letters
+        size_t len= strlen(p);
+        memmove(command, p, len + 1);
+        index_letters();
     }
 }
 
 // strip off X Y Z I J K parameters if G0/1/2/3
 void Gcode::strip_parameters()
 {
-    if(has_g && g < 4){
-        // strip the command of the XYZIJK parameters
-        string newcmd;
+    if(has_g && g < 4 && pre_parsed) {
+        for (const char *p = "XYZIJK"; *p; ++p) {
+            letters &= ~(1 << (*p - 'A'));
+            parsed &= ~(1 << (*p - 'A'));
+        }
+
+    }else if(has_g && g < 4){
+        // strip the command of the XYZIJK parameters, the result is never longer so it is done in place
+        char *out= command;
         char *cn= command;
         // find the start of each parameter
         char *pch= strpbrk(cn, "XYZIJK");
         while (pch != nullptr) {
             if(pch > cn) {
                 // copy non parameters to new string
-                newcmd.append(cn, pch-cn);
+                memmove(out, cn, pch-cn);
+                out += pch-cn;
             }
             // find the end of the parameter and its value
             char *eos;
@@ -753,14 +903,11 @@ void Gcode::strip_parameters()
             pch= strpbrk(cn, "XYZIJK"); // find next parameter
         }
         // append anything left on the line
-        newcmd.append(cn);
+        memmove(out, cn, strlen(cn) + 1);
 
         // strip whitespace to save even more, this causes problems so don't do it
         //newcmd.erase(std::remove_if(newcmd.begin(), newcmd.end(), ::isspace), newcmd.end());
 
-        // release the old one
-        free(command);
-        // copy the new shortened one
-        command= strdup(newcmd.c_str());
+        index_letters();
     }
 }
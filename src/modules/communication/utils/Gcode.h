@@ -10,9 +10,18 @@
 #define GCODE_H
 #include <string>
 #include <map>
+#include <stdint.h>
+
+#include "ObjectPool.h"
 
 using std::string;
 
+// commands shorter than this, nearly all of them, are kept in the Gcode itself, longer ones are copied to the heap.
+// Every Gcode on the stack carries it, so it is sized for the common command rather than the 130 byte line
+#define GCODE_INLINE_SIZE 64
+// Gcodes created with new that can be live at the same time before the heap is used
+#define GCODE_POOL_SIZE 4
+
 class StreamOutput;
 
 // Object to represent a Gcode command
@@ -21,10 +30,18 @@ class Gcode {
         using wcs_t= std::tuple<float, float, float>;
 
         Gcode(const string&, StreamOutput*, bool strip = true, unsigned int line = 0);
+        Gcode(const char *command, size_t len, StreamOutput*, bool strip = true, unsigned int line = 0);
+        // an already parsed G command, values holds one value per letter set in letters (bit 0 is A) in alphabetical order
+        Gcode(unsigned int g, uint32_t letters, const float *values, StreamOutput*, unsigned int line = 0);
         Gcode(const Gcode& to_copy);
         Gcode& operator= (const Gcode& to_copy);
         ~Gcode();
 
+        // one Gcode is created with new for every command dispatched, they come from pool so the heap does not fragment
+        static void *operator new(size_t size);
+        static void operator delete(void *p);
+        static ObjectPool pool;
+
         const char* get_command() const { return command; }
         bool has_letter ( char letter ) const;
         // 2024
@@ -63,9 +80,22 @@ class Gcode {
         StreamOutput* stream;
         string txt_after_ok;
 
+        // data that is not words, eg the base64 pixels of a G7, set by GcodeDispatch and only valid while it is dispatched
+        const char *data;
+        size_t data_len;
+
     private:
+        void set_command(const char *cmd, size_t len);
+        void index_letters();
         void prepare_cached_values(bool strip=true);
-        char *command;
+        char *command;              // points to buf unless it did not fit
+        char buf[GCODE_INLINE_SIZE];
+        // filled once when the command is set so looking up a word does not have to scan the command
+        uint32_t letters;           // letters found anywhere in the command, bit 0 is A
+        uint32_t parsed;            // letters whose first word is a plain number, the value is in values[]
+                                    // the others (expressions, variables etc) are evaluated from the command when asked for
+        float values[26];
+        bool pre_parsed;            // built from parsed words, there is no command
         float parse_expression(const char*& expr) const;
         float parse_term(const char*& expr) const;
         float parse_factor(const char*& expr) const;
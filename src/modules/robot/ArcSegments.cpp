@@ -0,0 +1,57 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ArcSegments.h"
+
+#include <math.h>
+
+float arc_segment_length(float radius, float max_error, float min_length, float rate_mm_s, float acceleration, float segments_per_second)
+{
+    float length = min_length;
+
+    // limit segments by maximum arc error
+    if(max_error > 0 && 2 * radius > max_error) {
+        float err_length = 2 * sqrtf(max_error * (2 * radius - max_error));
+        if(err_length > length) length = err_length;
+    }
+
+    // and by how many of them a second the planner is to get
+    if(segments_per_second > 0 && rate_mm_s > 0) {
+        float speed = rate_mm_s;
+        if(acceleration > 0 && acceleration * radius < speed * speed) speed = sqrtf(acceleration * radius);
+        if(speed / segments_per_second > length) length = speed / segments_per_second;
+    }
+
+    // catch fall through on above
+    if(length < 0.0001F) {
+        length = 0.5F; // the old default, so we avoid the divide by zero
+    }
+    return length;
+}
+
+ArcRotation::ArcRotation(float r0, float r1, float theta)
+{
+    start[0] = r0;
+    start[1] = r1;
+    cos_t = cosf(theta);
+    sin_t = sinf(theta);
+    c = 1;
+    s = 0;
+}
+
+void ArcRotation::step(float& r0, float& r1)
+{
+    float cn = c * cos_t - s * sin_t;
+    float sn = c * sin_t + s * cos_t;
+    // one Newton step towards cn^2 + sn^2 = 1, rounding only ever leaves it a few ulp off so that is enough
+    float k = (3 - (cn * cn + sn * sn)) * 0.5F;
+    c = cn * k;
+    s = sn * k;
+
+    r0 = start[0] * c - start[1] * s;
+    r1 = start[0] * s + start[1] * c;
+}
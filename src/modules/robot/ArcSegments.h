@@ -0,0 +1,32 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// The length of the segments an arc of radius is cut into: as long as max_error allows the chord to stray from the
+// arc and no shorter than min_length. With segments_per_second set they are also no shorter than the arc runs in
+// 1/segments_per_second at the speed it can run at, the feed rate or how fast acceleration can take it round the
+// radius if that is slower. That speed grows with the square root of the radius as the chord does, so the chord
+// error this adds is at most acceleration / (8 * segments_per_second^2) whatever the radius: large arcs at speed get
+// as few blocks as the planner can use, small ones stay as accurate as max_error asks.
+float arc_segment_length(float radius, float max_error, float min_length, float rate_mm_s, float acceleration, float segments_per_second);
+
+// Turns a radius vector round by the same angle each step with the exact rotation (cos and sin of the angle are
+// worked out once). Its length is pulled back to the start radius every step so it does not drift with rounding.
+class ArcRotation {
+    public:
+        // r0, r1 the radius vector from the center to the start, theta the angle of each step
+        ArcRotation(float r0, float r1, float theta);
+
+        // the radius vector one step on
+        void step(float& r0, float& r1);
+
+    private:
+        float start[2];
+        float cos_t, sin_t;
+        float c, s;     // cos and sin of the angle turned so far
+};
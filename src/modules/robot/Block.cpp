@@ -16,9 +16,9 @@
 #include "Gcode.h"
 #include "libs/StreamOutputPool.h"
 #include "StepTicker.h"
+#include "InputShaper.h"
 #include "platform_memory.h"
 
-#include "mri.h"
 #include <inttypes.h>
 
 using std::string;
@@ -26,8 +26,16 @@ using std::string;
 #define STEP_TICKER_FREQUENCY THEKERNEL->step_ticker->get_frequency()
 
 uint8_t Block::n_actuators= 0;
+bool Block::with_ramp_info= false;
 double Block::fp_scale= 0;
 
+// bisection steps for the top speed of an S-curve block that can not reach its nominal speed, the last one is within
+// 1/4096 of the way from its entry or exit speed to its nominal speed
+#define S_CURVE_SEARCH_STEPS 12
+// the planner sets the speeds of a block that is as short as its ramp allows from Block::max_allowable_speed(), which
+// s_curve_distance() comes back to within float rounding
+#define S_CURVE_DISTANCE_ROUNDING 1.0001F
+
 // A block represents a movement, it's length for each stepper motor, and the corresponding acceleration curves.
 // It's stacked on a queue, and that queue is then executed in order, to move the motors.
 // Most of the accel math is also done in this class
@@ -36,13 +44,15 @@ double Block::fp_scale= 0;
 Block::Block()
 {
     tick_info= nullptr;
+    ramp_info= nullptr;
     line = 0;
     clear();
 }
 
-void Block::init(uint8_t n)
+void Block::init(uint8_t n, bool ramps)
 {
     n_actuators= n;
+    with_ramp_info= ramps;
     fp_scale= (double)STEPTICKER_FPSCALE / pow((double)STEP_TICKER_FREQUENCY, 2.0); // we scale up by fixed point offset first to avoid tiny values
 }
 
@@ -68,32 +78,23 @@ void Block::clear()
     max_entry_speed     = 0.0F;
     is_ticking          = false;
     is_g123             = false;
+    s_curve             = false;
+    shaped              = false;
     locked              = false;
+    action              = nullptr;
+    action_object       = nullptr;
+    action_value        = 0.0F;
 
-	s_value             = 0.0F;
-    // 2024
-    /*
-	move_axis           = 0;
-    s_values[0]         = 0.0F;
-    s_values[1]         = 0.0F;
-    s_values[2]         = 0.0F;
-    s_values[3]         = 0.0F;
-    s_values[4]         = 0.0F;
-    s_values[5]         = 0.0F;
-    s_values[6]         = 0.0F;
-    s_values[7]         = 0.0F;
-    s_count 			= 1;
-    */
+    s_value             = 0;
+    s_values            = nullptr;
+    s_values_end        = 0;
+    s_count             = 0;
 
     total_move_ticks= 0;
-    if(tick_info == nullptr) {
-        // we create this once for this block
-        tick_info= new tickinfo_t[n_actuators]; //(tickinfo_t *)malloc(sizeof(tickinfo_t) * n_actuators);
-        if(tick_info == nullptr) {
-            // if we ran out of memory in AHB0 just stop here
-            __debugbreak();
-        }
-    }
+    accel_jerk_ticks= 0;
+    decel_jerk_ticks= 0;
+    // BlockQueue hands out the tick info when it allocates the ring
+    if(tick_info == nullptr) return;
 
     for(int i = 0; i < n_actuators; ++i) {
         tick_info[i].steps_per_tick= 0;
@@ -105,23 +106,34 @@ void Block::clear()
         tick_info[i].step_count= 0;
         tick_info[i].next_accel_event= 0;
     }
+
+    if(ramp_info == nullptr) return;
+
+    for(int i = 0; i < n_actuators; ++i) {
+        ramp_info[i].accel_jerk= 0;
+        ramp_info[i].decel_jerk= 0;
+        ramp_info[i].next_shape_event= UINT32_MAX;
+        ramp_info[i].shape_rise= 0;
+        ramp_info[i].shape_fall= 0;
+        ramp_info[i].shape_ramps= 0;
+    }
 }
 
 void Block::debug() const
 {
-    THEKERNEL->streams->printf("%p: steps-X:%lu Y:%lu Z:%lu ", this, this->steps[0], this->steps[1], this->steps[2]);
+    THEKERNEL->streams->printf("%p: steps-X:%lu Y:%lu Z:%lu ", this, (unsigned long)this->steps[0], (unsigned long)this->steps[1], (unsigned long)this->steps[2]);
     for (size_t i = E_AXIS; i < n_actuators; ++i) {
-        THEKERNEL->streams->printf("%c:%lu ", 'A' + i-E_AXIS, this->steps[i]);
+        THEKERNEL->streams->printf("%c:%lu ", (char)('A' + i-E_AXIS), (unsigned long)this->steps[i]);
     }
     THEKERNEL->streams->printf("(max:%lu) nominal:r%1.4f/s%1.4f mm:%1.4f acc:%1.2f accu:%lu decu:%lu ticks:%lu rates:%1.4f/%1.4f entry/max:%1.4f/%1.4f exit:%1.4f primary:%d ready:%d locked:%d ticking:%d recalc:%d nomlen:%d time:%f\r\n",
-                               this->steps_event_count,
+                               (unsigned long)this->steps_event_count,
                                this->nominal_rate,
                                this->nominal_speed,
                                this->millimeters,
                                this->acceleration,
-                               this->accelerate_until,
-                               this->decelerate_after,
-                               this->total_move_ticks,
+                               (unsigned long)this->accelerate_until,
+                               (unsigned long)this->decelerate_after,
+                               (unsigned long)this->total_move_ticks,
                                this->initial_rate,
                                this->maximum_rate,
                                this->entry_speed,
@@ -152,44 +164,88 @@ void Block::calculate_trapezoid( float entryspeed, float exitspeed )
     // if block is currently executing, don't touch anything!
     if (is_ticking) return;
 
+    // an action has no moves, it only hands the speed on to the block after it
+    if (is_action()) {
+        this->exit_speed = exitspeed;
+        return;
+    }
+
     float initial_rate = this->nominal_rate * (entryspeed / this->nominal_speed); // steps/sec
     float final_rate = this->nominal_rate * (exitspeed / this->nominal_speed);
     //printf("Initial rate: %f, final_rate: %f\n", initial_rate, final_rate);
     // How many steps ( can be fractions of steps, we need very precise values ) to accelerate and decelerate
     // This is a simplification to get rid of rate_delta and get the steps/s² accel directly from the mm/s² accel
-    float acceleration_per_second = (this->acceleration * this->steps_event_count) / this->millimeters;
+    float time_to_accelerate, time_to_decelerate;
 
-    float maximum_possible_rate = sqrtf( ( this->steps_event_count * acceleration_per_second ) + ( ( powf(initial_rate, 2) + powf(final_rate, 2) ) / 2.0F ) );
+    // Now we know how long it takes to accelerate and decelerate, but we must
+    // also know how long the entire move takes so we can figure out how long
+    // is the plateau if there is one
+    float plateau_time = 0;
 
-    //printf("id %d: acceleration_per_second: %f, maximum_possible_rate: %f steps/sec, %f mm/sec\n", this->id, acceleration_per_second, maximum_possible_rate, maximum_possible_rate/100);
+    // S-curve only, the time at each end of the ramps the acceleration changes for
+    float accel_jerk_time = 0, decel_jerk_time = 0;
+
+    if(this->s_curve && s_curve_distance(entryspeed, exitspeed) <= this->millimeters * S_CURVE_DISTANCE_ROUNDING) {
+        // the block goes as fast as it can and still fit both ramps in its length, searched for when that is slower than
+        // its nominal speed as the S-curve distances do not add up to a closed form. A block entered faster than it can
+        // slow down from is left to the constant acceleration below, which leaves its ramp events unreachable
+        float top_speed = this->nominal_speed;
+        if(s_curve_distance(entryspeed, top_speed) + s_curve_distance(top_speed, exitspeed) > this->millimeters) {
+            float low = std::max(entryspeed, exitspeed), high = top_speed;
+            for (int i = 0; i < S_CURVE_SEARCH_STEPS; ++i) {
+                float mid = (low + high) / 2.0F;
+                if(s_curve_distance(entryspeed, mid) + s_curve_distance(mid, exitspeed) > this->millimeters) high = mid;
+                else low = mid;
+            }
+            top_speed = low;
+        }
+        this->maximum_rate = this->nominal_rate * (top_speed / this->nominal_speed);
 
-    // Now this is the maximum rate we'll achieve this move, either because
-    // it's the higher we can achieve, or because it's the higher we are
-    // allowed to achieve
-    this->maximum_rate = std::min(maximum_possible_rate, this->nominal_rate);
+        time_to_accelerate = s_curve_time(top_speed - entryspeed);
+        time_to_decelerate = s_curve_time(top_speed - exitspeed);
 
-    // Now figure out how long it takes to accelerate in seconds
-    float time_to_accelerate = ( this->maximum_rate - initial_rate ) / acceleration_per_second;
+        // what the search left over, or all of it at the nominal speed
+        float plateau_distance = this->millimeters - s_curve_distance(entryspeed, top_speed) - s_curve_distance(top_speed, exitspeed);
+        if(plateau_distance > 0) plateau_time = plateau_distance / top_speed;
 
-    // Now figure out how long it takes to decelerate
-    float time_to_decelerate = ( final_rate -  this->maximum_rate ) / -acceleration_per_second;
+        // the acceleration changes at max_jerk until it is at the block's acceleration, a ramp too short to get there
+        // turns back half way
+        float jerk_time = this->acceleration / THEKERNEL->planner->max_jerk;
+        accel_jerk_time = std::min(jerk_time, time_to_accelerate / 2.0F);
+        decel_jerk_time = std::min(jerk_time, time_to_decelerate / 2.0F);
 
-    // Now we know how long it takes to accelerate and decelerate, but we must
-    // also know how long the entire move takes so we can figure out how long
-    // is the plateau if there is one
-    float plateau_time = 0;
+    } else {
+        // How many steps ( can be fractions of steps, we need very precise values ) to accelerate and decelerate
+        // This is a simplification to get rid of rate_delta and get the steps/s² accel directly from the mm/s² accel
+        float acceleration_per_second = (this->acceleration * this->steps_event_count) / this->millimeters;
+
+        float maximum_possible_rate = sqrtf( ( this->steps_event_count * acceleration_per_second ) + ( ( powf(initial_rate, 2) + powf(final_rate, 2) ) / 2.0F ) );
+
+        //printf("id %d: acceleration_per_second: %f, maximum_possible_rate: %f steps/sec, %f mm/sec\n", this->id, acceleration_per_second, maximum_possible_rate, maximum_possible_rate/100);
+
+        // Now this is the maximum rate we'll achieve this move, either because
+        // it's the higher we can achieve, or because it's the higher we are
+        // allowed to achieve
+        this->maximum_rate = std::min(maximum_possible_rate, this->nominal_rate);
+
+        // Now figure out how long it takes to accelerate in seconds
+        time_to_accelerate = ( this->maximum_rate - initial_rate ) / acceleration_per_second;
+
+        // Now figure out how long it takes to decelerate
+        time_to_decelerate = ( final_rate -  this->maximum_rate ) / -acceleration_per_second;
 
-    // Only if there is actually a plateau ( we are limited by nominal_rate )
-    if(maximum_possible_rate > this->nominal_rate) {
-        // Figure out the acceleration and deceleration distances ( in steps )
-        float acceleration_distance = ( ( initial_rate + this->maximum_rate ) / 2.0F ) * time_to_accelerate;
-        float deceleration_distance = ( ( this->maximum_rate + final_rate ) / 2.0F ) * time_to_decelerate;
+        // Only if there is actually a plateau ( we are limited by nominal_rate )
+        if(maximum_possible_rate > this->nominal_rate) {
+            // Figure out the acceleration and deceleration distances ( in steps )
+            float acceleration_distance = ( ( initial_rate + this->maximum_rate ) / 2.0F ) * time_to_accelerate;
+            float deceleration_distance = ( ( this->maximum_rate + final_rate ) / 2.0F ) * time_to_decelerate;
 
-        // Figure out the plateau steps
-        float plateau_distance = this->steps_event_count - acceleration_distance - deceleration_distance;
+            // Figure out the plateau steps
+            float plateau_distance = this->steps_event_count - acceleration_distance - deceleration_distance;
 
-        // Figure out the plateau time in seconds
-        plateau_time = plateau_distance / this->maximum_rate;
+            // Figure out the plateau time in seconds
+            plateau_time = plateau_distance / this->maximum_rate;
+        }
     }
 
     // Figure out how long the move takes total ( in seconds )
@@ -233,17 +289,60 @@ void Block::calculate_trapezoid( float entryspeed, float exitspeed )
     this->initial_rate = initial_rate;
     this->exit_speed = exitspeed;
 
-    // prepare the block for stepticker
-    this->prepare(acceleration_in_steps, deceleration_in_steps);
+    if(this->s_curve) {
+        // the acceleration ramps up from zero at the start of each ramp and back down to zero at its end. The ramps are
+        // taken from the events as a ramp that is never reached (entering faster than this block can go) does not come
+        // out as a sensible number of ticks, it has no jerk time either
+        uint32_t accel_ticks = this->accelerate_until <= total_move_ticks ? this->accelerate_until : 0;
+        uint32_t decel_ticks = this->decelerate_after < total_move_ticks ? total_move_ticks - this->decelerate_after : 0;
+        this->accel_jerk_ticks = std::min(accel_ticks / 2, (uint32_t)roundf(accel_jerk_time * STEP_TICKER_FREQUENCY));
+        this->decel_jerk_ticks = std::min(decel_ticks / 2, (uint32_t)roundf(decel_jerk_time * STEP_TICKER_FREQUENCY));
+    }
+
+    // prepare the block for stepticker, a block that is only planned (see BlockQueue::resize()) has no tick info
+    if(this->tick_info != nullptr) this->prepare(acceleration_in_steps, deceleration_in_steps);
 
     this->locked= false;
 }
 
 // Calculates the maximum allowable speed at this point when you must be able to reach target_velocity using the
 // acceleration within the allotted distance.
-float Block::max_allowable_speed(float acceleration, float target_velocity, float distance)
+float Block::max_allowable_speed(float acceleration, float target_velocity, float distance) const
+{
+    if(!this->s_curve || distance <= 0) return sqrtf(target_velocity * target_velocity - 2.0F * acceleration * distance);
+
+    // the speed change dv an S-curve ramp makes over the distance, s_curve_distance() solved for it. One that gets to
+    // the acceleration a takes dv / a + a / j so dv² + (2v + a²/j) dv + 2a (v a/j - distance) = 0
+    float a = fabsf(acceleration), j = THEKERNEL->planner->max_jerk, v = target_velocity;
+    float b = 2.0F * v + a * a / j;
+    float c = 2.0F * a * (v * a / j - distance);
+    float dv = -2.0F * c / (sqrtf(b * b - 4.0F * c) + b); // the root that is not lost to rounding when b is large
+    if(dv < a * a / j) {
+        // it turns back before it gets there and takes 2 s / √j with s = √dv, so s³ + 2v s = distance √j, Newton's
+        // method closes in on its one root from above, from whichever of the two terms alone gives the lower bound
+        float q = distance * sqrtf(j);
+        float s = v > 0 ? std::min(cbrtf(q), q / (2.0F * v)) : cbrtf(q);
+        for (int i = 0; i < 4; ++i) {
+            s -= (s * s * s + 2.0F * v * s - q) / (3.0F * s * s + 2.0F * v);
+        }
+        dv = s * s;
+    }
+    return v + dv;
+}
+
+// how long an S-curve ramp takes to change the speed by speed_change, the acceleration goes up at max_jerk, holds at the
+// block's acceleration and comes back down at max_jerk. A change too small to reach the acceleration turns back half way
+float Block::s_curve_time(float speed_change) const
+{
+    float a = this->acceleration, j = THEKERNEL->planner->max_jerk;
+    if(speed_change >= a * a / j) return speed_change / a + a / j;
+    return 2.0F * sqrtf(speed_change / j);
+}
+
+// the distance an S-curve ramp between the two speeds covers, it is symmetric so it averages half way between them
+float Block::s_curve_distance(float speed_0, float speed_1) const
 {
-    return sqrtf(target_velocity * target_velocity - 2.0F * acceleration * distance);
+    return (speed_0 + speed_1) / 2.0F * s_curve_time(fabsf(speed_1 - speed_0));
 }
 
 // Called by Planner::recalculate() when scanning the plan from last to first entry.
@@ -278,6 +377,13 @@ float Block::forward_pass(float prev_max_exit_speed)
     // speeds have already been reset, maximized, and reverse planned by reverse planner.
     // If nominal length is true, max junction speed is guaranteed to be reached. No need to recheck.
 
+    // an action has no length so whatever the previous move can exit at is what the next one can enter at
+    if (is_action()) {
+        if (prev_max_exit_speed < entry_speed)
+            entry_speed = prev_max_exit_speed;
+        return prev_max_exit_speed;
+    }
+
     // TODO: find out if both of these checks are necessary
     if (prev_max_exit_speed > nominal_speed)
         prev_max_exit_speed = nominal_speed;
@@ -331,6 +437,12 @@ void Block::prepare(float acceleration_in_steps, float deceleration_in_steps)
     double acceleration_per_tick = acceleration_in_steps * fp_scale; // this is now scaled to fit a 2.30 fixed point number
     double deceleration_per_tick = deceleration_in_steps * fp_scale;
 
+    // input shaping takes the ramps that are long enough for the shaper of each motor, S-curve blocks are never shaped
+    bool shaping = !this->s_curve && THEKERNEL->planner->input_shaping && this->ramp_info != nullptr;
+    uint32_t accel_ticks = this->accelerate_until <= this->total_move_ticks ? this->accelerate_until : 0;
+    uint32_t decel_ticks = this->decelerate_after < this->total_move_ticks ? this->total_move_ticks - this->decelerate_after : 0;
+    this->shaped = false;
+
     for (uint8_t m = 0; m < n_actuators; m++) {
         uint32_t steps = this->steps[m];
         this->tick_info[m].steps_to_move = steps;
@@ -343,14 +455,24 @@ void Block::prepare(float acceleration_in_steps, float deceleration_in_steps)
         this->tick_info[m].step_count = 0;
         this->tick_info[m].next_accel_event = this->total_move_ticks + 1;
 
+        // an S-curve ramp starts with no acceleration, StepTicker adds the jerk to it every tick until it is at its peak,
+        // ramps that are too short to shape stay constant acceleration
+        bool s_accel = this->accel_jerk_ticks > 0 && this->ramp_info != nullptr;
+        bool s_decel = this->decel_jerk_ticks > 0 && this->ramp_info != nullptr;
+
+        // a shaped ramp starts with no acceleration too, StepTicker sets it at each step of the staircase
+        const InputShaper& shaper = THEKERNEL->planner->get_input_shaper(m);
+        bool sh_accel = shaping && shaper.shapes(accel_ticks);
+        bool sh_decel = shaping && shaper.shapes(decel_ticks);
+
         double acceleration_change = 0;
         if(this->accelerate_until != 0) { // If the next accel event is the end of accel
             this->tick_info[m].next_accel_event = this->accelerate_until;
-            acceleration_change = acceleration_per_tick;
+            if(!s_accel && !sh_accel) acceleration_change = acceleration_per_tick;
 
         } else if(this->decelerate_after == 0 /*&& this->accelerate_until == 0*/) {
             // we start off decelerating
-            acceleration_change = -deceleration_per_tick;
+            if(!s_decel && !sh_decel) acceleration_change = -deceleration_per_tick;
 
         } else if(this->decelerate_after != this->total_move_ticks /*&& this->accelerate_until == 0*/) {
             // If the next event is the start of decel ( don't set this if the next accel event is accel end )
@@ -360,9 +482,44 @@ void Block::prepare(float acceleration_in_steps, float deceleration_in_steps)
         // already converted to fixed point just needs scaling by ratio
         //#define STEPTICKER_TOFP(x) ((int64_t)round((double)(x)*STEPTICKER_FPSCALE))
         this->tick_info[m].acceleration_change= (int64_t)round(acceleration_change * aratio);
-        this->tick_info[m].deceleration_change= -(int64_t)round(deceleration_per_tick * aratio);
+        this->tick_info[m].deceleration_change= s_decel || sh_decel ? 0 : -(int64_t)round(deceleration_per_tick * aratio);
         this->tick_info[m].plateau_rate= (int64_t)round(((this->maximum_rate * aratio) / STEP_TICKER_FREQUENCY) * STEPTICKER_FPSCALE);
 
+        if(this->ramp_info == nullptr) continue;
+        Block::rampinfo_t& ri = this->ramp_info[m];
+
+        // the accelerations over a ramp of n ticks with k jerk ticks at each end add up to jerk * k * (n - k), which has
+        // to be the same change in rate as the constant acceleration gives
+        ri.accel_jerk= 0;
+        ri.decel_jerk= 0;
+        if(s_accel) {
+            uint32_t n = this->accelerate_until, k = this->accel_jerk_ticks;
+            ri.accel_jerk= (int64_t)round(acceleration_per_tick * aratio * n / ((double)k * (n - k)));
+        }
+        if(s_decel) {
+            uint32_t n = this->total_move_ticks - this->decelerate_after, k = this->decel_jerk_ticks;
+            ri.decel_jerk= (int64_t)round(deceleration_per_tick * aratio * n / ((double)k * (n - k)));
+        }
+
+        // the staircase runs at its peak for all but the shaper's delay and duration of the ramp, for the same change in
+        // rate the peak is higher than the constant acceleration by n / (n - delay - duration), which only the ramps
+        // long enough to keep it within the acceleration limit are shaped for, see Planner::planned_acceleration()
+        ri.next_shape_event= UINT32_MAX;
+        ri.shape_rise= 0;
+        ri.shape_fall= 0;
+        ri.shape_ramps= (sh_accel ? SHAPE_ACCEL : 0) | (sh_decel ? SHAPE_DECEL : 0);
+        if(sh_accel) {
+            uint32_t n = accel_ticks;
+            ri.accel_peak= (int64_t)round(acceleration_per_tick * aratio * n / (n - shaper.get_delay() - shaper.get_duration()));
+            ri.next_shape_event= shaper.get_delay();
+        }
+        if(sh_decel) {
+            uint32_t n = decel_ticks;
+            ri.decel_peak= (int64_t)round(deceleration_per_tick * aratio * n / (n - shaper.get_delay() - shaper.get_duration()));
+            if(!sh_accel) ri.next_shape_event= this->decelerate_after + 1 + shaper.get_delay();
+        }
+        if(sh_accel || sh_decel) this->shaped = true;
+
         #if 0
         THEKERNEL->streams->printf("spt: %08lX %08lX, ac: %08lX %08lX, dc: %08lX %08lX, pr: %08lX %08lX\n",
             (uint32_t)(this->tick_info[m].steps_per_tick>>32), // 2.62 fixed point
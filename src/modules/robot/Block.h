@@ -7,16 +7,26 @@
 
 #pragma once
 
-#include <bitset>
+#include <stdint.h>
+
 #include "ActuatorCoordinates.h"
 
 class Block {
     public:
+        // rampinfo_t::shape_ramps
+        enum { SHAPE_ACCEL = 1, SHAPE_DECEL = 2 };
+
         Block();
 
-        static void init(uint8_t);
+        // the number of motors, and whether BlockQueue allocates ramp info for S-curve or input shaped ramps
+        static void init(uint8_t, bool);
 
         void calculate_trapezoid( float entry_speed, float exit_speed );
+        float max_allowable_speed( float acceleration, float target_velocity, float distance) const;
+        // S-curve only, the time a ramp that changes the speed by speed_change takes and the distance a ramp between
+        // two speeds covers, at the block's acceleration and max_jerk
+        float s_curve_time(float speed_change) const;
+        float s_curve_distance(float speed_0, float speed_1) const;
 
         float reverse_pass(float exit_speed);
         float forward_pass(float next_entry_speed);
@@ -25,9 +35,19 @@ class Block {
         void ready() { is_ready= true; }
         void clear();
         float get_trapezoid_rate(int i) const;
+        bool is_action() const { return action != nullptr; }
+        // laser power at this step of the primary actuator, a block with a power array spreads it evenly along the move.
+        // For the 1 ms update, the step ticker steps through the array without dividing, see Laser::step_sync()
+        uint16_t get_s_value(uint32_t step_count) const {
+            if(s_count <= 1) return s_value;
+            uint32_t i = (uint64_t)step_count * s_count / steps_event_count;
+            return s_values[i < s_count ? i : s_count - 1];
+        }
+
+        // run from the step ticker ISR when motion reaches the block, see Planner::append_action()
+        typedef void (*action_t)(void *object, float value);
 
     private:
-        float max_allowable_speed( float acceleration, float target_velocity, float distance);
         void prepare(float acceleration_in_steps, float deceleration_in_steps);
 
         static double fp_scale; // optimize to store this as it does not change
@@ -47,14 +67,23 @@ class Block {
         float max_entry_speed;
         unsigned int line;
 
+        // a synchronized action rather than a move, it has no steps and the planner passes speeds straight through it
+        action_t action;
+        void *action_object;
+        float action_value;
+
         // this is tick info needed for this block. applies to all motors
         uint32_t accelerate_until;
         uint32_t decelerate_after;
         uint32_t total_move_ticks;
-        std::bitset<k_max_actuators> direction_bits;     // Direction for each axis in bit form, relative to the direction port's mask
+        // S-curve only, ticks at each end of the acceleration and deceleration ramps where the acceleration changes at
+        // up to max_jerk
+        uint32_t accel_jerk_ticks;
+        uint32_t decel_jerk_ticks;
 
         // this is the data needed to determine when each motor needs to be issued a step
-        using tickinfo_t= struct {
+        // packed to 4 byte alignment as there is one per motor per block, LDRD only needs word alignment on the M3
+        using tickinfo_t= struct __attribute__((packed, aligned(4))) {
             int64_t steps_per_tick; // 2.62 fixed point
             int64_t counter; // 2.62 fixed point
             int64_t acceleration_change; // 2.62 fixed point signed
@@ -65,26 +94,53 @@ class Block {
             uint32_t next_accel_event;
         };
 
-        // need info for each active motor
+        // S-curve and input shaped ramps only, kept out of tickinfo_t so a queue that has neither does not carry them.
+        // A ramp is either an S-curve or input shaped, never both
+        using rampinfo_t= struct __attribute__((packed, aligned(4))) {
+            union {
+                int64_t accel_jerk; // 2.62 fixed point, S-curve change of acceleration_change per tick during the acceleration ramp
+                int64_t accel_peak; // 2.62 fixed point, input shaped acceleration_change at the top of the acceleration ramp
+            };
+            union {
+                int64_t decel_jerk; // 2.62 fixed point, same for the deceleration ramp
+                int64_t decel_peak;
+            };
+            // input shaping, see InputShaper::advance()
+            uint32_t next_shape_event;
+            uint8_t shape_rise;
+            uint8_t shape_fall;
+            uint8_t shape_ramps; // SHAPE_ACCEL and SHAPE_DECEL for the ramps still to shape
+        };
+
+        // need info for each active motor, points into the tick info array BlockQueue allocates with the ring
         tickinfo_t *tick_info;
+        // the same for the ramps, nullptr unless S-curve or input shaping is configured, see init()
+        rampinfo_t *ramp_info;
 
         static uint8_t n_actuators;
+        static bool with_ramp_info;
 
-        // 2024
-        // uint16_t s_values[8];
+        // laser power for each equal part of the move, 1.11 fixed point, points into the power ring BlockQueue allocates.
+        // s_values_end is the ring position to release it up to once the block is done
+        uint16_t *s_values;
+        uint32_t s_values_end;
+        uint16_t s_count;
+        // steps_event_count / s_count and its remainder, the steps of the primary actuator each power covers
+        uint32_t s_steps;
+        uint16_t s_steps_rem;
 
         struct {
+            uint8_t direction_bits;              // Direction for each axis in bit form (bit n is actuator n), relative to the direction port's mask
             bool recalculate_flag:1;             // Planner flag to recalculate trapezoids on entry junction
             bool nominal_length_flag:1;          // Planner flag for nominal speed always reached
             bool is_ready:1;
             bool primary_axis:1;                 // set if this move is a primary axis
             bool is_g123:1;                      // set if this is a G1, G2 or G3
+            bool s_curve:1;                      // set if the ramps are S-curves rather than constant acceleration
+            bool shaped:1;                       // set if input shaping has ramps of some motor to shape
             volatile bool is_ticking:1;          // set when this block is being actively ticked by the stepticker
             volatile bool locked:1;              // set to true when the critical data is being updated, stepticker will have to skip if this is set
 
-            // 2024
-            // uint8_t  s_count:4;                  // number of laser intensity values
-            // uint8_t  move_axis:3;                // axis of greatest movement
             uint16_t s_value:12;                 // for laser 1.11 Fixed point
         };
 };
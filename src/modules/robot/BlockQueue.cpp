@@ -2,7 +2,9 @@
 #include "Block.h"
 
 #include <cstdlib>
+#include <new>
 #include "cmsis.h"
+#include "MemoryPool.h"
 #include "platform_memory.h"
 
 /*
@@ -12,18 +14,20 @@
 BlockQueue::BlockQueue()
 {
     head_i = tail_i = length = 0;
-    isr_tail_i = tail_i;
+    isr_tail_i = staged_i = tail_i;
     ring = nullptr;
+    tick_info = nullptr;
+    ramp_info = nullptr;
+    ring_pool = tick_info_pool = ramp_info_pool = nullptr;
+    power = nullptr;
+    power_pool = nullptr;
+    power_length = 0;
+    power_head = power_tail = 0;
 }
 
-BlockQueue::BlockQueue(unsigned int length)
+BlockQueue::BlockQueue(unsigned int length) : BlockQueue()
 {
-    head_i = tail_i = 0;
-    isr_tail_i = tail_i;
-    void *v= AHB0.alloc(sizeof(Block) * length);
-    ring = new(v) Block[length];
-    // TODO: handle allocation failure
-    this->length = length;
+    resize(length);
 }
 
 /*
@@ -33,10 +37,46 @@ BlockQueue::BlockQueue(unsigned int length)
 BlockQueue::~BlockQueue()
 {
     head_i = tail_i = length = 0;
-    isr_tail_i = tail_i;
-    if(ring != nullptr)
-        AHB0.dealloc(ring); // delete [] ring;
+    isr_tail_i = staged_i = tail_i;
+    release(ring, tick_info, ramp_info, ring_pool, tick_info_pool, ramp_info_pool);
     ring = nullptr;
+    tick_info = nullptr;
+    ramp_info = nullptr;
+    dealloc(power, power_pool);
+    power = nullptr;
+}
+
+/*
+ * memory, the AHB banks are tried first as they are otherwise mostly idle
+ */
+
+void *BlockQueue::alloc(size_t size, MemoryPool *&pool)
+{
+    void *v = AHB0.alloc(size);
+    pool = &AHB0;
+    if(v == nullptr) {
+        v = AHB1.alloc(size);
+        pool = &AHB1;
+    }
+    if(v == nullptr) {
+        v = malloc(size);
+        pool = nullptr;
+    }
+    return v;
+}
+
+void BlockQueue::dealloc(void *p, MemoryPool *pool)
+{
+    if(p == nullptr) return;
+    if(pool != nullptr) pool->dealloc(p);
+    else free(p);
+}
+
+void BlockQueue::release(Block *ring, void *tick_info, void *ramp_info, MemoryPool *ring_pool, MemoryPool *tick_info_pool, MemoryPool *ramp_info_pool)
+{
+    dealloc(ring, ring_pool); // Block has nothing to destroy
+    dealloc(tick_info, tick_info_pool);
+    dealloc(ramp_info, ramp_info_pool);
 }
 
 /*
@@ -154,7 +194,7 @@ bool BlockQueue::is_empty() const
  * resize
  */
 
-bool BlockQueue::resize(unsigned int length)
+bool BlockQueue::resize(unsigned int length, bool with_tick_info)
 {
     if (is_empty())
     {
@@ -164,13 +204,18 @@ bool BlockQueue::resize(unsigned int length)
 
             if (is_empty()) // check again in case something was pushed
             {
-                head_i = tail_i = this->length = 0;
+                Block* oldring = ring;
+                void* oldtick_info = tick_info;
+                void* oldramp_info = ramp_info;
+
+                head_i = tail_i = isr_tail_i = staged_i = this->length = 0;
+                ring = nullptr;
+                tick_info = nullptr;
+                ramp_info = nullptr;
 
                 __enable_irq();
 
-                if (ring != nullptr)
-                    AHB0.dealloc(ring); // delete [] ring;
-                ring = nullptr;
+                release(oldring, oldtick_info, oldramp_info, ring_pool, tick_info_pool, ramp_info_pool);
 
                 return true;
             }
@@ -181,38 +226,91 @@ bool BlockQueue::resize(unsigned int length)
         }
 
         // Note: we don't use realloc so we can fall back to the existing ring if allocation fails
-        void *v= AHB0.alloc(sizeof(Block) * length);
-        Block* newring = new(v) Block[length];
-
-        if (newring != nullptr)
+        // the tick info is the larger of the two so it gets first pick, the ramp info is only there for S-curve and input
+        // shaped ramps (see Block::init())
+        bool with_ramp_info = with_tick_info && Block::with_ramp_info;
+        MemoryPool *newtick_info_pool = nullptr, *newramp_info_pool = nullptr, *newring_pool;
+        Block::tickinfo_t* newtick_info = with_tick_info ? (Block::tickinfo_t *)alloc(sizeof(Block::tickinfo_t) * Block::n_actuators * length, newtick_info_pool) : nullptr;
+        Block::rampinfo_t* newramp_info = with_ramp_info ? (Block::rampinfo_t *)alloc(sizeof(Block::rampinfo_t) * Block::n_actuators * length, newramp_info_pool) : nullptr;
+        Block* newring = (Block *)alloc(sizeof(Block) * length, newring_pool);
+
+        if (newring != nullptr && (newtick_info != nullptr || !with_tick_info) && (newramp_info != nullptr || !with_ramp_info))
         {
+            for (unsigned int i = 0; i < length; ++i) {
+                new(&newring[i]) Block();
+                if (newtick_info != nullptr) newring[i].tick_info = &newtick_info[i * Block::n_actuators];
+                if (newramp_info != nullptr) newring[i].ramp_info = &newramp_info[i * Block::n_actuators];
+                newring[i].clear();
+            }
+
             Block* oldring = ring;
+            void* oldtick_info = tick_info;
+            void* oldramp_info = ramp_info;
+            MemoryPool *oldring_pool = ring_pool, *oldtick_info_pool = tick_info_pool, *oldramp_info_pool = ramp_info_pool;
 
             __disable_irq();
 
             if (is_empty()) // check again in case something was pushed while malloc did its thing
             {
                 ring = newring;
+                tick_info = newtick_info;
+                ramp_info = newramp_info;
+                ring_pool = newring_pool;
+                tick_info_pool = newtick_info_pool;
+                ramp_info_pool = newramp_info_pool;
                 this->length = length;
-                head_i = tail_i = 0;
+                head_i = tail_i = isr_tail_i = staged_i = 0;
 
                 __enable_irq();
 
-                if (oldring != nullptr)
-                    AHB0.dealloc(oldring); // delete [] oldring;
+                release(oldring, oldtick_info, oldramp_info, oldring_pool, oldtick_info_pool, oldramp_info_pool);
 
                 return true;
             }
 
             __enable_irq();
-
-            AHB0.dealloc(newring); // delete [] newring;
         }
+
+        release(newring, newtick_info, newramp_info, newring_pool, newtick_info_pool, newramp_info_pool);
     }
 
     return false;
 }
 
+/*
+ * laser power ring
+ */
+
+bool BlockQueue::resize_power(unsigned int length)
+{
+    if (!is_empty() || power_head != power_tail) return false;
+
+    dealloc(power, power_pool);
+    power = nullptr;
+    power_length = 0;
+    if (length == 0) return true;
+
+    power = (uint16_t *)alloc(sizeof(uint16_t) * length, power_pool);
+    if (power == nullptr) return false;
+    power_length = length;
+    return true;
+}
+
+uint16_t *BlockQueue::claim_power(unsigned int n, uint32_t& end)
+{
+    if (n == 0 || n > get_max_power_values()) return nullptr;
+
+    // an array does not wrap, if it would not fit before the end of the ring it starts again at the beginning
+    uint32_t start = power_head;
+    unsigned int offset = start % power_length;
+    if (offset + n > power_length) start += power_length - offset;
+
+    if (start + n - power_tail > power_length) return nullptr;
+
+    power_head = end = start + n;
+    return &power[start % power_length];
+}
+
 // bool BlockQueue::provide(Block* buffer, unsigned int length)
 // {
 //     __disable_irq();
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstddef>
+#include <stdint.h>
+
 class Block;
+class MemoryPool;
 
 class BlockQueue {
 
@@ -41,9 +45,30 @@ public:
     /*
      * resize
      *
+     * the ring and the tick info for every block each go in AHB0, AHB1 or the heap, whichever has room first, and so
+     * does the ramp info when Block::with_ramp_info is set. A queue whose blocks are only planned and never stepped
+     * (JobEstimate) can do without either
+     *
      * returns true on success, or false if queue is not empty or not enough memory available
      */
-    bool resize(unsigned int);
+    bool resize(unsigned int, bool with_tick_info = true);
+    unsigned int get_length() const { return length; }
+
+    /*
+     * laser power ring
+     *
+     * blocks with a power array take it from here in queue order and give it back in the same order once they are done,
+     * positions count up for ever and wrap with the uint32_t so head - tail is always what is in use
+     *
+     * claim_power returns n contiguous entries or nullptr if there is not room yet, end is the position to release up to
+     */
+    bool resize_power(unsigned int);
+    uint16_t *claim_power(unsigned int n, uint32_t& end);
+    void release_power(uint32_t end) { power_tail = end; }
+    // gives back the last claim, for a block that is not queued after all
+    void unclaim_power(uint32_t end, unsigned int n) { power_head = end - n; }
+    unsigned int get_power_length() const { return power_length; }
+    unsigned int get_max_power_values() const { return power_length / 4; }
 
     /*
      * provide
@@ -66,6 +91,8 @@ protected:
 
     unsigned int next(unsigned int) const;
     unsigned int prev(unsigned int) const;
+    // blocks from one index up to another, eg head_i - isr_tail_i are what the step ticker has not finished yet
+    unsigned int count(unsigned int from, unsigned int to) const { return to >= from ? to - from : to + length - from; }
 
     /*
      * buffer variables
@@ -75,7 +102,24 @@ protected:
     volatile unsigned int head_i;
     volatile unsigned int tail_i;
     volatile unsigned int isr_tail_i;
+    // between isr_tail_i and head_i, the blocks before it have been handed to the step ticker, see Conveyor::stage_blocks()
+    volatile unsigned int staged_i;
 
 private:
+    static void *alloc(size_t size, MemoryPool *&pool);
+    static void dealloc(void *p, MemoryPool *pool);
+    void release(Block *ring, void *tick_info, void *ramp_info, MemoryPool *ring_pool, MemoryPool *tick_info_pool, MemoryPool *ramp_info_pool);
+
     Block* ring;
+    void* tick_info;                // tickinfo_t for every block, n_actuators each
+    void* ramp_info;                // rampinfo_t the same way, or nullptr
+    MemoryPool* ring_pool;          // where they came from, nullptr is the heap
+    MemoryPool* tick_info_pool;
+    MemoryPool* ramp_info_pool;
+
+    uint16_t* power;
+    MemoryPool* power_pool;
+    unsigned int power_length;
+    uint32_t power_head;
+    uint32_t power_tail;
 };
@@ -0,0 +1,42 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CollinearMerge.h"
+
+#include <string.h>
+
+void CollinearMerge::begin(const float start[3], const float end[3])
+{
+    memcpy(this->start, start, sizeof(this->start));
+    memcpy(points[0], end, sizeof(points[0]));
+    count = 1;
+}
+
+bool CollinearMerge::extend(const float end[3], float tolerance)
+{
+    if(count == 0 || count >= MAX_MERGED_SEGMENTS) return false;
+
+    float d[3] = {end[0] - start[0], end[1] - start[1], end[2] - start[2]};
+    float len2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    if(len2 <= 0) return false;
+
+    // each point has to be further along the new line than the one before it and before its end, and no further
+    // from it than the tolerance
+    float along = 0;
+    float tol2 = tolerance * tolerance;
+    for (int i = 0; i < count; ++i) {
+        float v[3] = {points[i][0] - start[0], points[i][1] - start[1], points[i][2] - start[2]};
+        float s = (v[0] * d[0] + v[1] * d[1] + v[2] * d[2]) / len2;
+        if(s <= along || s >= 1) return false;
+        along = s;
+        float e[3] = {v[0] - s * d[0], v[1] - s * d[1], v[2] - s * d[2]};
+        if(e[0] * e[0] + e[1] * e[1] + e[2] * e[2] > tol2) return false;
+    }
+
+    memcpy(points[count++], end, sizeof(points[0]));
+    return true;
+}
@@ -0,0 +1,36 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// most segments merged into one block
+#define MAX_MERGED_SEGMENTS 16
+
+// The run of segments the Planner merged into its last block, as the X, Y, Z positions (actuator mm) where each of
+// them ended. A segment carries on the run if a straight line from where the run started to where the segment ends
+// passes within the tolerance of every point the run went through, in the order it went through them.
+class CollinearMerge {
+    public:
+        CollinearMerge() : count(0) {}
+
+        // start a run with the segment from start to end
+        void begin(const float start[3], const float end[3]);
+        // true and the segment added to the run if it carries on the run within tolerance, false leaves it as it was
+        bool extend(const float end[3], float tolerance);
+        void clear() { count = 0; }
+
+        uint8_t get_count() const { return count; }
+        // where the run ends so far
+        const float *last() const { return points[count - 1]; }
+
+    private:
+        float start[3];
+        float points[MAX_MERGED_SEGMENTS][3];
+        uint8_t count;
+};
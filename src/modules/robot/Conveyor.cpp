@@ -29,6 +29,7 @@
 
 #define planner_queue_size_checksum CHECKSUM("planner_queue_size")
 #define queue_delay_time_ms_checksum CHECKSUM("queue_delay_time_ms")
+#define planner_laser_power_values_checksum CHECKSUM("planner_laser_power_values")
 
 /*
  * The conveyor holds the queue of blocks, takes care of creating them, and starting the executing chain of blocks
@@ -55,6 +56,12 @@
  * When isr_tail_i != tail, we clean up the tail block (performing ISR-unsafe delete operations) and consume it (increment tail pointer), returning it to the pool of clean, unused blocks which HEAD is allowed to prepare for queueing
  *
  * Thus, our two ringbuffers exist sharing the one ring of blocks, and we safely marshall used blocks from ISR context to IDLE context for safe cleanup.
+ *
+ * The ISR does not take blocks straight from HEAD either, in IDLE context stage_blocks() hands them over by moving a
+ * fourth index, staged_i, on from isr_tail_i towards HEAD, a block or two ahead of the ISR. The tick info of a block
+ * was worked out by Block::prepare() while it was planned, once it is staged the planner leaves it alone, so at a
+ * block boundary the ISR only has to take the block at isr_tail_i if it is before staged_i. Should IDLE context not
+ * get round to staging it in time the ISR takes it as it used to, rather than stop the machine.
  */
 
 
@@ -63,6 +70,8 @@ Conveyor::Conveyor()
     running = false;
     allow_fetch = false;
     flush= false;
+    queue_stats.depth_bucket = 1;
+    reset_queue_stats();
 }
 
 void Conveyor::on_module_loaded()
@@ -74,13 +83,30 @@ void Conveyor::on_module_loaded()
     //THEKERNEL->step_ticker->finished_fnc = std::bind( &Conveyor::all_moves_finished, this);
     queue_size = THEKERNEL->config->value(planner_queue_size_checksum)->by_default(32)->as_number();
     queue_delay_time_ms = THEKERNEL->config->value(queue_delay_time_ms_checksum)->by_default(100)->as_number();
+    power_values = THEKERNEL->config->value(planner_laser_power_values_checksum)->by_default(1024)->as_number();
 }
 
 // we allocate the queue here after config is completed so we do not run out of memory during config
 void Conveyor::start(uint8_t n)
 {
-    Block::init(n); // set the number of motors which determines how big the tick info vector is
-    queue.resize(queue_size);
+    Block::init(n, THEKERNEL->planner->has_shaped_ramps()); // set the number of motors which determines how big the tick info vector is
+
+    // a deep queue may not fit in the AHB banks and the heap, so use as many blocks as do fit
+    size_t n_blocks = queue_size;
+    while(!queue.resize(n_blocks) && n_blocks > 2) {
+        n_blocks -= (n_blocks + 7) / 8;
+    }
+    if(n_blocks != queue_size) {
+        THEKERNEL->streams->printf("WARNING: planner_queue_size %u does not fit in memory, using %u blocks\n", (unsigned int)queue_size, (unsigned int)n_blocks);
+        queue_size = n_blocks;
+    }
+
+    // laser power arrays, without any room for them a G1 with S a:b:c is queued as a block for each value
+    while(power_values > 0 && !queue.resize_power(power_values)) {
+        power_values /= 2;
+    }
+    queue_stats.depth_bucket = (queue_size + CONVEYOR_DEPTH_BUCKETS - 1) / CONVEYOR_DEPTH_BUCKETS;
+    stage_ahead_ticks = THEKERNEL->step_ticker->get_frequency() * CONVEYOR_STAGE_AHEAD_MS / 1000;
     running = true;
 }
 
@@ -105,6 +131,7 @@ void Conveyor::on_idle(void*)
             // Cleanly delete block
             Block* block = queue.tail_ref();
             //block->debug();
+            if(block->s_count > 1) queue.release_power(block->s_values_end);
             block->clear();
             queue.consume_tail();
         }
@@ -129,6 +156,13 @@ bool Conveyor::is_idle() const
 // Wait for the queue to be empty and for all the jobs to finish in step ticker
 void Conveyor::wait_for_idle(bool wait_for_motors)
 {
+    // only the outermost wait is timed, ON_IDLE handlers can wait too
+    bool timed = !idle_wait && !is_idle();
+    uint32_t start = us_ticker_read();
+    bool was_idle_wait = idle_wait;
+    idle_wait = true;
+    end_underrun();
+
     // wait for the job queue to empty, this means cycling everything on the block queue into the job queue
     // forcing them to be jobs
     running = false; // stops on_idle calling check_queue
@@ -145,6 +179,13 @@ void Conveyor::wait_for_idle(bool wait_for_motors)
     }
 
     running = true;
+    idle_wait = was_idle_wait;
+    if(timed) {
+        uint32_t us = us_ticker_read() - start;
+        queue_stats.waits++;
+        queue_stats.wait_us += us;
+        if(us > queue_stats.max_wait_us) queue_stats.max_wait_us = us;
+    }
     // returning now means that everything has totally finished
 }
 
@@ -162,11 +203,16 @@ void Conveyor::queue_head_block()
     if(THEKERNEL->is_halted()) {
         // we do not want to stick more stuff on the queue if we are in halt state
         // clear and release the block on the head
-        queue.head_ref()->clear();
+        Block *block = queue.head_ref();
+        if(block->s_count > 1) queue.unclaim_power(block->s_values_end, block->s_count);
+        block->clear();
         return; // if we got a halt then we are done here
     }
 
     queue.produce_head();
+    last_queued_us = us_ticker_read();
+    // a block after a short one may be due before the next idle
+    stage_blocks();
 
     // not sure if this is the correct place but we need to turn on the motors if they were not already on
     THEKERNEL->call_event(ON_ENABLE, (void*)1); // turn all enable pins on
@@ -187,7 +233,40 @@ void Conveyor::check_queue(bool force)
     if(force || queue.is_full() || (us_ticker_read() - last_time_check) >= (queue_delay_time_ms * 1000)) {
         last_time_check = us_ticker_read(); // reset timeout
         if(!flush) allow_fetch = true;
-        return;
+    }
+    stage_blocks();
+}
+
+// Hands the step ticker the next blocks, it runs up to CONVEYOR_STAGED_BLOCKS moves, counting the one it is on,
+// without waiting for this. A staged block is final, it is marked as ticking so the planner no longer changes it,
+// which is why the next one is only staged once the one running is nearly done. A stopped step ticker takes the first
+// block itself, see get_next_block(), the ones queued right after it can still change it until then
+void Conveyor::stage_blocks()
+{
+    if(!allow_fetch || flush) return;
+
+    for (;;) {
+        // the ISR moves isr_tail_i and, when it takes a block that was not staged in time, staged_i on as well, so
+        // all of this is looked at with it held off
+        __disable_irq();
+        // actions run on the same tick as the move after them so they do not count
+        unsigned int staged = 0;
+        for (unsigned int i = queue.isr_tail_i; i != queue.staged_i; i = queue.next(i)) {
+            if(!queue.item_ref(i)->is_action()) staged++;
+        }
+        if(queue.staged_i == queue.head_i || staged >= CONVEYOR_STAGED_BLOCKS || THEKERNEL->step_ticker->is_idle() ||
+           (staged > 0 && THEKERNEL->step_ticker->get_ticks_left() > stage_ahead_ticks)) {
+            __enable_irq();
+            return;
+        }
+
+        Block *b = queue.item_ref(queue.staged_i);
+        if(!b->is_ready) __debugbreak(); // should never happen
+        record_depth();
+        b->is_ticking = true;
+        b->recalculate_flag = false;
+        queue.staged_i = queue.next(queue.staged_i);
+        __enable_irq();
     }
 }
 
@@ -199,29 +278,115 @@ bool Conveyor::get_next_block(Block **block)
         while (queue.isr_tail_i != queue.head_i) {
             queue.isr_tail_i = queue.next(queue.isr_tail_i);
         }
+        queue.staged_i = queue.head_i;
     }
 
     // default the feerate to zero if there is no block available
     this->current_feedrate= 0;
 
-    if(THEKERNEL->is_halted() || queue.isr_tail_i == queue.head_i) return false; // we do not have anything to give
-
-    // wait for queue to fill up, optimizes planning
-    if(!allow_fetch) return false;
+    if(THEKERNEL->is_halted()) return false;
 
     Block *b= queue.item_ref(queue.isr_tail_i);
-    // we cannot use this now if it is being updated
-    if(!b->locked) {
+    if(queue.isr_tail_i == queue.staged_i) {
+        // the main loop did not stage it in time, take it as it is unless there is none yet or the planner is
+        // changing it
+        if(queue.isr_tail_i == queue.head_i || !allow_fetch || b->locked) {
+            record_starved();
+            return false;
+        }
         if(!b->is_ready) __debugbreak(); // should never happen
-
         b->is_ticking= true;
         b->recalculate_flag= false;
-        this->current_feedrate= b->nominal_speed;
-        *block= b;
-        return true;
+        record_depth();
+        queue.staged_i = queue.next(queue.isr_tail_i);
+        // starting from a stop is not late, the main loop leaves the first block to this
+        if(!THEKERNEL->step_ticker->is_idle()) queue_stats.unstaged++;
     }
 
-    return false;
+    if(!b->is_action()) this->current_feedrate= b->nominal_speed;
+    *block= b;
+    record_fetch();
+    return true;
+}
+
+// called as the block at staged_i is handed to the step ticker, how far ahead of it the planner is
+void Conveyor::record_depth()
+{
+    unsigned int behind = queue.count(queue.staged_i, queue.head_i) - 1;
+    unsigned int bucket = behind / queue_stats.depth_bucket;
+    queue_stats.depth[bucket < CONVEYOR_DEPTH_BUCKETS ? bucket : CONVEYOR_DEPTH_BUCKETS - 1]++;
+}
+
+// called from get_next_block() when the step ticker takes a block
+void Conveyor::record_fetch()
+{
+    end_underrun();
+    fetching = true;
+}
+
+// called from get_next_block() when there is no block for the step ticker, which asks again every tick until there is
+void Conveyor::record_starved()
+{
+    if(fetching) {
+        // it was running blocks, the queue running dry in a job other than in wait_for_idle() stops the machine
+        // until it has something again. A streamed job is not marked as one, it counts while blocks are still coming
+        // in, a block queued within queue_delay_time_ms, a lone command is held back that long before it runs so
+        // running out after it does not count
+        fetching = false;
+        bool streaming = (us_ticker_read() - last_queued_us) < queue_delay_time_ms * 1000;
+        if((job_running || streaming) && !idle_wait) {
+            starving = true;
+            underrun_ticks = 0;
+            queue_stats.underruns++;
+        }
+    }
+    if(starving) {
+        underrun_ticks++;
+        queue_stats.underrun_ticks++;
+    }
+}
+
+void Conveyor::end_underrun()
+{
+    if(starving) {
+        starving = false;
+        if(underrun_ticks > queue_stats.max_underrun_ticks) queue_stats.max_underrun_ticks = underrun_ticks;
+    }
+}
+
+void Conveyor::set_job_running(bool f)
+{
+    if(f && !job_running) {
+        reset_queue_stats();
+        THEKERNEL->step_ticker->reset_cycle_stats();
+    }
+    job_running = f;
+}
+
+Conveyor::QueueStats Conveyor::get_queue_stats() const
+{
+    __disable_irq();
+    QueueStats qs = queue_stats;
+    // an underrun still going on counts for what it has been so far
+    if(starving && underrun_ticks > qs.max_underrun_ticks) qs.max_underrun_ticks = underrun_ticks;
+    __enable_irq();
+    return qs;
+}
+
+void Conveyor::reset_queue_stats()
+{
+    __disable_irq();
+    for (auto& d : queue_stats.depth) d = 0;
+    queue_stats.underruns = 0;
+    queue_stats.underrun_ticks = 0;
+    queue_stats.max_underrun_ticks = 0;
+    queue_stats.unstaged = 0;
+    queue_stats.waits = 0;
+    queue_stats.wait_us = 0;
+    queue_stats.max_wait_us = 0;
+    underrun_ticks = 0;
+    starving = false;
+    __enable_irq();
 }
 
 // called from step ticker ISR when block is finished, do not do anything slow here
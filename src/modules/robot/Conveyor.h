@@ -12,9 +12,30 @@
 
 class Block;
 
+// the queue depth histogram has this many buckets, each a range of depths an eighth of the queue wide
+#define CONVEYOR_DEPTH_BUCKETS 8
+// moves the step ticker can run without waiting for the main loop, the one it is on and the next, and any actions
+// before them
+#define CONVEYOR_STAGED_BLOCKS 2
+// the next move is staged when the one running has this long left
+#define CONVEYOR_STAGE_AHEAD_MS 1
+
 class Conveyor : public Module
 {
 public:
+    // how well the block queue kept the step ticker fed, since the job started or the last reset_queue_stats()
+    struct QueueStats {
+        uint32_t depth[CONVEYOR_DEPTH_BUCKETS]; // blocks handed to the step ticker with this many queued behind them
+        uint32_t depth_bucket;                  // depths in each bucket
+        uint32_t underruns;                     // times the step ticker ran out of blocks while a job was running or blocks were streaming in
+        uint32_t underrun_ticks;                // step ticks it spent waiting for the next one
+        uint32_t max_underrun_ticks;
+        uint32_t unstaged;                      // blocks the step ticker had to take itself, not staged in time
+        uint32_t waits;                         // wait_for_idle() calls that had to wait
+        uint64_t wait_us;                       // time spent in them
+        uint32_t max_wait_us;
+    };
+
     Conveyor();
     void start(uint8_t n_actuators);
 
@@ -26,6 +47,9 @@ public:
     bool is_queue_empty() { return queue.is_empty(); };
     bool is_queue_full() { return queue.is_full(); };
     bool is_idle() const;
+    size_t get_queue_size() const { return queue_size; }
+    // most laser power values one block can carry
+    size_t get_max_power_values() const { return queue.get_max_power_values(); }
 
     // returns next available block writes it to block and returns true
     bool get_next_block(Block **block);
@@ -36,19 +60,41 @@ public:
     float get_current_feedrate() const { return current_feedrate; }
     void force_queue() { check_queue(true); }
 
+    // a job (a played file) started or ended, the queue stats start again with each one. The ticker running out of
+    // blocks counts as an underrun in a job, or outside one while the blocks of a streamed job are still coming in
+    void set_job_running(bool f);
+    QueueStats get_queue_stats() const;
+    void reset_queue_stats();
+
     friend class Planner; // for queue
 
 private:
     void check_queue(bool force= false);
     void queue_head_block(void);
+    void stage_blocks();
+    void record_depth();
+    void record_fetch();
+    void record_starved();
+    void end_underrun();
 
     using  Queue_t= BlockQueue;
     Queue_t queue;  // Queue of Blocks
 
     uint32_t queue_delay_time_ms;
     size_t queue_size;
+    size_t power_values;
     float current_feedrate{0}; // actual nominal feedrate that current block is running at in mm/sec
 
+    QueueStats queue_stats;
+    uint32_t underrun_ticks;    // of the underrun going on
+    volatile uint32_t last_queued_us{0};    // when the last block was queued, a source still sending blocks
+    uint32_t stage_ahead_ticks;
+    // not in the bitfield, the step ticker ISR changes some of these while the main loop changes the others
+    volatile bool job_running{false};
+    volatile bool idle_wait{false};     // in wait_for_idle(), the queue running dry is asked for, not an underrun
+    volatile bool fetching{false};      // the step ticker took the last block it asked for
+    volatile bool starving{false};      // it has run out since in a job or stream
+
     struct {
         volatile bool running:1;
         volatile bool allow_fetch:1;
@@ -0,0 +1,75 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CubicBezier.h"
+
+#include <math.h>
+
+// smallest step in t, so a degenerate curve still ends
+#define MIN_STEP 0.0001F
+
+CubicBezier::CubicBezier(const float p0[2], const float p1[2], const float p2[2], const float p3[2])
+{
+    for (int i = 0; i < 2; ++i) {
+        c[0][i] = p0[i];
+        c[1][i] = 3 * (p1[i] - p0[i]);
+        c[2][i] = 3 * (p2[i] - 2 * p1[i] + p0[i]);
+        c[3][i] = p3[i] - 3 * p2[i] + 3 * p1[i] - p0[i];
+    }
+}
+
+void CubicBezier::point(float t, float p[2]) const
+{
+    for (int i = 0; i < 2; ++i) {
+        p[i] = ((c[3][i] * t + c[2][i]) * t + c[1][i]) * t + c[0][i];
+    }
+}
+
+// length of the second derivative at t
+float CubicBezier::curvature(float t) const
+{
+    float x = 6 * c[3][0] * t + 2 * c[2][0];
+    float y = 6 * c[3][1] * t + 2 * c[2][1];
+    return sqrtf(x * x + y * y);
+}
+
+// length of the first derivative at t, mm per unit of t
+float CubicBezier::speed(float t) const
+{
+    float x = (3 * c[3][0] * t + 2 * c[2][0]) * t + c[1][0];
+    float y = (3 * c[3][1] * t + 2 * c[2][1]) * t + c[1][1];
+    return sqrtf(x * x + y * y);
+}
+
+float CubicBezier::chord_error(float t0, float t1) const
+{
+    float h = t1 - t0;
+    float a = curvature(t0), b = curvature(t1);
+    return (a > b ? a : b) * h * h / 8;
+}
+
+float CubicBezier::next(float t, float tolerance, float min_length) const
+{
+    float h = 1 - t;
+    if(tolerance > 0) {
+        // the step for the curvature at t, shrunk until it holds for the curvature at its end as well
+        float k = curvature(t);
+        if(k * h * h / 8 > tolerance) h = sqrtf(8 * tolerance / k);
+        for (int i = 0; i < 8; ++i) {
+            float e = chord_error(t, t + h);
+            if(e <= tolerance) break;
+            h *= 0.99F * sqrtf(tolerance / e);
+        }
+    }
+
+    // no shorter than min_length at the speed along the curve at t
+    float v = speed(t);
+    if(min_length > 0 && v > 0 && (tolerance <= 0 || h * v < min_length)) h = min_length / v;
+
+    if(h < MIN_STEP) h = MIN_STEP;
+    return t + h >= 1 - MIN_STEP ? 1 : t + h;
+}
@@ -0,0 +1,29 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// A cubic Bezier curve in the plane from p0 to p3 with the control points p1 and p2, as a polynomial in t from 0 to 1.
+// It is cut into straight segments by stepping t: the second derivative of a cubic is a straight line, so on a step
+// it is largest at one of the ends, and a chord is never further from the curve than that times the step squared / 8.
+class CubicBezier {
+    public:
+        CubicBezier(const float p0[2], const float p1[2], const float p2[2], const float p3[2]);
+
+        void point(float t, float p[2]) const;
+        // how far the chord from t0 to t1 can be from the curve between them
+        float chord_error(float t0, float t1) const;
+        // where the segment from t ends, as far along as it can go and stay within tolerance of the curve but at
+        // least about min_length mm long, 1 at the end of the curve. A tolerance of 0 steps by min_length alone
+        float next(float t, float tolerance, float min_length) const;
+
+    private:
+        float curvature(float t) const;
+        float speed(float t) const;
+
+        float c[4][2];  // coefficients of t^0..t^3 for each axis
+};
@@ -0,0 +1,116 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "InputShaper.h"
+
+#include <math.h>
+#include <string.h>
+
+// how much vibration EI leaves at the frequency it is tuned to, in exchange for a wider band it keeps it that low over
+#define EI_VIBRATION_TOLERANCE 0.05F
+
+InputShaper::InputShaper()
+{
+    configure(NONE, 0, 0, 0, 0);
+}
+
+void InputShaper::configure(TYPE type, float frequency, float damping, float tick_frequency, float ratio)
+{
+    this->type = type;
+    this->frequency = frequency;
+    this->damping = damping;
+    count = 0;
+    duration = 0;
+    delay = 0;
+    min_ramp = UINT32_MAX;
+    if(type == NONE || frequency <= 0 || damping < 0 || damping >= 1 || tick_frequency <= 0) return;
+
+    // impulses at each half of the damped period, the later ones smaller by how much the ringing dies down in between
+    float df = sqrtf(1 - damping * damping);
+    float k = expf(-damping * 3.14159265F / df);
+    float period = 1 / (frequency * df);
+    float a[INPUT_SHAPER_MAX_IMPULSES];
+    uint8_t n;
+    switch(type) {
+        case ZV:
+            a[0] = 1;
+            a[1] = k;
+            n = 2;
+            break;
+        case ZVD:
+            a[0] = 1;
+            a[1] = 2 * k;
+            a[2] = k * k;
+            n = 3;
+            break;
+        default: // EI
+            a[0] = (1 + EI_VIBRATION_TOLERANCE) / 4;
+            a[1] = (1 - EI_VIBRATION_TOLERANCE) / 2 * k;
+            a[2] = a[0] * k * k;
+            n = 3;
+            break;
+    }
+
+    float sum = 0;
+    for (int i = 0; i < n; ++i) sum += a[i];
+    float centroid = 0;
+    for (int i = 0; i < n; ++i) {
+        amplitude[i] = a[i] / sum;
+        centroid += amplitude[i] * i * period / 2;
+    }
+
+    // with damping the first impulse is the biggest, a ramp would get most of its change in speed early and cover a
+    // different distance than the constant acceleration it replaces, more for an acceleration and less for a
+    // deceleration, which leaves its block with steps to do at the wrong speed. Starting it later by the difference
+    // between half the span of the impulses and their centroid evens that out
+    delay = roundf(((n - 1) * period / 2 - 2 * centroid) * tick_frequency);
+    float total = 0;
+    for (int i = 0; i < n; ++i) {
+        total += amplitude[i];
+        offset[i] = roundf(i * period / 2 * tick_frequency);
+        level[i] = i == n - 1 ? INPUT_SHAPER_ONE : (uint32_t)roundf(total * INPUT_SHAPER_ONE);
+    }
+
+    duration = offset[n - 1];
+    if(duration > 0) count = n;
+
+    // a ramp of n ticks planned at ratio of the limit peaks at ratio * n / (n - delay - duration) of it
+    if(ratio < 1) min_ramp = ceilf((duration + delay) / (1 - ratio));
+}
+
+uint32_t InputShaper::advance(uint32_t now, uint32_t start, uint32_t n, uint8_t& rise, uint8_t& fall, uint32_t& level) const
+{
+    // each impulse runs for the ramp less the duration
+    uint32_t end = start + n - duration;
+    while(rise < count && start + offset[rise] <= now) rise++;
+    while(fall + 1 < count && end + offset[fall] <= now) fall++;
+
+    level = (rise > 0 ? this->level[rise - 1] : 0) - (fall > 0 ? this->level[fall - 1] : 0);
+
+    uint32_t next = UINT32_MAX;
+    if(rise < count) next = start + offset[rise];
+    if(fall + 1 < count && end + offset[fall] < next) next = end + offset[fall];
+    return next;
+}
+
+InputShaper::TYPE InputShaper::type_from_string(const char *s)
+{
+    if(strcasecmp(s, "zv") == 0) return ZV;
+    if(strcasecmp(s, "zvd") == 0) return ZVD;
+    if(strcasecmp(s, "ei") == 0) return EI;
+    return NONE;
+}
+
+const char *InputShaper::type_name(TYPE type)
+{
+    switch(type) {
+        case ZV: return "zv";
+        case ZVD: return "zvd";
+        case EI: return "ei";
+        default: return "none";
+    }
+}
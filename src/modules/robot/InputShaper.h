@@ -0,0 +1,77 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define INPUT_SHAPER_MAX_IMPULSES 3
+// acceleration levels are fixed point, this is all of the peak acceleration
+#define INPUT_SHAPER_ONE (1 << 16)
+
+// An input shaper for one axis. It splits each change of acceleration into a few impulses spread over a fraction of
+// the period of the vibration it is tuned to, sized so the ringing each of them starts cancels out the others'.
+//
+// Applied to a constant acceleration ramp of n ticks the ramp becomes a staircase: the acceleration a ramp of
+// n - duration ticks would have is started in steps, one for each impulse, and ended the same way, so it still takes
+// n ticks and gets to the same speed. It peaks at n / (n - delay - duration) of the average. The moves are planned at
+// a part of the acceleration limit, ratio, and only ramps long enough for the peak to stay within the limit are
+// shaped. The staircase starts delay ticks into the ramp so the ramp covers the same distance as the constant
+// acceleration it replaces.
+class InputShaper {
+    public:
+        enum TYPE {
+            NONE,
+            ZV,     // zero vibration, two impulses over half a period, the shortest
+            ZVD,    // zero vibration and derivative, three over a period, less sensitive to the frequency being off
+            EI      // extra insensitive, three over a period, leaves up to 5% at the frequency for a wider band
+        };
+
+        InputShaper();
+
+        // tune to frequency in Hz with the damping ratio, in ticks of tick_frequency, for ramps planned at ratio of the
+        // acceleration limit. NONE or a frequency of 0 does not shape, nor does one so high the impulses all fall on
+        // the same tick
+        void configure(TYPE type, float frequency, float damping, float tick_frequency, float ratio);
+
+        bool is_active() const { return count > 0; }
+        TYPE get_type() const { return type; }
+        float get_frequency() const { return frequency; }
+        float get_damping() const { return damping; }
+        uint8_t get_count() const { return count; }
+        float get_amplitude(int i) const { return amplitude[i]; }
+        // ticks from the first impulse
+        uint32_t get_offset(int i) const { return offset[i]; }
+        // ticks from the first impulse to the last
+        uint32_t get_duration() const { return duration; }
+        // ticks into a ramp its staircase starts
+        uint32_t get_delay() const { return delay; }
+
+        // would a ramp of n ticks be shaped, it is if its peak is within the acceleration limit
+        bool shapes(uint32_t n) const { return count > 0 && n >= min_ramp; }
+
+        // For the step ticker: where a shaped ramp of n ticks starting on tick start is on tick now. rise and fall are
+        // how many impulses have started and ended so far, 0 at the start of the ramp, and are moved on to now. Sets
+        // level to the part of the peak acceleration to run at from now on and returns the next tick it changes on, or
+        // UINT32_MAX when it does not any more. The last impulse is never ended, the ramp's own end does that
+        uint32_t advance(uint32_t now, uint32_t start, uint32_t n, uint8_t& rise, uint8_t& fall, uint32_t& level) const;
+
+        static TYPE type_from_string(const char *s);
+        static const char *type_name(TYPE type);
+
+    private:
+        float frequency;
+        float damping;
+        float amplitude[INPUT_SHAPER_MAX_IMPULSES];
+        uint32_t offset[INPUT_SHAPER_MAX_IMPULSES];     // ticks from the first impulse
+        uint32_t level[INPUT_SHAPER_MAX_IMPULSES];      // sum of the amplitudes up to each impulse, the last is INPUT_SHAPER_ONE
+        uint32_t duration;
+        uint32_t delay;
+        uint32_t min_ramp;                              // ticks of the shortest ramp shaped
+        TYPE type;
+        uint8_t count;
+};
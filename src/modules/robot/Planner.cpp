@@ -21,13 +21,20 @@ using namespace std;
 #include "checksumm.h"
 #include "Robot.h"
 #include "ConfigValue.h"
+#include "StepTicker.h"
 
 #include <math.h>
+#include <float.h>
 #include <algorithm>
 
 #define junction_deviation_checksum    CHECKSUM("junction_deviation")
 #define z_junction_deviation_checksum  CHECKSUM("z_junction_deviation")
 #define minimum_planner_speed_checksum CHECKSUM("minimum_planner_speed")
+#define acceleration_profile_checksum  CHECKSUM("acceleration_profile")
+#define max_jerk_checksum              CHECKSUM("max_jerk")
+#define merge_tolerance_checksum       CHECKSUM("planner_merge_tolerance")
+#define input_shaper_type_checksum     CHECKSUM("input_shaper_type")
+#define input_shaper_acceleration_ratio_checksum CHECKSUM("input_shaper_acceleration_ratio")
 
 // The Planner does the acceleration math for the queue of Blocks ( movements ).
 // It makes sure the speed stays within the configured constraints ( acceleration, junction_deviation, etc )
@@ -36,6 +43,8 @@ using namespace std;
 Planner::Planner()
 {
     memset(this->previous_unit_vec, 0, sizeof this->previous_unit_vec);
+    merge_block = nullptr;
+    merged_segments = 0;
     config_load();
 }
 
@@ -45,27 +54,73 @@ void Planner::config_load()
     this->junction_deviation = THEKERNEL->config->value(junction_deviation_checksum)->by_default(0.05F)->as_number();
     this->z_junction_deviation = THEKERNEL->config->value(z_junction_deviation_checksum)->by_default(NAN)->as_number(); // disabled by default
     this->minimum_planner_speed = THEKERNEL->config->value(minimum_planner_speed_checksum)->by_default(0.0f)->as_number();
+
+    // trapezoid (constant acceleration) unless s_curve is asked for
+    this->max_jerk = 0;
+    if(THEKERNEL->config->value(acceleration_profile_checksum)->by_default("trapezoid")->as_string() == "s_curve") {
+        this->max_jerk = std::max(0.0F, THEKERNEL->config->value(max_jerk_checksum)->by_default(10000.0F)->as_number());
+    }
+
+    this->merge_tolerance = THEKERNEL->config->value(merge_tolerance_checksum)->by_default(0.0F)->as_number();
+
+    // input shaping for X, Y and Z, each axis is tuned to the frequency it rings at, 0 leaves it as it is
+    this->input_shaper_type = InputShaper::type_from_string(THEKERNEL->config->value(input_shaper_type_checksum)->by_default("none")->as_string().c_str());
+    this->input_shaper_ratio = THEKERNEL->config->value(input_shaper_acceleration_ratio_checksum)->by_default(0.5F)->as_number();
+    this->input_shaper_ratio = std::max(0.1F, std::min(this->input_shaper_ratio, 0.9F));
+    uint16_t const frequency_checksums[3] = {CHECKSUM("input_shaper_frequency_x"), CHECKSUM("input_shaper_frequency_y"), CHECKSUM("input_shaper_frequency_z")};
+    uint16_t const damping_checksums[3] = {CHECKSUM("input_shaper_damping_x"), CHECKSUM("input_shaper_damping_y"), CHECKSUM("input_shaper_damping_z")};
+    this->input_shaping = false;
+    for (int i = 0; i < 3; i++) {
+        float frequency = THEKERNEL->config->value(frequency_checksums[i])->by_default(0.0F)->as_number();
+        float damping = THEKERNEL->config->value(damping_checksums[i])->by_default(0.1F)->as_number();
+        set_input_shaper(i, frequency, damping);
+    }
+    this->input_shaping = has_active_input_shaper();
+}
+
+void Planner::set_input_shaper(uint8_t m, float frequency, float damping)
+{
+    input_shaper[m].configure(input_shaper_type, frequency, damping, THEKERNEL->step_ticker->get_frequency(), input_shaper_ratio);
+    // nothing left to shape, the moves would only be planned at the lower acceleration and lose their S-curve
+    if(!has_active_input_shaper()) this->input_shaping = false;
+}
+
+bool Planner::has_active_input_shaper() const
+{
+    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+        if(input_shaper[i].is_active()) return true;
+    }
+    return false;
+}
+
+float Planner::planned_acceleration(float acceleration) const
+{
+    // the staircase of a shaped ramp peaks above its average, the ramps it is planned at input_shaper_ratio of the
+    // acceleration for are the ones it stays within the acceleration on, see InputShaper::shapes()
+    if(this->input_shaping) return acceleration * this->input_shaper_ratio;
+
+    // S-curve ramps are planned at their peak, Block::s_curve_time() works out how long each one takes at max_jerk
+    return acceleration;
 }
 
 
 // Append a block to the queue, compute it's speed factors
-// 2024
-bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float acceleration, float s_value, bool g123, unsigned int _line)
-// bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float acceleration, float *s_values, int s_count, bool g123, unsigned int _line)
+// s_values are the laser powers for s_count equal parts of the move, usually just the one
+bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float acceleration, const float *s_values, uint16_t s_count, bool g123, unsigned int _line)
 {
+    // a segment going straight on from the last block is merged into it rather than queued as a block of its own
+    if(merge_tolerance > 0 && merge_segment(actuator_pos, n_motors, rate_mm_s, distance, unit_vec, acceleration, s_values, s_count, g123)) return true;
+
     // Create ( recycle ) a new block
     Block* block = THECONVEYOR->queue.head_ref();
     block->line = _line;
 
+    float start[3];
+    for (int i = 0; i < 3; i++) start[i] = THEROBOT->actuators[i]->get_last_milestone();
+
     // Direction bits
     bool has_steps = false;
 
-    // 2024
-    /*
-    int bigaxis = 0;
-    int32_t bigsteps = 0;
-    */
-
     for (size_t i = 0; i < n_motors; i++) {
         int32_t steps = THEROBOT->actuators[i]->steps_to_target(actuator_pos[i]);
         // Update current position
@@ -75,16 +130,10 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
         }
 
         // find direction
-        block->direction_bits[i] = (steps < 0) ? 1 : 0;
+        if(steps < 0) block->direction_bits |= (1 << i);
+        else block->direction_bits &= ~(1 << i);
         // save actual steps in block
         block->steps[i] = labs(steps);
-
-        // 2024
-        /*
-        if( labs(steps) > bigsteps ) {
-			bigaxis = i;
-			bigsteps = labs(steps);
-		}*/
     }
 
     // sometimes even though there is a detectable movement it turns out there are no steps to be had from such a small move
@@ -95,51 +144,38 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     }
 
     // info needed by laser
-    // 2024
-    block->s_value = roundf(s_value*(1<<11)); // 1.11 fixed point
+    block->s_value = roundf(s_values[0]*(1<<11)); // 1.11 fixed point
     block->is_g123 = g123;
 
-    /*
-	block->move_axis = bigaxis;
-	block->s_count = s_count;
-	for( int i = 0; i < s_count; i++ ) {
-		block->s_values[i] = roundf(s_values[i] * (1<<11)); // 1.11 fixed point
-	}
-	block->s_value = block->s_values[0];
-
-	block->is_g123 = g123;
-	*/
-
-    // use default JD
-    float junction_deviation = this->junction_deviation;
-
-    // use either regular junction deviation or z specific and see if a primary axis move
-    block->primary_axis = true;
-    if(block->steps[ALPHA_STEPPER] == 0 && block->steps[BETA_STEPPER] == 0) {
-        if(block->steps[GAMMA_STEPPER] != 0) {
-            // z only move
-            if(!isnan(this->z_junction_deviation)) junction_deviation = this->z_junction_deviation;
-
-        } else {
-            // is not a primary axis move
-            block->primary_axis= false;
-            #if N_PRIMARY_AXIS > 3
-                for (int i = 3; i < N_PRIMARY_AXIS; ++i) {
-                    if(block->steps[i] != 0){
-                        block->primary_axis= true;
-                        break;
-                    }
-                }
-            #endif
-
+    if(s_count > 1) {
+        // the power array goes in the ring the queue keeps for them, it is given back once the block is done
+        uint16_t *sv;
+        while((sv = THECONVEYOR->queue.claim_power(s_count, block->s_values_end)) == nullptr && !THEKERNEL->is_halted()) {
+            THEKERNEL->call_event(ON_IDLE, this);
+        }
+        if(sv != nullptr) {
+            for (uint16_t i = 0; i < s_count; i++) {
+                sv[i] = roundf(s_values[i] * (1<<11)); // 1.11 fixed point
+            }
+            block->s_values = sv;
+            block->s_count = s_count;
         }
     }
 
-    block->acceleration = acceleration; // save in block
+    // use either regular junction deviation or z specific and see if a primary axis move
+    float junction_deviation = block_junction_deviation(block);
+
+    // input shaping shapes constant acceleration ramps, it takes over from the S-curve while it is on
+    block->acceleration = planned_acceleration(acceleration); // save in block
+    block->s_curve = this->max_jerk > 0 && !this->input_shaping;
 
     // Max number of steps, for all axes
     auto mi = std::max_element(block->steps.begin(), block->steps.end());
     block->steps_event_count = *mi;
+    if(block->s_count > 1) {
+        block->s_steps = block->steps_event_count / block->s_count;
+        block->s_steps_rem = block->steps_event_count % block->s_count;
+    }
 
     block->millimeters = distance;
 
@@ -157,53 +193,135 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     // is equal to the travel/step in the particular axis. For a 45 degree line the steppers of both
     // axes might step for every step event. Travel per step event is then sqrt(travel_x^2+travel_y^2).
 
-    // Compute maximum allowable entry speed at junction by centripetal acceleration approximation.
-    // Let a circle be tangent to both previous and current path line segments, where the junction
-    // deviation is defined as the distance from the junction to the closest edge of the circle,
-    // colinear with the circle center. The circular segment joining the two paths represents the
-    // path of centripetal acceleration. Solve for max velocity based on max acceleration about the
-    // radius of the circle, defined indirectly by junction deviation. This may be also viewed as
-    // path width or max_jerk in the previous grbl version. This approach does not actually deviate
-    // from path, but used as a robust way to compute cornering speeds, as it takes into account the
-    // nonlinearities of both the junction angle and junction velocity.
-
-    // NOTE however it does not take into account independent axis, in most cartesian X and Y and Z are totally independent
-    // and this allows one to stop with little to no decleration in many cases. This is particualrly bad on leadscrew based systems that will skip steps.
     float vmax_junction = minimum_planner_speed; // Set default max junction speed
 
     // if unit_vec was null then it was not a primary axis move so we skip the junction deviation stuff
     if (unit_vec != nullptr && !THECONVEYOR->is_queue_empty()) {
-        Block *prev_block = THECONVEYOR->queue.item_ref(THECONVEYOR->queue.prev(THECONVEYOR->queue.head_i));
+        // the junction is with the last move, actions queued after it are not in the path
+        Conveyor::Queue_t &queue = THECONVEYOR->queue;
+        unsigned int prev_i = queue.prev(queue.head_i);
+        while (queue.item_ref(prev_i)->is_action() && prev_i != queue.tail_i) prev_i = queue.prev(prev_i);
+        Block *prev_block = queue.item_ref(prev_i);
         float previous_nominal_speed = prev_block->primary_axis ? prev_block->nominal_speed : 0;
 
-        if (junction_deviation > 0.0F && previous_nominal_speed > 0.0F) {
-            // Compute cosine of angle between previous and current path. (prev_unit_vec is negative)
-            // NOTE: Max junction velocity is computed without sin() or acos() by trig half angle identity.
-            float cos_theta = - this->previous_unit_vec[X_AXIS] * unit_vec[X_AXIS]
-                              - this->previous_unit_vec[Y_AXIS] * unit_vec[Y_AXIS]
-                              - this->previous_unit_vec[Z_AXIS] * unit_vec[Z_AXIS];
+        vmax_junction = junction_speed(this->previous_unit_vec, previous_nominal_speed, unit_vec, block->nominal_speed, acceleration, junction_deviation);
+    }
+    set_entry_speed(block, vmax_junction);
+
+    // Update previous path unit_vector and nominal speed
+    if(unit_vec != nullptr) {
+        memcpy(previous_unit_vec, unit_vec, sizeof(previous_unit_vec)); // previous_unit_vec[] = unit_vec[]
+    } else {
+        memset(previous_unit_vec, 0, sizeof(previous_unit_vec));
+    }
+
+    // Math-heavy re-computing of the whole queue to take the new
+    this->recalculate();
+
+    // The block can now be used
+    block->ready();
+
+    THECONVEYOR->queue_head_block();
+
+    // the segments after it can be merged into it if it only moves X, Y and Z
+    merge_block = nullptr;
+    if(merge_tolerance > 0 && unit_vec != nullptr && s_count <= 1 && !THEKERNEL->is_halted()) {
+        bool xyz = true;
+        for (size_t i = 3; i < n_motors; i++) {
+            if(block->steps[i] != 0) xyz = false;
+        }
+        if(xyz) {
+            float end[3];
+            for (int i = 0; i < 3; i++) end[i] = THEROBOT->actuators[i]->get_last_milestone();
+            merge.begin(start, end);
+            merge_block = block;
+            merge_rate_mm_s = rate_mm_s;
+            merge_acceleration = acceleration;
+        }
+    }
+
+    return true;
+}
+
+// Sets whether the block moves a primary axis and returns the junction deviation for it, the Z one for a Z only move
+float Planner::block_junction_deviation(Block *block) const
+{
+    // use default JD
+    float junction_deviation = this->junction_deviation;
+
+    block->primary_axis = true;
+    if(block->steps[ALPHA_STEPPER] == 0 && block->steps[BETA_STEPPER] == 0) {
+        if(block->steps[GAMMA_STEPPER] != 0) {
+            // z only move
+            if(!isnan(this->z_junction_deviation)) junction_deviation = this->z_junction_deviation;
+
+        } else {
+            // is not a primary axis move
+            block->primary_axis= false;
             #if N_PRIMARY_AXIS > 3
                 for (int i = 3; i < N_PRIMARY_AXIS; ++i) {
-                    cos_theta -= this->previous_unit_vec[i] * unit_vec[i];
+                    if(block->steps[i] != 0){
+                        block->primary_axis= true;
+                        break;
+                    }
                 }
             #endif
 
-            // Skip and use default max junction speed for 0 degree acute junction.
-            if (cos_theta <= 0.9999F) {
-                vmax_junction = std::min(previous_nominal_speed, block->nominal_speed);
-                // Skip and avoid divide by zero for straight junctions at 180 degrees. Limit to min() of nominal speeds.
-                if (cos_theta >= -0.9999F) {
-                    // Compute maximum junction velocity based on maximum acceleration and junction deviation
-                    float sin_theta_d2 = sqrtf(0.5F * (1.0F - cos_theta)); // Trig half angle identity. Always positive.
-                    vmax_junction = std::min(vmax_junction, sqrtf(acceleration * junction_deviation * sin_theta_d2 / (1.0F - sin_theta_d2)));
-                }
+        }
+    }
+    return junction_deviation;
+}
+
+// Compute maximum allowable entry speed at junction by centripetal acceleration approximation.
+// Let a circle be tangent to both previous and current path line segments, where the junction
+// deviation is defined as the distance from the junction to the closest edge of the circle,
+// colinear with the circle center. The circular segment joining the two paths represents the
+// path of centripetal acceleration. Solve for max velocity based on max acceleration about the
+// radius of the circle, defined indirectly by junction deviation. This may be also viewed as
+// path width or max_jerk in the previous grbl version. This approach does not actually deviate
+// from path, but used as a robust way to compute cornering speeds, as it takes into account the
+// nonlinearities of both the junction angle and junction velocity.
+
+// NOTE however it does not take into account independent axis, in most cartesian X and Y and Z are totally independent
+// and this allows one to stop with little to no decleration in many cases. This is particualrly bad on leadscrew based systems that will skip steps.
+float Planner::junction_speed(const float *previous_unit_vec, float previous_nominal_speed, const float *unit_vec, float nominal_speed, float acceleration, float junction_deviation) const
+{
+    float vmax_junction = minimum_planner_speed; // Set default max junction speed
+
+    if (junction_deviation > 0.0F && previous_nominal_speed > 0.0F) {
+        // Compute cosine of angle between previous and current path. (prev_unit_vec is negative)
+        // NOTE: Max junction velocity is computed without sin() or acos() by trig half angle identity.
+        float cos_theta = - previous_unit_vec[X_AXIS] * unit_vec[X_AXIS]
+                          - previous_unit_vec[Y_AXIS] * unit_vec[Y_AXIS]
+                          - previous_unit_vec[Z_AXIS] * unit_vec[Z_AXIS];
+        #if N_PRIMARY_AXIS > 3
+            for (int i = 3; i < N_PRIMARY_AXIS; ++i) {
+                cos_theta -= previous_unit_vec[i] * unit_vec[i];
+            }
+        #endif
+
+        // Skip and use default max junction speed for 0 degree acute junction.
+        if (cos_theta <= 0.9999F) {
+            vmax_junction = std::min(previous_nominal_speed, nominal_speed);
+            // Skip and avoid divide by zero for straight junctions at 180 degrees. Limit to min() of nominal speeds.
+            if (cos_theta >= -0.9999F) {
+                // Compute maximum junction velocity based on maximum acceleration and junction deviation
+                float sin_theta_d2 = sqrtf(0.5F * (1.0F - cos_theta)); // Trig half angle identity. Always positive.
+                vmax_junction = std::min(vmax_junction, sqrtf(acceleration * junction_deviation * sin_theta_d2 / (1.0F - sin_theta_d2)));
             }
         }
     }
+    return vmax_junction;
+}
+
+// Starts a block that has just been filled in off at the fastest it can enter at, at most vmax_junction, and still
+// slow down to minimum_planner_speed by its end, recalculate() plans it from there with the blocks before it
+void Planner::set_entry_speed(Block *block, float vmax_junction)
+{
     block->max_entry_speed = vmax_junction;
 
     // Initialize block entry speed. Compute based on deceleration to user-defined minimum_planner_speed.
-    float v_allowable = max_allowable_speed(-acceleration, minimum_planner_speed, block->millimeters);
+    float v_allowable = block->max_allowable_speed(-block->acceleration, minimum_planner_speed, block->millimeters);
     block->entry_speed = std::min(vmax_junction, v_allowable);
 
     // Initialize planner efficiency flags
@@ -214,34 +332,126 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     // block nominal speed limits both the current and next maximum junction speeds. Hence, in both
     // the reverse and forward planners, the corresponding block junction speed will always be at the
     // the maximum junction speed and may always be ignored for any speed reduction checks.
-    if (block->nominal_speed <= v_allowable) { block->nominal_length_flag = true; }
-    else { block->nominal_length_flag = false; }
+    block->nominal_length_flag = block->nominal_speed <= v_allowable;
+    // an S-curve ramp up to nominal speed from part of the way there can be longer than the one from a stop, see
+    // Block::s_curve_distance(), none is longer than the whole ramp run at nominal speed
+    if(block->s_curve) block->nominal_length_flag = block->nominal_speed * block->s_curve_time(block->nominal_speed) <= block->millimeters;
 
     // Always calculate trapezoid for new block
     block->recalculate_flag = true;
+}
 
-    // Update previous path unit_vector and nominal speed
-    if(unit_vec != nullptr) {
-        memcpy(previous_unit_vec, unit_vec, sizeof(previous_unit_vec)); // previous_unit_vec[] = unit_vec[]
-    } else {
-        memset(previous_unit_vec, 0, sizeof(previous_unit_vec));
+// Extends the last block to the end of this segment if it goes straight on from it, that is it has the same speed,
+// acceleration and laser power, only moves X, Y and Z the same way and the run of segments merged into the block so
+// far stays within merge_tolerance of a straight line (see CollinearMerge). The block keeps the line it was queued
+// for, its entry junction and the look ahead before it, it is replanned as the newest block with the new length.
+// It can only be changed until the step ticker takes it, it is locked while this checks for that and changes it.
+bool Planner::merge_segment(ActuatorCoordinates &actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float acceleration, const float *s_values, uint16_t s_count, bool g123)
+{
+    Conveyor::Queue_t &queue = THECONVEYOR->queue;
+    Block *block = merge_block;
+    if(block == nullptr || unit_vec == nullptr || s_count > 1 || queue.is_empty() || queue.item_ref(queue.prev(queue.head_i)) != block) return false;
+    if(g123 != block->is_g123 || rate_mm_s != merge_rate_mm_s || acceleration != merge_acceleration || roundf(s_values[0]*(1<<11)) != block->s_value) return false;
+
+    // the machine has to be where the run ended, nothing else moved it since
+    for (int i = 0; i < 3; i++) {
+        if(THEROBOT->actuators[i]->get_last_milestone() != merge.last()[i]) return false;
     }
 
-    // Math-heavy re-computing of the whole queue to take the new
-    this->recalculate();
+    int32_t steps[k_max_actuators];
+    bool has_steps = false;
+    for (size_t i = 0; i < n_motors; i++) {
+        steps[i] = THEROBOT->actuators[i]->steps_to_target(actuator_pos[i]);
+        if(steps[i] == 0) continue;
+        if(i >= 3) return false;
+        // an axis can not turn round within a block
+        uint8_t direction_bit = steps[i] < 0 ? (1 << i) : 0;
+        if(block->steps[i] != 0 && (block->direction_bits & (1 << i)) != direction_bit) return false;
+        has_steps = true;
+    }
+    if(!has_steps) return false;
 
-    // The block can now be used
-    block->ready();
+    float end[3];
+    for (int i = 0; i < 3; i++) end[i] = steps[i] != 0 ? actuator_pos[i] : THEROBOT->actuators[i]->get_last_milestone();
+
+    // the step ticker does not take a locked block, if it already has it or is done with it it is too late
+    block->locked = true;
+    if(block->is_ticking || queue.isr_tail_i == queue.head_i || !merge.extend(end, merge_tolerance)) {
+        block->locked = false;
+        return false;
+    }
+
+    // it is the newest block again until it has been replanned
+    queue.head_i = queue.prev(queue.head_i);
+
+    for (size_t i = 0; i < 3; i++) {
+        if(steps[i] == 0) continue;
+        THEROBOT->actuators[i]->update_last_milestones(actuator_pos[i], steps[i]);
+        if(steps[i] < 0) block->direction_bits |= (1 << i);
+        else block->direction_bits &= ~(1 << i);
+        block->steps[i] += labs(steps[i]);
+    }
+
+    auto mi = std::max_element(block->steps.begin(), block->steps.end());
+    block->steps_event_count = *mi;
+    block->millimeters += distance;
+    block->nominal_rate = block->steps_event_count * rate_mm_s / block->millimeters;
+
+    set_entry_speed(block, block->max_entry_speed);
+
+    memcpy(previous_unit_vec, unit_vec, sizeof(previous_unit_vec));
+
+    // works out its trapezoid and tick info again, which unlocks it
+    this->recalculate();
+    block->locked = false;
 
     THECONVEYOR->queue_head_block();
+    merged_segments++;
 
     return true;
 }
 
+// The action goes in the queue as a block with no steps, the step ticker runs it when it gets to it and starts the
+// next move on the same tick. It has no length and no speed limit of its own so the moves either side of it are
+// planned as if it was not there. It runs in the step ticker ISR so it can only do quick things like setting a pin.
+void Planner::append_action(void (*action)(void *object, float value), void *object, float value)
+{
+    // the moves after it are not straight on from the one before it
+    merge_block = nullptr;
+
+    // nothing is moving so there is nothing to wait for
+    if (THECONVEYOR->is_idle()) {
+        action(object, value);
+        return;
+    }
+
+    Block* block = THECONVEYOR->queue.head_ref();
+    block->action = action;
+    block->action_object = object;
+    block->action_value = value;
+    block->millimeters = 0.0F;
+    block->acceleration = 0.0F;
+    block->nominal_speed = FLT_MAX;
+    block->max_entry_speed = FLT_MAX;
+    block->entry_speed = minimum_planner_speed;
+    block->nominal_length_flag = false;
+    block->recalculate_flag = true;
+
+    this->recalculate();
+
+    block->ready();
+
+    THECONVEYOR->queue_head_block();
+}
+
 void Planner::recalculate()
 {
-    Conveyor::Queue_t &queue = THECONVEYOR->queue;
+    recalculate(THECONVEYOR->queue);
+}
 
+// plans queue from its newest block, which is at head_i and not yet in the queue, back to the oldest one
+void Planner::recalculate(BlockQueue &queue)
+{
     unsigned int block_index;
 
     Block* previous;
@@ -324,14 +534,3 @@ void Planner::recalculate()
     // which has not had calculate_trapezoid run yet
     current->calculate_trapezoid(current->entry_speed, minimum_planner_speed);
 }
-
-
-// Calculates the maximum allowable speed at this point when you must be able to reach target_velocity using the
-// acceleration within the allotted distance.
-float Planner::max_allowable_speed(float acceleration, float target_velocity, float distance)
-{
-    // Was acceleration*60*60*distance, in case this breaks, but here we prefer to use seconds instead of minutes
-    return(sqrtf(target_velocity * target_velocity - 2.0F * acceleration * distance));
-}
-
-
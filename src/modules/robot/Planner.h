@@ -9,26 +9,63 @@
 #define PLANNER_H
 
 #include "ActuatorCoordinates.h"
+#include "CollinearMerge.h"
+#include "InputShaper.h"
 class Block;
+class BlockQueue;
 
 class Planner
 {
 public:
     Planner();
-    float max_allowable_speed( float acceleration, float target_velocity, float distance);
+    // queue action(object, value) to run when the moves queued so far are done, without stopping for it
+    void append_action(void (*action)(void *object, float value), void *object, float value);
+    // segments merged into the block before them since startup
+    uint32_t get_merged_segments() const { return merged_segments; }
+    // for actuator m, read by Block::prepare() and the step ticker so only to be changed while the queue is empty
+    const InputShaper& get_input_shaper(uint8_t m) const { return input_shaper[m]; }
+    // tune the shaper of actuator m, to the configured type, shaping goes off if that leaves no axis shaped
+    void set_input_shaper(uint8_t m, float frequency, float damping);
+    bool has_input_shaper() const { return input_shaper_type != InputShaper::NONE; }
+    // some axis has a shaper with a frequency, shaping can only be on then
+    bool has_active_input_shaper() const;
+    // S-curve or input shaping is configured, the blocks need Block::rampinfo_t for it
+    bool has_shaped_ramps() const { return max_jerk > 0 || has_input_shaper(); }
+    // mm/s³, 0 unless acceleration_profile is s_curve
+    float get_max_jerk() const { return max_jerk; }
+    // the acceleration the ramps of a move limited to acceleration are planned at, less for shaped ramps
+    float planned_acceleration(float acceleration) const;
 
     friend class Robot; // for acceleration, junction deviation, minimum_planner_speed
+    friend class Block; // for max_jerk, input_shaping
+    friend class JobEstimate; // to plan its blocks on a queue of its own like append_block() does
 
 private:
-    bool append_block(ActuatorCoordinates &target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float accleration, float s_value, bool g123, unsigned int _line);
-    // 2024
-    // bool append_block(ActuatorCoordinates &target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float accleration, float *s_values, int s_count, bool g123, unsigned int _line);
+    bool append_block(ActuatorCoordinates &target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float accleration, const float *s_values, uint16_t s_count, bool g123, unsigned int _line);
+    bool merge_segment(ActuatorCoordinates &target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float acceleration, const float *s_values, uint16_t s_count, bool g123);
+    float block_junction_deviation(Block *block) const;
+    float junction_speed(const float *previous_unit_vec, float previous_nominal_speed, const float *unit_vec, float nominal_speed, float acceleration, float junction_deviation) const;
+    void set_entry_speed(Block *block, float vmax_junction);
     void recalculate();
+    void recalculate(BlockQueue &queue);
     void config_load();
     float previous_unit_vec[N_PRIMARY_AXIS];
     float junction_deviation;    // Setting
     float z_junction_deviation;  // Setting
     float minimum_planner_speed; // Setting
+    float max_jerk;              // Setting, mm/s³ the acceleration of S-curve ramps changes at, 0 is a trapezoid
+    float merge_tolerance;       // Setting, how far off a run of segments merged into one block may be, 0 does not merge
+    InputShaper::TYPE input_shaper_type; // Setting
+    float input_shaper_ratio;    // Setting, part of the acceleration shaped moves are planned at
+    InputShaper input_shaper[k_max_actuators];
+    bool input_shaping;          // M593 S turns it off and on again for a job
+
+    // the last block queued while later segments can still be merged into it, and what it was queued with
+    Block *merge_block;
+    CollinearMerge merge;
+    float merge_rate_mm_s;
+    float merge_acceleration;
+    uint32_t merged_segments;
 };
 
 
@@ -11,6 +11,8 @@
 #include "Robot.h"
 #include "Planner.h"
 #include "Conveyor.h"
+#include "CubicBezier.h"
+#include "ArcSegments.h"
 #include "Pin.h"
 #include "StepperMotor.h"
 #include "Gcode.h"
@@ -48,11 +50,12 @@
 #define  delta_segments_per_second_checksum  CHECKSUM("delta_segments_per_second")
 #define  mm_per_arc_segment_checksum         CHECKSUM("mm_per_arc_segment")
 #define  mm_max_arc_error_checksum           CHECKSUM("mm_max_arc_error")
-#define  arc_correction_checksum             CHECKSUM("arc_correction")
+#define  arc_segments_per_second_checksum    CHECKSUM("arc_segments_per_second")
 #define  x_axis_max_speed_checksum           CHECKSUM("x_axis_max_speed")
 #define  y_axis_max_speed_checksum           CHECKSUM("y_axis_max_speed")
 #define  z_axis_max_speed_checksum           CHECKSUM("z_axis_max_speed")
 #define  segment_z_moves_checksum            CHECKSUM("segment_z_moves")
+#define  segment_at_compensation_checksum    CHECKSUM("segment_at_compensation")
 #define  save_g92_checksum                   CHECKSUM("save_g92")
 #define  save_g54_checksum                   CHECKSUM("save_g54")
 #define  set_g92_checksum                    CHECKSUM("set_g92")
@@ -89,6 +92,8 @@
 #define laser_module_default_power_checksum     CHECKSUM("laser_module_default_power")
 #define laser_module_maximum_s_value_checksum   CHECKSUM("laser_module_maximum_s_value")
 
+#define laser_module_raster_max_overscan_checksum CHECKSUM("laser_module_raster_max_overscan")
+
 #define laser_module_offset_x_checksum   CHECKSUM("laser_module_offset_x")
 #define laser_module_offset_y_checksum   CHECKSUM("laser_module_offset_y")
 #define laser_module_offset_z_checksum   CHECKSUM("laser_module_offset_z")
@@ -128,6 +133,7 @@ Robot::Robot()
     this->arm_solution = NULL;
     seconds_per_minute = 60.0F;
     this->compensationTransform = nullptr;
+    this->compensationSplits = nullptr;
     this->get_e_scale_fnc= nullptr;
     this->wcs_offsets.fill(wcs_t(0.0F, 0.0F, 0.0F, 0.0F, 0.0F));
     this->g92_offset = wcs_t(0.0F, 0.0F, 0.0F, 0.0F, 0.0F);
@@ -135,12 +141,21 @@ Robot::Robot()
     this->disable_segmentation= false;
     this->disable_arm_solution= false;
     this->n_motors= 0;
+    this->s_values= nullptr;
+    this->s_count= 0;
+    this->s_block_values= nullptr;
+    this->s_block_count= 0;
+    this->raster_open= false;
+    this->raster_dir= 0;
+    this->spline_open= false;
+    this->raster_pixel= 0.1F;
 }
 
 //Called when the module has just been loaded
 void Robot::on_module_loaded()
 {
     this->register_for_event(ON_GCODE_RECEIVED);
+    this->register_for_event(ON_HALT);
 
     // Configuration
     this->load_config();
@@ -208,7 +223,7 @@ void Robot::load_config()
     this->delta_segments_per_second = THEKERNEL->config->value(delta_segments_per_second_checksum )->by_default(0.0f   )->as_number();
     this->mm_per_arc_segment  = THEKERNEL->config->value(mm_per_arc_segment_checksum  )->by_default(    0.0f)->as_number();
     this->mm_max_arc_error    = THEKERNEL->config->value(mm_max_arc_error_checksum    )->by_default(   0.002f)->as_number();
-    this->arc_correction      = THEKERNEL->config->value(arc_correction_checksum      )->by_default(    5   )->as_number();
+    this->arc_segments_per_second = THEKERNEL->config->value(arc_segments_per_second_checksum)->by_default(0.0f)->as_number();
 
     // in mm/sec but specified in config as mm/min
     this->max_speeds[X_AXIS]  = THEKERNEL->config->value(x_axis_max_speed_checksum    )->by_default(4000.0F)->as_number() / 60.0F;
@@ -217,6 +232,7 @@ void Robot::load_config()
     this->max_speed           = THEKERNEL->config->value(max_speed_checksum           )->by_default(  -60.0F)->as_number() / 60.0F;
 
     this->segment_z_moves     = THEKERNEL->config->value(segment_z_moves_checksum     )->by_default(true)->as_bool();
+    this->segment_at_compensation = THEKERNEL->config->value(segment_at_compensation_checksum)->by_default(false)->as_bool();
     this->save_g92            = THEKERNEL->config->value(save_g92_checksum            )->by_default(false)->as_bool();
     this->save_g54            = THEKERNEL->config->value(save_g54_checksum            )->by_default(THEKERNEL->is_grbl_mode())->as_bool();
     string g92                = THEKERNEL->config->value(set_g92_checksum             )->by_default("")->as_string();
@@ -236,12 +252,8 @@ void Robot::load_config()
     // default s value for laser
     this->s_value = THEKERNEL->config->value(laser_module_default_power_checksum)->by_default(1.0F)->as_number()
     					* THEKERNEL->config->value(laser_module_maximum_s_value_checksum)->by_default(1.0f)->as_number();
-
-    // 2024
-    /*
-	this->s_values[0] = this->s_value;
-	this->s_count = 1;
-	*/
+    this->raster_s_scale = THEKERNEL->config->value(laser_module_maximum_s_value_checksum)->by_default(1.0f)->as_number() / 255.0F;
+    this->raster_max_overscan = THEKERNEL->config->value(laser_module_raster_max_overscan_checksum)->by_default(5.0F)->as_number();
 
 	this->laser_module_offset_x = THEKERNEL->config->value(laser_module_offset_x_checksum)->by_default(-38.0f)->as_number() ;
 	this->laser_module_offset_y = THEKERNEL->config->value(laser_module_offset_y_checksum)->by_default(5.0f)->as_number() ;
@@ -276,7 +288,7 @@ void Robot::load_config()
 
         if(!pins[0].connected() || !pins[1].connected()) { // step and dir must be defined, but enable is optional
             if(a <= Z_AXIS) {
-                THEKERNEL->streams->printf("FATAL: motor %c is not defined in config\n", 'X'+a);
+                THEKERNEL->streams->printf("FATAL: motor %c is not defined in config\n", (char)('X'+a));
                 n_motors= a; // we only have this number of motors
                 return;
             }
@@ -288,7 +300,7 @@ void Robot::load_config()
         uint8_t n= register_motor(sm);
         if(n != a) {
             // this is a fatal error
-            THEKERNEL->streams->printf("FATAL: motor %d does not match index %d\n", n, a);
+            THEKERNEL->streams->printf("FATAL: motor %d does not match index %d\n", n, (int)a);
             return;
         }
 
@@ -438,7 +450,7 @@ void Robot::print_position(uint8_t subcode, std::string& res, bool ignore_extrud
 
     } else {
         // get real time positions
-        float mpos[3];
+        float mpos[5]; // mcs2wcs() reads A and B as well
         get_current_machine_position(mpos);
 
         // current_position/mpos includes the compensation transform so we need to get the inverse to get actual position
@@ -517,7 +529,7 @@ void Robot::check_max_actuator_speeds()
         float step_freq = actuators[i]->get_max_rate() * actuators[i]->get_steps_per_mm();
         if (step_freq > THEKERNEL->base_stepping_frequency) {
             actuators[i]->set_max_rate(floorf(THEKERNEL->base_stepping_frequency / actuators[i]->get_steps_per_mm()));
-            THEKERNEL->streams->printf("WARNING: actuator %d rate exceeds base_stepping_frequency * ..._steps_per_mm: %f, setting to %f\n", i, step_freq, actuators[i]->get_max_rate());
+            THEKERNEL->streams->printf("WARNING: actuator %d rate exceeds base_stepping_frequency * ..._steps_per_mm: %f, setting to %f\n", (int)i, step_freq, actuators[i]->get_max_rate());
         }
     }
 }
@@ -562,12 +574,20 @@ void Robot::on_gcode_received(void *argument)
 
     enum MOTION_MODE_T motion_mode= NONE;
 
+    // anything but another G7 ends a raster line, its slow down is queued before whatever that does
+    if(raster_open && !(gcode->has_g && gcode->g == 7)) {
+        end_raster(gcode->line);
+        raster_dir= 0;
+    }
+
     if( gcode->has_g) {
         switch( gcode->g ) {
             case 0:  motion_mode = SEEK;    break;
             case 1:  motion_mode = LINEAR;  break;
             case 2:  motion_mode = CW_ARC;  break;
             case 3:  motion_mode = CCW_ARC; break;
+            case 5:  motion_mode = SPLINE;  break;
+            case 7:  motion_mode = RASTER;  break;
             case 4: { // G4 Dwell
                 uint32_t delay_ms = 0;
                 if (gcode->has_letter('P')) {
@@ -827,7 +847,7 @@ void Robot::on_gcode_received(void *argument)
 
             case 30: // M30 end of program in grbl mode (otherwise it is delete sdcard file)
                 if(!THEKERNEL->is_grbl_mode()) break;
-                // fall through to M2
+                // fall through - to M2
             case 2: // M2 end of program
                 current_wcs = 0;
                 absolute_mode = true;
@@ -856,7 +876,7 @@ void Robot::on_gcode_received(void *argument)
                     }
 
                     THEKERNEL->conveyor->wait_for_idle();
-                    THEKERNEL->call_event(ON_ENABLE, (void *)bm);
+                    THEKERNEL->call_event(ON_ENABLE, (void *)(uintptr_t)bm);
                     break;
                 }
                 // fall through
@@ -906,12 +926,12 @@ void Robot::on_gcode_received(void *argument)
             case 203: // M203 Set maximum feedrates in mm/sec, M203.1 set maximum actuator feedrates
                     if(gcode->get_num_args() == 0) {
                         for (size_t i = X_AXIS; i <= Z_AXIS; i++) {
-                            gcode->stream->printf(" %c: %g ", 'X' + i, gcode->subcode == 0 ? this->max_speeds[i] : actuators[i]->get_max_rate());
+                            gcode->stream->printf(" %c: %g ", (char)('X' + i), gcode->subcode == 0 ? this->max_speeds[i] : actuators[i]->get_max_rate());
                         }
                         if(gcode->subcode == 1) {
                             for (size_t i = A_AXIS; i < n_motors; i++) {
                                 if(actuators[i]->is_extruder()) continue; //extruders handle this themselves
-                                gcode->stream->printf(" %c: %g ", 'A' + i - A_AXIS, actuators[i]->get_max_rate());
+                                gcode->stream->printf(" %c: %g ", (char)('A' + i - A_AXIS), actuators[i]->get_max_rate());
                             }
                         }else{
                             gcode->stream->printf(" S: %g ", this->max_speed);
@@ -1066,6 +1086,14 @@ void Robot::on_gcode_received(void *argument)
 
                 gcode->stream->printf(";X- Junction Deviation, Z- Z junction deviation, S - Minimum Planner speed mm/sec:\nM205 X%1.5f Z%1.5f S%1.5f\n", THEKERNEL->planner->junction_deviation, isnan(THEKERNEL->planner->z_junction_deviation)?-1:THEKERNEL->planner->z_junction_deviation, THEKERNEL->planner->minimum_planner_speed);
 
+                if(THEKERNEL->planner->has_input_shaper()) {
+                    gcode->stream->printf(";Input shaping frequency Hz and damping ratio:\n");
+                    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+                        const InputShaper& shaper = THEKERNEL->planner->get_input_shaper(i);
+                        gcode->stream->printf("M593 %c F%1.3f D%1.3f\n", 'X'+i, shaper.get_frequency(), shaper.get_damping());
+                    }
+                }
+
                 gcode->stream->printf(";Max cartesian feedrates in mm/sec:\nM203 X%1.5f Y%1.5f Z%1.5f S%1.5f\n", this->max_speeds[X_AXIS], this->max_speeds[Y_AXIS], this->max_speeds[Z_AXIS], this->max_speed);
 
                 gcode->stream->printf(";Max actuator feedrates in mm/sec:\nM203.1 ");
@@ -1113,6 +1141,46 @@ void Robot::on_gcode_received(void *argument)
             }
             break;
 
+            case 593: { // M593 Sn turns input shaping off and on, Xnnn Ynnn Znnn Fnnn Dnnn tunes the axes given (X and Y with none) to nnn Hz and damping ratio
+                Planner *planner = THEKERNEL->planner;
+                if(!planner->has_input_shaper()) {
+                    gcode->stream->printf("Input shaping needs input_shaper_type set in config\n");
+                    break;
+                }
+
+                // the step ticker uses the shapers of the blocks queued so far
+                THEKERNEL->conveyor->wait_for_idle();
+                if(gcode->has_letter('F') || gcode->has_letter('D')) {
+                    bool any = gcode->has_letter('X') || gcode->has_letter('Y') || gcode->has_letter('Z');
+                    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+                        if(any ? !gcode->has_letter('X'+i) : i == Z_AXIS) continue;
+                        const InputShaper& shaper = planner->get_input_shaper(i);
+                        float f = gcode->has_letter('F') ? gcode->get_value('F') : shaper.get_frequency();
+                        float d = gcode->has_letter('D') ? gcode->get_value('D') : shaper.get_damping();
+                        planner->set_input_shaper(i, f, d);
+                    }
+                }
+                // after F, M593 S1 F40 tunes and turns it on
+                if(gcode->has_letter('S')) {
+                    planner->input_shaping = gcode->get_uint('S') == 1 && planner->has_active_input_shaper();
+                    if(gcode->get_uint('S') == 1 && !planner->input_shaping) gcode->stream->printf("No axis has a shaper frequency, set one with F\n");
+                }
+
+                if(gcode->get_num_args() == 0) {
+                    gcode->stream->printf("Input shaping is %s:", planner->input_shaping ? "on" : "off");
+                    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+                        const InputShaper& shaper = planner->get_input_shaper(i);
+                        if(shaper.is_active()) {
+                            gcode->stream->printf(" %c %s %1.2fHz damping %1.3f", 'X'+i, InputShaper::type_name(shaper.get_type()), shaper.get_frequency(), shaper.get_damping());
+                        } else {
+                            gcode->stream->printf(" %c not shaped", 'X'+i);
+                        }
+                    }
+                    gcode->stream->printf("\n");
+                }
+            }
+            break;
+
             case 665: { // M665 set optional arm solution variables based on arm solution.
                 // the parameter args could be any letter each arm solution only accepts certain ones
                 BaseSolution::arm_options_t options = gcode->get_args();
@@ -1155,11 +1223,22 @@ void Robot::on_gcode_received(void *argument)
         is_g123= false;
     }
 
-    current_motion_mode = motion_mode;
+    // G7 and G5 are not modal, a line without a G after it does not continue the raster or spline
+    current_motion_mode = motion_mode == RASTER || motion_mode == SPLINE ? NONE : motion_mode;
 
     next_command_is_MCS = false; // must be on same line as G0 or G1
 }
 
+void Robot::on_halt(void *argument)
+{
+    if(argument == nullptr) {
+        // whatever was queued of the raster line is gone
+        raster_open= false;
+        raster_dir= 0;
+        spline_open= false;
+    }
+}
+
 int Robot::get_active_extruder() const
 {
     for (int i = E_AXIS; i < n_motors; ++i) {
@@ -1169,7 +1248,7 @@ int Robot::get_active_extruder() const
     return 0;
 }
 
-// process a G0/G1/G2/G3
+// process a G0/G1/G2/G3/G5
 void Robot::process_move(Gcode *gcode, enum MOTION_MODE_T motion_mode)
 {
     // we have a G0/G1/G2/G3 so extract parameters and apply offsets to get machine coordinate target
@@ -1299,71 +1378,28 @@ void Robot::process_move(Gcode *gcode, enum MOTION_MODE_T motion_mode)
             this->feed_rate = this->to_millimeters( gcode->get_value('F') );
     }
 
+    // S is modal When specified on a G0/1/2/3 command, S a:b:c on a G1 spreads those powers evenly along the line
+    // and leaves the last one as the modal S
+    s_count = 0;
     if(gcode->has_letter('S')) {
-    	s_value = gcode->get_value('S');
-    }
-
-    // S is modal When specified on a G0/1/2/3 command
-    if(gcode->has_letter('S')) {
-    	s_value = gcode->get_value('S');
+        char *p;
+        s_value = gcode->get_value('S', &p);
+        if(p != nullptr && *p == ':' && motion_mode == LINEAR) {
+            if(s_values == nullptr) s_values = new float[MAX_S_VALUES];
+            s_values[0] = s_value;
+            s_count = 1;
+            while(*p == ':' && s_count < MAX_S_VALUES) {
+                char *e;
+                float v = strtof(p + 1, &e);
+                if(e == p + 1) break;
+                s_values[s_count++] = v;
+                p = e;
+            }
+            s_value = s_values[s_count - 1];
+            if(s_count == 1) s_count = 0;
+        }
     }
 
-    /*
-	s_count = 1;
-	int index = gcode->index_of_letter('S');
-    if (index >= 0) {
-		s_value = gcode->get_value_at_index(index);
-		s_values[0] = s_value;
-
-		index = gcode->index_of_letter(':', index + 1);
-		if(index >= 0) {
-			s_values[1] = gcode->get_value_at_index(index);
-			s_count = 2;
-
-			index = gcode->index_of_letter(':', index+1);
-			if(index >= 0) {
-				s_values[2] = gcode->get_value_at_index(index);
-				s_count = 3;
-
-				index = gcode->index_of_letter(':', index+1);
-				if(index >= 0) {
-					s_values[3] = gcode->get_value_at_index(index);
-					s_count = 4;
-
-					index = gcode->index_of_letter(':', index+1);
-					if(index >= 0) {
-						s_values[4] = gcode->get_value_at_index(index);
-						s_count = 5;
-
-						index = gcode->index_of_letter(':', index+1);
-						if(index >= 0) {
-							s_values[5] = gcode->get_value_at_index(index);
-							s_count = 6;
-
-							index = gcode->index_of_letter(':', index+1);
-							if(index >= 0) {
-								s_values[6] = gcode->get_value_at_index(index);
-								s_count = 7;
-
-								index = gcode->index_of_letter(':', index+1);
-								if(index >= 0) {
-									s_values[7] = gcode->get_value_at_index(index);
-									s_count = 8;
-								}
-							}
-						}
-					}
-				}
-			}
-		}
-	}*/
-
-
-    // S is modal When specified on a G0/1/2/3 command
-    // if(gcode->has_letter('S')) {
-    //	s_value = gcode->get_value('S');
-    //}
-
     bool moved= false;
 
     // Perform any physical actions
@@ -1383,7 +1419,16 @@ void Robot::process_move(Gcode *gcode, enum MOTION_MODE_T motion_mode)
             // Note arcs are not currently supported by extruder based machines, as 3D slicers do not use arcs (G2/G3)
             moved = this->compute_arc(gcode, offset, target, motion_mode);
             break;
+
+        case RASTER:
+            moved = this->append_raster(gcode, target);
+            break;
+
+        case SPLINE:
+            moved = this->append_spline(gcode, target, offset);
+            break;
     }
+    spline_open= motion_mode == SPLINE && !gcode->is_error;
 
     // needed to act as start of next arc command
     memcpy(arc_milestone, target, sizeof(arc_milestone));
@@ -1422,8 +1467,8 @@ void Robot::reset_axis_position(float x, float y, float z)
 // Reset the position for an axis (used in homing, and to reset extruder after suspend)
 void Robot::reset_axis_position(float position, int axis)
 {
-    compensated_machine_position[axis] = position;
     if(axis <= Z_AXIS) {
+        compensated_machine_position[axis] = position;
         reset_axis_position(compensated_machine_position[X_AXIS], compensated_machine_position[Y_AXIS], compensated_machine_position[Z_AXIS]);
 
 #if MAX_ROBOT_ACTUATORS > 3
@@ -1643,8 +1688,9 @@ bool Robot::append_milestone(const float target[], float rate_mm_s, unsigned int
 
     DEBUG_PRINTF("distance: %f, aux_move: %d\n", distance, auxilliary_move);
 
-    // use default acceleration to start with
-    float acceleration = default_acceleration;
+    // the most acceleration every moving actuator allows along the move, see below
+    float acceleration = INFINITY;
+    bool all_limited = true;
 
     float isecs = distance / rate_mm_s;
 
@@ -1679,7 +1725,8 @@ bool Robot::append_milestone(const float target[], float rate_mm_s, unsigned int
 					rate_mm_s = actuators[actuator]->get_max_rate();
 				}
 				float ma = actuators[actuator]->get_acceleration(); // in mm / sec² or degree / sec² for A axis
-				if (!isnan(ma)) acceleration = ma;
+				if (!isnan(ma)) acceleration = std::min(acceleration, ma);
+				else all_limited = false;
 				// THEKERNEL->streams->printf("only A: %1.4f, %1.4f, %1.4f, %1.4f\r\n", abs_y_wcs, abs_z_wcs, rate_mm_s, a_perimeter);
 				continue;
 			} else {
@@ -1709,23 +1756,27 @@ bool Robot::append_milestone(const float target[], float rate_mm_s, unsigned int
 
 		DEBUG_PRINTF("act: %d, d: %f, distance: %f, actrate: %f, rate: %f, secs: %f, acc: %f\n", actuator, d, distance, actuator_rate, rate_mm_s, 1/isecs, acceleration);
 
-		// adjust acceleration to lowest found, for all actuators as this also corrects
-		// the math for a tiny X move and large A move
+		// each actuator gets d / distance of the block acceleration, limit it to what keeps this one within its own
+		// acceleration, this also corrects the math for a tiny X move and large A move
 		float ma = actuators[actuator]->get_acceleration(); // in mm / sec² or degree / sec² for A axis
-		if (!isnan(ma)) {  // if axis does not have acceleration set then it uses the default_acceleration
-			float ca = (d / distance) * acceleration;
-			if (ca > ma) {
-				if (actuator == A_AXIS) {
-					acceleration *= (ma * 3 / ca);
-				} else {
-					acceleration *= (ma / ca);
-				}
+		if (!isnan(ma)) {
+			if (actuator == A_AXIS) ma *= A_AXIS_COMBINED_ACCELERATION;
+			float ca = ma * distance / d;
+			if (ca < acceleration) {
+				acceleration = ca;
 				DEBUG_PRINTF("new acceleration: %f\n", acceleration);
-				// THEKERNEL->streams->printf("Reduce acceleration from %1.2f to %1.2f, %f\n", ca, acceleration, rate_mm_s);
 			}
+		} else {
+			// if axis does not have acceleration set then it uses the default_acceleration
+			all_limited = false;
 		}
 	}
 
+	// default_acceleration is the limit of the path as a whole, unless every actuator that moves has its own, then
+	// each of them is taken to its limit along the move, eg a diagonal goes faster than either axis alone
+	if (!all_limited) acceleration = std::min(acceleration, default_acceleration);
+	else if (isinf(acceleration)) acceleration = default_acceleration;
+
     // if we are in feed hold wait here until it is released, this means that even segmented lines will pause
     while(THEKERNEL->get_feed_hold()) {
         THEKERNEL->call_event(ON_IDLE, this);
@@ -1736,9 +1787,9 @@ bool Robot::append_milestone(const float target[], float rate_mm_s, unsigned int
     // Append the block to the planner
     // NOTE that distance here should be either the distance travelled by the XYZ axis, or the E mm travel if a solo E move
     // NOTE this call will bock until there is room in the block queue, on_idle will continue to be called
-    if(THEKERNEL->planner->append_block( actuator_pos, n_motors, rate_mm_s, distance, auxilliary_move ? nullptr : unit_vec, acceleration, s_value, is_g123, line)) {
-// 2024
-//    if(THEKERNEL->planner->append_block( actuator_pos, n_motors, rate_mm_s, distance, auxilliary_move ? nullptr : unit_vec, acceleration, s_values, s_count, is_g123, line)) {
+    bool has_s_values = s_block_count > 0;
+    if(THEKERNEL->planner->append_block( actuator_pos, n_motors, rate_mm_s, distance, auxilliary_move ? nullptr : unit_vec, acceleration,
+                                         has_s_values ? s_block_values : &s_value, has_s_values ? s_block_count : 1, is_g123, line)) {
         // this is the new compensated machine position
         memcpy(this->compensated_machine_position, transformed_target, n_motors * sizeof(float));
         return true;
@@ -1814,6 +1865,9 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
     // In delta robots either mm_per_line_segment can be used OR delta_segments_per_second
     // The latter is more efficient and avoids splitting fast long lines into very small segments, like initial z move to 0, it is what Johanns Marlin delta port does
     uint16_t segments;
+    // with segment_at_compensation the compensation says where the line has to be split, if it can
+    float split_at[MAX_COMPENSATION_SPLITS];
+    int splits= -1;
 
     if(this->disable_segmentation || (!segment_z_moves && !gcode->has_letter('X') && !gcode->has_letter('Y'))) {
         segments= 1;
@@ -1827,6 +1881,10 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
         segments = max(1.0F, ceilf(this->delta_segments_per_second * seconds));
         // TODO if we are only moving in Z on a delta we don't really need to segment at all
 
+    } else if(this->segment_at_compensation && compensationTransform && compensationSplits &&
+              (splits= compensationSplits(machine_position, target, split_at, MAX_COMPENSATION_SPLITS)) >= 0) {
+        segments = splits + 1;
+
     } else {
         if(this->mm_per_line_segment == 0.0F) {
             segments = 1; // don't split it up
@@ -1836,6 +1894,59 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
     }
 
     bool moved= false;
+
+    if(s_count > 1) {
+        // each block takes as many of the powers as it can carry and still ends where the line is segmented. A block
+        // spreads its powers evenly so it ends on a boundary between them, or has just the one power when the line is
+        // segmented part way through it
+        size_t max_values = std::max<size_t>(THECONVEYOR->get_max_power_values(), 1);
+        float start[n_motors];
+        float segment_end[n_motors];
+        memcpy(start, machine_position, n_motors*sizeof(float));
+        uint16_t first = 0;     // the first power of the next block
+        float from = 0;         // where along the line that block starts
+        uint16_t cut = 0;       // the next of the points the line is segmented at
+        while(first < s_count) {
+            if(THEKERNEL->is_halted()) break; // don't queue any more segments
+            float cut_at = 1;
+            for (; cut + 1 < segments; cut++) {
+                cut_at = splits >= 0 ? split_at[cut] : (cut + 1.0F) / segments;
+                if(cut_at * s_count > from * s_count + 0.001F) break;
+                cut_at = 1;
+            }
+
+            // a power the line was segmented part way through is on its own
+            uint16_t last = from * s_count > first + 0.001F ? first + 1 : std::min<size_t>(first + max_values, s_count);
+            float to = (float)last / s_count;
+            if(cut_at * s_count < last - 0.001F) {
+                uint16_t whole = floorf(cut_at * s_count + 0.001F);
+                if(whole > first) {
+                    // the whole powers before the cut, the one it is part way through goes in a block of its own
+                    last = whole;
+                    to = (float)whole / s_count;
+                } else {
+                    last = first + 1;
+                    to = cut_at;
+                }
+            }
+
+            for (int j = 0; j < n_motors; j++)
+                segment_end[j] = last == s_count && to * s_count > last - 0.001F ? target[j] : start[j] + (target[j] - start[j]) * to;
+
+            s_block_values = &s_values[first];
+            s_block_count = last - first;
+            bool b= this->append_milestone(segment_end, rate_mm_s, gcode->line);
+            moved= moved || b;
+            if(to * s_count > last - 0.001F) first = last;
+            from = to;
+        }
+        s_block_values = nullptr;
+        s_block_count = 0;
+
+        this->next_command_is_MCS = false; // always reset this
+        return moved;
+    }
+
     if (segments > 1) {
         // A vector to keep track of the endpoint of each segment
         float segment_delta[n_motors];
@@ -1851,7 +1962,7 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
         for (int i = 1; i < segments; i++) {
             if(THEKERNEL->is_halted()) return false; // don't queue any more segments
             for (int j = 0; j < n_motors; j++)
-                segment_end[j] += segment_delta[j];
+                segment_end[j] = splits >= 0 ? machine_position[j] + (target[j] - machine_position[j]) * split_at[i - 1] : segment_end[j] + segment_delta[j];
 
             // Append the end of this segment to the queue
             // this can block waiting for free block queue or if in feed hold
@@ -1920,63 +2031,32 @@ bool Robot::append_arc(Gcode * gcode, const float target[], const float offset[]
         return false;
     }
 
-    // limit segments by maximum arc error
-    float arc_segment = this->mm_per_arc_segment;
-    if ((this->mm_max_arc_error > 0) && (2 * radius > this->mm_max_arc_error)) {
-        float min_err_segment = 2 * sqrtf((this->mm_max_arc_error * (2 * radius - this->mm_max_arc_error)));
-        if (this->mm_per_arc_segment < min_err_segment) {
-            arc_segment = min_err_segment;
-        }
-    }
-
-    // catch fall through on above
-    if(arc_segment < 0.0001F) {
-        arc_segment= 0.5F; /// the old default, so we avoid the divide by zero
+    // the acceleration it can go round with, the lowest of the plane's axis, one with none of its own counting as
+    // default_acceleration
+    float acceleration = INFINITY;
+    const uint8_t plane[2] = {this->plane_axis_0, this->plane_axis_1};
+    for (uint8_t i : plane) {
+        float ma = actuators[i]->get_acceleration();
+        acceleration = std::min(acceleration, isnan(ma) ? this->default_acceleration : ma);
     }
+    float arc_segment = arc_segment_length(radius, this->mm_max_arc_error, this->mm_per_arc_segment, rate_mm_s, acceleration, this->arc_segments_per_second);
 
     // Figure out how many segments for this gcode
     // TODO for deltas we need to make sure we are at least as many segments as requested, also if mm_per_line_segment is set we need to use the
-    uint16_t segments = floorf(millimeters_of_travel / arc_segment);
+    // rounded up so none of them is longer than arc_segment
+    uint16_t segments = ceilf(millimeters_of_travel / arc_segment);
     bool moved= false;
 
     if(segments > 1) {
         float theta_per_segment = angular_travel / segments;
         float linear_per_segment = linear_travel / segments;
 
-        /* Vector rotation by transformation matrix: r is the original vector, r_T is the rotated vector,
-        and phi is the angle of rotation. Based on the solution approach by Jens Geisler.
-        r_T = [cos(phi) -sin(phi);
-        sin(phi) cos(phi] * r ;
-        For arc generation, the center of the circle is the axis of rotation and the radius vector is
-        defined from the circle center to the initial position. Each line segment is formed by successive
-        vector rotations. This requires only two cos() and sin() computations to form the rotation
-        matrix for the duration of the entire arc. Error may accumulate from numerical round-off, since
-        all float numbers are single precision on the Arduino. (True float precision will not have
-        round off issues for CNC applications.) Single precision error can accumulate to be greater than
-        tool precision in some cases. Therefore, arc path correction is implemented.
-
-        Small angle approximation may be used to reduce computation overhead further. This approximation
-        holds for everything, but very small circles and large mm_per_arc_segment values. In other words,
-        theta_per_segment would need to be greater than 0.1 rad and N_ARC_CORRECTION would need to be large
-        to cause an appreciable drift error. N_ARC_CORRECTION~=25 is more than small enough to correct for
-        numerical drift error. N_ARC_CORRECTION may be on the order a hundred(s) before error becomes an
-        issue for CNC machines with the single precision Arduino calculations.
-        This approximation also allows mc_arc to immediately insert a line segment into the planner
-        without the initial overhead of computing cos() or sin(). By the time the arc needs to be applied
-        a correction, the planner should have caught up to the lag caused by the initial mc_arc overhead.
-        This is important when there are successive arc motions.
-        */
-        // Vector rotation matrix values
-        float cos_T = 1 - 0.5F * theta_per_segment * theta_per_segment; // Small angle approximation
-        float sin_T = theta_per_segment;
+        // each segment ends where the radius vector from the start is turned by one more theta_per_segment, see
+        // ArcRotation, it only takes a few multiplies a segment and does not drift off the arc however long it is
+        ArcRotation rotation(r_axis0, r_axis1, theta_per_segment);
 
         // TODO we need to handle the ABC axis here by segmenting them
         float arc_target[n_motors];
-        float sin_Ti;
-        float cos_Ti;
-        float r_axisi;
-        uint16_t i;
-        int8_t count = 0;
 
         // init array for all axis
         memcpy(arc_target, machine_position, n_motors*sizeof(float));
@@ -1984,24 +2064,10 @@ bool Robot::append_arc(Gcode * gcode, const float target[], const float offset[]
         // Initialize the linear axis
         arc_target[this->plane_axis_2] = this->machine_position[this->plane_axis_2];
 
-        for (i = 1; i < segments; i++) { // Increment (segments-1)
+        for (uint16_t i = 1; i < segments; i++) { // Increment (segments-1)
             if(THEKERNEL->is_halted()) return false; // don't queue any more segments
 
-            if (count < this->arc_correction ) {
-                // Apply vector rotation matrix
-                r_axisi = r_axis0 * sin_T + r_axis1 * cos_T;
-                r_axis0 = r_axis0 * cos_T - r_axis1 * sin_T;
-                r_axis1 = r_axisi;
-                count++;
-            } else {
-                // Arc correction to radius vector. Computed only every N_ARC_CORRECTION increments.
-                // Compute exact location by applying transformation matrix from initial radius vector(=-offset).
-                cos_Ti = cosf(i * theta_per_segment);
-                sin_Ti = sinf(i * theta_per_segment);
-                r_axis0 = -offset[this->plane_axis_0] * cos_Ti + offset[this->plane_axis_1] * sin_Ti;
-                r_axis1 = -offset[this->plane_axis_0] * sin_Ti - offset[this->plane_axis_1] * cos_Ti;
-                count = 0;
-            }
+            rotation.step(r_axis0, r_axis1);
 
             // Update arc_target location
             arc_target[this->plane_axis_0] = center_axis0 + r_axis0;
@@ -2037,6 +2103,182 @@ bool Robot::compute_arc(Gcode * gcode, const float offset[], const float target[
     return this->append_arc(gcode, target, offset,  radius, is_clockwise );
 }
 
+// G5 X Y [I J] P Q, a cubic Bezier in the XY plane from where it is to X Y, I J is the first control point relative to
+// the start and P Q the second one relative to the end. Right after another G5, I J can be left out to carry on
+// smoothly with the last second control point mirrored through the start. Z and the other axis move evenly along it.
+// It is cut into segments within mm_max_arc_error of the curve and no shorter than mm_per_arc_segment, more where it
+// bends tightly and fewer where it is nearly straight
+bool Robot::append_spline(Gcode *gcode, const float target[], const float offset[])
+{
+    float rate_mm_s= this->feed_rate / seconds_per_minute;
+    if(rate_mm_s <= 0.0F) {
+        gcode->is_error= true;
+        gcode->txt_after_ok= (rate_mm_s == 0 ? "Undefined feed rate" : "feed rate < 0");
+        THEKERNEL->streams->printf(rate_mm_s == 0 ? "Alarm:Undefined feed rate\n" : "Alarm:feed rate < 0\n");
+        return false;
+    }
+
+    bool has_ij= gcode->has_letter('I') || gcode->has_letter('J');
+    if(this->plane_axis_0 != X_AXIS || this->plane_axis_1 != Y_AXIS) {
+        gcode->is_error= true;
+        gcode->txt_after_ok= "G5 is only supported in the XY plane";
+        return false;
+    }
+    if(!gcode->has_letter('P') || !gcode->has_letter('Q') || (!has_ij && !spline_open)) {
+        gcode->is_error= true;
+        gcode->txt_after_ok= "G5 needs P Q, and I J unless it follows another G5";
+        return false;
+    }
+
+    float p0[2]= {arc_milestone[X_AXIS], arc_milestone[Y_AXIS]};
+    float p1[2];
+    if(has_ij) {
+        p1[0]= p0[0] + offset[0];
+        p1[1]= p0[1] + offset[1];
+    }else{
+        p1[0]= p0[0] - spline_control[0];
+        p1[1]= p0[1] - spline_control[1];
+    }
+    spline_control[0]= this->to_millimeters(gcode->get_value('P'));
+    spline_control[1]= this->to_millimeters(gcode->get_value('Q'));
+    float p2[2]= {target[X_AXIS] + spline_control[0], target[Y_AXIS] + spline_control[1]};
+    float p3[2]= {target[X_AXIS], target[Y_AXIS]};
+    CubicBezier curve(p0, p1, p2, p3);
+
+    float tolerance= this->mm_max_arc_error;
+    float min_length= this->mm_per_arc_segment;
+    if(tolerance <= 0 && min_length < 0.0001F) min_length= 0.5F; // the old arc default
+
+    bool moved= false;
+    float segment_end[n_motors];
+    float t= curve.next(0, tolerance, min_length);
+    while(t < 1) {
+        if(THEKERNEL->is_halted()) return false; // don't queue any more segments
+
+        curve.point(t, segment_end);
+        for (int i = Z_AXIS; i < n_motors; ++i) {
+            segment_end[i]= machine_position[i] + (target[i] - machine_position[i]) * t;
+        }
+        if(this->append_milestone(segment_end, rate_mm_s, gcode->line)) moved= true;
+        t= curve.next(t, tolerance, min_length);
+    }
+
+    // the last segment arrives at the target exactly
+    if(this->append_milestone(target, rate_mm_s, gcode->line)) moved= true;
+
+    return moved;
+}
+
+// G7 [$0|$1] [X Y] [P pixel_mm] [F] D<base64>, a laser raster line along X with one byte of power for each pixel,
+// 255 being laser_module_maximum_s_value. $, X or Y start a new line at X Y ($1 +X, $0 -X, otherwise the opposite
+// way to the last one, +X first), a G7 with just D carries on from where the last one stopped so a line can be
+// sent over several G7s. Each line gets a run up to the feed rate before it and a slow down after it with the laser
+// off, target is left at where the pixels end
+bool Robot::append_raster(Gcode *gcode, float target[])
+{
+    if(gcode->has_letter('P')) raster_pixel = this->to_millimeters(gcode->get_value('P'));
+    float rate_mm_s = this->feed_rate / seconds_per_minute;
+    if(raster_pixel <= 0 || rate_mm_s <= 0) {
+        gcode->is_error= true;
+        gcode->txt_after_ok= rate_mm_s <= 0 ? "Undefined feed rate\n" : "Invalid pixel size\n";
+        return false;
+    }
+
+    bool moved= false;
+    const char *dir = strchr(gcode->get_command(), '$');
+    if(!raster_open || dir != nullptr || gcode->has_letter('X') || gcode->has_letter('Y')) {
+        if(raster_open) end_raster(gcode->line);
+
+        if(dir != nullptr) {
+            raster_dir = dir[1] == '0' ? -1 : 1;
+        } else {
+            raster_dir = raster_dir == 0 ? 1 : -raster_dir;
+        }
+
+        // the line starts at the target, it is reached at the feed rate from the overscan before it
+        float start[n_motors];
+        float run_up[n_motors];
+        memcpy(start, target, n_motors*sizeof(float));
+        memcpy(run_up, target, n_motors*sizeof(float));
+        run_up[X_AXIS] -= raster_dir * raster_overscan(rate_mm_s);
+        is_g123= false;
+        if(raster_move(run_up, this->seek_rate / seconds_per_minute, gcode->line)) moved= true;
+        if(raster_move(start, rate_mm_s, gcode->line)) moved= true;
+        raster_open= true;
+    }
+
+    // the pixels, as many to a move as a G1 S a:b:c can have
+    if(s_values == nullptr) s_values = new float[MAX_S_VALUES];
+    uint8_t pixels[MAX_S_VALUES];
+    const char *data = gcode->data;
+    size_t len = gcode->data != nullptr ? gcode->data_len : 0;
+    const size_t chunk = MAX_S_VALUES / 3 * 4; // whole groups of 4 characters
+    float modal_s = s_value;
+    is_g123= true;
+    while(len > 0 && !THEKERNEL->is_halted()) {
+        size_t l = std::min(len, chunk);
+        size_t n = base64_decode(data, l, pixels, MAX_S_VALUES);
+        if(n == 0) break;
+
+        float end[n_motors];
+        memcpy(end, machine_position, n_motors*sizeof(float));
+        end[X_AXIS] += raster_dir * raster_pixel * n;
+        for (size_t i = 0; i < n; ++i) {
+            s_values[i] = pixels[i] * raster_s_scale;
+        }
+        s_value = s_values[0];
+        s_count = n > 1 ? n : 0;
+        if(this->append_line(gcode, end, rate_mm_s, NAN)) {
+            memcpy(machine_position, end, n_motors*sizeof(float));
+            moved= true;
+        }
+        data += l;
+        len -= l;
+    }
+    s_count = 0;
+    s_value = modal_s;
+
+    memcpy(target, machine_position, n_motors*sizeof(float));
+    return moved;
+}
+
+// the slow down after a raster line, with the laser off
+void Robot::end_raster(unsigned int line)
+{
+    raster_open= false;
+    if(THEKERNEL->is_halted()) return;
+
+    float rate_mm_s = this->feed_rate / seconds_per_minute;
+    float run_out[n_motors];
+    memcpy(run_out, machine_position, n_motors*sizeof(float));
+    run_out[X_AXIS] += raster_dir * raster_overscan(rate_mm_s);
+    is_g123= false;
+    if(raster_move(run_out, rate_mm_s, line)) {
+        memcpy(arc_milestone, run_out, sizeof(arc_milestone));
+    }
+}
+
+// a run up or slow down of a raster line, not segmented as it is short and along X
+bool Robot::raster_move(const float target[], float rate_mm_s, unsigned int line)
+{
+    if(memcmp(target, machine_position, n_motors*sizeof(float)) == 0) return false;
+    if(!append_milestone(target, rate_mm_s, line)) return false;
+    memcpy(machine_position, target, n_motors*sizeof(float));
+    return true;
+}
+
+// how far X takes to get to rate_mm_s from a stop, which the pixels at the ends of a line need to be at full speed
+float Robot::raster_overscan(float rate_mm_s) const
+{
+    // the moves get limited to what X can do
+    rate_mm_s = std::min(rate_mm_s, std::min(max_speeds[X_AXIS], actuators[X_AXIS]->get_max_rate()));
+    float acceleration = actuators[X_AXIS]->get_acceleration();
+    if(isnan(acceleration)) acceleration = default_acceleration;
+    // S-curve and shaped ramps average less than the peak acceleration, as the planner allows for
+    acceleration = THEKERNEL->planner->planned_acceleration(acceleration);
+    return std::min(rate_mm_s * rate_mm_s / (2.0F * acceleration), raster_max_overscan);
+}
+
 
 float Robot::theta(float x, float y)
 {
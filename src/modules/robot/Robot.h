@@ -26,6 +26,12 @@ class StepperMotor;
 
 // 9 WCS offsets
 #define MAX_WCS 9UL
+#define MAX_S_VALUES 256 // most laser powers a G1 can give with S a:b:c
+#define MAX_COMPENSATION_SPLITS 64 // most places a line is split at where the compensation changes slope
+#define A_AXIS_COMBINED_ACCELERATION 3 // times its acceleration the A axis may turn at along with X, Y or Z
+
+// rounds the target of a G0-G3 to the nearest 0.005
+float ROUND_NEAR_HALF(float x);
 
 class Robot : public Module {
     public:
@@ -33,6 +39,7 @@ class Robot : public Module {
         Robot();
         void on_module_loaded();
         void on_gcode_received(void* argument);
+        void on_halt(void* argument);
 
         void reset_axis_position(float position, int axis);
         void reset_axis_position(float x, float y, float z);
@@ -80,6 +87,9 @@ class Robot : public Module {
 
         // set by a leveling strategy to transform the target of a move according to the current plan
         std::function<void(float*, bool, bool)> compensationTransform;
+        // set with it when the compensation is piecewise linear, fills the fractions of the way from start to end the
+        // line has to be split at to follow it (ascending, up to the max given), returns how many or -1 if it can not
+        std::function<int(const float*, const float*, float*, int)> compensationSplits;
         // set by an active extruder, returns the amount to scale the E parameter by (to convert mm³ to mm)
         std::function<float(void)> get_e_scale_fnc;
 
@@ -101,11 +111,14 @@ class Robot : public Module {
             bool disable_segmentation:1;                      // set to disable segmentation
             bool disable_arm_solution:1;                      // set to disable the arm solution
             bool segment_z_moves:1;
+            bool segment_at_compensation:1;                   // split lines where the compensation changes slope instead of every mm_per_line_segment
             bool save_g92:1;                                  // save g92 on M500 if set
             bool save_g54:1;                                  // save WCS on M500 if set
             bool is_g123:1;
             bool soft_endstop_enabled:1;
             bool soft_endstop_halt:1;
+            bool raster_open:1;                               // a G7 raster line is running, it can be continued by the next G7
+            bool spline_open:1;                               // the last move was a G5, the next G5 can leave out I J
             uint8_t plane_axis_0:2;                           // Current plane ( XY, XZ, YZ )
             uint8_t plane_axis_1:2;
             uint8_t plane_axis_2:2;
@@ -118,7 +131,9 @@ class Robot : public Module {
             SEEK, // G0
             LINEAR, // G1
             CW_ARC, // G2
-            CCW_ARC // G3
+            CCW_ARC, // G3
+            RASTER, // G7
+            SPLINE // G5
         };
 
         void load_config();
@@ -126,6 +141,11 @@ class Robot : public Module {
         bool append_line( Gcode* gcode, const float target[], float rate_mm_s, float delta_e);
         bool append_arc( Gcode* gcode, const float target[], const float offset[], float radius, bool is_clockwise );
         bool compute_arc(Gcode* gcode, const float offset[], const float target[], enum MOTION_MODE_T motion_mode);
+        bool append_raster(Gcode* gcode, float target[]);
+        bool append_spline(Gcode* gcode, const float target[], const float offset[]);
+        void end_raster(unsigned int line);
+        bool raster_move(const float target[], float rate_mm_s, unsigned int line);
+        float raster_overscan(float rate_mm_s) const;
         void process_move(Gcode *gcode, enum MOTION_MODE_T);
         bool is_homed(uint8_t i) const;
 
@@ -153,28 +173,27 @@ class Robot : public Module {
         float mm_per_line_segment;                           // Setting : Used to split lines into segments
         float mm_per_arc_segment;                            // Setting : Used to split arcs into segments
         float mm_max_arc_error;                              // Setting : Used to limit total arc segments to max error
+        float arc_segments_per_second;                       // Setting : Used to lengthen arc segments at speed, 0 does not
         float delta_segments_per_second;                     // Setting : Used to split lines into segments for delta based on speed
         float seconds_per_minute;                            // for realtime speed change
         float default_acceleration;                          // the defualt accleration if not set for each axis
         float s_value;                                       // modal S value
-        // 2024
-        /*
-        float s_values[8];                                   // block S values
-		int   s_count;
-		*/
+        float *s_values;                                     // S a:b:c on a G1, the power for each equal part of it, allocated when first used
+        uint16_t s_count;                                    // values in s_values, 0 for a plain S
+        const float *s_block_values;                         // the part of s_values the next block queued gets
+        uint16_t s_block_count;
+        float raster_pixel;                                  // G7 P, mm along X for each pixel
+        float raster_s_scale;                                // S for a G7 pixel of 1, a pixel of 255 is laser_module_maximum_s_value
+        float raster_max_overscan;                           // Setting : longest run up and slow down a G7 line gets
+        int8_t raster_dir;                                   // 1 for +X, -1 for -X, 0 before the first line
         float arc_milestone[3];                              // used as start of an arc command
+        float spline_control[2];                             // the last G5's second control point relative to where it ended
         float max_delta;
 
         float laser_module_offset_x;
 		float laser_module_offset_y;
 		float laser_module_offset_z;
 
-		// Number of arc generation iterations by small angle approximation before exact arc trajectory
-        // correction. This parameter may be decreased if there are issues with the accuracy of the arc
-        // generations. In general, the default value is more than enough for the intended CNC applications
-        // of grbl, and should be on the order or greater than the size of the buffer to help with the
-        // computational efficiency of generating arcs.
-        int arc_correction;                                  // Setting : how often to rectify arc computation
         float max_speeds[3];                                 // Setting : max allowable speed in mm/s for each axis
         float max_speed;                                     // Setting : maximum feedrate in mm/s as specified by F parameter
         bool probe_tool_not_calibrated;
@@ -184,6 +203,7 @@ class Robot : public Module {
 
         // Used by Planner
         friend class Planner;
+        friend class JobEstimate; // for the limits and offsets it plans with
 };
 
 
@@ -23,6 +23,7 @@
 #include "Gcode.h"
 #include "PwmOut.h" // mbed.h lib
 #include "Conveyor.h"
+#include "Planner.h"
 
 #include "libs/PublicData.h"
 #include "PublicDataRequest.h"
@@ -43,10 +44,13 @@
 #define laser_module_minimum_power_checksum     CHECKSUM("laser_module_minimum_power")
 #define laser_module_max_power_checksum         CHECKSUM("laser_module_max_power")
 #define laser_module_maximum_s_value_checksum   CHECKSUM("laser_module_maximum_s_value")
+#define laser_module_power_update_steps_checksum CHECKSUM("laser_module_power_update_steps")
 
 Laser::Laser()
 {
     laser_on = false;
+    sync_block = nullptr;
+    power_update_steps = 0;
     scale = 1;
     testing = false;
 }
@@ -118,9 +122,16 @@ void Laser::on_module_loaded()
     this->register_for_event(ON_GET_PUBLIC_DATA);
 
     // no point in updating the power more than the PWM frequency, but not faster than 1KHz
-    ms_per_tick = 1000 / std::min(1000UL, 1000000 / period);
+    ms_per_tick = 1000 / std::min(1000UL, 1000000UL / period);
     // 2024
-    THEKERNEL->slow_ticker->attach(std::min(1000UL, 1000000 / period), this, &Laser::set_proportional_power);
+    THEKERNEL->slow_ticker->attach(std::min(1000UL, 1000000UL / period), this, &Laser::set_proportional_power);
+
+    // while moving the power is set by the step ticker as the speed changes and every so many steps, so it follows the
+    // moves rather than lagging them by up to a slow tick. 0 leaves it to the slow ticker
+    this->power_update_steps = THEKERNEL->config->value(laser_module_power_update_steps_checksum)->by_default(10)->as_int();
+    if(this->power_update_steps > 0) {
+        THEKERNEL->step_ticker->set_step_sync(Laser::step_sync, this, this->power_update_steps);
+    }
     // THEKERNEL->slow_ticker->attach(std::min(4000UL, 1000000 / period), this, &Laser::set_proportional_power);
     // THEKERNEL->slow_ticker->attach(1, this, &Laser::set_proportional_power);
 
@@ -131,12 +142,12 @@ void Laser::on_console_line_received( void *argument )
     if(THEKERNEL->is_halted()) return; // if in halted state ignore any commands
 
     SerialMessage *msgp = static_cast<SerialMessage *>(argument);
-    string possible_command = msgp->message;
 
-    // ignore anything that is not lowercase or a letter
-    if(possible_command.empty() || !islower(possible_command[0]) || !isalpha(possible_command[0])) {
+    // ignore anything that is not lowercase or a letter, before copying the line
+    if(msgp->message.empty() || !islower(msgp->message[0]) || !isalpha(msgp->message[0])) {
         return;
     }
+    string possible_command = msgp->message;
 
     string cmd = shift_parameter(possible_command);
 
@@ -241,23 +252,19 @@ void Laser::on_gcode_received(void *argument)
     if (gcode->has_m) {
     	if (gcode->m == 3 && THEKERNEL->get_laser_mode())
 		{
-    		THECONVEYOR->wait_for_idle();
-            // M3 with S value provided: set speed
+            // M3 with S value provided: set speed, it is only used by the moves queued after this
             if (gcode->has_letter('S'))
             {
             	THEROBOT->set_s_value(gcode->get_value('S'));
             }
-        	// turn on laser pin
-        	this->laser_pin->set(true);
-    		this->laser_on = true;
     		this->testing = false;
+        	// turn on laser pin when the moves before this are done, without stopping for it
+        	THEKERNEL->planner->append_action(Laser::switch_action, this, 1);
     		// THEKERNEL->streams->printf("Laser on, S: %1.4f\n", THEROBOT->get_s_value());
 		} else if (gcode->m == 5) {
-    		THECONVEYOR->wait_for_idle();
-			this->laser_on = false;
 			this->testing = false;
-        	// turn on laser pin
-        	this->laser_pin->set(false);
+        	// turn off laser pin when the moves before this are done
+        	THEKERNEL->planner->append_action(Laser::switch_action, this, 0);
 		} else if (gcode->m == 321 && !THEKERNEL->get_laser_mode()) { // change to laser mode
 			THECONVEYOR->wait_for_idle();
         	THEKERNEL->set_laser_mode(true);
@@ -374,12 +381,18 @@ void Laser::on_gcode_received(void *argument)
     }
 }
 
-// calculates the current speed ratio from the currently executing block
-float Laser::current_speed_ratio(const Block *block) const
+// power for the block at the rate its primary actuator pm is stepping at now, before scaling to the power range.
+// A block with a power array is at the value for how far along it the primary actuator is
+float Laser::block_power(const Block *block, size_t pm, uint16_t s_value) const
 {
-    // find the primary moving actuator (the one with the most steps)
+    float requested_power = (float)s_value / (1 << 11) / this->laser_maximum_s_value; // s_value is 1.11 Fixed point
+    float ratio = block->get_trapezoid_rate(pm) / block->nominal_rate;
+    return requested_power * ratio * scale;
+}
 
-	// 2024
+// the primary moving actuator of the block (the one with the most steps)
+size_t Laser::primary_motor(const Block *block) const
+{
     size_t pm = 0;
     uint32_t max_steps = 0;
     for (size_t i = 0; i < THEROBOT->get_number_registered_motors(); i++) {
@@ -389,23 +402,68 @@ float Laser::current_speed_ratio(const Block *block) const
             pm = i;
         }
     }
+    return pm;
+}
 
-    // figure out the ratio of its speed, from 0 to 1 based on where it is on the trapezoid,
-    // this is based on the fraction it is of the requested rate (nominal rate)
-    float ratio = block->get_trapezoid_rate(pm) / block->nominal_rate;
-
-    return ratio;
-
-    /*
-    // find the primary moving actuator (the one with the most steps)
-    size_t pm = block->move_axis;
-    // figure out the ratio of its speed, from 0 to 1 based on where it is on the trapezoid,
-    // this is based on the fraction it is of the requested rate (nominal rate)
-    float ratio = block->get_trapezoid_rate(pm) / block->nominal_rate;
+// queued by M3 and M5, run from the step ticker ISR
+void Laser::switch_action(void *laser, float on)
+{
+    Laser *l = static_cast<Laser *>(laser);
+    l->laser_pin->set(on != 0);
+    l->laser_on = on != 0;
+    // turning on is left to the next block, there is nothing to burn until it moves
+    if(!l->laser_on && l->power_update_steps > 0 && !l->testing) l->set_laser_power(0);
+}
 
-    return ratio;
-    */
+// moves sync_next on to where the power after the next one starts, ceil((sync_index + 2) * steps_event_count / s_count)
+// kept as the whole steps each power covers plus the remainders carried over, so the ISR does not divide
+void Laser::next_power_step(const Block *block)
+{
+    sync_next += block->s_steps;
+    if (sync_rem >= block->s_steps_rem) {
+        sync_rem -= block->s_steps_rem;
+    } else {
+        sync_next++;
+        sync_rem += block->s_count - block->s_steps_rem;
+    }
+}
 
+// called from the step ticker ISR as the running block changes speed, see StepTicker::set_step_sync().
+// Returns the steps to the next value of a power array so the change is not left until the next regular update
+uint32_t Laser::step_sync(void *laser, const Block *block, uint8_t primary)
+{
+    Laser *l = static_cast<Laser *>(laser);
+    // every block is synced on its first tick, which starts its power array from the first value
+    if (block != l->sync_block) {
+        l->sync_block = block;
+        l->sync_index = 0;
+        l->sync_next = 0;
+        l->sync_rem = 0;
+        if (block != nullptr && block->s_count > 1) l->next_power_step(block);
+    }
+    if (!THEKERNEL->get_laser_mode() || l->testing) return 0;
+
+    if (l->laser_on && block != nullptr && block->is_g123) {
+        uint16_t s_value = block->s_value;
+        uint32_t steps = 0;
+        if (block->s_count > 1) {
+            // synced at least at every change of value, so this is at most a step or two on
+            uint32_t step_count = block->tick_info[primary].step_count;
+            while (step_count >= l->sync_next && l->sync_index < block->s_count - 1) {
+                l->sync_index++;
+                l->next_power_step(block);
+            }
+            s_value = block->s_values[l->sync_index];
+            steps = l->sync_next - step_count;
+        }
+        float power = l->block_power(block, primary, s_value);
+        l->set_laser_power(((l->laser_maximum_power - l->laser_minimum_power) * power) + l->laser_minimum_power);
+        return steps;
+    } else {
+        // a G0 or nothing moving
+        l->set_laser_power(0);
+    }
+    return 0;
 }
 
 // get laser power for the currently executing block, returns false if nothing running or a G0
@@ -416,23 +474,9 @@ bool Laser::get_laser_power(float& power) const
     // Note to avoid a race condition where the block is being cleared we check the is_ready flag which gets cleared first,
     // as this is an interrupt if that flag is not clear then it cannot be cleared while this is running and the block will still be valid (albeit it may have finished)
     if (block != nullptr && block->is_ready && block->is_g123) {
-    	// 2024
-        float requested_power = (float)block->s_value / (1 << 11) / this->laser_maximum_s_value; // s_value is 1.11 Fixed point
-        float ratio = current_speed_ratio(block);
-        power = requested_power * ratio * scale;
-        return true;
-
-        /*
-		int axis = block->move_axis;
-		int shift_steps = block->tick_info[axis].steps_to_move / int(block->s_count);
-		int idx = block->tick_info[axis].step_count / shift_steps;
-
-        float requested_power = (float)block->s_values[idx] / (1 << 11) / this->laser_maximum_s_value; // s_value is 1.11 Fixed point
-        float ratio = current_speed_ratio(block);
-        power = requested_power * ratio * scale;
+        size_t pm = primary_motor(block);
+        power = block_power(block, pm, block->get_s_value(block->tick_info[pm].step_count));
         return true;
-        */
-
     }
 
     return false;
@@ -449,6 +493,11 @@ uint32_t Laser::set_proportional_power(uint32_t dummy)
         return 0;
     }
 
+    // the step ticker looks after the power while anything is moving, see step_sync()
+    if (this->power_update_steps > 0 && !THEKERNEL->step_ticker->is_idle()) {
+        return 0;
+    }
+
     if (laser_on) {
         float power;
         if(get_laser_power(power)) {
@@ -10,6 +10,7 @@
 #include "libs/Module.h"
 
 #include <stdint.h>
+#include <stddef.h>
 
 namespace mbed {
     class PwmOut;
@@ -34,7 +35,11 @@ class Laser : public Module{
     private:
         uint32_t set_proportional_power(uint32_t dummy);
         bool get_laser_power(float& power) const;
-        float current_speed_ratio(const Block *block) const;
+        size_t primary_motor(const Block *block) const;
+        float block_power(const Block *block, size_t pm, uint16_t s_value) const;
+        static void switch_action(void *laser, float on);
+        static uint32_t step_sync(void *laser, const Block *block, uint8_t primary);
+        void next_power_step(const Block *block);
 
         Pin *laser_pin;
         mbed::PwmOut *pwm_pin;    // PWM output to regulate the laser power
@@ -46,9 +51,17 @@ class Laser : public Module{
         float scale;
 
         int32_t ms_per_tick; // ms between each ticks, depends on PWM frequency
+        int32_t power_update_steps; // primary actuator steps between power updates while moving, 0 to update from the slow ticker
+
+        volatile bool laser_on;   // set if the laser is on, not in the flags as the step ticker sets it, see switch_action()
+
+        // where step_sync() is in the power array of the block running, only used from the step ticker ISR
+        const Block *sync_block;
+        uint32_t sync_next;       // step of the primary actuator the power after sync_index starts at
+        uint16_t sync_rem;        // what rounding sync_next up to a whole step added, in 1/s_count steps
+        uint16_t sync_index;
 
         struct {
-            bool laser_on:1;      // set if the laser is on
             bool pwm_inverting:1; // stores whether the PWM period should be inverted
             bool ttl_used:1;        // stores whether we have a TTL output
             bool ttl_inverting:1;   // stores whether the TTL output should be inverted
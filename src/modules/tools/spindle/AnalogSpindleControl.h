@@ -37,6 +37,7 @@ class AnalogSpindleControl: public SpindleControl {
         void turn_on(void);
         void turn_off(void);
         void set_speed(int);
+        bool set_speed_from_isr(void) { return true; }
         void report_speed(void);
         void update_pwm(float); 
 };
@@ -80,6 +80,7 @@ class PWMSpindleControl: public SpindleControl {
         void turn_on(void);
         void turn_off(void);
         void set_speed(int);
+        bool set_speed_from_isr(void) { return true; }
         void report_speed(void);
         void set_p_term(float);
         void set_i_term(float);
@@ -9,12 +9,19 @@
 #include "libs/Kernel.h"
 #include "Gcode.h"
 #include "Conveyor.h"
+#include "Planner.h"
 #include "SpindleControl.h"
 #include "libs/StreamOutputPool.h"
 #include "libs/PublicData.h"
 #include "SwitchPublicAccess.h"
 #include "ATCHandlerPublicAccess.h"
 
+// queued by M3 S with the spindle on, run from the step ticker ISR
+void SpindleControl::speed_action(void *spindle, float rpm)
+{
+    static_cast<SpindleControl *>(spindle)->set_speed(rpm);
+}
+
 void SpindleControl::on_gcode_received(void *argument) 
 {
     
@@ -59,13 +66,21 @@ void SpindleControl::on_gcode_received(void *argument)
         			return;
             	}
 
-                THECONVEYOR->wait_for_idle();
-                // open vacuum if set
+                // a speed change with the spindle running goes in step with the moves rather than stopping for it
+                bool in_step = spindle_on && gcode->has_letter('S') && set_speed_from_isr();
+                if (!in_step) {
+                    THECONVEYOR->wait_for_idle();
+                }
+                // open vacuum if set, the spindle is already running for a speed change so it need not wait
             	if (THEKERNEL->get_vacuum_mode()) {
             		// open vacuum
             		bool b = true;
                     PublicData::set_value( switch_checksum, vacuum_checksum, state_checksum, &b );
             	}
+                if (in_step) {
+                    THEKERNEL->planner->append_action(SpindleControl::speed_action, this, gcode->get_value('S'));
+                    return;
+                }
 
                 // M3 with S value provided: set speed
                 if (gcode->has_letter('S'))
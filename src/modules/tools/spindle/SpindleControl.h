@@ -22,10 +22,13 @@ class SpindleControl: public Module {
     private:
         void on_gcode_received(void *argument);
         void on_halt(void *argument);
+        static void speed_action(void *spindle, float rpm);
         
         virtual void turn_on(void) {};
         virtual void turn_off(void) {};
         virtual void set_speed(int) {};
+        // true if set_speed() is quick enough to be called from the step ticker ISR
+        virtual bool set_speed_from_isr(void) { return false; };
         virtual void report_speed(void) {};
         virtual void set_p_term(float) {};
         virtual void set_i_term(float) {};
@@ -54,6 +54,10 @@
         "Two corners"" is not absolutely the correct name for this mode, because it uses only one corner and rectangle size.
         It can be turned off with G32 R0 and turned on with G32 R1.
 
+    The compensation is interpolated bilinearly between the grid points, or it can follow a smooth (bicubic) surface
+    through them, which takes four times as much memory, with
+       leveling-strategy.rectangular-grid.bicubic  true
+
     Display mode of current grid can be changed to human readable mode (table with coordinates) by using
        leveling-strategy.rectangular-grid.human_readable  true
 
@@ -125,9 +129,12 @@
 #define dampening_start_checksum     CHECKSUM("dampening_start")
 #define before_probe_gcode_checksum  CHECKSUM("before_probe_gcode")
 #define after_probe_gcode_checksum   CHECKSUM("after_probe_gcode")
+#define bicubic_checksum             CHECKSUM("bicubic")
 
 #define GRIDFILE "/sd/cartesian.grid"
 #define GRIDFILE_NM "/sd/cartesian_nm.grid"
+// how far a segment may be off the bilinear surface in a cell when lines are split at the grid
+#define GRID_SEGMENT_TOLERANCE 0.001F
 
 CartGridStrategy::CartGridStrategy(ZProbe *zprobe) : LevelingStrategy(zprobe)
 {
@@ -155,6 +162,7 @@ bool CartGridStrategy::handleConfig()
     only_by_two_corners = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, only_by_two_corners_checksum)->by_default(false)->as_bool();
     human_readable = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, human_readable_checksum)->by_default(false)->as_bool();
     do_manual_attach = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, m_attach_checksum)->by_default(false)->as_bool();
+    bicubic = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, bicubic_checksum)->by_default(false)->as_bool();
 
     this->height_limit = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, height_limit_checksum)->by_default(NAN)->as_number();
     this->dampening_start = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, dampening_start_checksum)->by_default(NAN)->as_number();
@@ -488,14 +496,29 @@ bool CartGridStrategy::handleGcode(Gcode *gcode)
 void CartGridStrategy::setAdjustFunction(bool on)
 {
     if(on) {
+        // the grid does not change while it is on, the compensation uses the coefficients worked out from it here
+        if(!coefficients.build(grid, current_grid_x_size, current_grid_y_size, x_start, y_start, x_size, y_size, bicubic)) {
+            THEKERNEL->streams->printf("Error: Not enough memory for the grid compensation, it is off\n");
+            THEROBOT->compensationTransform = nullptr;
+            THEROBOT->compensationSplits = nullptr;
+            return;
+        }
+        if(bicubic && !coefficients.is_bicubic()) {
+            THEKERNEL->streams->printf("Not enough memory for bicubic compensation, using bilinear\n");
+        }
+
         // set the compensationTransform in robot
         using std::placeholders::_1;
         using std::placeholders::_2;
         using std::placeholders::_3;
         THEROBOT->compensationTransform = std::bind(&CartGridStrategy::doCompensation, this, _1, _2, _3); // [this](float *target, bool inverse) { doCompensation(target, inverse); };
+        using std::placeholders::_4;
+        THEROBOT->compensationSplits = std::bind(&CartGridStrategy::segmentCompensation, this, _1, _2, _3, _4);
     } else {
         // clear it
         THEROBOT->compensationTransform = nullptr;
+        THEROBOT->compensationSplits = nullptr;
+        coefficients.clear();
     }
 }
 
@@ -725,7 +748,7 @@ bool CartGridStrategy::doProbe(Gcode *gc)
 
 void CartGridStrategy::doCompensation(float *target, bool inverse, bool debug)
 {
-    // Adjust print surface height by linear interpolation over the bed_level array.
+    // Adjust print surface height by interpolating over the grid, from the coefficients built when it was turned on
     // offset scale: 1 for default (use offset as is)
     float scale = 1.0;
     if (!isnan(this->damping_interval)) {
@@ -740,40 +763,8 @@ void CartGridStrategy::doCompensation(float *target, bool inverse, bool debug)
         }
     }
 
-    // find min/maxes, and handle the case where size is negative (assuming this is possible? Legacy code supported this)
-    float min_x = std::min(this->x_start, this->x_start + this->x_size);
-    float max_x = std::max(this->x_start, this->x_start + this->x_size);
-    float min_y = std::min(this->y_start, this->y_start + this->y_size);
-    float max_y = std::max(this->y_start, this->y_start + this->y_size);
-
-    // clamp the input to the bounds of the compensation grid
-    // if a point is beyond the bounds of the grid, it will get the offset of the closest grid point
-    //    float x_target = std::min(std::max(target[X_AXIS], min_x), max_x);
-    //    float y_target = std::min(std::max(target[Y_AXIS], min_y), max_y);
-
-    // change to set offset = 0 if a point is beyond the bounds of the grid
-    float x_target = target[X_AXIS];
-    float y_target = target[Y_AXIS];
-    if (x_target < min_x - 0.001 || x_target > max_x + 0.001 || y_target < min_y - 0.001 || y_target > max_y + 0.001) {
-    	return;
-    }
-
-    // we need to make sure that floor_x and floor_y are always < grid_size-1
-    float grid_x = std::max(0.001F, std::min(this->current_grid_x_size - 1.001F, (x_target - this->x_start) / (this->x_size / (this->current_grid_x_size - 1))));
-    float grid_y = std::max(0.001F, std::min(this->current_grid_y_size - 1.001F, (y_target - this->y_start) / (this->y_size / (this->current_grid_y_size - 1))));
-    int floor_x = floorf(grid_x);
-    int floor_y = floorf(grid_y);
-    float ratio_x = grid_x - floor_x;
-    float ratio_y = grid_y - floor_y;
-    float z1 = grid[(floor_x) + ((floor_y) * this->current_grid_x_size)];
-    float z2 = grid[(floor_x) + ((floor_y + 1) * this->current_grid_x_size)];
-    float z3 = grid[(floor_x + 1) + ((floor_y) * this->current_grid_x_size)];
-    float z4 = grid[(floor_x + 1) + ((floor_y + 1) * this->current_grid_x_size)];
-    float left = (1 - ratio_y) * z1 + ratio_y * z2;
-    float right = (1 - ratio_y) * z3 + ratio_y * z4;
-    float offset = (1 - ratio_x) * left + ratio_x * right;
-
-    // handle case where the grid was incomplete (should never happen)
+    // a point beyond the bounds of the grid gets no offset, nor does any if the grid was incomplete (should never happen)
+    float offset = coefficients.offset(target[X_AXIS], target[Y_AXIS]);
     if(isnan(offset)) return;
 
     if (inverse) {
@@ -787,18 +778,6 @@ void CartGridStrategy::doCompensation(float *target, bool inverse, bool debug)
     	THEKERNEL->streams->printf("//DEBUG: x_size: %f, y_size:%f\n", this->x_size, this->y_size);
     	THEKERNEL->streams->printf("//DEBUG: x_start: %f, y_start:%f\n", this->x_start, this->y_start);
         THEKERNEL->streams->printf("//DEBUG: TARGET: %f, %f, %f\n", target[0], target[1], target[2]);
-        THEKERNEL->streams->printf("//DEBUG: grid_x= %f\n", grid_x);
-        THEKERNEL->streams->printf("//DEBUG: grid_y= %f\n", grid_y);
-        THEKERNEL->streams->printf("//DEBUG: floor_x= %d\n", floor_x);
-        THEKERNEL->streams->printf("//DEBUG: floor_y= %d\n", floor_y);
-        THEKERNEL->streams->printf("//DEBUG: ratio_x= %f\n", ratio_x);
-        THEKERNEL->streams->printf("//DEBUG: ratio_y= %f\n", ratio_y);
-        THEKERNEL->streams->printf("//DEBUG: z1= %f\n", z1);
-        THEKERNEL->streams->printf("//DEBUG: z2= %f\n", z2);
-        THEKERNEL->streams->printf("//DEBUG: z3= %f\n", z3);
-        THEKERNEL->streams->printf("//DEBUG: z4= %f\n", z4);
-        THEKERNEL->streams->printf("//DEBUG: left= %f\n", left);
-        THEKERNEL->streams->printf("//DEBUG: right= %f\n", right);
         THEKERNEL->streams->printf("//DEBUG: offset= %f\n", offset);
         THEKERNEL->streams->printf("//DEBUG: scale= %f\n", scale);
         THEKERNEL->streams->printf("//DEBUG: adjustment= %f\n", offset*scale);
@@ -806,6 +785,17 @@ void CartGridStrategy::doCompensation(float *target, bool inverse, bool debug)
 //#endif
 }
 
+// where a line has to be split to follow the bilinear grid, see GridCoefficients::splits
+int CartGridStrategy::segmentCompensation(const float *start, const float *end, float *t, int max)
+{
+    if (!isnan(this->damping_interval)) {
+        // no compensation above the limit, and a damped offset changing with Z is not piecewise linear
+        if(start[Z_AXIS] > this->height_limit && end[Z_AXIS] > this->height_limit) return 0;
+        if(start[Z_AXIS] != end[Z_AXIS] && std::max(start[Z_AXIS], end[Z_AXIS]) > this->dampening_start) return -1;
+    }
+
+    return coefficients.splits(start[X_AXIS], start[Y_AXIS], end[X_AXIS], end[Y_AXIS], GRID_SEGMENT_TOLERANCE, t, max);
+}
 
 // Print calibration results for plotting or manual frame adjustment.
 void CartGridStrategy::print_bed_level(StreamOutput *stream)
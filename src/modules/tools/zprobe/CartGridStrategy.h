@@ -1,6 +1,7 @@
 #pragma once
 
 #include "LevelingStrategy.h"
+#include "GridCoefficients.h"
 
 #include <string.h>
 #include <tuple>
@@ -26,6 +27,7 @@ private:
     void setAdjustFunction(bool on);
     void print_bed_level(StreamOutput *stream);
     void doCompensation(float *target, bool inverse, bool debug);
+    int segmentCompensation(const float *start, const float *end, float *t, int max);
     void reset_bed_level();
     void save_grid(StreamOutput *stream);
     bool load_grid(StreamOutput *stream);
@@ -39,6 +41,7 @@ private:
     std::string before_probe, after_probe;
 
     float *grid;
+    GridCoefficients coefficients;          // the grid as it is used to compensate, built when compensation is turned on
     std::tuple<float, float, float> probe_offsets;
     float *m_attach;
     float x_start,y_start;
@@ -58,5 +61,6 @@ private:
         bool only_by_two_corners:1;
         bool human_readable:1;
         bool new_file_format:1;
+        bool bicubic:1;
     };
 };
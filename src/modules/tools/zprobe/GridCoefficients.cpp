@@ -0,0 +1,229 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GridCoefficients.h"
+
+#include "platform_memory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+#include <string.h>
+
+GridCoefficients::GridCoefficients()
+{
+    coeffs = nullptr;
+    pool = nullptr;
+    allocated = 0;
+    cells_x = cells_y = 0;
+    bicubic = false;
+}
+
+GridCoefficients::~GridCoefficients()
+{
+    release();
+}
+
+void GridCoefficients::clear()
+{
+    release();
+    cells_x = cells_y = 0;
+}
+
+// the AHB banks are tried first as they are otherwise mostly idle, then the heap
+bool GridCoefficients::alloc(size_t n)
+{
+    size_t size = n * sizeof(float);
+    coeffs = (float *)AHB0.alloc(size);
+    pool = &AHB0;
+    if(coeffs == nullptr) {
+        coeffs = (float *)AHB1.alloc(size);
+        pool = &AHB1;
+    }
+    if(coeffs == nullptr) {
+        coeffs = (float *)malloc(size);
+        pool = nullptr;
+    }
+    allocated = coeffs != nullptr ? n : 0;
+    return coeffs != nullptr;
+}
+
+void GridCoefficients::release()
+{
+    if(coeffs != nullptr) {
+        if(pool != nullptr) pool->dealloc(coeffs);
+        else free(coeffs);
+    }
+    coeffs = nullptr;
+    pool = nullptr;
+    allocated = 0;
+}
+
+// the grid value at x, y, points off the grid are extended along the line through the two nearest
+static float grid_at(const float *grid, int nx, int ny, int x, int y)
+{
+    if(x < 0) return 2 * grid_at(grid, nx, ny, 0, y) - grid_at(grid, nx, ny, 1, y);
+    if(x >= nx) return 2 * grid_at(grid, nx, ny, nx - 1, y) - grid_at(grid, nx, ny, nx - 2, y);
+    if(y < 0) return 2 * grid_at(grid, nx, ny, x, 0) - grid_at(grid, nx, ny, x, 1);
+    if(y >= ny) return 2 * grid_at(grid, nx, ny, x, ny - 1) - grid_at(grid, nx, ny, x, ny - 2);
+    return grid[x + nx * y];
+}
+
+// coefficients of t^0..t^3 of the Catmull-Rom curve between p[1] and p[2]
+static void catmull_rom(const float p[4], float c[4])
+{
+    c[0] = p[1];
+    c[1] = 0.5F * (p[2] - p[0]);
+    c[2] = 0.5F * (2 * p[0] - 5 * p[1] + 4 * p[2] - p[3]);
+    c[3] = 0.5F * (-p[0] + 3 * p[1] - 3 * p[2] + p[3]);
+}
+
+bool GridCoefficients::build(const float *grid, uint8_t nx, uint8_t ny, float x_start, float y_start, float x_size, float y_size, bool bicubic)
+{
+    cells_x = cells_y = 0;
+    if(nx < 2 || ny < 2 || x_size == 0 || y_size == 0) return false;
+
+    size_t cells = (nx - 1) * (ny - 1);
+    size_t n = cells * (bicubic ? 16 : 4);
+    if(n > allocated) {
+        release();
+        if(!alloc(n) && bicubic) {
+            bicubic = false;
+            n = cells * 4;
+            alloc(n);
+        }
+        if(coeffs == nullptr) return false;
+    }
+
+    this->bicubic = bicubic;
+    this->x_start = x_start;
+    this->y_start = y_start;
+    // the size can be negative
+    min_x = std::min(x_start, x_start + x_size);
+    max_x = std::max(x_start, x_start + x_size);
+    min_y = std::min(y_start, y_start + y_size);
+    max_y = std::max(y_start, y_start + y_size);
+    x_scale = (nx - 1) / x_size;
+    y_scale = (ny - 1) / y_size;
+
+    float *c = coeffs;
+    for (int y = 0; y < ny - 1; y++) {
+        for (int x = 0; x < nx - 1; x++) {
+            if(!bicubic) {
+                float z1 = grid[x + nx * y];
+                float z2 = grid[x + nx * (y + 1)];
+                float z3 = grid[(x + 1) + nx * y];
+                float z4 = grid[(x + 1) + nx * (y + 1)];
+                *c++ = z1;
+                *c++ = z3 - z1;
+                *c++ = z2 - z1;
+                *c++ = z4 - z3 - z2 + z1;
+                continue;
+            }
+
+            // along X for each of the four rows around the cell, then those along Y for each power of u
+            float rows[4][4];
+            for (int r = 0; r < 4; r++) {
+                float p[4];
+                for (int i = 0; i < 4; i++) p[i] = grid_at(grid, nx, ny, x - 1 + i, y - 1 + r);
+                catmull_rom(p, rows[r]);
+            }
+            for (int k = 0; k < 4; k++) {
+                float p[4] = {rows[0][k], rows[1][k], rows[2][k], rows[3][k]};
+                float v[4];
+                catmull_rom(p, v);
+                for (int m = 0; m < 4; m++) c[m * 4 + k] = v[m];
+            }
+            c += 16;
+        }
+    }
+
+    cells_x = nx - 1;
+    cells_y = ny - 1;
+    return true;
+}
+
+float GridCoefficients::offset(float x, float y) const
+{
+    if(cells_x == 0) return NAN;
+    if(x < min_x - 0.001F || x > max_x + 0.001F || y < min_y - 0.001F || y > max_y + 0.001F) return NAN;
+
+    // keep within the cells, a point on the last grid line is in the last cell
+    float gx = std::max(0.001F, std::min(cells_x - 0.001F, (x - x_start) * x_scale));
+    float gy = std::max(0.001F, std::min(cells_y - 0.001F, (y - y_start) * y_scale));
+    int cx = gx;
+    int cy = gy;
+    float u = gx - cx;
+    float v = gy - cy;
+
+    int cell = cx + cells_x * cy;
+    if(!bicubic) {
+        const float *c = &coeffs[cell * 4];
+        return c[0] + c[1] * u + (c[2] + c[3] * u) * v;
+    }
+
+    const float *c = &coeffs[cell * 16];
+    float r[4];
+    for (int m = 0; m < 4; m++, c += 4) {
+        r[m] = ((c[3] * u + c[2]) * u + c[1]) * u + c[0];
+    }
+    return ((r[3] * v + r[2]) * v + r[1]) * v + r[0];
+}
+
+// the fractions of the way along from g0 to g0 + dg where it crosses the lines 0 to cells, added to t
+static bool grid_crossings(float g0, float dg, int cells, float *t, int& n, int max)
+{
+    if(dg == 0) return true;
+    int lo = std::max(0, (int)ceilf(std::min(g0, g0 + dg)));
+    int hi = std::min(cells, (int)floorf(std::max(g0, g0 + dg)));
+    for (int k = lo; k <= hi; ++k) {
+        float f = (k - g0) / dg;
+        if(f <= 0.0001F || f >= 0.9999F) continue; // already an end of the line
+        if(n >= max) return false;
+        t[n++] = f;
+    }
+    return true;
+}
+
+int GridCoefficients::splits(float x0, float y0, float x1, float y1, float tolerance, float *t, int max) const
+{
+    if(cells_x == 0 || bicubic) return -1;
+
+    float gx0 = (x0 - x_start) * x_scale;
+    float gy0 = (y0 - y_start) * y_scale;
+    float dgx = (x1 - x_start) * x_scale - gx0;
+    float dgy = (y1 - y_start) * y_scale - gy0;
+
+    int n = 0;
+    if(!grid_crossings(gx0, dgx, cells_x, t, n, max) || !grid_crossings(gy0, dgy, cells_y, t, n, max)) return -1;
+    std::sort(t, t + n);
+    // through a grid point it crosses both lines at once
+    n = std::unique(t, t + n, [](float a, float b) { return b - a <= 0.0001F; }) - t;
+
+    // within a cell the line follows a parabola on the surface, bowed by the twist of the cell (d) times how far it
+    // goes across the cell each way, that is split evenly until the segments are within tolerance of it
+    for (int i = n; i >= 0; --i) {
+        float ta = i > 0 ? t[i - 1] : 0;
+        float tb = i < n ? t[i] : 1;
+        float tm = (ta + tb) / 2;
+        float gx = gx0 + dgx * tm;
+        float gy = gy0 + dgy * tm;
+        if(gx < 0 || gx > cells_x || gy < 0 || gy > cells_y) continue; // off the grid there is no offset
+
+        int cell = std::min((int)gx, cells_x - 1) + cells_x * std::min((int)gy, cells_y - 1);
+        float bow = fabsf(coeffs[cell * 4 + 3] * dgx * dgy) * (tb - ta) * (tb - ta) / 4;
+        if(!(bow > tolerance)) continue;
+        int k = ceilf(sqrtf(bow / tolerance));
+        if(n + k - 1 > max) return -1;
+        memmove(&t[i + k - 1], &t[i], (n - i) * sizeof(float));
+        for (int j = 1; j < k; ++j) {
+            t[i + j - 1] = ta + (tb - ta) * j / k;
+        }
+        n += k - 1;
+    }
+    return n;
+}
@@ -0,0 +1,57 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class MemoryPool;
+
+// The Z offsets of a probed rectangular grid turned into a table of polynomial coefficients for each cell, so the
+// offset at a point only takes a multiply per axis to find its cell and then evaluating that cell's polynomial.
+// Bilinear cells are a + b*u + c*v + d*u*v with u, v the position across the cell from 0 to 1, that is the same
+// interpolation CartGridStrategy always did between the four grid points around the point. Bicubic cells are
+// Catmull-Rom patches through the 4x4 points around the cell (a line through the edge points is extended past the
+// edges), which follow a curved bed more closely and have no kinks in the slope at the grid lines.
+// The table is built once when the grid is probed or loaded, in AHB0 or AHB1 when there is room, else on the heap.
+class GridCoefficients
+{
+public:
+    GridCoefficients();
+    ~GridCoefficients();
+
+    // build the table for a grid of nx by ny points (grid[x + nx * y]) over x_start + x_size by y_start + y_size,
+    // false if there is no memory for it, a bicubic table that does not fit is built bilinear instead
+    bool build(const float *grid, uint8_t nx, uint8_t ny, float x_start, float y_start, float x_size, float y_size, bool bicubic);
+    void clear();
+
+    // the offset at x, y, NAN outside of the grid (with 0.001 to spare) or if the grid was incomplete
+    float offset(float x, float y) const;
+
+    // where a straight line from x0, y0 to x1, y1 has to be split for straight segments to follow the bilinear
+    // surface within tolerance, as fractions of the way along in ascending order: where it crosses a grid line
+    // (the edges included, the offset drops to 0 outside of the grid), and in between across a twisted cell.
+    // Returns how many, -1 if there would be more than max or the surface is bicubic
+    int splits(float x0, float y0, float x1, float y1, float tolerance, float *t, int max) const;
+
+    bool is_bicubic() const { return bicubic; }
+
+private:
+    bool alloc(size_t n);
+    void release();
+
+    float *coeffs;          // 4 or 16 per cell, cells in rows of nx - 1
+    MemoryPool *pool;       // coeffs came from, nullptr for the heap
+    size_t allocated;       // floats in coeffs, a 255 by 255 bicubic grid needs over a million
+    uint8_t cells_x, cells_y;
+    bool bicubic;
+
+    float x_start, y_start;
+    float min_x, max_x, min_y, max_y;
+    float x_scale, y_scale; // cells per mm, the reciprocal of the grid spacing
+};
@@ -360,9 +360,12 @@ void ThreePointStrategy::setAdjustFunction(bool on)
     if(on) {
         // set the compensationTransform in robot
         THEROBOT->compensationTransform= [this](float *target, bool inverse, bool debug) { if(inverse) target[2] -= this->plane->getz(target[0], target[1]); else target[2] += this->plane->getz(target[0], target[1]); };
+        // a plane is followed exactly by a straight line, it never needs splitting
+        THEROBOT->compensationSplits= [](const float *start, const float *end, float *t, int max) { return 0; };
     }else{
         // clear it
         THEROBOT->compensationTransform= nullptr;
+        THEROBOT->compensationSplits= nullptr;
     }
 }
 
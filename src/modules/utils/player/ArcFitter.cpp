@@ -0,0 +1,190 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ArcFitter.h"
+
+#include "CompiledGcode.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#define LETTER(c) (1 << ((c) - 'A'))
+
+// how far round the G1s of one arc can go, measured along them, well short of a full circle so the end of the
+// arc can not be taken for its start
+#define ARC_FIT_MAX_SWEEP (1.5F * 3.14159265F)
+
+static bool get_letter(const CompiledLine& cl, char c, float& v)
+{
+    uint32_t bit = LETTER(c);
+    if(!(cl.letters & bit)) return false;
+    int n = 0;
+    for (int i = 0; i < c - 'A'; ++i) {
+        if(cl.letters & (1 << i)) n++;
+    }
+    v = cl.values[n];
+    return true;
+}
+
+ArcFitter::ArcFitter()
+{
+    tolerance = 0;
+    count = 0;
+    sent = 0;
+    path = 0;
+    feed_rate = 0;
+    known_x = known_y = known_z = false;
+    has_z = has_f = false;
+    clockwise = false;
+}
+
+// would the run with p added still be an arc, if so the center and direction are those of the arc with it
+bool ArcFitter::fits(const float p[2])
+{
+    // the circle through the start, the middle point and p
+    int n = count + 1;
+    const float *m = points[n / 2 - 1];
+    float bx = m[0] - start[0], by = m[1] - start[1];
+    float cx = p[0] - start[0], cy = p[1] - start[1];
+    float d = 2 * (bx * cy - by * cx);
+    if(d == 0) return false;
+    float b2 = bx * bx + by * by, c2 = cx * cx + cy * cy;
+    float ux = (cy * b2 - by * c2) / d;
+    float uy = (bx * c2 - cx * b2) / d;
+    float r2 = ux * ux + uy * uy;
+    if(r2 > ARC_FIT_MAX_RADIUS * ARC_FIT_MAX_RADIUS) return false;
+    float r = sqrtf(r2);
+    float c[2] = {start[0] + ux, start[1] + uy};
+
+    float lo = r > tolerance ? (r - tolerance) * (r - tolerance) : 0;
+    float hi = (r + tolerance) * (r + tolerance);
+    float l[2] = {p[0] - points[count - 1][0], p[1] - points[count - 1][1]};
+    if((path + sqrtf(l[0] * l[0] + l[1] * l[1])) / r > ARC_FIT_MAX_SWEEP) return false;
+
+    // every point and the middle of every G1 on the circle, each G1 going round the same way by less than a quarter
+    bool cw = false;
+    for (int i = 0; i < n; ++i) {
+        const float *a = i == 0 ? start : points[i - 1];
+        const float *b = i == n - 1 ? p : points[i];
+        float u[2] = {a[0] - c[0], a[1] - c[1]};
+        float v[2] = {b[0] - c[0], b[1] - c[1]};
+        float v2 = v[0] * v[0] + v[1] * v[1];
+        if(v2 < lo || v2 > hi) return false;
+        float mx = (u[0] + v[0]) / 2, my = (u[1] + v[1]) / 2;
+        float m2 = mx * mx + my * my;
+        if(m2 < lo || m2 > hi) return false;
+
+        float cross = u[0] * v[1] - u[1] * v[0];
+        if(cross == 0 || u[0] * v[0] + u[1] * v[1] <= 0) return false;
+        if(i == 0) cw = cross < 0;
+        else if((cross < 0) != cw) return false;
+    }
+
+    center[0] = c[0];
+    center[1] = c[1];
+    clockwise = cw;
+    return true;
+}
+
+bool ArcFitter::add(const CompiledLine& cl, bool absolute, unsigned int len)
+{
+    const uint32_t allowed = LETTER('X') | LETTER('Y') | LETTER('Z') | LETTER('F');
+    if(!absolute || cl.g != 1 || (cl.letters & ~allowed) || !(cl.letters & (LETTER('X') | LETTER('Y')))) return false;
+    if(count >= ARC_FIT_MAX_POINTS || (count > 0 && (cl.letters & LETTER('F')))) return false;
+    if(!known_x || !known_y) return false;
+
+    // Z has to stay exactly where it is, the lines of the run are sent with pos[2] for it
+    float v;
+    if(get_letter(cl, 'Z', v) && (!known_z || v != pos[2])) return false;
+
+    float p[2] = {pos[0], pos[1]};
+    get_letter(cl, 'X', p[0]);
+    get_letter(cl, 'Y', p[1]);
+    if(p[0] == pos[0] && p[1] == pos[1]) return false;
+
+    if(count == 0) {
+        start[0] = pos[0];
+        start[1] = pos[1];
+        path = 0;
+        sent = 0;
+        has_z = false;
+        has_f = get_letter(cl, 'F', feed_rate);
+    } else if(!fits(p)) {
+        return false;
+    }
+
+    if(cl.letters & LETTER('Z')) has_z = true;
+    path += hypotf(p[0] - pos[0], p[1] - pos[1]);
+    points[count][0] = p[0];
+    points[count][1] = p[1];
+    lens[count] = len;
+    count++;
+    pos[0] = p[0];
+    pos[1] = p[1];
+    return true;
+}
+
+void ArcFitter::moved(const CompiledLine *cl, bool absolute)
+{
+    if(cl == nullptr) {
+        known_x = known_y = known_z = false;
+        return;
+    }
+
+    float v;
+    const char axis[3] = {'X', 'Y', 'Z'};
+    for (int i = 0; i < 3; ++i) {
+        if(!get_letter(*cl, axis[i], v)) continue;
+        pos[i] = v;
+        bool known = absolute;
+        if(i == 0) known_x = known;
+        else if(i == 1) known_y = known;
+        else known_z = known;
+    }
+}
+
+void ArcFitter::flush(std::string& line, unsigned int& lines, uint32_t& len)
+{
+    char buf[96];
+    const char *f = has_f && sent == 0 ? " F" : nullptr;
+
+    if(count >= ARC_FIT_MIN_LINES) {
+        const float *e = points[count - 1];
+        int n = snprintf(buf, sizeof(buf), "%s X%.5f Y%.5f", clockwise ? "G2" : "G3", e[0], e[1]);
+        if(has_z) n += snprintf(buf + n, sizeof(buf) - n, " Z%.5f", pos[2]);
+        n += snprintf(buf + n, sizeof(buf) - n, " I%.5f J%.5f", center[0] - start[0], center[1] - start[1]);
+        if(f != nullptr) snprintf(buf + n, sizeof(buf) - n, " F%.6g", feed_rate);
+        line = buf;
+
+        lines = count;
+        len = 0;
+        for (int i = 0; i < count; ++i) len += lens[i];
+        count = 0;
+        return;
+    }
+
+    // not enough of them, the next one as it was
+    const float *e = points[sent];
+    int n = snprintf(buf, sizeof(buf), "G1 X%.5f Y%.5f", e[0], e[1]);
+    if(has_z) n += snprintf(buf + n, sizeof(buf) - n, " Z%.5f", pos[2]);
+    if(f != nullptr) snprintf(buf + n, sizeof(buf) - n, " F%.6g", feed_rate);
+    line = buf;
+
+    lines = 1;
+    len = lens[sent];
+    if(++sent >= count) {
+        count = 0;
+        sent = 0;
+    }
+}
+
+void ArcFitter::clear()
+{
+    count = 0;
+    sent = 0;
+    known_x = known_y = known_z = false;
+}
@@ -0,0 +1,68 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+struct CompiledLine;
+
+// most G1s fitted into one arc
+#define ARC_FIT_MAX_POINTS 32
+// runs of fewer G1s than this are sent as they are, an arc for them would not save the Robot anything
+#define ARC_FIT_MIN_LINES 4
+// flatter than this it is a straight line as far as the Robot is concerned
+#define ARC_FIT_MAX_RADIUS 1000.0F
+
+// Fits runs of G1s whose points lie on a circle into one G2/G3, which the Robot cuts into as many segments as
+// mm_max_arc_error needs rather than one block per G1. A G1 carries on the run when it only has X, Y and Z (F only
+// on the first), does not move Z, and the circle through the start, middle and end of the run passes within the
+// tolerance of every point of it and of the middle of every G1 between them, all going round the same way.
+// The lines come parsed by GcodeCompiler::parse_motion in absolute mode and the XY plane, anything else has to be
+// flushed before it, like for LaserCluster. Only the Player fits the files it plays, a host streaming a job waits for
+// the ok of each line and has no end of job to flush the last run on, so its G1s are not held back to be fitted.
+class ArcFitter {
+    public:
+        ArcFitter();
+
+        void set_tolerance(float t) { tolerance = t; }
+
+        // take a G1 if it carries on the arc, or starts one when empty, len is the length of its source line
+        bool add(const CompiledLine& cl, bool absolute, unsigned int len);
+        // a line that was sent as it is, nullptr for one that was not parsed so where it leaves the machine is not known
+        void moved(const CompiledLine *cl, bool absolute);
+
+        bool empty() const { return count == 0; }
+        // the next line to send for the lines taken so far, one G2/G3 for all of them if there are enough to be worth
+        // it, otherwise each of them as a G1, and how many source lines and characters it stands for
+        void flush(std::string& line, unsigned int& lines, uint32_t& len);
+        // forget the run and the position
+        void clear();
+
+    private:
+        bool fits(const float p[2]);
+
+        float tolerance;
+        float pos[3];           // X, Y and Z the last line left the machine at, when known
+        float start[2];         // where the run started
+        float points[ARC_FIT_MAX_POINTS][2];
+        uint16_t lens[ARC_FIT_MAX_POINTS]; // of the source lines, which can be longer than 255
+        float center[2];        // of the circle through the run so far
+        float path;             // length of the G1s of the run
+        float feed_rate;
+        uint8_t count;
+        uint8_t sent;           // points of a short run already flushed as G1s
+        struct {
+            bool known_x:1;
+            bool known_y:1;
+            bool known_z:1;
+            bool has_z:1;       // some line of the run had a Z
+            bool has_f:1;
+            bool clockwise:1;
+        };
+};
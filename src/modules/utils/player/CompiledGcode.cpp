@@ -0,0 +1,280 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CompiledGcode.h"
+
+#include "ReadAheadFile.h"
+#include "libs/Kernel.h"
+#include "libs/StreamOutput.h"
+#include "GcodeDispatch.h"
+#include "Gcode.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define COMPILED_GCODE_MAGIC   0x31424347 // "GCB1"
+#define COMPILED_GCODE_VERSION 2
+
+GcodeCompiler::GcodeCompiler()
+{
+    fp = nullptr;
+    pos = 0;
+    motion_lines = 0;
+    text_lines = 0;
+    pending_len = 0;
+    discard = false;
+    failed = false;
+}
+
+bool GcodeCompiler::begin(const std::string& p)
+{
+    cancel();
+
+    path = p;
+    fp = fopen(path.c_str(), "wb");
+    if(fp == nullptr) return false;
+
+    // marked incomplete until finish() so a partial file is never played
+    uint32_t header[4] = {COMPILED_GCODE_MAGIC, COMPILED_GCODE_VERSION, 0, 0};
+    SourceStamp stamp;
+    if(fwrite(header, sizeof(uint32_t), 4, fp) != 4 || fwrite(&stamp, sizeof(stamp), 1, fp) != 1) {
+        cancel();
+        return false;
+    }
+
+    pos = 0;
+    motion_lines = 0;
+    text_lines = 0;
+    pending_len = 0;
+    discard = false;
+    failed = false;
+    return true;
+}
+
+// follows what Player::on_main_loop does with each line, so only lines it would send end up in the compiled file
+void GcodeCompiler::add_line(const char *line, size_t len)
+{
+    if(fp == nullptr || len == 0) return;
+    pos += len;
+
+    if(pending_len > 0) {
+        // more followed the line without a newline, so it was the start of a long line which is discarded
+        pending_len = 0;
+        discard = true;
+    }
+
+    if(line[len - 1] != '\n') {
+        memcpy(pending, line, len);
+        pending_len = len;
+        return;
+    }
+
+    if(discard) { // the rest of a long line
+        discard = false;
+        return;
+    }
+    if(len == 1) return; // empty line
+
+    write_line(line, len);
+}
+
+void GcodeCompiler::write_line(const char *line, size_t len)
+{
+    CompiledLine cl;
+    uint8_t hdr[2] = {COMPILED_TEXT, (uint8_t)len};
+    bool ok;
+
+    if(parse_motion(line, len, cl)) {
+        int n = 0;
+        for (int i = 0; i < 26; ++i) {
+            if(cl.letters & (1 << i)) n++;
+        }
+        hdr[0] = COMPILED_MOTION | cl.g;
+        ok = fwrite(hdr, 1, 2, fp) == 2 && fwrite(&cl.letters, sizeof(uint32_t), 1, fp) == 1 &&
+             fwrite(cl.values, sizeof(float), n, fp) == (size_t)n;
+        motion_lines++;
+
+    } else {
+        ok = fwrite(hdr, 1, 2, fp) == 2 && fwrite(line, 1, len, fp) == len;
+        text_lines++;
+    }
+
+    if(!ok) failed = true;
+}
+
+bool GcodeCompiler::finish(uint32_t file_size, const SourceStamp& stamp)
+{
+    if(fp == nullptr) return false;
+
+    // the last line of the file does not need a newline
+    if(pending_len > 0) {
+        if(!discard && pending_len > 1) write_line(pending, pending_len);
+        pending_len = 0;
+    }
+
+    // if we did not see the whole file it can not be played from this
+    if(failed || pos != file_size) {
+        cancel();
+        return false;
+    }
+
+    uint32_t header[4] = {COMPILED_GCODE_MAGIC, COMPILED_GCODE_VERSION, file_size, 1};
+    if(fseek(fp, 0, SEEK_SET) != 0 || fwrite(header, sizeof(uint32_t), 4, fp) != 4 || fwrite(&stamp, sizeof(stamp), 1, fp) != 1) {
+        cancel();
+        return false;
+    }
+    fclose(fp);
+    fp = nullptr;
+    return true;
+}
+
+void GcodeCompiler::cancel()
+{
+    if(fp == nullptr) return;
+
+    fclose(fp);
+    fp = nullptr;
+    remove(path.c_str());
+}
+
+static inline bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Only accepts what is certain to give the same Gcode as the text: a single G0-G3 with plain numbers and no
+// repeated letters. Anything GcodeDispatch does more than split the line (G90/G91 moved to the front, G53,
+// modal lines without a G, several commands) or that Gcode would evaluate (expressions, variables) stays text.
+bool GcodeCompiler::parse_motion(const char *line, size_t len, CompiledLine& cl)
+{
+    const char *p = line;
+    const char *end = line + len;
+
+    // GcodeDispatch checks for these before stripping comments
+    for (const char *s = line; s + 3 <= end; ++s) {
+        if(s[0] == 'G' && s[1] == '9' && (s[2] == '0' || s[2] == '1')) return false;
+    }
+
+    while(p < end && isspace(*p)) p++;
+    if(p < end && *p == 'N') {
+        while(p < end && strchr("N0123456789.,- ", *p) != nullptr) p++;
+    }
+    for (const char *s = p; s < end; ++s) {
+        if(*s == ';' || *s == '(') {
+            end = s;
+            break;
+        }
+    }
+
+    if(p >= end || *p++ != 'G' || p >= end || !isdigit(*p)) return false;
+    unsigned int g = 0;
+    while(p < end && isdigit(*p)) {
+        g = g * 10 + (*p++ - '0');
+        if(g > 3) return false;
+    }
+    if(p < end && !is_blank(*p) && !(*p >= 'A' && *p <= 'Z')) return false; // subcode or junk
+
+    cl.type = COMPILED_MOTION;
+    cl.g = g;
+    cl.len = len;
+    cl.letters = 0;
+
+    float values[26];
+    while(true) {
+        while(p < end && is_blank(*p)) p++;
+        if(p >= end) break;
+
+        char c = *p++;
+        if(c < 'A' || c > 'Z' || c == 'G' || c == 'M' || c == 'T' || c == 'N') return false;
+        uint32_t bit = 1 << (c - 'A');
+        if(cl.letters & bit) return false;
+
+        while(p < end && (*p == ' ' || *p == '\t')) p++;
+        const char *num = p;
+        if(p < end && (*p == '-' || *p == '+')) p++;
+        bool digits = false;
+        while(p < end && isdigit(*p)) { p++; digits = true; }
+        if(p < end && *p == '.') {
+            p++;
+            while(p < end && isdigit(*p)) { p++; digits = true; }
+        }
+        if(!digits || p - num > 31) return false;
+
+        // the next thing has to be another word, not an operator or anything else Gcode would try to evaluate
+        const char *q = p;
+        while(q < end && is_blank(*q)) q++;
+        if(q < end && !(*q >= 'A' && *q <= 'Z')) return false;
+
+        char tmp[32];
+        memcpy(tmp, num, p - num);
+        tmp[p - num] = '\0';
+        values[c - 'A'] = strtof(tmp, nullptr);
+        cl.letters |= bit;
+    }
+
+    int n = 0;
+    for (int i = 0; i < 26; ++i) {
+        if(cl.letters & (1 << i)) cl.values[n++] = values[i];
+    }
+    return true;
+}
+
+FILE *CompiledGcode::open(const std::string& path, uint32_t file_size, const SourceStamp& stamp)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if(f == nullptr) return nullptr;
+
+    uint32_t header[4];
+    SourceStamp compiled_from;
+    if(fread(header, sizeof(uint32_t), 4, f) != 4 || header[0] != COMPILED_GCODE_MAGIC || header[1] != COMPILED_GCODE_VERSION ||
+       header[2] != file_size || header[3] != 1 || fread(&compiled_from, sizeof(compiled_from), 1, f) != 1 || !(compiled_from == stamp)) {
+        fclose(f);
+        return nullptr;
+    }
+    return f;
+}
+
+bool CompiledGcode::read(ReadAheadFile& reader, CompiledLine& cl)
+{
+    uint8_t hdr[2];
+    if(reader.read(hdr, 2) != 2 || hdr[1] == 0 || hdr[1] >= sizeof(cl.text)) return false;
+    cl.len = hdr[1];
+
+    if(hdr[0] & COMPILED_MOTION) {
+        cl.type = COMPILED_MOTION;
+        cl.g = hdr[0] & ~COMPILED_MOTION;
+        if(reader.read(&cl.letters, sizeof(uint32_t)) != sizeof(uint32_t)) return false;
+        size_t n = 0;
+        for (int i = 0; i < 26; ++i) {
+            if(cl.letters & (1 << i)) n++;
+        }
+        return reader.read(cl.values, n * sizeof(float)) == n * sizeof(float);
+    }
+
+    cl.type = COMPILED_TEXT;
+    if(reader.read(cl.text, cl.len) != cl.len) return false;
+    cl.text[cl.len] = '\0';
+    return true;
+}
+
+void CompiledGcode::dispatch(const CompiledLine& cl, StreamOutput *stream, unsigned int line)
+{
+    Gcode gcode(cl.g, cl.letters, cl.values, stream, line);
+
+    // a following line with just coordinates or a G53 uses this
+    THEKERNEL->gcode_dispatch->set_modal_command(cl.g);
+    THEKERNEL->call_event(ON_GCODE_RECEIVED, &gcode);
+
+    if (gcode.is_error) {
+        // same as GcodeDispatch, we cannot continue safely after an error so we enter HALT state
+        stream->printf(THEKERNEL->is_grbl_mode() ? "error:" : "Error: ");
+        stream->printf("%s\r\n", gcode.txt_after_ok.empty() ? "unknown" : gcode.txt_after_ok.c_str());
+        stream->printf("Entering Alarm/Halt state\n");
+        THEKERNEL->call_event(ON_HALT, nullptr);
+    }
+}
@@ -0,0 +1,85 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+#include "SourceStamp.h"
+
+class ReadAheadFile;
+class StreamOutput;
+
+// Compiled gcode files, kept in /sd/gcodes/.gcb/ next to the .md5 sidecar.
+// A compiled file holds one record per line the Player would send from the text file, in the same order.
+// Plain G0-G3 lines are stored already parsed (the G number and a binary value per word) and are sent straight to
+// the modules as a Gcode, which skips GcodeDispatch and all the string handling. Anything else (M codes, expressions,
+// several commands on a line...) is stored as the text line and goes through GcodeDispatch as usual.
+// Each record also holds the length of its source line so progress and played lines stay the same as for the text.
+//
+// header: magic, version, size of the source file, complete flag, all uint32_t, then the source's SourceStamp
+// text record: COMPILED_TEXT, source length, the source line
+// motion record: COMPILED_MOTION | g, source length, letters (uint32_t, bit 0 is A), one float per letter set
+#define COMPILED_GCODE_HEADER_SIZE (16 + sizeof(SourceStamp))
+#define COMPILED_TEXT   0x01
+#define COMPILED_MOTION 0x80
+
+struct CompiledLine {
+    uint8_t type;           // COMPILED_TEXT or COMPILED_MOTION
+    uint8_t g;
+    uint8_t len;            // length of the source line
+    uint32_t letters;
+    float values[26];       // in letter order, only as many as letters are set
+    char text[130];         // the source line for a text record
+};
+
+class GcodeCompiler {
+    public:
+        GcodeCompiler();
+        ~GcodeCompiler() { cancel(); }
+
+        // start writing a compiled file to path, the source is then added a line at a time from its start
+        bool begin(const std::string& path);
+        // one line of the source as returned by fgets into a 130 byte buffer
+        void add_line(const char *line, size_t len);
+        // the whole source has been added, marks the compiled file as usable for this version of it
+        bool finish(uint32_t file_size, const SourceStamp& stamp);
+        // throw away a compiled file that was not finished
+        void cancel();
+
+        uint32_t get_motion_lines() const { return motion_lines; }
+        uint32_t get_text_lines() const { return text_lines; }
+
+        // parse a line the way GcodeDispatch and Gcode would, false if it is not a plain G0-G3 command
+        static bool parse_motion(const char *line, size_t len, CompiledLine& cl);
+
+    private:
+        void write_line(const char *line, size_t len);
+
+        std::string path;
+        FILE *fp;
+        uint32_t pos;
+        uint32_t motion_lines;
+        uint32_t text_lines;
+        char pending[130];      // the last line if it had no newline, it is a long line unless it ends the file
+        uint8_t pending_len;
+        struct {
+            bool discard:1;
+            bool failed:1;
+        };
+};
+
+namespace CompiledGcode {
+    // open a compiled file if it is complete and was compiled from this version of the file, positioned at the first record
+    FILE *open(const std::string& path, uint32_t file_size, const SourceStamp& stamp);
+    // read the next record, false at the end of the file
+    bool read(ReadAheadFile& reader, CompiledLine& cl);
+    // send a motion record to the modules like GcodeDispatch would
+    void dispatch(const CompiledLine& cl, StreamOutput *stream, unsigned int line);
+}
@@ -0,0 +1,677 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "JobEstimate.h"
+
+#include "libs/Kernel.h"
+#include "libs/StreamOutput.h"
+#include "Gcode.h"
+#include "Robot.h"
+#include "Planner.h"
+#include "Conveyor.h"
+#include "Block.h"
+#include "StepperMotor.h"
+#include "StepTicker.h"
+#include "BaseSolution.h"
+#include "ArcSegments.h"
+#include "CubicBezier.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+
+#define PI 3.14159265358979323846F // force to be float, do not use M_PI
+
+static_assert(ESTIMATE_MAX_WCS == MAX_WCS, "the estimate keeps an offset for each of the Robot's WCS");
+
+JobEstimate::JobEstimate()
+{
+    tool_count = 0;
+    rapid = cutting = dwell = 0;
+    blocks = tool_changes = untimed = 0;
+}
+
+bool JobEstimate::begin()
+{
+    // what is left of an estimate that was not finished
+    while(!queue.is_empty()) queue.consume_tail();
+    if(!queue.resize(THECONVEYOR->get_queue_size(), false)) return false;
+
+    Robot *robot = THEROBOT;
+    size_t n = std::min((size_t)robot->n_motors, (size_t)ESTIMATE_AXES);
+    for (size_t i = 0; i < n; ++i) last_steps[i] = robot->actuators[i]->get_last_milestone_steps();
+    memset(previous_unit_vec, 0, sizeof(previous_unit_vec));
+    previous_nominal_speed = 0;
+
+    robot->get_axis_position(position, ESTIMATE_AXES);
+    for (size_t i = 0; i < MAX_WCS; ++i) {
+        std::tie(wcs_offsets[i][X_AXIS], wcs_offsets[i][Y_AXIS], wcs_offsets[i][Z_AXIS], wcs_offsets[i][A_AXIS], wcs_offsets[i][B_AXIS]) = robot->wcs_offsets[i];
+    }
+    std::tie(g92_offset[X_AXIS], g92_offset[Y_AXIS], g92_offset[Z_AXIS], g92_offset[A_AXIS], g92_offset[B_AXIS]) = robot->g92_offset;
+    std::tie(tool_offset[X_AXIS], tool_offset[Y_AXIS], tool_offset[Z_AXIS], tool_offset[A_AXIS], tool_offset[B_AXIS]) = robot->tool_offset;
+    current_wcs = robot->current_wcs;
+    update_offset();
+
+    feed_rate = robot->feed_rate;
+    seek_rate = robot->seek_rate;
+    motion = 0;
+    spline_open = false;
+    plane[0] = robot->plane_axis_0;
+    plane[1] = robot->plane_axis_1;
+    plane[2] = robot->plane_axis_2;
+    // Player plays a file in absolute mode
+    absolute_mode = true;
+    inch_mode = robot->inch_mode;
+
+    rapid = cutting = dwell = 0;
+    blocks = tool_changes = untimed = 0;
+    next_tool = -1;
+    tool_count = 1;
+    tools[0].tool = -1;
+    tools[0].time = 0;
+    current_tool = 0;
+    return true;
+}
+
+// the first of chars in [s, end), or end if there is none
+static const char *find_first_of(const char *s, const char *end, const char *chars)
+{
+    for (; s < end; ++s) {
+        if(strchr(chars, *s) != nullptr) return s;
+    }
+    return end;
+}
+
+// the line is cleaned up and split into commands the way GcodeDispatch::on_console_line_received() does it
+void JobEstimate::add_line(const char *line, size_t len)
+{
+    while(len > 0 && isspace(line[0])) {
+        line++;
+        len--;
+    }
+    while(len > 0 && isspace(line[len - 1])) len--;
+    if(len == 0) return;
+
+    // a G7 raster line, where its pixels take the laser is not worked out
+    if(toupper(line[0]) == 'G') {
+        size_t i = 1;
+        while(i < len && line[i] == '0') ++i;
+        if(i < len && line[i] == '7' && (i + 1 == len || !isdigit(line[i + 1]))) {
+            flush();
+            untimed++;
+            return;
+        }
+    }
+
+    // lowercase lines are console commands
+    if(islower(line[0])) return;
+
+    const char *p = line;
+    const char *end = line + len;
+    if(*p == 'N') {
+        while(p < end && strchr("N0123456789.,- ", *p) != nullptr) p++;
+    }
+    end = find_first_of(p, end, ";(");
+    if(p == end) return;
+
+    // a line of just words moves with the last G0-G3, or is a G1 if it starts with F
+    char buf[144];
+    size_t n = 0;
+    if(strchr("XYZAF", *p) != nullptr) {
+        n = snprintf(buf, sizeof(buf), "G%d ", *p == 'F' ? 1 : motion);
+    } else if(strchr("GMTS", *p) == nullptr) {
+        return;
+    }
+    size_t rest = std::min((size_t)(end - p), sizeof(buf) - n - 1);
+    memcpy(buf + n, p, rest);
+    n += rest;
+    buf[n] = '\0';
+
+    // G90 or G91 goes first whatever else is on the line
+    if(buf[0] == 'G') {
+        char *g9 = strstr(buf, "G90");
+        if(g9 == nullptr) g9 = strstr(buf, "G91");
+        if(g9 != nullptr) {
+            char mode[3];
+            memcpy(mode, g9, 3);
+            memmove(buf + 3, buf, g9 - buf);
+            memcpy(buf, mode, 3);
+        }
+    }
+
+    end = buf + n;
+    const char *cmd_end = buf;
+    while(cmd_end < end) {
+        const char *cmd_start = cmd_end;
+        const char *from = std::min(cmd_start + 2, end);
+        const char *next = end;
+        if(*cmd_start == 'G') {
+            bool s_and_m = find_first_of(from, end, "S") != end && find_first_of(from, end, "M") != end;
+            next = find_first_of(from, end, s_and_m ? "GMST" : "GMT");
+        } else if(*cmd_start == 'M') {
+            next = find_first_of(from, end, "GM");
+        } else if(*cmd_start == 'T' || *cmd_start == 'S') {
+            const char *m = find_first_of(from, end, "M");
+            next = m == end ? find_first_of(from, end, "GST") : find_first_of(std::min(m + 2, end), end, "GMST");
+        }
+        cmd_end = next;
+
+        Gcode gcode(cmd_start, cmd_end - cmd_start, &StreamOutput::NullStream, false);
+        bool mcs = false;
+        if(gcode.has_g && gcode.g == 53) {
+            // the G0 or G1 after it on the line, or the last G0-G3 with the words of the G53
+            if(cmd_end == end) {
+                gcode.g = motion;
+            } else {
+                gcode = Gcode(cmd_end, end - cmd_end, &StreamOutput::NullStream);
+                cmd_end = end;
+                if(!gcode.has_g || gcode.g > 1) continue;
+            }
+            mcs = true;
+        }
+        if(gcode.has_g && gcode.g < 4) motion = gcode.g;
+        if(gcode.has_m && (gcode.m == 2 || (gcode.m == 30 && THEKERNEL->is_grbl_mode()))) motion = 1;
+
+        command(gcode, mcs);
+    }
+}
+
+void JobEstimate::command(Gcode& gcode, bool mcs)
+{
+    if(gcode.has_m) {
+        if(gcode.has_letter('T')) next_tool = gcode.get_int('T');
+        if(gcode.m == 6) {
+            // the machine stops for a tool change, it is not known how long the change itself takes
+            flush();
+            tool_changes++;
+            untimed++;
+            use_tool(next_tool);
+        }
+        return;
+    }
+    if(!gcode.has_g) {
+        if(gcode.has_letter('T')) next_tool = gcode.get_int('T');
+        return;
+    }
+
+    switch(gcode.g) {
+        case 0: case 1: case 2: case 3: case 5:
+            move(gcode, mcs);
+            break;
+
+        case 4: {
+            // the same as Robot, a dwell waits for the queue to run dry first
+            uint32_t delay_ms = 0;
+            if(gcode.has_letter('P')) delay_ms = THEKERNEL->is_grbl_mode() ? gcode.get_value('P') * 1000.0F : gcode.get_int('P');
+            if(gcode.has_letter('S')) delay_ms += gcode.get_int('S') * 1000;
+            if(delay_ms > 0) {
+                flush();
+                dwell += delay_ms / 1000.0;
+                tools[current_tool].time += delay_ms / 1000.0;
+            }
+            break;
+        }
+
+        case 10:
+            set_wcs(gcode);
+            break;
+
+        case 17: plane[0] = X_AXIS; plane[1] = Y_AXIS; plane[2] = Z_AXIS; break;
+        case 18: plane[0] = X_AXIS; plane[1] = Z_AXIS; plane[2] = Y_AXIS; break;
+        case 19: plane[0] = Y_AXIS; plane[1] = Z_AXIS; plane[2] = X_AXIS; break;
+        case 20: inch_mode = true; break;
+        case 21: inch_mode = false; break;
+
+        case 28: case 30: case 32: case 38:
+            // homing, probing and moving to a stored position, where they leave the machine is not known
+            flush();
+            untimed++;
+            break;
+
+        case 54: case 55: case 56: case 57: case 58: case 59:
+            current_wcs = gcode.g - 54;
+            if(gcode.g == 59 && gcode.subcode > 0) current_wcs = std::min(current_wcs + gcode.subcode, (int)MAX_WCS - 1);
+            update_offset();
+            break;
+
+        case 90: absolute_mode = true; break;
+        case 91: absolute_mode = false; break;
+
+        case 92:
+            set_g92(gcode);
+            break;
+    }
+}
+
+// G10 L2 and L20 as Robot::on_gcode_received() sets the offsets
+void JobEstimate::set_wcs(const Gcode& gcode)
+{
+    if(!gcode.has_letter('L') || (gcode.get_int('L') != 2 && gcode.get_int('L') != 20) || !gcode.has_letter('P')) return;
+    size_t n = gcode.get_uint('P');
+    if(n == 0) n = current_wcs;
+    else --n;
+    if(n >= MAX_WCS) return;
+
+    // setting Z clears the tool offset
+    if(gcode.has_letter('Z')) memset(tool_offset, 0, sizeof(tool_offset));
+
+    float *wcs = wcs_offsets[n];
+    for (int i = 0; i < ESTIMATE_AXES; ++i) {
+        char letter = i <= Z_AXIS ? 'X' + i : 'A' + i - A_AXIS;
+        if(!gcode.has_letter(letter)) continue;
+        // A and B are in degrees, never inches
+        float v = i <= Z_AXIS ? to_mm(gcode.get_value(letter)) : gcode.get_value(letter);
+        if(gcode.get_int('L') == 2) {
+            wcs[i] = v;
+        } else if(i <= Z_AXIS) {
+            // the machine position becomes v
+            wcs[i] = position[i] - v;
+        } else {
+            wcs[i] -= v - (position[i] - wcs[i] + g92_offset[i] - tool_offset[i]);
+        }
+    }
+    update_offset();
+}
+
+// G92 as Robot::on_gcode_received() sets the offset, and G92.4 which sets the machine position
+void JobEstimate::set_g92(const Gcode& gcode)
+{
+    if(gcode.subcode == 1 || gcode.subcode == 2 || gcode.get_num_args() == 0) {
+        memset(g92_offset, 0, sizeof(g92_offset));
+
+    } else if(gcode.subcode == 4) {
+        // a manual homing, A with R or S turns it to the other side of the turn first
+        flush();
+        if(gcode.has_letter('A') && (gcode.has_letter('R') || gcode.has_letter('S'))) {
+            untimed++;
+            return;
+        }
+        for (int i = 0; i <= A_AXIS; ++i) {
+            char letter = i <= Z_AXIS ? 'X' + i : 'A';
+            if(gcode.has_letter(letter)) position[i] = gcode.get_value(letter);
+        }
+        // the next block starts from there
+        ActuatorCoordinates actuator_pos;
+        to_actuators(position, actuator_pos);
+        size_t n = std::min((size_t)THEROBOT->n_motors, (size_t)ESTIMATE_AXES);
+        for (size_t i = 0; i < n; ++i) last_steps[i] = lroundf(actuator_pos[i] * THEROBOT->actuators[i]->get_steps_per_mm());
+        return;
+
+    } else if(gcode.subcode == 3) {
+        for (int i = 0; i < ESTIMATE_AXES; ++i) {
+            char letter = i <= Z_AXIS ? 'X' + i : 'A' + i - A_AXIS;
+            g92_offset[i] = gcode.has_letter(letter) ? gcode.get_value(letter) : 0;
+        }
+
+    } else if(gcode.subcode == 0) {
+        // the current work position becomes the value
+        for (int i = 0; i < ESTIMATE_AXES; ++i) {
+            char letter = i <= Z_AXIS ? 'X' + i : 'A' + i - A_AXIS;
+            if(!gcode.has_letter(letter)) continue;
+            float v = i <= Z_AXIS ? to_mm(gcode.get_value(letter)) : gcode.get_value(letter);
+            g92_offset[i] += v - (position[i] - wcs_offsets[current_wcs][i] + g92_offset[i] - tool_offset[i]);
+        }
+    }
+    update_offset();
+}
+
+// what Robot::process_move adds to an absolute target
+void JobEstimate::update_offset()
+{
+    for (int i = 0; i < ESTIMATE_AXES; ++i) offset[i] = wcs_offsets[current_wcs][i] - g92_offset[i] + tool_offset[i];
+}
+
+// the target Robot::process_move works out for a G0-G3 or G5 and how it is cut into segments
+void JobEstimate::move(Gcode& gcode, bool mcs)
+{
+    float target[ESTIMATE_AXES];
+    memcpy(target, position, sizeof(target));
+    for (int i = 0; i < ESTIMATE_AXES; ++i) {
+        char letter = i <= Z_AXIS ? 'X' + i : 'A' + i - A_AXIS;
+        if(!gcode.has_letter(letter)) continue;
+        // A and B are in degrees, never inches
+        float v = i <= Z_AXIS ? to_mm(gcode.get_value(letter)) : gcode.get_value(letter);
+        if(mcs) target[i] = ROUND_NEAR_HALF(v);
+        else if(absolute_mode) target[i] = ROUND_NEAR_HALF(v + offset[i]);
+        else target[i] = ROUND_NEAR_HALF(v + position[i]);
+    }
+
+    if(gcode.has_letter('F')) {
+        if(gcode.g == 0) seek_rate = to_mm(gcode.get_value('F'));
+        else feed_rate = to_mm(gcode.get_value('F'));
+    }
+
+    float arc_offset[3] = {0, 0, 0};
+    for (char letter = 'I'; letter <= 'K'; letter++) {
+        if(gcode.has_letter(letter)) arc_offset[letter - 'I'] = to_mm(gcode.get_value(letter));
+    }
+
+    bool g5 = false;
+    switch(gcode.g) {
+        case 0: case 1:
+            line(target, gcode.g == 0, gcode.has_letter('X') || gcode.has_letter('Y'));
+            break;
+
+        case 2: case 3:
+            arc(target, arc_offset, gcode.g == 2);
+            break;
+
+        case 5: {
+            bool has_ij = gcode.has_letter('I') || gcode.has_letter('J');
+            // the Robot does not take it either
+            if(plane[0] != X_AXIS || plane[1] != Y_AXIS || !gcode.has_letter('P') || !gcode.has_letter('Q') || (!has_ij && !spline_open)) break;
+            float control[2] = {to_mm(gcode.get_value('P')), to_mm(gcode.get_value('Q'))};
+            spline(target, has_ij ? arc_offset : nullptr, control);
+            g5 = true;
+            break;
+        }
+    }
+    spline_open = g5;
+}
+
+// cut the same as Robot::append_line, but not at where the compensation changes slope as there is none here
+void JobEstimate::line(const float target[], bool rapid, bool xy)
+{
+    Robot *robot = THEROBOT;
+    float rate_mm_s = (rapid ? seek_rate : feed_rate) / robot->get_seconds_per_minute();
+    // the Robot raises an alarm
+    if(rate_mm_s <= 0.0F) return;
+
+    float millimeters_of_travel = sqrtf(powf(target[X_AXIS] - position[X_AXIS], 2) + powf(target[Y_AXIS] - position[Y_AXIS], 2) + powf(target[Z_AXIS] - position[Z_AXIS], 2));
+    uint16_t segments = 1;
+    if(millimeters_of_travel < 0.00001F || robot->disable_segmentation || (!robot->segment_z_moves && !xy)) {
+        segments = 1;
+    } else if(robot->delta_segments_per_second > 1.0F) {
+        segments = std::max(1.0F, ceilf(robot->delta_segments_per_second * millimeters_of_travel / rate_mm_s));
+    } else if(robot->mm_per_line_segment != 0.0F) {
+        segments = ceilf(millimeters_of_travel / robot->mm_per_line_segment);
+    }
+
+    if(segments > 1) {
+        float segment_delta[ESTIMATE_AXES];
+        float segment_end[ESTIMATE_AXES];
+        memcpy(segment_end, position, sizeof(segment_end));
+        for (int i = 0; i < ESTIMATE_AXES; i++) segment_delta[i] = (target[i] - position[i]) / segments;
+        for (int i = 1; i < segments; i++) {
+            for (int j = 0; j < ESTIMATE_AXES; j++) segment_end[j] += segment_delta[j];
+            milestone(segment_end, rate_mm_s, !rapid);
+        }
+    }
+    milestone(target, rate_mm_s, !rapid);
+}
+
+// cut the same as Robot::append_arc
+void JobEstimate::arc(const float target[], const float offset[], bool clockwise)
+{
+    Robot *robot = THEROBOT;
+    float rate_mm_s = feed_rate / robot->get_seconds_per_minute();
+    if(rate_mm_s <= 0.0F) return;
+
+    uint8_t p0 = plane[0], p1 = plane[1], p2 = plane[2];
+    float radius = hypotf(offset[p0], offset[p1]);
+    float center0 = position[p0] + offset[p0];
+    float center1 = position[p1] + offset[p1];
+    float linear_travel = target[p2] - position[p2];
+    float r0 = -offset[p0], r1 = -offset[p1];
+    float rt0 = target[p0] - center0, rt1 = target[p1] - center1;
+
+    float angular_travel;
+    if(position[p0] == target[p0] && position[p1] == target[p1]) {
+        // a full circle
+        angular_travel = clockwise ? -2 * PI : 2 * PI;
+    } else {
+        angular_travel = atan2f(r0 * rt1 - r1 * rt0, r0 * rt0 + r1 * rt1);
+        if(p2 == Y_AXIS) clockwise = !clockwise;
+        if(clockwise) {
+            if(angular_travel > 0) angular_travel -= 2 * PI;
+        } else {
+            if(angular_travel < 0) angular_travel += 2 * PI;
+        }
+    }
+
+    float millimeters_of_travel = hypotf(angular_travel * radius, fabsf(linear_travel));
+    if(millimeters_of_travel < 0.000001F) return;
+
+    float acceleration = INFINITY;
+    const uint8_t axes[2] = {p0, p1};
+    for (uint8_t i : axes) {
+        float ma = robot->actuators[i]->get_acceleration();
+        acceleration = std::min(acceleration, isnan(ma) ? robot->get_default_acceleration() : ma);
+    }
+    float arc_segment = arc_segment_length(radius, robot->mm_max_arc_error, robot->mm_per_arc_segment, rate_mm_s, acceleration, robot->arc_segments_per_second);
+    uint16_t segments = ceilf(millimeters_of_travel / arc_segment);
+
+    if(segments > 1) {
+        float theta_per_segment = angular_travel / segments;
+        float linear_per_segment = linear_travel / segments;
+        ArcRotation rotation(r0, r1, theta_per_segment);
+        float arc_target[ESTIMATE_AXES];
+        memcpy(arc_target, position, sizeof(arc_target));
+        for (uint16_t i = 1; i < segments; i++) {
+            rotation.step(r0, r1);
+            arc_target[p0] = center0 + r0;
+            arc_target[p1] = center1 + r1;
+            arc_target[p2] += linear_per_segment;
+            milestone(arc_target, rate_mm_s, true);
+        }
+    }
+    milestone(target, rate_mm_s, true);
+}
+
+// cut the same as Robot::append_spline, offset is I J or nullptr to carry on from the last G5
+void JobEstimate::spline(const float target[], const float *offset, const float control[])
+{
+    Robot *robot = THEROBOT;
+    float rate_mm_s = feed_rate / robot->get_seconds_per_minute();
+    if(rate_mm_s <= 0.0F) return;
+
+    float p0[2] = {position[X_AXIS], position[Y_AXIS]};
+    float p1[2];
+    if(offset != nullptr) {
+        p1[0] = p0[0] + offset[0];
+        p1[1] = p0[1] + offset[1];
+    } else {
+        p1[0] = p0[0] - spline_control[0];
+        p1[1] = p0[1] - spline_control[1];
+    }
+    spline_control[0] = control[0];
+    spline_control[1] = control[1];
+    float p2[2] = {target[X_AXIS] + control[0], target[Y_AXIS] + control[1]};
+    float p3[2] = {target[X_AXIS], target[Y_AXIS]};
+    CubicBezier curve(p0, p1, p2, p3);
+
+    float tolerance = robot->mm_max_arc_error;
+    float min_length = robot->mm_per_arc_segment;
+    if(tolerance <= 0 && min_length < 0.0001F) min_length = 0.5F;
+
+    float start[ESTIMATE_AXES], point[ESTIMATE_AXES];
+    memcpy(start, position, sizeof(start));
+    float t = curve.next(0, tolerance, min_length);
+    while(t < 1) {
+        curve.point(t, point);
+        for (int i = Z_AXIS; i < ESTIMATE_AXES; ++i) point[i] = start[i] + (target[i] - start[i]) * t;
+        milestone(point, rate_mm_s, true);
+        t = curve.next(t, tolerance, min_length);
+    }
+    milestone(target, rate_mm_s, true);
+}
+
+// where the actuators go for a machine position, as Robot::append_milestone works it out
+void JobEstimate::to_actuators(const float target[], ActuatorCoordinates& actuator_pos) const
+{
+    Robot *robot = THEROBOT;
+    if(!robot->disable_arm_solution) {
+        robot->arm_solution->cartesian_to_actuator(target, actuator_pos);
+    } else {
+        for (size_t i = X_AXIS; i <= Z_AXIS; i++) actuator_pos[i] = target[i];
+    }
+    for (size_t i = A_AXIS; i < std::min((size_t)robot->n_motors, (size_t)ESTIMATE_AXES); i++) actuator_pos[i] = target[i];
+}
+
+// the limits Robot::append_milestone puts on a move
+void JobEstimate::milestone(const float target[], float rate_mm_s, bool g123)
+{
+    Robot *robot = THEROBOT;
+    size_t n_motors = std::min((size_t)robot->n_motors, (size_t)ESTIMATE_AXES);
+
+    float deltas[ESTIMATE_AXES];
+    bool moved = false;
+    float sos = 0;
+    for (size_t i = 0; i < n_motors; ++i) {
+        deltas[i] = target[i] - position[i];
+        if(fabsf(deltas[i]) < 0.00001F) continue;
+        moved = true;
+        if(i < N_PRIMARY_AXIS) sos += powf(deltas[i], 2);
+    }
+    if(!moved) return;
+
+    bool auxilliary_move = true;
+    for (int i = 0; i < N_PRIMARY_AXIS; ++i) {
+        if(fabsf(deltas[i]) >= 0.00001F) auxilliary_move = false;
+    }
+    float distance = auxilliary_move ? 0 : sqrtf(sos);
+    if(!auxilliary_move && distance < 0.00001F) return;
+
+    float unit_vec[N_PRIMARY_AXIS];
+    if(!auxilliary_move) {
+        for (size_t i = X_AXIS; i < N_PRIMARY_AXIS; i++) {
+            unit_vec[i] = deltas[i] / distance;
+            if(i <= Z_AXIS && robot->max_speeds[i] > 0) {
+                float axis_speed = fabsf(unit_vec[i] * rate_mm_s);
+                if(axis_speed > robot->max_speeds[i]) rate_mm_s *= robot->max_speeds[i] / axis_speed;
+            }
+        }
+        if(robot->max_speed > 0 && rate_mm_s > robot->max_speed) rate_mm_s = robot->max_speed;
+    }
+
+    ActuatorCoordinates actuator_pos;
+    to_actuators(target, actuator_pos);
+    if(auxilliary_move) {
+        // a rotary only move, the Robot's conversion of its speed to the surface speed is not followed
+        sos = 0;
+        for (size_t i = A_AXIS; i < n_motors; i++) sos += powf(deltas[i], 2);
+        distance = sqrtf(sos);
+        if(distance < 0.00001F) return;
+    }
+
+    float acceleration = INFINITY;
+    bool all_limited = true;
+    for (size_t i = 0; i < n_motors; ++i) {
+        float d = fabsf(deltas[i]);
+        StepperMotor *actuator = robot->actuators[i];
+        if(d < 0.00001F || !actuator->is_selected()) continue;
+        float actuator_rate = d * rate_mm_s / distance;
+        if(actuator_rate > actuator->get_max_rate()) rate_mm_s *= actuator->get_max_rate() / actuator_rate;
+
+        float ma = actuator->get_acceleration();
+        if(isnan(ma)) {
+            all_limited = false;
+            continue;
+        }
+        if(i == A_AXIS && !auxilliary_move) ma *= A_AXIS_COMBINED_ACCELERATION;
+        acceleration = std::min(acceleration, ma * distance / d);
+    }
+    float default_acceleration = robot->get_default_acceleration();
+    if(!all_limited) acceleration = std::min(acceleration, default_acceleration);
+    else if(isinf(acceleration)) acceleration = default_acceleration;
+
+    queue_block(actuator_pos, distance, rate_mm_s, acceleration, auxilliary_move ? nullptr : unit_vec, g123);
+    memcpy(position, target, sizeof(position));
+}
+
+// the block Planner::append_block() would queue, planned the same way
+void JobEstimate::queue_block(const ActuatorCoordinates& actuator_pos, float millimeters, float rate_mm_s, float acceleration, const float *unit_vec, bool g123)
+{
+    Planner *planner = THEKERNEL->planner;
+    size_t n_motors = std::min((size_t)THEROBOT->n_motors, (size_t)ESTIMATE_AXES);
+
+    Block *block = queue.head_ref();
+    block->clear();
+    bool has_steps = false;
+    for (size_t i = 0; i < n_motors; i++) {
+        int32_t target_steps = lroundf(actuator_pos[i] * THEROBOT->actuators[i]->get_steps_per_mm());
+        int32_t steps = target_steps - last_steps[i];
+        if(steps != 0) {
+            last_steps[i] = target_steps;
+            has_steps = true;
+        }
+        block->steps[i] = labs(steps);
+    }
+    // the move is carried on to the next one, as on the machine
+    if(!has_steps) return;
+
+    block->is_g123 = g123;
+    float junction_deviation = planner->block_junction_deviation(block);
+    block->acceleration = planner->planned_acceleration(acceleration);
+    block->s_curve = planner->max_jerk > 0 && !planner->input_shaping;
+    block->steps_event_count = *std::max_element(block->steps.begin(), block->steps.end());
+    block->millimeters = millimeters;
+    block->nominal_speed = rate_mm_s;
+    block->nominal_rate = block->steps_event_count * rate_mm_s / millimeters;
+
+    float vmax_junction = planner->minimum_planner_speed;
+    if(unit_vec != nullptr && !queue.is_empty()) {
+        vmax_junction = planner->junction_speed(previous_unit_vec, previous_nominal_speed, unit_vec, rate_mm_s, acceleration, junction_deviation);
+    }
+    planner->set_entry_speed(block, vmax_junction);
+
+    if(unit_vec != nullptr) memcpy(previous_unit_vec, unit_vec, sizeof(previous_unit_vec));
+    else memset(previous_unit_vec, 0, sizeof(previous_unit_vec));
+    previous_nominal_speed = block->primary_axis ? rate_mm_s : 0;
+
+    planner->recalculate(queue);
+    // the oldest block has to run to make room, as on the machine the queue only takes the new block once it has
+    while(queue.is_full()) retire();
+    queue.produce_head();
+    blocks++;
+}
+
+// The oldest block runs, it takes the ticks its trapezoid was last planned with and the block after it starts to
+// run, from then on it is not planned again
+void JobEstimate::retire()
+{
+    Block *block = queue.tail_ref();
+    double t = block->total_move_ticks / (double)THEKERNEL->step_ticker->get_frequency();
+    if(block->is_g123) cutting += t;
+    else rapid += t;
+    tools[current_tool].time += t;
+
+    queue.consume_tail();
+    if(!queue.is_empty()) queue.tail_ref()->is_ticking = true;
+}
+
+// run the queue dry, the machine comes to a stop
+void JobEstimate::flush()
+{
+    while(!queue.is_empty()) retire();
+    previous_nominal_speed = 0;
+}
+
+void JobEstimate::finish()
+{
+    flush();
+    queue.resize(0);
+}
+
+void JobEstimate::use_tool(int tool)
+{
+    for (uint8_t i = 0; i < tool_count; ++i) {
+        if(tools[i].tool == tool) {
+            current_tool = i;
+            return;
+        }
+    }
+    if(tool_count < ESTIMATE_MAX_TOOLS) {
+        tools[tool_count].tool = tool;
+        tools[tool_count].time = 0;
+        tool_count++;
+    }
+    current_tool = tool_count - 1;
+}
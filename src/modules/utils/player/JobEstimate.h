@@ -0,0 +1,120 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "ActuatorCoordinates.h"
+#include "BlockQueue.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Gcode;
+
+// tools the time is split between, the rest all count as the last one
+#define ESTIMATE_MAX_TOOLS 16
+// G0-G3 go to X, Y, Z, A and B
+#define ESTIMATE_AXES 5
+// G54 to G59.3, the Robot's MAX_WCS
+#define ESTIMATE_MAX_WCS 9
+
+// How long a gcode file takes to run, worked out without running it. The lines are split into commands where
+// GcodeDispatch splits them and parsed into Gcodes, each move gets the limits the Robot puts on it (feed and seek
+// rates, axis and actuator speeds, per actuator accelerations) and is cut into the same line, arc and spline segments.
+// The blocks are filled in and planned by the Planner the way it plans the Robot's, each takes the ticks
+// Block::calculate_trapezoid() works out for it, but they go in a queue of their own that is as long as the
+// Conveyor's and has no tick info, so nothing is queued for the step ticker and no module other than this sees the
+// lines. The oldest block runs when the queue is full, from then on it is not planned again, as on the machine.
+//
+// It follows G0-G3, G5, G4, G10 L2/L20, G17-G19, G20/G21, G53-G59, G90/G91, G92 and G92.4, M6 T to split the time
+// between tools and the G4 and M6 that make the machine stop. What the machine does for other commands (homing,
+// probing, the tool change itself, waiting for the spindle, G7 raster lines) takes time it does not know about, these
+// are only counted. Segments are not merged (planner_merge_tolerance) nor split for grid compensation. The settings
+// are the Robot's and the Planner's, and the first move starts from where the machine is, with its offsets.
+class JobEstimate {
+    public:
+        JobEstimate();
+
+        // start a new estimate from where the machine is now, with the machine's current settings, false if there is
+        // no memory for the queue
+        bool begin();
+        // one line of the file as returned by fgets into a 130 byte buffer
+        void add_line(const char *line, size_t len);
+        // the whole file has been added, runs the blocks still queued to a stop and frees the queue
+        void finish();
+
+        // all in seconds of machine time
+        double get_total() const { return rapid + cutting + dwell; }
+        double get_rapid() const { return rapid; }
+        double get_cutting() const { return cutting; }
+        double get_dwell() const { return dwell; }
+        uint32_t get_blocks() const { return blocks; }
+        uint32_t get_tool_changes() const { return tool_changes; }
+        // commands whose time is not known, eg G28, G38, M6
+        uint32_t get_untimed() const { return untimed; }
+        // time spent with each tool, the first is the tool the machine had when the file started, -1 if unknown
+        uint8_t get_tool_count() const { return tool_count; }
+        int get_tool(int i) const { return tools[i].tool; }
+        double get_tool_time(int i) const { return tools[i].time; }
+
+    private:
+        void command(Gcode& gcode, bool mcs);
+        void set_wcs(const Gcode& gcode);
+        void set_g92(const Gcode& gcode);
+        void update_offset();
+        void move(Gcode& gcode, bool mcs);
+        void line(const float target[], bool rapid, bool xy);
+        void milestone(const float target[], float rate_mm_s, bool g123);
+        void arc(const float target[], const float offset[], bool clockwise);
+        void spline(const float target[], const float *offset, const float control[]);
+        void to_actuators(const float target[], ActuatorCoordinates& actuator_pos) const;
+        void queue_block(const ActuatorCoordinates& actuator_pos, float millimeters, float rate_mm_s, float acceleration, const float *unit_vec, bool g123);
+        void retire();
+        void flush();
+        void use_tool(int tool);
+        float to_mm(float v) const { return inch_mode ? v * 25.4F : v; }
+
+        // planned like the Conveyor's queue, the oldest block is the one running
+        BlockQueue queue;
+        int32_t last_steps[k_max_actuators];    // where the last block left each actuator
+        float previous_unit_vec[N_PRIMARY_AXIS];
+        float previous_nominal_speed;           // of the last block queued if it moved a primary axis, else 0
+
+        // where the last move left the machine, in machine coordinates
+        float position[ESTIMATE_AXES];
+        float wcs_offsets[ESTIMATE_MAX_WCS][ESTIMATE_AXES];
+        float g92_offset[ESTIMATE_AXES];
+        float tool_offset[ESTIMATE_AXES];
+        float offset[ESTIMATE_AXES];    // work to machine coordinates for the selected WCS
+        uint8_t current_wcs;
+        float feed_rate;            // mm/min
+        float seek_rate;
+        uint8_t motion;             // the last G0-G3, what a line of just words moves with
+        float spline_control[2];    // the last G5's second control point relative to where it ended
+        uint8_t plane[3];           // the plane's two axes and the one square to it
+
+        // summed in double, a long job is millions of blocks of a few ms
+        double rapid;
+        double cutting;
+        double dwell;
+        uint32_t blocks;
+        uint32_t tool_changes;
+        uint32_t untimed;
+        int next_tool;              // from T, taken by M6
+        struct {
+            int tool;
+            double time;
+        } tools[ESTIMATE_MAX_TOOLS];
+        uint8_t tool_count;
+        uint8_t current_tool;       // index into tools
+
+        struct {
+            bool absolute_mode:1;
+            bool inch_mode:1;
+            bool spline_open:1;     // the last move was a G5, the next G5 can leave out I J
+        };
+};
@@ -0,0 +1,179 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LaserCluster.h"
+
+#include "CompiledGcode.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#define LETTER(c) (1 << ((c) - 'A'))
+
+// raster pixels are well under this, anything longer is a move of its own
+#define LASER_CLUSTER_MAX_PIXEL 1.0F
+// how far a line can be off the direction of the cluster, or off a whole number of pixels, for coordinates with 3 decimals
+#define LASER_CLUSTER_TOLERANCE 0.0011F
+
+static bool get_letter(const CompiledLine& cl, char c, float& v)
+{
+    uint32_t bit = LETTER(c);
+    if(!(cl.letters & bit)) return false;
+    int n = 0;
+    for (int i = 0; i < c - 'A'; ++i) {
+        if(cl.letters & (1 << i)) n++;
+    }
+    v = cl.values[n];
+    return true;
+}
+
+LaserCluster::LaserCluster()
+{
+    values = nullptr;
+    max_values = 0;
+    count = 0;
+    lines = 0;
+    len = 0;
+    feed_rate = 0;
+    pixel = 0;
+    known_x = known_y = false;
+    has_x = has_y = has_f = false;
+    absolute = true;
+}
+
+// how far the line moves X and Y, false if that is not known
+bool LaserCluster::axis_moves(const CompiledLine& cl, bool absolute, float d[2]) const
+{
+    const char axis[2] = {'X', 'Y'};
+    const bool known[2] = {known_x, known_y};
+    for (int i = 0; i < 2; ++i) {
+        float v;
+        if(!get_letter(cl, axis[i], v)) {
+            d[i] = 0;
+        } else if(!absolute) {
+            d[i] = v;
+        } else if(known[i]) {
+            d[i] = v - pos[i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LaserCluster::add(const CompiledLine& cl, bool absolute, unsigned int len)
+{
+    const uint32_t allowed = LETTER('X') | LETTER('Y') | LETTER('S') | LETTER('F');
+    if(cl.g != 1 || (cl.letters & ~allowed) || !(cl.letters & LETTER('S')) || !(cl.letters & (LETTER('X') | LETTER('Y')))) return false;
+    if(count > 0 && ((cl.letters & LETTER('F')) || absolute != this->absolute)) return false;
+
+    float d[2];
+    if(!axis_moves(cl, absolute, d)) return false;
+    float l = sqrtf(d[0] * d[0] + d[1] * d[1]);
+    if(l <= 0 || l >= LASER_CLUSTER_MAX_PIXEL) return false;
+
+    unsigned int r = 1;
+    if(count > 0) {
+        // same way as the first line and a whole number of its length
+        if(d[0] * dir[0] + d[1] * dir[1] <= 0 || fabsf(d[0] * dir[1] - d[1] * dir[0]) > LASER_CLUSTER_TOLERANCE) return false;
+        r = lroundf(l / pixel);
+        if(r == 0 || fabsf(l - r * pixel) > LASER_CLUSTER_TOLERANCE * r || count + r > max_values) return false;
+
+    } else {
+        if(max_values < 2) return false;
+        if(values == nullptr) values = new float[max_values];
+        dir[0] = d[0] / l;
+        dir[1] = d[1] / l;
+        pixel = l;
+        has_x = has_y = false;
+        has_f = get_letter(cl, 'F', feed_rate);
+        this->absolute = absolute;
+        if(!absolute) {
+            // the merged line moves by the sum of them
+            pos[0] = pos[1] = 0;
+        }
+    }
+
+    float s = 0, v = 0;
+    get_letter(cl, 'S', s);
+    for (unsigned int i = 0; i < r; ++i) {
+        values[count++] = s;
+    }
+
+    if(get_letter(cl, 'X', v)) has_x = true;
+    if(get_letter(cl, 'Y', v)) has_y = true;
+    pos[0] += d[0];
+    pos[1] += d[1];
+    if(absolute) {
+        // the exact coordinates of the line rather than the sum
+        if(get_letter(cl, 'X', v)) pos[0] = v;
+        if(get_letter(cl, 'Y', v)) pos[1] = v;
+    }
+
+    lines++;
+    this->len += len;
+    return true;
+}
+
+void LaserCluster::moved(const CompiledLine *cl, bool absolute)
+{
+    if(cl == nullptr) {
+        known_x = known_y = false;
+        return;
+    }
+
+    float v;
+    if(absolute) {
+        if(get_letter(*cl, 'X', v)) {
+            pos[0] = v;
+            known_x = true;
+        }
+        if(get_letter(*cl, 'Y', v)) {
+            pos[1] = v;
+            known_y = true;
+        }
+    }
+}
+
+void LaserCluster::flush(std::string& line, unsigned int& lines, uint32_t& len)
+{
+    char buf[32];
+    line = "G1";
+    if(has_f) {
+        snprintf(buf, sizeof(buf), " F%.6g", feed_rate);
+        line.append(buf);
+    }
+    if(has_x) {
+        snprintf(buf, sizeof(buf), " X%.5f", pos[0]);
+        line.append(buf);
+    }
+    if(has_y) {
+        snprintf(buf, sizeof(buf), " Y%.5f", pos[1]);
+        line.append(buf);
+    }
+    line.append(" S");
+    line.reserve(line.size() + count * 8);
+    for (unsigned int i = 0; i < count; ++i) {
+        // as many digits as a float holds, a power like 1234.5 or 0.00123 comes back as it was in the file
+        snprintf(buf, sizeof(buf), i == 0 ? "%.7g" : ":%.7g", values[i]);
+        line.append(buf);
+    }
+
+    lines = this->lines;
+    len = this->len;
+    count = 0;
+    this->lines = 0;
+    this->len = 0;
+}
+
+void LaserCluster::clear()
+{
+    count = 0;
+    lines = 0;
+    len = 0;
+    known_x = known_y = false;
+}
@@ -0,0 +1,59 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+struct CompiledLine;
+
+// Merges the short G1s of a laser raster line into one G1 with a power for each pixel, G1 X.. Y.. S a:b:c,
+// which the Robot spreads evenly along the line and the Planner queues as one block with a power array.
+// A G1 continues the cluster when it only has X, Y and S (F only on the first), goes the same way, is under
+// LASER_CLUSTER_MAX_PIXEL mm and is a whole number of the first one's length, it then gives that many values.
+// The lines come parsed by GcodeCompiler::parse_motion, anything it does not parse has to be flushed before it.
+class LaserCluster {
+    public:
+        LaserCluster();
+
+        // most values one merged line can have
+        void set_max_values(unsigned int n) { max_values = n; }
+
+        // take a G1 if it continues the cluster, or starts one when empty, len is the length of its source line
+        bool add(const CompiledLine& cl, bool absolute, unsigned int len);
+        // a line that was sent as it is, nullptr for one that was not parsed so where it leaves the machine is not known
+        void moved(const CompiledLine *cl, bool absolute);
+
+        bool empty() const { return count == 0; }
+        // the merged G1 for the lines taken so far and how many source lines and characters it stands for
+        void flush(std::string& line, unsigned int& lines, uint32_t& len);
+        // forget the cluster and the position
+        void clear();
+
+    private:
+        bool axis_moves(const CompiledLine& cl, bool absolute, float d[2]) const;
+
+        float *values;          // S for each pixel, allocated when first used
+        unsigned int max_values;
+        unsigned int count;
+        unsigned int lines;
+        uint32_t len;
+
+        float pos[2];           // X and Y the last line left the machine at, when known
+        float dir[2];           // unit vector of the first line
+        float pixel;            // length of the first line
+        float feed_rate;
+        struct {
+            bool known_x:1;
+            bool known_y:1;
+            bool has_x:1;       // some line of the cluster had an X or Y
+            bool has_y:1;
+            bool has_f:1;
+            bool absolute:1;
+        };
+};
@@ -0,0 +1,172 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LineIndex.h"
+
+#include "libs/utils.h"
+
+// index file layout, all little endian uint32_t
+//  header: magic, interval, size of the indexed file, complete flag, then the file's SourceStamp
+//  then one entry per interval lines: byte offset of the line following lines (i+1)*interval
+#define LINE_INDEX_MAGIC  0x3258444C // "LDX2"
+#define LINE_INDEX_HEADER 4
+#define LINE_INDEX_HEADER_SIZE (LINE_INDEX_HEADER * sizeof(uint32_t) + sizeof(SourceStamp))
+
+LineIndex::LineIndex()
+{
+    fp = nullptr;
+    pos = 0;
+    lines = 0;
+    n_entries = 0;
+    line_len = 0;
+}
+
+bool LineIndex::begin(const std::string& filename)
+{
+    cancel();
+
+    // the sidecar path is derived the same way as the .md5 one, which only works under gcodes/
+    if(filename.compare(0, 11, "/sd/gcodes/") != 0) return false;
+
+    path = change_to_idx_path(filename);
+    check_and_make_path(path);
+    fp = fopen(path.c_str(), "w+b");
+    if(fp == nullptr) return false;
+
+    // marked incomplete until finish() so a partial index is never used
+    uint32_t header[LINE_INDEX_HEADER] = {LINE_INDEX_MAGIC, LINE_INDEX_INTERVAL, 0, 0};
+    SourceStamp stamp;
+    if(fwrite(header, sizeof(uint32_t), LINE_INDEX_HEADER, fp) != LINE_INDEX_HEADER || fwrite(&stamp, sizeof(stamp), 1, fp) != 1) {
+        cancel();
+        return false;
+    }
+
+    pos = 0;
+    lines = 0;
+    n_entries = 0;
+    line_len = 0;
+    return true;
+}
+
+void LineIndex::feed(const char *buf, size_t len)
+{
+    if(fp == nullptr) return;
+
+    for (size_t i = 0; i < len; ++i) {
+        ++pos;
+        // fgets stops at a newline or when its buffer is full
+        if(buf[i] == '\n' || ++line_len == LINE_INDEX_MAX_LINE) {
+            line_len = 0;
+            if(++lines % LINE_INDEX_INTERVAL == 0) add_offset(pos);
+        }
+    }
+}
+
+void LineIndex::add_line(size_t len)
+{
+    if(fp == nullptr) return;
+
+    pos += len;
+    if(++lines % LINE_INDEX_INTERVAL == 0) add_offset(pos);
+}
+
+void LineIndex::add_offset(uint32_t offset)
+{
+    entries[n_entries++] = offset;
+    if(n_entries == sizeof(entries) / sizeof(entries[0])) flush();
+}
+
+void LineIndex::flush()
+{
+    if(n_entries > 0 && fwrite(entries, sizeof(uint32_t), n_entries, fp) != n_entries) {
+        // out of space or card removed, do not leave a broken index behind
+        cancel();
+        return;
+    }
+    n_entries = 0;
+}
+
+void LineIndex::finish(uint32_t file_size, const SourceStamp& stamp)
+{
+    if(fp == nullptr) return;
+
+    // if we did not see the whole file the offsets can not be trusted
+    if(pos != file_size) {
+        cancel();
+        return;
+    }
+
+    flush();
+    if(fp == nullptr) return;
+
+    uint32_t header[LINE_INDEX_HEADER] = {LINE_INDEX_MAGIC, LINE_INDEX_INTERVAL, file_size, 1};
+    if(fseek(fp, 0, SEEK_SET) != 0 || fwrite(header, sizeof(uint32_t), LINE_INDEX_HEADER, fp) != LINE_INDEX_HEADER ||
+       fwrite(&stamp, sizeof(stamp), 1, fp) != 1) {
+        cancel();
+        return;
+    }
+    fclose(fp);
+    fp = nullptr;
+}
+
+void LineIndex::cancel()
+{
+    if(fp == nullptr) return;
+
+    fclose(fp);
+    fp = nullptr;
+    remove(path.c_str());
+}
+
+FILE *LineIndex::open_index(const std::string& filename, uint32_t file_size, const SourceStamp& stamp)
+{
+    if(filename.compare(0, 11, "/sd/gcodes/") != 0) return nullptr;
+
+    FILE *f = fopen(change_to_idx_path(filename).c_str(), "rb");
+    if(f == nullptr) return nullptr;
+
+    uint32_t header[LINE_INDEX_HEADER];
+    SourceStamp indexed;
+    if(fread(header, sizeof(uint32_t), LINE_INDEX_HEADER, f) != LINE_INDEX_HEADER || header[0] != LINE_INDEX_MAGIC ||
+       header[1] != LINE_INDEX_INTERVAL || header[2] != file_size || header[3] != 1 ||
+       fread(&indexed, sizeof(indexed), 1, f) != 1 || !(indexed == stamp)) {
+        fclose(f);
+        return nullptr;
+    }
+    return f;
+}
+
+bool LineIndex::has_index(const std::string& filename, uint32_t file_size, const SourceStamp& stamp)
+{
+    FILE *f = open_index(filename, file_size, stamp);
+    if(f == nullptr) return false;
+    fclose(f);
+    return true;
+}
+
+bool LineIndex::lookup(const std::string& filename, uint32_t file_size, const SourceStamp& stamp, unsigned long line, unsigned long& indexed_line, uint32_t& offset)
+{
+    unsigned long k = line / LINE_INDEX_INTERVAL;
+    if(k == 0) return false; // nothing to skip
+
+    FILE *f = open_index(filename, file_size, stamp);
+    if(f == nullptr) return false;
+
+    bool ok = false;
+    if(fseek(f, 0, SEEK_END) == 0) {
+        // the line may be past the last entry, in the last interval of the file
+        unsigned long n = (ftell(f) - LINE_INDEX_HEADER_SIZE) / sizeof(uint32_t);
+        if(k > n) k = n;
+        if(k > 0 && fseek(f, LINE_INDEX_HEADER_SIZE + (k - 1) * sizeof(uint32_t), SEEK_SET) == 0 && fread(&offset, sizeof(uint32_t), 1, f) == 1) {
+            indexed_line = k * LINE_INDEX_INTERVAL;
+            ok = true;
+        }
+    }
+
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,56 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+#include "SourceStamp.h"
+
+// Sparse line number to byte offset index of a gcode file, kept in /sd/gcodes/.idx/ next to the .md5 sidecar,
+// so goto can seek close to a line instead of reading the whole file up to it.
+// A line is counted the way the Player reads it, ie what one fgets() into its 130 byte buffer returns.
+#define LINE_INDEX_INTERVAL 1000
+#define LINE_INDEX_MAX_LINE 129
+
+class LineIndex {
+    public:
+        LineIndex();
+        ~LineIndex() { cancel(); }
+
+        // start building the index of filename, the file is then fed to it sequentially from the start
+        bool begin(const std::string& filename);
+        // raw file data, eg as it is uploaded
+        void feed(const char *buf, size_t len);
+        // one line as returned by fgets
+        void add_line(size_t len);
+        // the whole file has been fed, marks the index as usable for this version of the file
+        void finish(uint32_t file_size, const SourceStamp& stamp);
+        // throw away an index that was not fed to the end
+        void cancel();
+        bool is_building() const { return fp != nullptr; }
+
+        // true if there is a complete index for this version of the file
+        static bool has_index(const std::string& filename, uint32_t file_size, const SourceStamp& stamp);
+        // finds the last indexed line at or before line, returns false if there is no usable index for this file
+        static bool lookup(const std::string& filename, uint32_t file_size, const SourceStamp& stamp, unsigned long line, unsigned long& indexed_line, uint32_t& offset);
+
+    private:
+        static FILE *open_index(const std::string& filename, uint32_t file_size, const SourceStamp& stamp);
+        void add_offset(uint32_t offset);
+        void flush();
+
+        std::string path;
+        FILE *fp;
+        uint32_t pos;
+        unsigned long lines;
+        uint32_t entries[16];
+        uint8_t n_entries;
+        uint8_t line_len;
+};
@@ -32,6 +32,7 @@
 #include "TemperatureControlPool.h"
 #include "StepTicker.h"
 #include "Block.h"
+#include "JobEstimate.h"
 #include "quicklz.h"
 
 #include <math.h>
@@ -49,6 +50,11 @@
 #define before_resume_gcode_checksum      CHECKSUM("before_resume_gcode")
 #define leave_heaters_on_suspend_checksum CHECKSUM("leave_heaters_on_suspend")
 #define laser_module_clustering_checksum 	  CHECKSUM("laser_module_clustering")
+#define play_batch_lines_checksum         CHECKSUM("play_batch_lines")
+#define play_batch_time_us_checksum       CHECKSUM("play_batch_time_us")
+#define play_read_buffer_size_checksum    CHECKSUM("play_read_buffer_size")
+#define play_compiled_checksum            CHECKSUM("play_compiled")
+#define arc_fitting_tolerance_checksum    CHECKSUM("arc_fitting_tolerance")
 
 extern SDFAT mounter;
 
@@ -71,11 +77,15 @@ Player::Player()
 {
     this->playing_file = false;
     this->current_file_handler = nullptr;
+    this->compiled_file_handler = nullptr;
+    this->estimate = nullptr;
+    this->estimate_file = nullptr;
+    this->estimate_discard = false;
     this->booted = false;
     this->elapsed_secs = 0;
     this->reply_stream = nullptr;
     this->inner_playing = false;
-    this->slope = 0.0;
+    this->reset_feed_stats();
 }
 
 void Player::on_module_loaded()
@@ -83,6 +93,7 @@ void Player::on_module_loaded()
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_SECOND_TICK);
+    this->register_for_event(ON_IDLE);
     this->register_for_event(ON_GET_PUBLIC_DATA);
     this->register_for_event(ON_SET_PUBLIC_DATA);
     this->register_for_event(ON_GCODE_RECEIVED);
@@ -100,12 +111,29 @@ void Player::on_module_loaded()
     this->leave_heaters_on = THEKERNEL->config->value(leave_heaters_on_suspend_checksum)->by_default(false)->as_bool();
 
     this->laser_clustering = THEKERNEL->config->value(laser_module_clustering_checksum)->by_default(false)->as_bool();
+    this->arc_fit_tolerance = THEKERNEL->config->value(arc_fitting_tolerance_checksum)->by_default(0.0F)->as_number();
+
+    // how many lines to feed per main loop at most (1 feeds a line per main loop), and for how long
+    this->batch_lines = THEKERNEL->config->value(play_batch_lines_checksum)->by_default(8)->as_int();
+    this->batch_time_us = THEKERNEL->config->value(play_batch_time_us_checksum)->by_default(2000)->as_int();
+    if(this->batch_lines < 1) this->batch_lines = 1;
+
+    // size of each of the two read ahead buffers, they are allocated while a file is played
+    this->reader.set_size(THEKERNEL->config->value(play_read_buffer_size_checksum)->by_default(2048)->as_int());
+
+    // play the compiled version of a file when it has an up to date one
+    this->play_compiled = THEKERNEL->config->value(play_compiled_checksum)->by_default(false)->as_bool();
 }
 
 void Player::on_halt(void* argument)
 {
     this->clear_buffered_queue();
 
+    if(argument == nullptr && this->estimate != nullptr) {
+        THEKERNEL->streams->printf("Estimate of %s aborted by halt\r\n", this->estimate_filename.c_str());
+        this->end_estimate();
+    }
+
     if(argument == nullptr && this->playing_file ) {
         abort_command("1", &(StreamOutput::NullStream));
 	}
@@ -121,7 +149,35 @@ void Player::on_halt(void* argument)
 
 void Player::on_second_tick(void *)
 {
-    if(this->playing_file) this->elapsed_secs++;
+    if(this->playing_file) {
+        this->elapsed_secs++;
+
+        // goto can move played_lines backwards
+        this->lines_per_sec = played_lines >= lines_last_sec ? played_lines - lines_last_sec : 0;
+        if(this->lines_per_sec > this->peak_lines_per_sec) this->peak_lines_per_sec = this->lines_per_sec;
+        this->read_bytes_per_sec = this->reader.get_bytes_read() - this->bytes_last_sec;
+    }
+    this->lines_last_sec = played_lines;
+    this->bytes_last_sec = this->reader.get_bytes_read();
+}
+
+// while the main loop waits for room in the block queue read the next chunk of the file
+void Player::on_idle(void *)
+{
+    if(this->playing_file) {
+        this->reader.prefetch();
+    }
+}
+
+void Player::reset_feed_stats()
+{
+    this->lines_last_sec = 0;
+    this->lines_per_sec = 0;
+    this->peak_lines_per_sec = 0;
+    this->fitted_lines = 0;
+    this->fitted_arcs = 0;
+    this->bytes_last_sec = this->reader.get_bytes_read();
+    this->read_bytes_per_sec = 0;
 }
 
 void Player::select_file(string argument)
@@ -149,6 +205,8 @@ void Player::select_file(string argument)
 
     if(this->current_file_handler != NULL) {
         this->playing_file = false;
+        this->close_compiled();
+        this->reader.detach();
         fclose(this->current_file_handler);
     }
     this->current_file_handler = fopen( this->filename.c_str(), "r");
@@ -166,7 +224,11 @@ void Player::select_file(string argument)
             this->file_size = ftell(this->current_file_handler);
             fseek(this->current_file_handler, 0, SEEK_SET);
         }
+        if(!this->reader.attach(this->current_file_handler)) {
+            THEKERNEL->streams->printf("WARNING: no memory for the play read ahead buffers\n");
+        }
         THEKERNEL->streams->printf("File opened:%s Size:%ld\r\n", this->filename.c_str(), this->file_size);
+        this->start_line_index();
         THEKERNEL->streams->printf("File selected\r\n");
     }
     this->played_cnt = 0;
@@ -174,33 +236,99 @@ void Player::select_file(string argument)
     this->elapsed_secs = 0;
     this->playing_lines = 0;
     this->goto_line = 0;
+    this->laser_cluster.clear();
+    this->arc_fitter.clear();
+    this->reset_feed_stats();
 }
 
 void Player::goto_line_number(unsigned long line_number)
 {
+    this->laser_cluster.clear();
+    this->arc_fitter.clear();
     this->goto_line = line_number;
     this->goto_line = this->goto_line < 1 ? 1 : this->goto_line;
     THEKERNEL->streams->printf("Goto line %lu...\r\n", this->goto_line);
     // goto line
     char buf[130]; // lines upto 128 characters are allowed, anything longer is discarded
 
-    // goto file begin
-    fseek(this->current_file_handler, 0, SEEK_SET);
-    played_lines = 0;
-    played_cnt   = 0;
+    // the compiled file can not be positioned by line, carry on from the text
+    if (this->compiled_file_handler != NULL) {
+        this->close_compiled();
+        this->reader.attach(this->current_file_handler);
+    }
+
+    unsigned long indexed_line;
+    uint32_t offset;
+    if (LineIndex::lookup(this->filename, this->file_size, this->source_stamp, this->goto_line, indexed_line, offset) &&
+        this->reader.seek(offset)) {
+        // seek close to the line, only the last few lines have to be read
+        this->line_index.cancel();
+        played_lines = indexed_line;
+        played_cnt   = offset;
+    } else {
+        // goto file begin, reading the whole file up to the line indexes it on the way
+        this->reader.seek(0);
+        played_lines = 0;
+        played_cnt   = 0;
+        this->start_line_index();
+    }
 
-    while (fgets(buf, sizeof(buf), this->current_file_handler) != NULL) {
+    while (played_lines < this->goto_line && this->reader.gets(buf, sizeof(buf)) != NULL) {
         if (played_lines % 100 == 0) {
             THEKERNEL->call_event(ON_IDLE);
         }
         int len = strlen(buf);
         if (len == 0) continue; // empty line? should not be possible
 
+        this->line_index.add_line(len);
         played_lines += 1;
         played_cnt += len;
-        if (played_lines >= this->goto_line) {
-            break;
+    }
+}
+
+// index the file as it gets read from the start, unless it already has a complete index. Called each time a file is
+// opened, which is when the version of it being played is taken
+void Player::start_line_index()
+{
+    this->line_index.cancel();
+    get_source_stamp(this->filename, this->source_stamp);
+    if (this->file_size > 0 && !LineIndex::has_index(this->filename, this->file_size, this->source_stamp)) {
+        this->line_index.begin(this->filename);
+    }
+}
+
+// the modification time and md5 sidecar of a file in /sd/gcodes, see SourceStamp.h
+void Player::get_source_stamp(const string& filename, SourceStamp& stamp)
+{
+    stamp = SourceStamp();
+
+    size_t slash = filename.rfind('/');
+    DIR *d = opendir(filename.substr(0, slash).c_str());
+    if (d != NULL) {
+        struct dirent *p;
+        while ((p = readdir(d)) != NULL) {
+            if (filename.compare(slash + 1, string::npos, p->d_name) == 0) {
+                stamp.mtime = (uint32_t)p->d_date << 16 | p->d_time;
+                break;
+            }
         }
+        closedir(d);
+    }
+
+    if (filename.compare(0, 11, "/sd/gcodes/") != 0) return;
+    FILE *f = fopen(change_to_md5_path(filename).c_str(), "rb");
+    if (f != NULL) {
+        if (fread(stamp.md5, 1, sizeof(stamp.md5), f) != sizeof(stamp.md5)) memset(stamp.md5, 0, sizeof(stamp.md5));
+        fclose(f);
+    }
+}
+
+void Player::close_compiled()
+{
+    if (this->compiled_file_handler != NULL) {
+        this->reader.detach();
+        fclose(this->compiled_file_handler);
+        this->compiled_file_handler = NULL;
     }
 }
 
@@ -291,6 +419,8 @@ void Player::on_gcode_received(void *argument)
                         this->filename = currentfn;
                         this->file_size = old_size;
                         this->current_stream = nullptr;
+                        this->reader.attach(this->current_file_handler);
+                        this->start_line_index();
                     }
                 }
             } else {
@@ -424,15 +554,15 @@ void Player::on_console_line_received( void *argument )
 {
     if(THEKERNEL->is_halted()) return; // if in halted state ignore any commands
 
-    SerialMessage new_message = *static_cast<SerialMessage *>(argument);
-
-    string possible_command = new_message.message;
+    const SerialMessage& new_message = *static_cast<SerialMessage *>(argument);
 
-    // ignore anything that is not lowercase or a letter
-    if(possible_command.empty() || !islower(possible_command[0]) || !isalpha(possible_command[0])) {
+    // ignore anything that is not lowercase or a letter, before copying the line as most of them are gcodes
+    if(new_message.message.empty() || !islower(new_message.message[0]) || !isalpha(new_message.message[0])) {
         return;
     }
 
+    string possible_command = new_message.message;
+
     string cmd = shift_parameter(possible_command);
 
 	// new_message.stream->printf("Play Received %s\r\n", possible_command.c_str());
@@ -454,6 +584,10 @@ void Player::on_console_line_received( void *argument )
     	this->buffer_command( possible_command, new_message.stream );
     }else if (cmd == "upload") {
     	this->upload_command( possible_command, new_message.stream );
+    }else if (cmd == "compile") {
+        this->compile_command( possible_command, new_message.stream );
+    }else if (cmd == "estimate") {
+        this->estimate_command( possible_command, new_message.stream );
     }else if (cmd == "download") {
         memset(md5_str, 0, sizeof(md5_str));
     	if (possible_command.find("config.txt") != string::npos) {
@@ -470,6 +604,151 @@ void Player::buffer_command( string parameters, StreamOutput *stream )
 	stream->printf("Command buffered: %s\r\n", parameters.c_str());
 }
 
+// Compile a gcode file so it plays without parsing its motion lines, see CompiledGcode.h
+void Player::compile_command( string parameters, StreamOutput *stream )
+{
+    string fn = absolute_from_relative(shift_parameter(parameters));
+
+    if (this->playing_file || THEKERNEL->is_suspending()) {
+        stream->printf("Currently printing, abort print first\r\n");
+        return;
+    }
+
+    if (fn.compare(0, 11, "/sd/gcodes/") != 0) {
+        stream->printf("Can only compile files in /sd/gcodes\r\n");
+        return;
+    }
+
+    FILE *f = fopen(fn.c_str(), "r");
+    if (f == NULL) {
+        stream->printf("File not found: %s\r\n", fn.c_str());
+        return;
+    }
+
+    GcodeCompiler compiler;
+    string gcb = change_to_gcb_path(fn);
+    check_and_make_path(gcb);
+    if (!compiler.begin(gcb)) {
+        stream->printf("Could not create %s\r\n", gcb.c_str());
+        fclose(f);
+        return;
+    }
+
+    char buf[130]; // same chunks as when the file is played
+    uint32_t size = 0;
+    unsigned long cnt = 0;
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        size_t len = strlen(buf);
+        compiler.add_line(buf, len);
+        size += len;
+        if (++cnt % 100 == 0) {
+            THEKERNEL->call_event(ON_IDLE);
+        }
+    }
+    fclose(f);
+
+    SourceStamp stamp;
+    get_source_stamp(fn, stamp);
+    if (!compiler.finish(size, stamp)) {
+        stream->printf("Compile failed: %s\r\n", fn.c_str());
+        return;
+    }
+    stream->printf("Compiled %s, %lu motion lines, %lu other lines\r\n", fn.c_str(), (unsigned long)compiler.get_motion_lines(), (unsigned long)compiler.get_text_lines());
+}
+
+static void print_duration(StreamOutput *stream, const char *name, double secs)
+{
+    unsigned long s = lround(secs);
+    stream->printf("%s %02lu:%02lu:%02lu", name, s / 3600, (s % 3600) / 60, s % 60);
+}
+
+// Work out how long a gcode file takes to run without running it, see JobEstimate.h. The file is read a batch per
+// main loop and the result goes to all streams, the one the command came on may be gone by the time it is done
+void Player::estimate_command( string parameters, StreamOutput *stream )
+{
+    string fn = absolute_from_relative(shift_parameter(parameters));
+
+    // it starts from where the machine is, which a file being played keeps changing
+    if (this->playing_file || THEKERNEL->is_suspending()) {
+        stream->printf("Currently printing, abort print first\r\n");
+        return;
+    }
+
+    FILE *f = fopen(fn.c_str(), "r");
+    if (f == NULL) {
+        stream->printf("File not found: %s\r\n", fn.c_str());
+        return;
+    }
+
+    if (this->estimate != nullptr) {
+        stream->printf("Estimate of %s replaced\r\n", this->estimate_filename.c_str());
+        this->end_estimate();
+    }
+
+    // kept until the whole file has been read, see estimate_batch()
+    this->estimate = new JobEstimate();
+    this->estimate_file = f;
+    if (!this->estimate->begin()) {
+        stream->printf("No memory for the estimate\r\n");
+        this->end_estimate();
+        return;
+    }
+    this->estimate_filename = fn;
+    this->estimate_lines = 0;
+    this->estimate_discard = false;
+    this->estimate_start = us_ticker_read();
+    stream->printf("Estimating %s\r\n", fn.c_str());
+}
+
+// as many lines of the file being estimated as batch_time_us allows, there is no block queue to fill so the line
+// budget does not apply
+void Player::estimate_batch()
+{
+    char buf[130]; // same chunks as when the file is played
+    uint32_t batch_start = us_ticker_read();
+    while (fgets(buf, sizeof(buf), this->estimate_file) != NULL) {
+        size_t len = strlen(buf);
+        if (len == 0) continue;
+        if (buf[len - 1] == '\n' || feof(this->estimate_file)) {
+            if (!this->estimate_discard) this->estimate->add_line(buf, len);
+            this->estimate_discard = false;
+        } else {
+            this->estimate_discard = true; // a long line is not played
+        }
+        this->estimate_lines++;
+        if ((us_ticker_read() - batch_start) >= this->batch_time_us) return;
+    }
+    this->estimate->finish();
+
+    StreamOutput *stream = THEKERNEL->streams;
+    JobEstimate *estimate = this->estimate;
+    stream->printf("Estimate for %s: %lu lines, %lu blocks in %lu ms\r\n", this->estimate_filename.c_str(), this->estimate_lines, (unsigned long)estimate->get_blocks(), (unsigned long)(us_ticker_read() - this->estimate_start) / 1000);
+    print_duration(stream, "total", estimate->get_total());
+    print_duration(stream, ", rapid", estimate->get_rapid());
+    print_duration(stream, ", cutting", estimate->get_cutting());
+    print_duration(stream, ", dwell", estimate->get_dwell());
+    stream->printf("\r\n");
+    for (int i = 0; i < estimate->get_tool_count(); ++i) {
+        if (i == 0 && estimate->get_tool_time(0) == 0) continue;
+        if (estimate->get_tool(i) < 0) stream->printf("current tool");
+        else stream->printf("T%d", estimate->get_tool(i));
+        print_duration(stream, "", estimate->get_tool_time(i));
+        stream->printf("\r\n");
+    }
+    if (estimate->get_untimed() > 0) {
+        stream->printf("not counted: %lu tool changes, homing or probing\r\n", (unsigned long)estimate->get_untimed());
+    }
+    this->end_estimate();
+}
+
+void Player::end_estimate()
+{
+    fclose(this->estimate_file);
+    this->estimate_file = nullptr;
+    delete this->estimate;
+    this->estimate = nullptr;
+}
+
 // Play a gcode file by considering each line as if it was received on the serial console
 void Player::play_command( string parameters, StreamOutput *stream )
 {
@@ -498,7 +777,15 @@ void Player::play_command( string parameters, StreamOutput *stream )
         return;
     }
 
+    // it would hold up the file, and the machine no longer starts from where it started
+    if (this->estimate != nullptr) {
+        stream->printf("Estimate of %s aborted\r\n", this->estimate_filename.c_str());
+        this->end_estimate();
+    }
+
     if (this->current_file_handler != NULL) { // must have been a paused print
+        this->close_compiled();
+        this->reader.detach();
         fclose(this->current_file_handler);
     }
 
@@ -539,11 +826,30 @@ void Player::play_command( string parameters, StreamOutput *stream )
         fseek(this->current_file_handler, 0, SEEK_SET);
         stream->printf("  File size %ld\r\n", file_size);
     }
+    if(!this->reader.attach(this->current_file_handler)) {
+        stream->printf("WARNING: no memory for the play read ahead buffers\n");
+    }
+    this->start_line_index();
+
+    // a compiled file has the lines already parsed, it is not used with -v as the lines are not echoed from it
+    if (this->play_compiled && this->current_stream == nullptr && file_size > 0 && this->filename.compare(0, 11, "/sd/gcodes/") == 0) {
+        this->compiled_file_handler = CompiledGcode::open(change_to_gcb_path(this->filename), file_size, this->source_stamp);
+        if (this->compiled_file_handler != NULL) {
+            this->line_index.cancel();
+            this->reader.attach(this->compiled_file_handler);
+            this->reader.seek(COMPILED_GCODE_HEADER_SIZE);
+            stream->printf("  Using compiled file\r\n");
+        }
+    }
+
     this->played_cnt = 0;
     this->played_lines = 0;
     this->elapsed_secs = 0;
     this->playing_lines = 0;
     this->goto_line = 0;
+    this->laser_cluster.clear();
+    this->arc_fitter.clear();
+    this->reset_feed_stats();
 
     // force into absolute mode
     THEROBOT->absolute_mode = true;
@@ -609,6 +915,10 @@ void Player::progress_command( string parameters, StreamOutput *stream )
             if(est > 0) {
                 stream->printf(", est time: %02lu:%02lu:%02lu",  est / 3600, (est % 3600) / 60, est % 60);
             }
+            stream->printf(", lines/sec: %lu, peak: %lu, queue starved: %lu, read: %lu bytes/sec", this->lines_per_sec, this->peak_lines_per_sec, (unsigned long)THEKERNEL->conveyor->get_queue_stats().underruns, this->read_bytes_per_sec);
+            if(this->arc_fit_tolerance > 0) {
+                stream->printf(", arcs fitted: %lu from %lu lines", this->fitted_arcs, this->fitted_lines);
+            }
             stream->printf("\r\n");
         } else {
             stream->printf("SD printing byte %lu/%lu\r\n", played_cnt, file_size);
@@ -633,8 +943,13 @@ void Player::abort_command( string parameters, StreamOutput *stream )
     this->goto_line = 0;
     this->file_size = 0;
     this->clear_buffered_queue();
+    this->laser_cluster.clear();
+    this->arc_fitter.clear();
     this->filename = "";
     this->current_stream = NULL;
+    this->line_index.cancel();
+    this->close_compiled();
+    this->reader.detach();
 
     fclose(current_file_handler);
     current_file_handler = NULL;
@@ -703,6 +1018,13 @@ void Player::on_main_loop(void *argument)
 
     }
 
+    // the queue stats are per played file
+    THEKERNEL->conveyor->set_job_running(this->playing_file);
+
+    if (this->estimate != nullptr) {
+        this->estimate_batch();
+    }
+
     if ( this->playing_file ) {
         if(THEKERNEL->is_halted() || THEKERNEL->is_suspending() || THEKERNEL->is_waiting() || this->inner_playing) {
             return;
@@ -724,24 +1046,20 @@ void Player::on_main_loop(void *argument)
 
         char buf[130]; // lines up to 128 characters are allowed, anything longer is discarded
         bool discard = false;
+        FILE *batch_file = this->current_file_handler;
+        uint32_t batch_start = us_ticker_read();
+        unsigned int batch_cnt = 0;
 
-        // 2024
-        /*
-        bool is_cluster = false;
-        int cluster_index = 0;
-        float x_value = 0.0, y_value = 0.0, sum_x_value = 0.0, sum_y_value = 0.0,
-        		s_value = 0.0, distance = 0.0, min_distance = 10000.0, min_value = 0.0,
-				sum_distance = 0.0, sum_value = 0.0;
-        string clustered_gcode = "";
-        float clustered_s_value[8];
-        float clustered_distance[8];
-        */
+        if (this->compiled_file_handler != NULL && !this->feed_compiled(batch_cnt, batch_start, batch_file)) {
+            return;
+        }
 
-        while (fgets(buf, sizeof(buf), this->current_file_handler) != NULL) {
+        while (this->compiled_file_handler == NULL && this->reader.gets(buf, sizeof(buf)) != NULL) {
 
             int len = strlen(buf);
             if (len == 0) continue; // empty line? should not be possible
-            if (buf[len - 1] == '\n' || feof(this->current_file_handler)) {
+            this->line_index.add_line(len);
+            if (buf[len - 1] == '\n' || this->reader.eof()) {
                 if(discard) { // we are discarding a long line
                     discard = false;
                     continue;
@@ -749,77 +1067,13 @@ void Player::on_main_loop(void *argument)
 
                 if (len == 1) continue; // empty line
 
-                /*
-            	// Add laser cluster support when in laser mode
-            	if (this->laser_clustering && THEKERNEL->get_laser_mode() && !THEROBOT->absolute_mode && played_lines > 100) {
-            		// G1 X0.5 Y 0.8 S1:0:0.5:0.75:0:0.2
-            		is_cluster = this->check_cluster(buf, &x_value, &y_value, &distance, &slope, &s_value);
-                    min_value = fmin(min_distance, distance);
-                    sum_value = sum_distance + distance;
-            		if (is_cluster && (min_value > 0 && sum_value * 1.0 / min_value < 8.1)) {
-                        min_distance = min_value;
-                        sum_distance = sum_value;
-                        sum_x_value += x_value;
-                        sum_y_value += y_value;
-                        cluster_index ++;
-                        clustered_s_value[cluster_index - 1] = s_value;
-                        clustered_distance[cluster_index - 1] = distance;
-                        played_lines += 1;
-                        played_cnt += len;
-						if (cluster_index >= 8 || (min_distance > 0 && sum_distance * 1.0 / min_distance > 7.9)) {
-	                        sprintf(md5_str, "G1 X%.3f Y%.3f S", sum_x_value, sum_y_value);
-	                        clustered_gcode = md5_str;
-	                        for (int i = 0; i < cluster_index; i ++) {
-	                            for (float j = min_distance; j < clustered_distance[i] + 0.01; j+= min_distance) {
-	                            	sprintf(md5_str, "%s%.2f", (i == 0 ? "" : ":"), clustered_s_value[i]);
-	                                clustered_gcode.append(md5_str);
-	                            }
-	                        }
-
-							struct SerialMessage message;
-							message.message = clustered_gcode;
-							message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
-							message.line = played_lines + 1;
-
-							// waits for the queue to have enough room
-							THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
-							// fputs(clustered_gcode.c_str(), this->temp_file_handler);
-							// fputs("\n", this->temp_file_handler);
-							// THEKERNEL->streams->printf("1-[Line: %d] %s\n", message.line, clustered_gcode.c_str());
-							return;
-						}
-						continue;
-            		} else {
-                		if (cluster_index > 0) {
-	                        sprintf(md5_str, "G1 X%.3f Y%.3f S", sum_x_value, sum_y_value);
-	                        clustered_gcode = md5_str;
-	                        for (int i = 0; i < cluster_index; i ++) {
-	                            for (float j = min_distance; j < clustered_distance[i] + 0.01; j+= min_distance) {
-	                            	sprintf(md5_str, "%s%.2f", (i == 0 ? "" : ":"), clustered_s_value[i]);
-	                                clustered_gcode.append(md5_str);
-	                            }
-	                        }
-	                        clustered_gcode.append("\n");
-
-    						struct SerialMessage message;
-    						message.message = clustered_gcode;
-    						message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
-    						message.line = played_lines + 1;
-
-    						// waits for the queue to have enough room
-    						THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
-    						// fputs(clustered_gcode.c_str(), this->temp_file_handler);
-    						// fputs("\n", this->temp_file_handler);
-    						// THEKERNEL->streams->printf("2-[Line: %d] %s\n", message.line, clustered_gcode.c_str());
-                		}
-                        sum_x_value = 0.0;
-                        sum_y_value = 0.0;
-                        sum_distance = 0.0;
-                        cluster_index = 0;
-                        min_distance = 10000.0;
-            		}
-            	}
-*/
+                if (this->laser_clustering && (THEKERNEL->get_laser_mode() || !this->laser_cluster.empty())) {
+                    CompiledLine cl;
+                    if (this->cluster_line(GcodeCompiler::parse_motion(buf, len, cl) ? &cl : nullptr, len)) continue;
+                } else if (this->arc_fit_tolerance > 0) {
+                    CompiledLine cl;
+                    if (this->fit_line(GcodeCompiler::parse_motion(buf, len, cl) ? &cl : nullptr, len)) continue;
+                }
 
                 if (this->current_stream != nullptr) {
                     this->current_stream->printf("%s", buf);
@@ -842,7 +1096,8 @@ void Player::on_main_loop(void *argument)
                     this->suspend_command("", THEKERNEL->streams);
                 }
 
-                return; // we feed one line per main loop
+                if (this->feed_done(batch_cnt, batch_start, batch_file)) return;
+                continue;
 
             } else {
                 // discard long line
@@ -851,6 +1106,17 @@ void Player::on_main_loop(void *argument)
             }
         }
 
+        // the last raster line of the file, the end of it is handled on the next loop
+        if (!this->laser_cluster.empty()) {
+            this->send_cluster();
+            return;
+        }
+        if (!this->arc_fitter.empty()) {
+            this->send_fitted();
+            return;
+        }
+
+        this->line_index.finish(file_size, this->source_stamp);
         this->playing_file = false;
         this->filename = "";
         played_cnt = 0;
@@ -859,6 +1125,8 @@ void Player::on_main_loop(void *argument)
         goto_line = 0;
         file_size = 0;
 
+        this->close_compiled();
+        this->reader.detach();
         fclose(this->current_file_handler);
         current_file_handler = NULL;
 
@@ -875,34 +1143,128 @@ void Player::on_main_loop(void *argument)
     }
 }
 
-/*
-bool Player::check_cluster(const char *gcode_str, float *x_value, float *y_value, float *distance, float *slope, float *s_value)
+// keep feeding until the block queue is full or the budget for this main loop is used up,
+// or the line changed what we are doing (abort, suspend, macro call etc)
+bool Player::feed_done(unsigned int& batch_cnt, uint32_t batch_start, FILE *batch_file)
 {
-	float new_slope = 0.0;
-	bool is_cluster = false;
-	Gcode *gcode = new Gcode(gcode_str, &StreamOutput::NullStream);
-	if (!gcode->has_m && gcode->has_g && gcode->g == 1) {
-		*x_value = gcode->get_value('X');
-		*y_value = gcode->get_value('Y');
-		*s_value = gcode->get_value('S');
-		*distance = sqrtf((*x_value) * (*x_value) + (*y_value) * (*y_value));
-		if (*x_value == 0) {
-			new_slope = *y_value > 0 ? 1000 : -1000;
-		} else if (*y_value == 0) {
-			new_slope = *x_value > 0 ? 0.001 : -0.001;
-		} else {
-			new_slope = *y_value / *x_value;
-		}
-		if ((*distance) < 1.0 && fabs (new_slope - *slope) < 0.1) {
-			is_cluster = true;
-		}
-		*slope = new_slope;
-	}
-	delete gcode;
+    if (++batch_cnt >= this->batch_lines || THEKERNEL->conveyor->is_queue_full() || (us_ticker_read() - batch_start) >= this->batch_time_us ||
+        !this->playing_file || this->current_file_handler != batch_file || this->inner_playing || !this->buffered_queue.empty() ||
+        THEKERNEL->is_halted() || THEKERNEL->is_suspending() || THEKERNEL->is_waiting()) {
+        return true;
+    }
+    return false;
+}
 
-	return is_cluster;
+// same as the text loop in on_main_loop but from a compiled file, motion lines go straight to the modules
+// returns false when it stopped for this main loop, true at the end of the file
+bool Player::feed_compiled(unsigned int& batch_cnt, uint32_t batch_start, FILE *batch_file)
+{
+    CompiledLine cl;
+    while (CompiledGcode::read(this->reader, cl)) {
+        if (this->laser_clustering && (THEKERNEL->get_laser_mode() || !this->laser_cluster.empty())) {
+            if (this->cluster_line(cl.type == COMPILED_MOTION ? &cl : nullptr, cl.len)) continue;
+        } else if (this->arc_fit_tolerance > 0) {
+            if (this->fit_line(cl.type == COMPILED_MOTION ? &cl : nullptr, cl.len)) continue;
+        }
+        if (cl.type == COMPILED_MOTION) {
+            CompiledGcode::dispatch(cl, &(StreamOutput::NullStream), played_lines + 1);
+        } else {
+            struct SerialMessage message;
+            message.message = cl.text;
+            message.stream = &(StreamOutput::NullStream);
+            message.line = played_lines + 1;
+            THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+        }
+        played_lines += 1;
+        played_cnt += cl.len;
+        if (this->compiled_file_handler == NULL) {
+            // the line moved playing back to the text file (goto)
+            return false;
+        }
+        if (THEKERNEL->get_line_by_line_exec_mode() && cl.len > 2 && (cl.type == COMPILED_MOTION || (cl.text[0] != ';' && cl.text[0] != '('))) {
+            this->suspend_command("", THEKERNEL->streams);
+        }
+
+        if (this->feed_done(batch_cnt, batch_start, batch_file)) return false;
+    }
+    return true;
+}
+
+// Laser raster lines are merged into one G1 with a power for each pixel, see LaserCluster. Returns true if the line
+// was taken into the cluster, otherwise it is sent as usual after the cluster it ended
+bool Player::cluster_line(const CompiledLine *cl, unsigned int len)
+{
+    if (THEKERNEL->get_line_by_line_exec_mode()) cl = nullptr;
+    // the arc fitter does not follow where the raster lines leave the machine
+    this->arc_fitter.moved(nullptr, true);
+    this->laser_cluster.set_max_values(std::min(THEKERNEL->conveyor->get_max_power_values(), (size_t)MAX_S_VALUES));
+
+    bool absolute = THEROBOT->absolute_mode;
+    if (cl != nullptr && this->laser_cluster.add(*cl, absolute, len)) return true;
+    this->send_cluster();
+    if (cl != nullptr && this->laser_cluster.add(*cl, absolute, len)) return true;
+    this->laser_cluster.moved(cl, absolute);
+    return false;
+}
+
+void Player::send_cluster()
+{
+    if (this->laser_cluster.empty()) return;
+
+    struct SerialMessage message;
+    unsigned int lines;
+    uint32_t len;
+    this->laser_cluster.flush(message.message, lines, len);
+    if (this->current_stream != nullptr) {
+        this->current_stream->printf("%s\n", message.message.c_str());
+    }
+    message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
+    message.line = played_lines + 1;
+
+    // waits for the queue to have enough room
+    THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+    played_lines += lines;
+    played_cnt += len;
+}
+
+// Runs of G1s on a circle are sent as one G2/G3, see ArcFitter. Returns true if the line was taken into the run,
+// otherwise it is sent as usual after what the run it ended was sent as
+bool Player::fit_line(const CompiledLine *cl, unsigned int len)
+{
+    if (THEKERNEL->get_line_by_line_exec_mode() || THEROBOT->plane_axis_2 != Z_AXIS) cl = nullptr;
+    this->arc_fitter.set_tolerance(THEROBOT->from_millimeters(this->arc_fit_tolerance));
+
+    bool absolute = THEROBOT->absolute_mode;
+    if (cl != nullptr && this->arc_fitter.add(*cl, absolute, len)) return true;
+    this->send_fitted();
+    if (cl != nullptr && this->arc_fitter.add(*cl, absolute, len)) return true;
+    this->arc_fitter.moved(cl, absolute);
+    return false;
+}
+
+void Player::send_fitted()
+{
+    while (!this->arc_fitter.empty()) {
+        struct SerialMessage message;
+        unsigned int lines;
+        uint32_t len;
+        this->arc_fitter.flush(message.message, lines, len);
+        if (this->current_stream != nullptr) {
+            this->current_stream->printf("%s\n", message.message.c_str());
+        }
+        message.stream = this->current_stream == nullptr ? &(StreamOutput::NullStream) : this->current_stream;
+        message.line = played_lines + 1;
+
+        // waits for the queue to have enough room
+        THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+        played_lines += lines;
+        played_cnt += len;
+        if (lines > 1) {
+            this->fitted_arcs++;
+            this->fitted_lines += lines;
+        }
+    }
 }
-*/
 
 void Player::on_get_public_data(void *argument)
 {
@@ -1216,8 +1578,10 @@ int Player::decompress(string sfilename, string dfilename, uint32_t sfilesize, S
 	uint8_t u8ReadBuffer_hdr[BLOCK_HEADER_SIZE] = { 0 };
 	uint32_t u32DcmprsSize = 0, u32BlockSize = 0, u32BlockNum = 0, u32TotalDcmprsSize = 0, i = 0,j = 0,k=0;
 	qlz_state_decompress s_stDecompressState;
+	LineIndex index; // removed again if it is not finished
 	f_in= fopen(sfilename.c_str(), "rb");
 	f_out= fopen(dfilename.c_str(), "w+");
+	index.begin(dfilename);
 	if (f_in == NULL || f_out == NULL)
 	{
 		memset(fbuff, 0, sizeof(fbuff));
@@ -1246,6 +1610,7 @@ int Player::decompress(string sfilename, string dfilename, uint32_t sfilesize, S
 		// Set the file write system buffer 4096 Byte
 		setvbuf(f_out, (char*)&xbuff[4096], _IOFBF, 4096);
 		fwrite(fbuff, sizeof(char),u32DcmprsSize, f_out);
+		index.feed((const char *)fbuff, u32DcmprsSize);
 		u32TotalDcmprsSize += u32DcmprsSize;
 		u32BlockNum += 1;
 		if(++k>10)
@@ -1267,6 +1632,11 @@ int Player::decompress(string sfilename, string dfilename, uint32_t sfilesize, S
 		fclose(f_in);
 	if (f_out!= NULL)
 		fclose(f_out);
+	if (index.is_building()) {
+		SourceStamp stamp;
+		get_source_stamp(dfilename, stamp);
+		index.finish(u32TotalDcmprsSize, stamp);
+	}
 	memset(fbuff, 0, sizeof(fbuff));
 	sprintf((char*)fbuff, "#Info: decompart = %u\r\n", u32BlockNum);
 	stream->printf((char*)fbuff);
@@ -1294,6 +1664,7 @@ void Player::upload_command( string parameters, StreamOutput *stream )
     int recv_count = 0;
     bool md5_received = false;
     uint32_t u32filesize = 0;
+    LineIndex index; // removed again if the upload does not complete
 
     // open file
 	char error_msg[64];
@@ -1333,6 +1704,10 @@ void Player::upload_command( string parameters, StreamOutput *stream )
     }
     else {
     	fd = fopen(filename.c_str(), "wb");
+    	// index plain gcode files while they arrive, lz files are indexed as they get decompressed
+    	if (filename.find("firmware.bin") == string::npos) {
+    		index.begin(filename);
+    	}
     }
 		
     FILE *fd_md5 = NULL;
@@ -1343,6 +1718,8 @@ void Player::upload_command( string parameters, StreamOutput *stream )
 	}
     if (filename.find("firmware.bin") == string::npos) {
     	fd_md5 = fopen(md5_filename.c_str(), "wb");
+    	// the file gets replaced, a compiled version of the old one must not be played for it
+    	remove(change_to_gcb_path(filename.substr(0, filename.find(".lz"))).c_str());
     }
 
     if (fd == NULL || (filename.find("firmware.bin") == string::npos && fd_md5 == NULL)) {
@@ -1445,6 +1822,7 @@ void Player::upload_command( string parameters, StreamOutput *stream )
             // Set the file write system buffer 4096 Byte
         	setvbuf(fd, (char*)fbuff, _IOFBF, 4096);
 			fwrite(&xbuff[4 + is_stx], sizeof(char), len, fd);
+			index.feed((const char *)&xbuff[4 + is_stx], len);
 			u32filesize += len;
 			++ packetno;
 			retrans = MAXRETRANS + 1;
@@ -1464,6 +1842,7 @@ upload_error:
 	// renable TIME0 and TIME1
 	NVIC_EnableIRQ(TIMER0_IRQn);     // Enable interrupt handler
 	NVIC_EnableIRQ(TIMER1_IRQn);     // Enable interrupt handler
+	index.cancel();
 
 	if (fd != NULL) {
 		fclose(fd);
@@ -1491,10 +1870,16 @@ upload_success:
 		fclose(fd);
 		fd = NULL;
 	}
+	// the index is for the file with the md5 just received
 	if (fd_md5 != NULL) {
 		fclose(fd_md5);
 		fd_md5 = NULL;
 	}
+	if (index.is_building()) {
+		SourceStamp stamp;
+		get_source_stamp(filename, stamp);
+		index.finish(u32filesize, stamp);
+	}
 	flush_input(stream);
 
     THEKERNEL->set_uploading(false);
@@ -9,6 +9,11 @@
 #pragma once
 
 #include "Module.h"
+#include "LineIndex.h"
+#include "ReadAheadFile.h"
+#include "CompiledGcode.h"
+#include "LaserCluster.h"
+#include "ArcFitter.h"
 
 #include <stdio.h>
 #include <string>
@@ -18,6 +23,7 @@
 using std::string;
 
 class StreamOutput;
+class JobEstimate;
 
 class Player : public Module {
     public:
@@ -27,6 +33,7 @@ class Player : public Module {
         void on_console_line_received( void* argument );
         void on_main_loop( void* argument );
         void on_second_tick(void* argument);
+        void on_idle(void* argument);
         void select_file(string argument);
         void goto_line_number(unsigned long line_number);
         void play_opened_file();
@@ -46,6 +53,10 @@ class Player : public Module {
         void buffer_command( string parameters, StreamOutput* stream );
         void upload_command( string parameters, StreamOutput* stream );
         void download_command( string parameters, StreamOutput* stream );
+        void compile_command( string parameters, StreamOutput* stream );
+        void estimate_command( string parameters, StreamOutput* stream );
+        void estimate_batch();
+        void end_estimate();
         
         void test_command(string parameters, StreamOutput* stream );
         
@@ -61,8 +72,6 @@ class Player : public Module {
 		
 		int decompress(string sfilename, string dfilename, uint32_t sfilesize, StreamOutput* stream);
 //		int compressfile(string sfilename, string dfilename, StreamOutput* stream);
-        // 2024
-        // bool check_cluster(const char *gcode_str, float *x_value, float *y_value, float *distance, float *slope, float *s_value);
 
         string filename;
         string last_filename;
@@ -80,10 +89,22 @@ class Player : public Module {
         using macro_file_queue_item= std::tuple<std::string, unsigned long>; // allows running macros. This forms a stact filepath, line number, to return to when the internal file is complete
         std::queue<macro_file_queue_item> macro_file_queue;
         void clear_macro_file_queue();
+        void reset_feed_stats();
+        void start_line_index();
+        static void get_source_stamp(const string& filename, SourceStamp& stamp);
+        void close_compiled();
+        bool feed_compiled(unsigned int& batch_cnt, uint32_t batch_start, FILE *batch_file);
+        bool feed_done(unsigned int& batch_cnt, uint32_t batch_start, FILE *batch_file);
+        bool cluster_line(const CompiledLine *cl, unsigned int len);
+        void send_cluster();
+        bool fit_line(const CompiledLine *cl, unsigned int len);
+        void send_fitted();
 
         FILE* current_file_handler;
+        FILE* compiled_file_handler;        // when set the reader plays this instead of current_file_handler
         // FILE* temp_file_handler;
         long file_size;
+        SourceStamp source_stamp;           // of the file as it was opened, see start_line_index()
         unsigned long played_cnt;
         unsigned long elapsed_secs;
         unsigned long played_lines;
@@ -91,7 +112,28 @@ class Player : public Module {
         unsigned int playing_lines;
         uint8_t current_motion_mode;
         float saved_position[3]; // only saves XYZ
-        float slope;
+
+        // batched feed, lines are fed per main loop until the block queue is full or either budget is used up
+        uint32_t batch_time_us;
+        uint16_t batch_lines;
+        unsigned long lines_last_sec;       // played_lines at the previous second tick
+        unsigned long lines_per_sec;
+        unsigned long peak_lines_per_sec;
+        unsigned long fitted_lines;         // G1s sent as arcs with arc_fitting_tolerance
+        unsigned long fitted_arcs;
+        uint32_t bytes_last_sec;            // reader bytes read at the previous second tick
+        uint32_t read_bytes_per_sec;
+        ReadAheadFile reader;               // all reads of current_file_handler go through this
+        LineIndex line_index;               // built while the file is read from its start, if it has none yet
+        LaserCluster laser_cluster;         // raster lines waiting to be sent as one, with laser_clustering
+        ArcFitter arc_fitter;               // G1s waiting to be sent as an arc, with arc_fitting_tolerance
+        float arc_fit_tolerance;
+        // the estimate command reads its file a batch per main loop, see estimate_batch()
+        JobEstimate *estimate;
+        FILE *estimate_file;
+        string estimate_filename;
+        unsigned long estimate_lines;
+        uint32_t estimate_start;
         std::map<uint16_t, float> saved_temperatures;
         struct {
             bool on_boot_gcode_enable:1;
@@ -102,5 +144,7 @@ class Player : public Module {
             bool override_leave_heaters_on:1;
             bool inner_playing:1;
             bool laser_clustering:1;
+            bool play_compiled:1;
+            bool estimate_discard:1;        // the estimate is skipping the rest of a long line
         };
 };
@@ -0,0 +1,193 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ReadAheadFile.h"
+
+#include "MemoryPool.h"
+#include "platform_memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTOR_SIZE 512
+
+ReadAheadFile::ReadAheadFile()
+{
+    fp = nullptr;
+    buf[0] = buf[1] = nullptr;
+    pool[0] = pool[1] = nullptr;
+    len[0] = len[1] = 0;
+    size = 0;
+    rpos = 0;
+    bytes_read = 0;
+    cur = 0;
+    back_ready = false;
+    file_eof = false;
+}
+
+// AHB SRAM first as it is otherwise mostly idle, then the main heap
+char *ReadAheadFile::alloc_buffer(MemoryPool *&p)
+{
+    void *v = AHB1.alloc(size);
+    p = &AHB1;
+    if(v == nullptr) {
+        v = AHB0.alloc(size);
+        p = &AHB0;
+    }
+    if(v == nullptr) {
+        v = malloc(size);
+        p = nullptr;
+    }
+    return (char *)v;
+}
+
+void ReadAheadFile::set_size(uint16_t sz)
+{
+    free_buffers();
+    size = (sz + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+    if(size == 0) size = SECTOR_SIZE;
+}
+
+bool ReadAheadFile::alloc_buffers()
+{
+    if(buf[0] != nullptr) return true;
+
+    buf[0] = alloc_buffer(pool[0]);
+    buf[1] = alloc_buffer(pool[1]);
+    if(buf[0] == nullptr || buf[1] == nullptr) {
+        free_buffers();
+        return false;
+    }
+    return true;
+}
+
+void ReadAheadFile::free_buffers()
+{
+    for (int i = 0; i < 2; ++i) {
+        if(buf[i] == nullptr) continue;
+        if(pool[i] != nullptr) pool[i]->dealloc(buf[i]);
+        else free(buf[i]);
+        buf[i] = nullptr;
+    }
+    len[0] = len[1] = 0;
+    back_ready = false;
+}
+
+bool ReadAheadFile::attach(FILE *f)
+{
+    fp = f;
+    if(fp == nullptr) return true;
+    if(!alloc_buffers()) return false;
+
+    // we do the buffering, so fread goes straight to the filesystem
+    setvbuf(fp, nullptr, _IONBF, 0);
+    seek(0);
+    return true;
+}
+
+void ReadAheadFile::detach()
+{
+    fp = nullptr;
+    free_buffers();
+}
+
+bool ReadAheadFile::seek(uint32_t offset)
+{
+    if(fp == nullptr) return false;
+    if(buf[0] == nullptr) return fseek(fp, offset, SEEK_SET) == 0;
+
+    // keep every read sector aligned so FatFs can transfer whole sectors into our buffer
+    uint32_t base = offset & ~(SECTOR_SIZE - 1);
+    back_ready = false;
+    file_eof = false;
+    cur = 0;
+    rpos = 0;
+    len[0] = 0;
+    if(fseek(fp, base, SEEK_SET) != 0) return false;
+    fill(0);
+    rpos = offset - base > len[0] ? len[0] : offset - base;
+    return true;
+}
+
+bool ReadAheadFile::fill(uint8_t i)
+{
+    size_t n = fread(buf[i], 1, size, fp);
+    len[i] = n;
+    bytes_read += n;
+    if(n < size) file_eof = true;
+    return n > 0;
+}
+
+// swap in the back buffer, reading it now if the idle prefetch did not get to it
+bool ReadAheadFile::next()
+{
+    if(!back_ready) {
+        if(file_eof || !fill(cur ^ 1)) return false;
+    }
+    cur ^= 1;
+    rpos = 0;
+    back_ready = false;
+    return true;
+}
+
+void ReadAheadFile::prefetch()
+{
+    if(fp == nullptr || buf[0] == nullptr || back_ready || file_eof) return;
+    back_ready = fill(cur ^ 1);
+}
+
+char *ReadAheadFile::gets(char *s, int n)
+{
+    if(fp == nullptr) return nullptr;
+    if(buf[0] == nullptr) return fgets(s, n, fp);
+    if(n < 2) return nullptr;
+
+    int cnt = 0;
+    while(cnt < n - 1) {
+        if(rpos >= len[cur] && !next()) break;
+
+        const char *src = &buf[cur][rpos];
+        size_t avail = len[cur] - rpos;
+        if(avail > (size_t)(n - 1 - cnt)) avail = n - 1 - cnt;
+
+        const char *nl = (const char *)memchr(src, '\n', avail);
+        size_t l = nl != nullptr ? nl - src + 1 : avail;
+        memcpy(&s[cnt], src, l);
+        cnt += l;
+        rpos += l;
+        if(nl != nullptr) break;
+    }
+
+    if(cnt == 0) return nullptr;
+    s[cnt] = '\0';
+    return s;
+}
+
+size_t ReadAheadFile::read(void *dst, size_t n)
+{
+    if(fp == nullptr) return 0;
+    if(buf[0] == nullptr) return fread(dst, 1, n, fp);
+
+    size_t cnt = 0;
+    while(cnt < n) {
+        if(rpos >= len[cur] && !next()) break;
+
+        size_t l = len[cur] - rpos;
+        if(l > n - cnt) l = n - cnt;
+        memcpy((char *)dst + cnt, &buf[cur][rpos], l);
+        cnt += l;
+        rpos += l;
+    }
+    return cnt;
+}
+
+bool ReadAheadFile::eof() const
+{
+    if(fp == nullptr) return true;
+    if(buf[0] == nullptr) return feof(fp);
+    return file_eof && !back_ready && rpos >= len[cur];
+}
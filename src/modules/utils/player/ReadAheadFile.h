@@ -0,0 +1,65 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+class MemoryPool;
+
+// Reads the played file in large sector aligned chunks into two buffers and splits lines out of them in memory.
+// The stdio buffer is turned off so each chunk goes straight to FatFs, which reads whole sectors with one
+// multi block disk_read. The back buffer is filled from ON_IDLE while the main loop waits on the block queue,
+// if it is not ready when the front one runs out it is filled there and then.
+// The buffers are only allocated while a file is attached, so they take no memory when nothing is played.
+// Without buffers (out of memory) it falls back to plain fgets.
+class ReadAheadFile {
+    public:
+        ReadAheadFile();
+
+        // size of each of the two buffers, rounded up to whole sectors
+        void set_size(uint16_t size);
+        // start reading fp from its start, fp stays owned by the caller, allocates the buffers if they are not yet,
+        // false if there was no memory for them, it then reads with plain fgets
+        bool attach(FILE *fp);
+        // stop reading and free the buffers
+        void detach();
+        bool seek(uint32_t offset);
+
+        // same semantics as fgets
+        char *gets(char *s, int size);
+        // same semantics as fread of n bytes
+        size_t read(void *dst, size_t n);
+        // same as feof after gets, no more data
+        bool eof() const;
+        // fill the back buffer if it is not ready yet
+        void prefetch();
+
+        uint32_t get_bytes_read() const { return bytes_read; }
+        uint16_t get_size() const { return size; }
+
+    private:
+        char *alloc_buffer(MemoryPool *&pool);
+        bool alloc_buffers();
+        void free_buffers();
+        bool fill(uint8_t i);
+        bool next();
+
+        FILE *fp;
+        char *buf[2];
+        MemoryPool *pool[2];        // where each buffer came from, nullptr is the heap
+        uint16_t len[2];
+        uint16_t size;
+        uint16_t rpos;              // read position in the front buffer
+        uint32_t bytes_read;        // from the card since boot
+        uint8_t cur;                // front buffer
+        struct {
+            bool back_ready:1;
+            bool file_eof:1;        // the last fill hit the end of the file
+        };
+};
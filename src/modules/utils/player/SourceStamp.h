@@ -0,0 +1,22 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Which version of a gcode file something built from it was built from, on top of its size. The size alone does not
+// change when a file is rewritten with the same number of bytes, the modification time the card records and the md5
+// the host sent with the file do. Player::get_source_stamp() fills it in.
+struct SourceStamp {
+    uint32_t mtime;         // FAT date << 16 | time, 0 if not known
+    char md5[32];           // from the .md5 sidecar, zeros if there is none
+
+    SourceStamp() { memset(this, 0, sizeof(*this)); }
+    bool operator==(const SourceStamp& o) const { return memcmp(this, &o, sizeof(*this)) == 0; }
+};
@@ -32,6 +32,7 @@
 #include "GcodeDispatch.h"
 #include "BaseSolution.h"
 #include "StepperMotor.h"
+#include "StepTicker.h"
 #include "Configurator.h"
 #include "Block.h"
 #include "SpindlePublicAccess.h"
@@ -97,6 +98,8 @@ const SimpleShell::ptentry_t SimpleShell::commands_table[] = {
 	{"ftype",	 SimpleShell::ftype_command},
     {"version",  SimpleShell::version_command},
     {"mem",      SimpleShell::mem_command},
+    {"ticker",   SimpleShell::ticker_command},
+    {"queue",    SimpleShell::queue_command},
     {"get",      SimpleShell::get_command},
     {"set_temp", SimpleShell::set_temp_command},
     {"switch",   SimpleShell::switch_command},
@@ -195,6 +198,8 @@ void SimpleShell::on_module_loaded()
 
 void SimpleShell::on_second_tick(void *)
 {
+    Gcode::pool.second_tick();
+
     // we are timing out for the reset
     if (reset_delay_secs > 0) {
         if (--reset_delay_secs == 0) {
@@ -288,13 +293,13 @@ bool SimpleShell::parse_command(const char *cmd, string args, StreamOutput *stre
 // When a new line is received, check if it is a command, and if it is, act upon it
 void SimpleShell::on_console_line_received( void *argument )
 {
-    SerialMessage new_message = *static_cast<SerialMessage *>(argument);
-    string possible_command = new_message.message;
+    const SerialMessage& new_message = *static_cast<SerialMessage *>(argument);
 
-    // ignore anything that is not lowercase or a $ as it is not a command
-    if(possible_command.size() == 0 || (!islower(possible_command[0]) && possible_command[0] != '$')) {
+    // ignore anything that is not lowercase or a $ as it is not a command, before copying the line
+    if(new_message.message.size() == 0 || (!islower(new_message.message[0]) && new_message.message[0] != '$')) {
         return;
     }
+    string possible_command = new_message.message;
 
     // it is a grbl compatible command
     if(possible_command[0] == '$' && possible_command.size() >= 2) {
@@ -479,6 +484,8 @@ void SimpleShell::rm_command( string parameters, StreamOutput *stream )
     string path = absolute_from_relative(shift_parameter( parameters ));
     string md5_path = change_to_md5_path(path);
     string lz_path = change_to_lz_path(path);
+    string idx_path = change_to_idx_path(path);
+    string gcb_path = change_to_gcb_path(path);
     if(!parameters.empty() && shift_parameter(parameters) == "-e") {
     	send_eof = true;
     }
@@ -518,6 +525,8 @@ void SimpleShell::rm_command( string parameters, StreamOutput *stream )
     	}*/
     	string str_lz = absolute_from_relative(lz_path);
 		s = remove(str_lz.c_str());
+		remove(idx_path.c_str());
+		remove(gcb_path.c_str());
 		if(send_eof) {
             stream->_putc(EOT);
     	}
@@ -534,6 +543,10 @@ void SimpleShell::mv_command( string parameters, StreamOutput *stream )
     string to = absolute_from_relative(shift_parameter(parameters));
     string md5_to = change_to_md5_path(to);
     string lz_to = change_to_lz_path(to);
+    string idx_from = change_to_idx_path(from);
+    string idx_to = change_to_idx_path(to);
+    string gcb_from = change_to_gcb_path(from);
+    string gcb_to = change_to_gcb_path(to);
     if(!parameters.empty() && shift_parameter(parameters) == "-e") {
     	send_eof = true;
     }
@@ -567,6 +580,8 @@ void SimpleShell::mv_command( string parameters, StreamOutput *stream )
         	}
         }*/
         s = rename(lz_from.c_str(), lz_to.c_str());
+        rename(idx_from.c_str(), idx_to.c_str());
+        rename(gcb_from.c_str(), gcb_to.c_str());
         if (send_eof) {
 			stream->_putc(EOT);
 		}
@@ -817,7 +832,58 @@ void SimpleShell::mem_command( string parameters, StreamOutput *stream)
         AHB1.debug(stream);
     }
 
-    stream->printf("Block size: %u bytes, Tickinfo size: %u bytes\n", sizeof(Block), sizeof(Block::tickinfo_t) * Block::n_actuators);
+    stream->printf("Block size: %u bytes, Tickinfo size: %u bytes, Planner queue: %u blocks\n", sizeof(Block), sizeof(Block::tickinfo_t) * Block::n_actuators, THECONVEYOR->get_queue_size());
+
+    ObjectPool& gp = Gcode::pool;
+    stream->printf("Gcode pool: %u/%u in use, peak %u, %lu allocs (%lu from heap), %lu/s%s\r\n",
+                   gp.get_in_use(), gp.get_size(), gp.get_peak(), gp.get_allocs(), gp.get_misses(), gp.get_allocs_per_sec(),
+                   gp.is_reserved() ? "" : ", not reserved at boot so all from heap");
+}
+
+// how long the step tick ISR takes, against the cycles there are between ticks at base_stepping_frequency
+void SimpleShell::ticker_command( string parameters, StreamOutput *stream)
+{
+    StepTicker *st = StepTicker::getInstance();
+    if (shift_parameter(parameters) == "reset") {
+        st->reset_cycle_stats();
+        stream->printf("Step ticker cycle stats reset\r\n");
+        return;
+    }
+
+    StepTicker::CycleStats cs = st->get_cycle_stats();
+    uint32_t period = SystemCoreClock / st->get_frequency();
+    if (cs.ticks == 0) {
+        stream->printf("Step ticker: no ticks with a block to run yet, %lu cycles between ticks at %1.0f Hz\r\n", period, st->get_frequency());
+        return;
+    }
+    uint32_t avg = cs.total / cs.ticks;
+    stream->printf("Step ticker: %lu ticks, cycles per tick min/avg/max %lu/%lu/%lu, %lu cycles between ticks at %1.0f Hz, max uses %lu%%, %lu blocks started in at most %lu cycles\r\n",
+                   cs.ticks, cs.min, avg, cs.max, period, st->get_frequency(), cs.max * 100 / period, cs.starts, cs.max_start);
+}
+
+void SimpleShell::queue_command( string parameters, StreamOutput *stream)
+{
+    if (shift_parameter(parameters) == "reset") {
+        THEKERNEL->conveyor->reset_queue_stats();
+        stream->printf("Block queue stats reset\r\n");
+        return;
+    }
+
+    Conveyor::QueueStats qs = THEKERNEL->conveyor->get_queue_stats();
+    uint32_t taken = 0;
+    for (uint32_t n : qs.depth) taken += n;
+    stream->printf("Block queue: %lu blocks handed to the step ticker, with this many queued behind them", taken);
+    for (int i = 0; i < CONVEYOR_DEPTH_BUCKETS; ++i) {
+        uint32_t from = i * qs.depth_bucket;
+        if (from >= THEKERNEL->conveyor->get_queue_size()) break;
+        stream->printf(" %lu-%lu: %lu", from, from + qs.depth_bucket - 1, qs.depth[i]);
+    }
+    stream->printf(", %lu not staged in time", qs.unstaged);
+
+    float ms_per_tick = 1000.0F / StepTicker::getInstance()->get_frequency();
+    stream->printf("\r\nUnderruns: %lu, %1.1f ms in all, longest %1.1f ms. Waiting for idle: %lu, %1.1f ms in all, longest %1.1f ms\r\n",
+                   qs.underruns, qs.underrun_ticks * ms_per_tick, qs.max_underrun_ticks * ms_per_tick,
+                   qs.waits, qs.wait_us / 1000.0F, qs.max_wait_us / 1000.0F);
 }
 
 static uint32_t getDeviceType()
@@ -2159,6 +2225,8 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("Commands:\r\n");
     stream->printf("version\r\n");
     stream->printf("mem [-v]\r\n");
+    stream->printf("ticker [reset] - step ticker ISR cycles per tick since the file started\r\n");
+    stream->printf("queue [reset] - block queue depth, underruns and time waiting for idle since the file started\r\n");
     stream->printf("ls [-s] [-e] [folder]\r\n");
     stream->printf("cd folder\r\n");
     stream->printf("pwd\r\n");
@@ -2167,6 +2235,8 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("mv file newfile [-e]\r\n");
     stream->printf("remount\r\n");
     stream->printf("play file [-v]\r\n");
+    stream->printf("compile file - pre-parses a gcode file so play sends its moves without parsing them\r\n");
+    stream->printf("estimate file - works out how long a gcode file takes to run, in all, rapid, cutting and per tool\r\n");
     stream->printf("progress - shows progress of current play\r\n");
     stream->printf("abort - abort currently playing file\r\n");
     stream->printf("reset - reset smoothie\r\n");
@@ -56,6 +56,8 @@ private:
 
     static void switch_command(string parameters, StreamOutput *stream );
     static void mem_command(string parameters, StreamOutput *stream );
+    static void ticker_command(string parameters, StreamOutput *stream );
+    static void queue_command(string parameters, StreamOutput *stream );
 
     static void net_command( string parameters, StreamOutput *stream);
     static void ap_command( string parameters, StreamOutput *stream);
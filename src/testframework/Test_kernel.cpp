@@ -26,7 +26,6 @@ This is aprt of the Smoothie test framework, it generates a Mockable Kernl so ke
 #include "modules/communication/GcodeDispatch.h"
 #include "modules/robot/Planner.h"
 #include "modules/robot/Robot.h"
-#include "modules/robot/Stepper.h"
 #include "modules/robot/Conveyor.h"
 
 #include "Config.h"
@@ -61,12 +60,31 @@ Kernel::Kernel(){
     // dummies (would be nice to refactor to not have to create a conveyor)
     this->conveyor= new Conveyor();
 
+    // a test that loads the motion modules brings up the rest of them itself, what they read from the kernel
+    // starts out as on a machine that was never set up
+    this->robot = nullptr;
+    this->planner = nullptr;
+    this->step_ticker = nullptr;
+    this->halted = false;
+    this->feed_hold = false;
+    this->enable_feed_hold = false;
+    this->grbl_mode = false;
+    this->laser_mode = false;
+    this->zprobing = false;
+    this->eeprom_data = new EEPROM_data();
+    this->factory_set = new FACTORY_SET();
+
     // Configure UART depending on MRI config
     // Match up the SerialConsole to MRI UART. This makes it easy to use only one UART for both debug and actual commands.
     NVIC_SetPriorityGrouping(0);
     NVIC_SetPriority(UART0_IRQn, 5);
 }
 
+// the tests never save anything
+void Kernel::write_eeprom_data()
+{
+}
+
 // Add a module to Kernel. We don't actually hold a list of modules we just call its on_module_loaded
 void Kernel::add_module(Module* module){
     module->on_module_loaded();
@@ -0,0 +1,220 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Host replacements for the bits of hardware the motion pipeline touches: GPIO and timer registers are plain memory,
+the timers are driven by sim_run_ticks(), PWM outputs just remember their duty cycle and the memory pools just use the heap.
+*/
+
+#include "Simulator.h"
+
+#include "libs/Kernel.h"
+#include "libs/StepTicker.h"
+#include "libs/SlowTicker.h"
+#include "libs/Hook.h"
+#include "libs/MemoryPool.h"
+#include "libs/Pin.h"
+#include "libs/MRI_Hooks.h"
+#include "libs/ConfigSources/FileConfigSource.h"
+#include "libs/utils.h"
+
+#include "mbed.h"
+#include "PwmOut.h"
+
+#include <time.h>
+
+LPC_GPIO_TypeDef sim_gpio[5];
+LPC_TIM_TypeDef sim_tim[4];
+LPC_SC_TypeDef sim_sc;
+LPC_WDT_TypeDef sim_wdt;
+DWT_Type sim_dwt;
+CoreDebug_Type sim_core_debug;
+uint32_t SystemCoreClock = 100000000;
+
+SimStats sim_stats;
+
+extern "C" void TIMER0_IRQHandler(void);
+extern "C" void TIMER1_IRQHandler(void);
+
+SlowTicker* global_slow_ticker;
+static uint32_t slow_tick_period;   // in step ticks
+static uint32_t slow_tick_countdown;
+
+mbed::PwmOut *sim_pwm;
+
+uint64_t sim_host_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void sim_run_ticks(uint32_t n)
+{
+    static bool stopped = true;
+    StepTicker *st = StepTicker::getInstance();
+    uint64_t t = sim_host_ns();
+    for (uint32_t i = 0; i < n; ++i) {
+        const Block *b = st->get_current_block();
+        if(b == nullptr) {
+            ++sim_stats.idle_ticks;
+            stopped = true;
+        }
+        TIMER0_IRQHandler();
+        if(st->get_current_block() != b && st->get_current_block() != nullptr) {
+            sim_record_block(st->get_current_block(), stopped);
+            stopped = false;
+        }
+        if(sim_stats.check_profile) {
+            // a block that starts from a stop gets its first tick straight away, the next one after a block ends waits for the next tick
+            const Block *ticked = b != nullptr ? b : st->get_current_block();
+            if(ticked != nullptr) sim_sample_profile(ticked, b == nullptr);
+        }
+        if(sim_stats.check_laser) {
+            const Block *ticked = b != nullptr ? b : st->get_current_block();
+            if(ticked != nullptr) sim_sample_laser(ticked);
+        }
+        // step_tick arms TIMER1 when it issued a step, the unstep happens before the next tick
+        if(LPC_TIM1->TCR == 1) {
+            LPC_TIM1->TCR = 0;
+            TIMER1_IRQHandler();
+        }
+        // it has a lower priority so it runs after the step ticker when both are due
+        if(global_slow_ticker != nullptr && --slow_tick_countdown == 0) {
+            slow_tick_countdown = slow_tick_period;
+            global_slow_ticker->tick();
+        }
+    }
+    sim_stats.tick_ns += sim_host_ns() - t;
+    sim_stats.ticks += n;
+}
+
+// simulated time derived from the number of step ticks run so far
+extern "C" uint32_t us_ticker_read(void)
+{
+    StepTicker *st = StepTicker::getInstance();
+    if(st == nullptr) return 0;
+    return (uint32_t)(sim_stats.ticks * 1000000ULL / (uint64_t)st->get_frequency());
+}
+
+extern "C" void wait_us(int us)
+{
+    StepTicker *st = StepTicker::getInstance();
+    if(st == nullptr || us <= 0) return;
+    sim_run_ticks((uint64_t)us * (uint64_t)st->get_frequency() / 1000000ULL);
+}
+
+extern "C" void wait_ms(int ms) { wait_us(ms * 1000); }
+extern "C" void wait(float s) { wait_us(s * 1000000.0F); }
+
+extern "C" void set_high_on_debug(int port, int pin) {}
+extern "C" void set_low_on_debug(int port, int pin) {}
+
+// the pools are only an optimization on the target, on the host everything comes from the heap
+MemoryPool* MemoryPool::first = NULL;
+
+MemoryPool::MemoryPool(void* base, uint16_t size) : next(nullptr), base(base), size(size) {}
+MemoryPool::~MemoryPool() {}
+void* MemoryPool::alloc(size_t nbytes) { return malloc(nbytes); }
+void  MemoryPool::dealloc(void* p) { ::free(p); }
+void  MemoryPool::debug(StreamOutput*) {}
+bool  MemoryPool::has(void*) { return false; }
+uint32_t MemoryPool::free(void) { return 0; }
+
+static MemoryPool _AHB0_heap(nullptr, 0);
+static MemoryPool _AHB1_heap(nullptr, 0);
+MemoryPool* _AHB0 = &_AHB0_heap;
+MemoryPool* _AHB1 = &_AHB1_heap;
+
+// Pins only need to parse and remember port/pin/inversion, the registers are plain memory
+Pin::Pin()
+{
+    this->inverting = false;
+    this->valid = false;
+    this->pin = 32;
+    this->port = nullptr;
+}
+
+Pin* Pin::from_string(std::string value)
+{
+    LPC_GPIO_TypeDef* gpios[5] = {LPC_GPIO0, LPC_GPIO1, LPC_GPIO2, LPC_GPIO3, LPC_GPIO4};
+    const char* cs = value.c_str();
+    char* cn = NULL;
+
+    this->valid = false;
+    this->port_number = strtol(cs, &cn, 10);
+    if (cn > cs && port_number <= 4 && *cn == '.') {
+        cs = ++cn;
+        this->pin = strtol(cs, &cn, 10);
+        if (cn > cs && pin < 32) {
+            this->port = gpios[(unsigned int)this->port_number];
+            this->valid = true;
+            for (; *cn; cn++) {
+                if(*cn == '!') this->inverting = true;
+            }
+        }
+    }
+    return this;
+}
+
+Pin* Pin::as_open_drain() { return this; }
+Pin* Pin::as_repeater() { return this; }
+Pin* Pin::pull_up() { return this; }
+Pin* Pin::pull_down() { return this; }
+Pin* Pin::pull_none() { return this; }
+// only the laser asks for one
+mbed::PwmOut* Pin::hardware_pwm() { return sim_pwm = new mbed::PwmOut(); }
+mbed::InterruptIn* Pin::interrupt_pin() { return nullptr; }
+
+// there is no embedded config.default, the simulator always loads its config with a FirmConfigSource over a file buffer
+char _binary_config_default_start, _binary_config_default_end;
+char _binary_config2_default_start, _binary_config2_default_end;
+
+// nor is there an sd card to hold a config file
+FileConfigSource::FileConfigSource(string config_file, const char *name) : config_file(config_file), config_file_found(false) { this->name_checksum = get_checksum(name); }
+void FileConfigSource::transfer_values_to_cache(ConfigCache *cache) {}
+void FileConfigSource::transfer_values_to_cache(ConfigCache *cache, const char *file_name) {}
+bool FileConfigSource::is_named(uint16_t check_sum) { return check_sum == this->name_checksum; }
+bool FileConfigSource::write(string setting, string value) { return false; }
+string FileConfigSource::read(uint16_t check_sums[3]) { return ""; }
+bool FileConfigSource::has_config_file() { return false; }
+void FileConfigSource::try_config_file(string candidate) {}
+string FileConfigSource::get_config_file() { return config_file; }
+
+// the slow ticker runs its hooks every so many step ticks, there is no ISP button or leds to look after
+SlowTicker::SlowTicker()
+{
+    global_slow_ticker = this;
+    max_frequency = 5;
+    set_frequency(max_frequency);
+    flag_1s_count = 0;
+    flag_1s_flag = 0;
+}
+
+void SlowTicker::on_module_loaded() {}
+void SlowTicker::on_idle(void*) {}
+void SlowTicker::start() {}
+
+void SlowTicker::set_frequency(int frequency)
+{
+    this->interval = (SystemCoreClock >> 2) / frequency;
+    StepTicker *st = StepTicker::getInstance();
+    slow_tick_period = st != nullptr ? st->get_frequency() / frequency : 1;
+    if(slow_tick_period == 0) slow_tick_period = 1;
+    slow_tick_countdown = slow_tick_period;
+}
+
+void SlowTicker::tick()
+{
+    for (Hook* hook : this->hooks) {
+        hook->countdown -= this->interval;
+        if (hook->countdown < 0) {
+            hook->countdown += hook->interval;
+            hook->call();
+        }
+    }
+}
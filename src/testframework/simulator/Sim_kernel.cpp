@@ -0,0 +1,257 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Kernel for the host side motion simulator, only the motion pipeline (Conveyor, Robot, Planner, StepTicker),
+GcodeDispatch and Laser are loaded.
+ON_IDLE doubles as the simulated step timer, every call runs a slice of step ticks so the ISR makes progress
+whenever the real code would be waiting on it.
+*/
+
+#include "Simulator.h"
+
+#include "libs/Kernel.h"
+#include "libs/Module.h"
+#include "libs/Config.h"
+#include "libs/StreamOutput.h"
+#include "libs/StreamOutputPool.h"
+#include "libs/StepTicker.h"
+#include "libs/SlowTicker.h"
+#include "libs/PublicData.h"
+#include "libs/MemoryPool.h"
+#include "modules/robot/Planner.h"
+#include "modules/robot/Robot.h"
+#include "modules/robot/Conveyor.h"
+#include "modules/communication/GcodeDispatch.h"
+#include "modules/communication/utils/Gcode.h"
+#include "modules/tools/laser/Laser.h"
+#include "SimpleShell.h"
+#include "checksumm.h"
+#include "ConfigValue.h"
+#include "FirmConfigSource.h"
+#include "Test_kernel.h"
+
+#include <stdio.h>
+#include <string>
+#include <map>
+
+#define base_stepping_frequency_checksum            CHECKSUM("base_stepping_frequency")
+#define microseconds_per_step_pulse_checksum        CHECKSUM("microseconds_per_step_pulse")
+#define laser_module_clustering_checksum            CHECKSUM("laser_module_clustering")
+#define arc_fitting_tolerance_checksum              CHECKSUM("arc_fitting_tolerance")
+
+Kernel* Kernel::instance;
+
+class StdoutStream : public StreamOutput {
+    public:
+        int puts(const char* s, int size = 0) { return fputs(s, stdout) < 0 ? 0 : strlen(s); }
+};
+
+Kernel::Kernel()
+{
+    halted = false;
+    feed_hold = false;
+    enable_feed_hold = false;
+    bad_mcu = false;
+    uploading = false;
+    laser_mode = false;
+    vacuum_mode = false;
+    optional_stop_mode = false;
+    line_by_line_exec_mode = false;
+    sleeping = false;
+    waiting = false;
+    tool_waiting = false;
+    suspending = false;
+    aborted = false;
+    halt_reason = MANUAL;
+    atc_state = 0;
+    zprobing = false;
+    probeLaserOn = false;
+    probe_addr = 0;
+    checkled = false;
+    spindleon = false;
+    cachewait = false;
+    grbl_mode = false;
+    ok_per_line = true;
+    use_leds = false;
+
+    instance = this;
+
+    // as the Kernel does at boot
+    Gcode::pool.reserve();
+
+    this->i2c = nullptr;
+    this->factory_set = new FACTORY_SET();
+    this->eeprom_data = new EEPROM_data();
+    this->factory_set->MachineModel = CARVERA;
+
+    this->streams = new StreamOutputPool();
+    this->streams->append_stream(new StdoutStream());
+    this->current_path = "/";
+
+    this->serial = nullptr;
+    this->gcode_dispatch = nullptr;
+    this->simpleshell = nullptr;
+    this->configurator = nullptr;
+    this->slow_ticker = nullptr;
+    this->adc = nullptr;
+    this->config = nullptr;
+    this->robot = nullptr;
+    this->planner = nullptr;
+    this->conveyor = nullptr;
+    this->step_ticker = nullptr;
+}
+
+void sim_kernel_setup(const char *config_file, const char *overrides)
+{
+    FILE *fp = fopen(config_file, "r");
+    if(fp == NULL) {
+        fprintf(stderr, "cannot open config %s\n", config_file);
+        exit(1);
+    }
+    // FirmConfigSource reads straight from the buffer so it has to live as long as the config
+    std::string *buf = new std::string();
+    char tmp[1024];
+    size_t n;
+    while((n = fread(tmp, 1, sizeof(tmp), fp)) > 0) buf->append(tmp, n);
+    fclose(fp);
+    if(overrides != nullptr) {
+        buf->append("\n");
+        buf->append(overrides);
+    }
+
+    THEKERNEL->config = new Config(new FirmConfigSource("rom", buf->data(), buf->data() + buf->size()));
+    THEKERNEL->config->config_cache_load();
+
+    THEKERNEL->step_ticker = new StepTicker();
+    THEKERNEL->base_stepping_frequency = THEKERNEL->config->value(base_stepping_frequency_checksum)->by_default(100000)->as_number();
+    float microseconds_per_step_pulse = THEKERNEL->config->value(microseconds_per_step_pulse_checksum)->by_default(1)->as_number();
+    THEKERNEL->step_ticker->set_frequency(THEKERNEL->base_stepping_frequency);
+    THEKERNEL->step_ticker->set_unstep_time(microseconds_per_step_pulse);
+    THEKERNEL->slow_ticker = new SlowTicker();
+
+    THEKERNEL->add_module(THEKERNEL->conveyor = new Conveyor());
+    THEKERNEL->add_module(THEKERNEL->robot = new Robot());
+    THEKERNEL->planner = new Planner();
+    THEKERNEL->add_module(THEKERNEL->gcode_dispatch = new GcodeDispatch());
+    THEKERNEL->add_module(new Laser());
+    sim_laser_setup();
+    sim_stats.laser_clustering = THEKERNEL->config->value(laser_module_clustering_checksum)->by_default(false)->as_bool();
+    sim_stats.arc_fit_tolerance = THEKERNEL->config->value(arc_fitting_tolerance_checksum)->by_default(0.0F)->as_number();
+
+    THEKERNEL->config->config_cache_clear();
+
+    THECONVEYOR->start(THEROBOT->get_number_registered_motors());
+    THEKERNEL->step_ticker->start();
+}
+
+void Kernel::add_module(Module* module)
+{
+    module->on_module_loaded();
+}
+
+void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod)
+{
+    this->hooks[id_event].push_back(mod);
+}
+
+void sim_mark_block_start()
+{
+    sim_stats.block_mark_ns = sim_host_ns();
+    sim_stats.block_mark_tick_ns = sim_stats.tick_ns;
+}
+
+static std::map<_EVENT_ENUM, std::function<void(void*)> > event_callbacks;
+
+void Kernel::call_event(_EVENT_ENUM id_event, void * argument)
+{
+    for (auto m : hooks[id_event]) {
+        (m->*kernel_callback_functions[id_event])(argument);
+    }
+    auto cb = event_callbacks.find(id_event);
+    if(cb != event_callbacks.end()) cb->second(argument);
+
+    if(id_event == ON_IDLE) {
+        // the ISR keeps running while the main loop waits
+        sim_run_ticks(sim_stats.ticks_per_idle);
+
+    }else if(id_event == ON_ENABLE && argument == (void*)1) {
+        // Conveyor::queue_head_block() fires this once per block it queues
+        uint64_t now = sim_host_ns();
+        uint64_t ns = (now - sim_stats.block_mark_ns) - (sim_stats.tick_ns - sim_stats.block_mark_tick_ns);
+        if(sim_stats.blocks == 0 || ns < sim_stats.block_min_ns) sim_stats.block_min_ns = ns;
+        if(ns > sim_stats.block_max_ns) sim_stats.block_max_ns = ns;
+        sim_stats.block_total_ns += ns;
+        sim_stats.blocks++;
+        sim_mark_block_start();
+    }
+}
+
+bool Kernel::kernel_has_event(_EVENT_ENUM id_event, Module *mod)
+{
+    for (auto m : hooks[id_event]) {
+        if(m == mod) return true;
+    }
+    return false;
+}
+
+void Kernel::unregister_for_event(_EVENT_ENUM id_event, Module *mod)
+{
+    for (auto i = hooks[id_event].begin(); i != hooks[id_event].end(); ++i) {
+        if(*i == mod) {
+            hooks[id_event].erase(i);
+            return;
+        }
+    }
+}
+
+// there is no shell, commands GcodeDispatch hands over to it are ignored
+bool SimpleShell::parse_command(const char *cmd, string args, StreamOutput *stream)
+{
+    return false;
+}
+
+uint8_t Kernel::get_state()
+{
+    return conveyor->is_idle() ? IDLE : RUN;
+}
+
+float Kernel::get_user_var(int var_num)
+{
+    return 0;
+}
+
+// there is no eeprom on the host, offsets just live in eeprom_data
+void Kernel::read_eeprom_data() {}
+void Kernel::write_eeprom_data() {}
+void Kernel::erase_eeprom_data() {}
+void Kernel::check_eeprom_data() {}
+
+// for the unit tests run with -T, they load the config and the modules they test themselves like on the target, see
+// Test_kernel.cpp
+void test_kernel_setup_config(const char* start, const char* end)
+{
+    THEKERNEL->config = new Config(new FirmConfigSource("rom", start, end));
+    THEKERNEL->config->config_cache_load();
+}
+
+void test_kernel_teardown()
+{
+    delete THEKERNEL->config;
+    THEKERNEL->config = nullptr;
+    event_callbacks.clear();
+}
+
+void test_kernel_trap_event(_EVENT_ENUM id_event, std::function<void(void*)> fnc)
+{
+    event_callbacks[id_event] = fnc;
+}
+
+void test_kernel_untrap_event(_EVENT_ENUM id_event)
+{
+    event_callbacks.erase(id_event);
+}
@@ -0,0 +1,121 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Checks the laser power follows the moves. Every step of the primary actuator of a G1/G2/G3 the power the block asks
+for at the speed of that step is worked out here from its S value, and compared with the duty cycle the Laser module
+had written to its PWM output by the end of that tick. Steps while the laser is off (M5) or testing are not checked,
+nor are G0s which should always have it at 0.
+*/
+
+#include "Simulator.h"
+
+#include "modules/robot/Block.h"
+#include "modules/tools/laser/LaserPublicAccess.h"
+#include "libs/Kernel.h"
+#include "libs/Config.h"
+#include "libs/ConfigValue.h"
+#include "libs/PublicData.h"
+#include "libs/StepTicker.h"
+#include "checksumm.h"
+#include "PwmOut.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#define laser_module_pwm_pin_checksum           CHECKSUM("laser_module_pwm_pin")
+#define laser_module_maximum_power_checksum     CHECKSUM("laser_module_maximum_power")
+#define laser_module_minimum_power_checksum     CHECKSUM("laser_module_minimum_power")
+#define laser_module_maximum_s_value_checksum   CHECKSUM("laser_module_maximum_s_value")
+
+// the power has to be within this of what the speed at each step asks for, as a fraction of full power
+#define LASER_POWER_TOLERANCE 0.02
+
+extern mbed::PwmOut *sim_pwm;
+
+struct LaserStats {
+    // settings
+    bool pwm_inverting;
+    float maximum_power;
+    float minimum_power;
+    float maximum_s_value;
+
+    const Block *block;
+    uint8_t primary;
+    uint32_t step_count;        // of the primary actuator at the last tick
+
+    uint64_t steps;             // checked
+    uint64_t g0_steps;
+    uint32_t g0_lit;            // G0 steps with the laser not at 0
+    uint32_t off_steps;         // over the tolerance
+    double max_error;
+    double total_error;
+};
+
+static LaserStats laser;
+
+void sim_laser_setup()
+{
+    laser.pwm_inverting = THEKERNEL->config->value(laser_module_pwm_pin_checksum)->by_default("2.4")->as_string().find('!') != std::string::npos;
+    laser.maximum_power = THEKERNEL->config->value(laser_module_maximum_power_checksum)->by_default(1.0f)->as_number();
+    laser.minimum_power = THEKERNEL->config->value(laser_module_minimum_power_checksum)->by_default(0)->as_number();
+    laser.maximum_s_value = THEKERNEL->config->value(laser_module_maximum_s_value_checksum)->by_default(1.0f)->as_number();
+}
+
+void sim_sample_laser(const Block *b)
+{
+    if(b != laser.block) {
+        laser.block = b;
+        laser.primary = 0;
+        for (uint8_t m = 1; m < Block::n_actuators; ++m) {
+            if(b->steps[m] > b->steps[laser.primary]) laser.primary = m;
+        }
+        laser.step_count = 0;
+    }
+
+    // only the ticks the primary actuator stepped on
+    uint32_t step_count = b->tick_info[laser.primary].step_count;
+    if(step_count == laser.step_count) return;
+    laser.step_count = step_count;
+
+    if(sim_pwm == nullptr) return;
+    float duty = sim_pwm->read();
+    double applied = laser.pwm_inverting ? 1 - duty : duty;
+
+    struct laser_status status;
+    if(!PublicData::get_value(laser_checksum, get_laser_status_checksum, &status) || !status.mode || status.testing) return;
+
+    if(!b->is_g123) {
+        laser.g0_steps++;
+        if(applied > 0) laser.g0_lit++;
+        return;
+    }
+    if(!status.state) return;
+
+    // the speed of this step, from the rate the primary actuator is stepping at
+    double rate = (double)b->tick_info[laser.primary].steps_per_tick / STEPTICKER_FPSCALE * THEKERNEL->step_ticker->get_frequency();
+    double power = (double)b->get_s_value(step_count) / (1 << 11) / laser.maximum_s_value * (rate / b->nominal_rate) * (status.scale / 100);
+    double commanded = (laser.maximum_power - laser.minimum_power) * power + laser.minimum_power;
+    if(commanded > 1) commanded = 1;
+    if(commanded <= 0.0001) commanded = 0;
+
+    double error = fabs(applied - commanded);
+    laser.steps++;
+    laser.total_error += error;
+    if(error > laser.max_error) laser.max_error = error;
+    if(error > LASER_POWER_TOLERANCE) laser.off_steps++;
+}
+
+bool sim_laser_report()
+{
+    printf("laser: %llu steps checked, power error max %1.4f avg %1.5f, %u steps off by more than %1.2f, %u of %llu G0 steps lit\n",
+           (unsigned long long)laser.steps, laser.max_error, laser.steps > 0 ? laser.total_error / laser.steps : 0,
+           laser.off_steps, LASER_POWER_TOLERANCE, laser.g0_lit, (unsigned long long)laser.g0_steps);
+    bool ok = laser.off_steps == 0 && laser.g0_lit == 0;
+    printf("laser check: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
@@ -0,0 +1,430 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Replays a gcode file through the real Robot/Planner/Conveyor/StepTicker code on the host and reports how fast the
+planner and the step ticker ISR run, see Readme.md
+*/
+
+#include "Simulator.h"
+
+#include "libs/Kernel.h"
+#include "libs/StreamOutput.h"
+#include "libs/StepTicker.h"
+#include "modules/robot/Robot.h"
+#include "modules/robot/Conveyor.h"
+#include "modules/robot/Planner.h"
+#include "StepperMotor.h"
+#include "libs/SerialMessage.h"
+#include "CompiledGcode.h"
+#include "ReadAheadFile.h"
+#include "LaserCluster.h"
+#include "ArcFitter.h"
+#include "GridCoefficients.h"
+#include "JobEstimate.h"
+#include "easyunit/testharness.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <algorithm>
+#include <math.h>
+
+// output from the modules (ok, error messages etc) is not interesting here
+static NullStreamOutput null_stream;
+
+static unsigned int lines_fed;
+static unsigned int lines_parsed;   // of those, sent already parsed from a compiled file
+static unsigned int lines_clustered;// of those, merged into raster lines
+static unsigned int clusters;
+static LaserCluster laser_cluster;
+static unsigned int lines_fitted;   // of those, sent as arcs
+static unsigned int arcs_fitted;
+static ArcFitter arc_fitter;
+
+static void send_line(const char *line, unsigned int lineno)
+{
+    struct SerialMessage message;
+    message.message = line;
+    message.stream = &null_stream;
+    message.line = lineno;
+    sim_mark_block_start();
+    THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+    lines_fed++;
+}
+
+static void send_cluster()
+{
+    if(laser_cluster.empty()) return;
+
+    std::string line;
+    unsigned int lines;
+    uint32_t len;
+    laser_cluster.flush(line, lines, len);
+    send_line(line.c_str(), lines_fed + 1);
+    lines_fed += lines - 1;
+    lines_clustered += lines;
+    clusters++;
+}
+
+// same as Player::cluster_line, true if the line was taken into the raster line being merged
+static bool cluster_line(const CompiledLine *cl, unsigned int len)
+{
+    arc_fitter.moved(nullptr, true);
+    laser_cluster.set_max_values(std::min(THECONVEYOR->get_max_power_values(), (size_t)MAX_S_VALUES));
+
+    bool absolute = THEROBOT->absolute_mode;
+    if(cl != nullptr && laser_cluster.add(*cl, absolute, len)) return true;
+    send_cluster();
+    if(cl != nullptr && laser_cluster.add(*cl, absolute, len)) return true;
+    laser_cluster.moved(cl, absolute);
+    return false;
+}
+
+static bool clustering()
+{
+    return sim_stats.laser_clustering && (THEKERNEL->get_laser_mode() || !laser_cluster.empty());
+}
+
+static void send_fitted()
+{
+    while(!arc_fitter.empty()) {
+        std::string line;
+        unsigned int lines;
+        uint32_t len;
+        arc_fitter.flush(line, lines, len);
+        send_line(line.c_str(), lines_fed + 1);
+        lines_fed += lines - 1;
+        if(lines > 1) {
+            lines_fitted += lines;
+            arcs_fitted++;
+        }
+    }
+}
+
+// same as Player::fit_line, true if the line was taken into the arc being fitted
+static bool fit_line(const CompiledLine *cl, unsigned int len)
+{
+    if(THEROBOT->plane_axis_2 != Z_AXIS) cl = nullptr;
+    arc_fitter.set_tolerance(THEROBOT->from_millimeters(sim_stats.arc_fit_tolerance));
+
+    bool absolute = THEROBOT->absolute_mode;
+    if(cl != nullptr && arc_fitter.add(*cl, absolute, len)) return true;
+    send_fitted();
+    if(cl != nullptr && arc_fitter.add(*cl, absolute, len)) return true;
+    arc_fitter.moved(cl, absolute);
+    return false;
+}
+
+// feed the file the way Player does, 130 byte chunks with longer lines discarded
+static void play_text(FILE *fp)
+{
+    char buf[130];
+    bool discard = false;
+    while(fgets(buf, sizeof(buf), fp) != NULL) {
+        int len = strlen(buf);
+        if(len == 0) continue;
+        if(buf[len - 1] == '\n' || feof(fp)) {
+            if(discard) {
+                discard = false;
+                continue;
+            }
+            if(len == 1) continue;
+            if(clustering()) {
+                CompiledLine cl;
+                if(cluster_line(GcodeCompiler::parse_motion(buf, len, cl) ? &cl : nullptr, len)) continue;
+            } else if(sim_stats.arc_fit_tolerance > 0) {
+                CompiledLine cl;
+                if(fit_line(GcodeCompiler::parse_motion(buf, len, cl) ? &cl : nullptr, len)) continue;
+            }
+            send_line(buf, lines_fed + 1);
+        } else {
+            discard = true;
+        }
+    }
+    send_cluster();
+    send_fitted();
+}
+
+static bool compile_file(FILE *fp, const char *out, uint32_t size)
+{
+    GcodeCompiler compiler;
+    if(!compiler.begin(out)) return false;
+
+    char buf[130];
+    while(fgets(buf, sizeof(buf), fp) != NULL) {
+        compiler.add_line(buf, strlen(buf));
+    }
+    if(!compiler.finish(size, SourceStamp())) return false;
+
+    printf("compiled: %u motion lines, %u other lines\n", (unsigned)compiler.get_motion_lines(), (unsigned)compiler.get_text_lines());
+    return true;
+}
+
+// feed a compiled file the way Player::feed_compiled does
+static bool play_compiled(const char *path, uint32_t size)
+{
+    FILE *fp = CompiledGcode::open(path, size, SourceStamp());
+    if(fp == NULL) return false;
+
+    ReadAheadFile reader;
+    reader.set_size(2048);
+    reader.attach(fp);
+    reader.seek(COMPILED_GCODE_HEADER_SIZE);
+
+    CompiledLine cl;
+    while(CompiledGcode::read(reader, cl)) {
+        if(clustering()) {
+            if(cluster_line(cl.type == COMPILED_MOTION ? &cl : nullptr, cl.len)) continue;
+        } else if(sim_stats.arc_fit_tolerance > 0) {
+            if(fit_line(cl.type == COMPILED_MOTION ? &cl : nullptr, cl.len)) continue;
+        }
+        if(cl.type == COMPILED_MOTION) {
+            sim_mark_block_start();
+            CompiledGcode::dispatch(cl, &null_stream, lines_fed + 1);
+            lines_fed++;
+            lines_parsed++;
+        } else {
+            send_line(cl.text, lines_fed + 1);
+        }
+    }
+    send_cluster();
+    send_fitted();
+    reader.detach();
+    fclose(fp);
+    return true;
+}
+
+// a warped bed probed on a 7x7 grid from 0,0 to x_size,y_size, compensated the way CartGridStrategy does it
+#define SIM_GRID_SIZE 7
+static GridCoefficients sim_grid;
+
+static bool setup_grid(const char *arg)
+{
+    float x_size, y_size;
+    if(sscanf(arg, "%f,%f", &x_size, &y_size) != 2) return false;
+
+    float grid[SIM_GRID_SIZE * SIM_GRID_SIZE];
+    for (int y = 0; y < SIM_GRID_SIZE; ++y) {
+        for (int x = 0; x < SIM_GRID_SIZE; ++x) {
+            grid[x + SIM_GRID_SIZE * y] = 0.2F * sinf(x * 0.9F) + 0.1F * cosf(y * 1.3F) - 0.01F * x * y;
+        }
+    }
+    if(!sim_grid.build(grid, SIM_GRID_SIZE, SIM_GRID_SIZE, 0, 0, x_size, y_size, false)) return false;
+
+    THEROBOT->compensationTransform = [](float *target, bool inverse, bool debug) {
+        float offset = sim_grid.offset(target[X_AXIS], target[Y_AXIS]);
+        if(!isnan(offset)) target[Z_AXIS] += inverse ? -offset : offset;
+    };
+    THEROBOT->compensationSplits = [](const float *start, const float *end, float *t, int max) {
+        return sim_grid.splits(start[X_AXIS], start[Y_AXIS], end[X_AXIS], end[Y_AXIS], 0.001F, t, max);
+    };
+    return true;
+}
+
+// what the estimate command would report for the file, run before the file is played so it starts from the same place
+static double estimate_file(FILE *fp)
+{
+    JobEstimate estimate;
+    if(!estimate.begin()) {
+        printf("estimate: no memory for the queue\n");
+        return 0;
+    }
+    uint64_t t = sim_host_ns();
+    char buf[130];
+    bool discard = false;
+    unsigned int lines = 0;
+    while(fgets(buf, sizeof(buf), fp) != NULL) {
+        size_t len = strlen(buf);
+        if(len == 0) continue;
+        if(buf[len - 1] == '\n' || feof(fp)) {
+            if(!discard) estimate.add_line(buf, len);
+            discard = false;
+        } else {
+            discard = true;
+        }
+        lines++;
+    }
+    estimate.finish();
+    fseek(fp, 0, SEEK_SET);
+    double ns = sim_host_ns() - t;
+
+    printf("estimate: %u lines, %u blocks in %1.3f ms, %1.0f lines/s\n", lines, (unsigned)estimate.get_blocks(), ns / 1e6, lines / (ns / 1e9));
+    printf("estimate: total %1.3f s, rapid %1.3f s, cutting %1.3f s, dwell %1.3f s, %u tool changes, %u commands not counted\n",
+           estimate.get_total(), estimate.get_rapid(), estimate.get_cutting(), estimate.get_dwell(),
+           (unsigned)estimate.get_tool_changes(), (unsigned)estimate.get_untimed());
+    for (int i = 0; i < estimate.get_tool_count(); ++i) {
+        if(estimate.get_tool_time(i) > 0) printf("estimate: tool %d %1.3f s\n", estimate.get_tool(i), estimate.get_tool_time(i));
+    }
+    return estimate.get_total();
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-c config] [-q planner_queue_size] [-e \"setting value\"] [-p] [-l] [-t ticks_per_idle] [-b] [-g x_size,y_size] [-o compiled_out] [-E] file.cnc\n", name);
+    fprintf(stderr, "       %s -T runs the motion unit tests\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *config_file = "src/config.default";
+    const char *gcode_file = nullptr;
+    const char *compiled_out = nullptr;
+    bool compiled = false;
+    bool estimate = false;
+    const char *grid_size = nullptr;
+    uint32_t ticks_per_idle = 0;
+    bool unit_tests = false;
+    std::string overrides;
+
+    for (int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) config_file = argv[++i];
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) ticks_per_idle = strtoul(argv[++i], nullptr, 10);
+        else if(strcmp(argv[i], "-q") == 0 && i + 1 < argc) overrides += std::string("planner_queue_size ") + argv[++i] + "\n";
+        else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc) overrides += std::string(argv[++i]) + "\n";
+        else if(strcmp(argv[i], "-p") == 0) sim_stats.check_profile = true;
+        else if(strcmp(argv[i], "-l") == 0) sim_stats.check_laser = true;
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) compiled_out = argv[++i];
+        else if(strcmp(argv[i], "-b") == 0) compiled = true;
+        else if(strcmp(argv[i], "-E") == 0) estimate = true;
+        else if(strcmp(argv[i], "-g") == 0 && i + 1 < argc) grid_size = argv[++i];
+        else if(strcmp(argv[i], "-T") == 0) unit_tests = true;
+        else if(argv[i][0] == '-') usage(argv[0]);
+        else gcode_file = argv[i];
+    }
+
+    if(unit_tests) {
+        // they bring up what they test themselves
+        new Kernel();
+        const TestResult *result = TestRegistry::runAndPrint();
+        return result->getTotalFailures() + result->getTotalErrors() > 0 ? 2 : 0;
+    }
+    if(gcode_file == nullptr) usage(argv[0]);
+
+    FILE *fp = fopen(gcode_file, "r");
+    if(fp == NULL) {
+        fprintf(stderr, "cannot open %s\n", gcode_file);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    uint32_t size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    // just make the compiled file, eg to copy it to /sd/gcodes/.gcb/ with the gcode file
+    if(compiled_out != nullptr) {
+        bool ok = compile_file(fp, compiled_out, size);
+        fclose(fp);
+        if(!ok) fprintf(stderr, "cannot compile %s to %s\n", gcode_file, compiled_out);
+        return ok ? 0 : 1;
+    }
+
+    new Kernel();
+    sim_kernel_setup(config_file, overrides.c_str());
+    if(grid_size != nullptr && !setup_grid(grid_size)) {
+        fprintf(stderr, "bad grid size %s\n", grid_size);
+        return 1;
+    }
+
+    // default to the ISR getting 1ms ahead of the main loop each time it idles
+    uint32_t freq = THEKERNEL->base_stepping_frequency;
+    sim_stats.ticks_per_idle = ticks_per_idle > 0 ? ticks_per_idle : (freq / 1000 > 0 ? freq / 1000 : 1);
+
+    char tmpname[] = "/tmp/smoothie_sim_XXXXXX";
+    if(compiled) {
+        int fd = mkstemp(tmpname);
+        if(fd < 0) {
+            fprintf(stderr, "cannot create a temporary file\n");
+            return 1;
+        }
+        close(fd);
+        uint64_t t = sim_host_ns();
+        if(!compile_file(fp, tmpname, size)) {
+            fprintf(stderr, "cannot compile %s\n", gcode_file);
+            remove(tmpname);
+            return 1;
+        }
+        printf("compile time: %1.3f ms\n", (sim_host_ns() - t) / 1e6);
+    }
+
+    double estimated = estimate ? estimate_file(fp) : 0;
+
+    // the file is a job as Player plays one, the queue running dry before its end is an underrun
+    THECONVEYOR->set_job_running(true);
+    uint64_t start = sim_host_ns();
+    if(compiled) {
+        play_compiled(tmpname, size);
+        remove(tmpname);
+    } else {
+        play_text(fp);
+    }
+    fclose(fp);
+    THECONVEYOR->set_job_running(false);
+
+    THECONVEYOR->wait_for_idle();
+    uint64_t wall_ns = sim_host_ns() - start;
+    uint64_t plan_ns = wall_ns - sim_stats.tick_ns;
+
+    printf("file: %s, %u lines fed (%u already parsed), %u blocks\n", gcode_file, lines_fed, lines_parsed, sim_stats.blocks);
+    if(sim_stats.laser_clustering) {
+        printf("laser clustering: %u lines merged into %u raster lines\n", lines_clustered, clusters);
+    }
+    if(sim_stats.arc_fit_tolerance > 0) {
+        printf("arc fitting: %u lines fitted into %u arcs\n", lines_fitted, arcs_fitted);
+    }
+    printf("host time: %1.3f ms total, %1.3f ms planning, %1.3f ms in step ticker\n",
+           wall_ns / 1e6, plan_ns / 1e6, sim_stats.tick_ns / 1e6);
+    printf("feed: %1.0f lines/s\n", lines_fed / (plan_ns / 1e9));
+    if(sim_stats.blocks > 0) {
+        printf("planner: %1.0f blocks/s, latency per block min/avg/max %1.2f/%1.2f/%1.2f us\n",
+               sim_stats.blocks / (plan_ns / 1e9),
+               sim_stats.block_min_ns / 1e3, (double)sim_stats.block_total_ns / sim_stats.blocks / 1e3, sim_stats.block_max_ns / 1e3);
+    }
+    if(sim_stats.tick_ns > 0) {
+        double ticks_s = sim_stats.ticks / (sim_stats.tick_ns / 1e9);
+        printf("step ticker: %llu ticks (%llu idle), %1.0f ticks/s sustained, %1.1fx base_stepping_frequency of %lu Hz\n",
+               (unsigned long long)sim_stats.ticks, (unsigned long long)sim_stats.idle_ticks, ticks_s, ticks_s / freq, (unsigned long)freq);
+    }
+    if(THEKERNEL->planner->get_merged_segments() > 0) {
+        printf("planner merge: %lu segments merged into the blocks before them\n", (unsigned long)THEKERNEL->planner->get_merged_segments());
+    }
+    printf("simulated machine time: %1.3f s\n", (double)sim_stats.ticks / freq);
+    if(estimate) {
+        double machine = (double)sim_stats.ticks / freq;
+        printf("estimate: %1.3f s, %+1.2f%% of the simulated machine time\n", estimated, (estimated - machine) / machine * 100);
+    }
+    Conveyor::QueueStats qs = THECONVEYOR->get_queue_stats();
+    printf("queue: blocks handed to the step ticker with this many queued behind them");
+    for (int i = 0; i < CONVEYOR_DEPTH_BUCKETS && i * qs.depth_bucket < THECONVEYOR->get_queue_size(); ++i) {
+        printf(" %u-%u: %u", (unsigned)(i * qs.depth_bucket), (unsigned)((i + 1) * qs.depth_bucket - 1), (unsigned)qs.depth[i]);
+    }
+    printf(", %u not staged in time\nqueue: %u underruns for %1.3f s (longest %1.3f s), %u waits for idle\n", (unsigned)qs.unstaged,
+           (unsigned)qs.underruns, (double)qs.underrun_ticks / freq, (double)qs.max_underrun_ticks / freq, (unsigned)qs.waits);
+    sim_planner_report(THECONVEYOR->get_queue_size());
+    if(sim_stats.check_laser && sim_stats.ticks > 0) {
+        // for a raster these are its pixels, per second of planning and per second of the job
+        printf("laser: %llu powers, %1.0f/s planned, %1.0f/s of machine time\n", (unsigned long long)sim_stats.laser_values,
+               sim_stats.laser_values / (plan_ns / 1e9), sim_stats.laser_values / ((double)sim_stats.ticks / freq));
+    }
+    bool profile_ok = !sim_stats.check_profile || sim_profile_report();
+    bool laser_ok = !sim_stats.check_laser || sim_laser_report();
+
+    // every step the planner asked for should have been issued by the step ticker
+    bool ok = true;
+    for (size_t i = 0; i < THEROBOT->actuators.size(); ++i) {
+        StepperMotor *a = THEROBOT->actuators[i];
+        if((int32_t)a->get_current_step() != a->get_last_milestone_steps()) {
+            printf("actuator %u: stepped to %ld but planned %ld\n", (unsigned)i, (long)(int32_t)a->get_current_step(), (long)a->get_last_milestone_steps());
+            ok = false;
+        }
+    }
+    printf("step check: %s\n", ok ? "ok" : "FAILED");
+
+    return ok && profile_ok && laser_ok ? 0 : 2;
+}
@@ -0,0 +1,239 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+Where the machine time of a replay went. Every block is recorded as the step ticker starts it, with the speeds it
+actually ran at, afterwards the whole job is replanned with the same junction limits but looking ahead over all of
+it. The difference between the two is time the planner lost by not seeing far enough ahead (the last block in the
+queue always has to plan to stop), the difference between the replan and running every block at its feed rate is
+time lost to acceleration.
+*/
+
+#include "Simulator.h"
+
+#include "modules/robot/Block.h"
+#include "libs/Kernel.h"
+#include "libs/StepTicker.h"
+#include "modules/robot/Robot.h"
+#include "modules/robot/Planner.h"
+#include "StepperMotor.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+struct SimBlock {
+    float millimeters;
+    float nominal_speed;
+    float acceleration;
+    float max_entry_speed;  // junction limit with the previous block
+    float entry_speed;      // what it ran at
+    float exit_speed;
+    bool after_stop;        // the queue had run dry, eg waiting for an M code, so it had to start from a stop
+};
+
+static std::vector<SimBlock> blocks;
+
+void sim_record_block(const Block *b, bool after_stop)
+{
+    SimBlock sb;
+    sb.millimeters = b->millimeters;
+    sb.nominal_speed = b->nominal_speed;
+    sb.acceleration = b->acceleration;
+    sb.max_entry_speed = b->max_entry_speed;
+    sb.entry_speed = b->nominal_rate > 0 ? b->initial_rate * b->nominal_speed / b->nominal_rate : 0;
+    sb.exit_speed = b->exit_speed;
+    sb.after_stop = after_stop;
+    blocks.push_back(sb);
+    if(b->is_g123) sim_stats.laser_values += b->s_count > 1 ? b->s_count : 1;
+}
+
+// time for a trapezoid (or triangle) from v0 to v1 over d with cruise speed vn
+static double move_time(double v0, double v1, double vn, double a, double d)
+{
+    double da = (vn * vn - v0 * v0) / (2 * a);
+    double dd = (vn * vn - v1 * v1) / (2 * a);
+    if(da + dd <= d) {
+        return (vn - v0) / a + (vn - v1) / a + (d - da - dd) / vn;
+    }
+    double vp = sqrt(a * d + (v0 * v0 + v1 * v1) / 2);
+    vp = std::max(vp, std::max(v0, v1));
+    return (vp - v0) / a + (vp - v1) / a;
+}
+
+void sim_planner_report(uint32_t queue_size)
+{
+    size_t n = blocks.size();
+    if(n == 0) return;
+
+    double feed_time = 0, run_time = 0, ideal_time = 0;
+    unsigned stops = 0;
+    for (auto& b : blocks) {
+        feed_time += b.millimeters / b.nominal_speed;
+        run_time += move_time(b.entry_speed, b.exit_speed, b.nominal_speed, b.acceleration, b.millimeters);
+        if(b.after_stop) stops++;
+    }
+
+    // reverse pass, the fastest each block can be entered and still slow down for everything after it.
+    // Blocks that ran after a stop or before one keep the speeds they ran at as nothing would change those
+    std::vector<float> max_entry(n);
+    float next_entry = 0;
+    for (size_t i = n; i-- > 0; ) {
+        const SimBlock& b = blocks[i];
+        float exit = (i == n - 1 || blocks[i + 1].after_stop) ? b.exit_speed : next_entry;
+        float v = b.after_stop ? b.entry_speed : std::min(b.max_entry_speed, b.nominal_speed);
+        max_entry[i] = std::min(v, sqrtf(exit * exit + 2 * b.acceleration * b.millimeters));
+        next_entry = max_entry[i];
+    }
+
+    // forward pass, limited by how fast each block can get going from the one before it
+    float prev_exit = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const SimBlock& b = blocks[i];
+        float entry = b.after_stop ? b.entry_speed : std::min(max_entry[i], prev_exit);
+        float exit = (i == n - 1 || blocks[i + 1].after_stop) ? b.exit_speed : max_entry[i + 1];
+        exit = std::min(exit, sqrtf(entry * entry + 2 * b.acceleration * b.millimeters));
+        ideal_time += move_time(entry, exit, b.nominal_speed, b.acceleration, b.millimeters);
+        prev_exit = exit;
+    }
+
+    printf("motion: %u blocks (%u from a stop), %1.3f s at feed rate, acceleration limited +%1.3f s, planner limited +%1.3f s with a %lu block queue\n",
+           (unsigned)n, stops, feed_time, ideal_time - feed_time, run_time - ideal_time, (unsigned long)queue_size);
+}
+
+// the path speed of the running block is taken from the rate of its primary axis
+struct ProfileStats {
+    const Block *block;
+    uint8_t primary;
+    double speed;               // mm/s at the last tick
+    double accel;               // mm/s² over the last tick
+    double max_accel;
+    double max_accel_step;      // within a block
+    double max_boundary_speed_step;
+    double max_boundary_accel_step;
+    double max_s_curve_exit_error; // between the speed an S-curve block ended at and its exit speed
+    double max_s_curve_jerk;    // mm/s³ within S-curve blocks, away from the ramp events
+    uint32_t tick;              // of the running block
+    uint32_t boundaries;
+    uint32_t unramped;          // blocks entered faster than they could slow down from, they run at their entry speed
+    double actuator_rate[k_max_actuators];      // mm/s (or degrees/s) of each actuator at the last tick
+    double actuator_max_accel[k_max_actuators]; // within unshaped blocks with long enough ramps and steps
+};
+
+// an S-curve block has to end at its exit speed, give or take the rounding of its ramps to ticks
+#define S_CURVE_SPEED_TOLERANCE 0.5 // mm/s
+// Block::calculate_trapezoid() rounds ramps down to whole ticks and raises the acceleration to match, by up to a tick's
+// worth, and an actuator's share of the block is its whole steps, not the mm it was limited by, so the actuator
+// accelerations are only checked where ramps and steps are long enough for that to be within 1%
+#define ACTUATOR_ACCELERATION_TOLERANCE 1.01
+#define ACTUATOR_ACCELERATION_MIN_RAMP 100 // ticks
+#define ACTUATOR_ACCELERATION_MIN_STEPS 100
+// an S-curve block changes its acceleration at up to max_jerk, give or take the rounding of its ramps and jerk ticks to
+// whole ticks, which is within 5% on ramps that long. The last few ticks are left out as the steps can run out first
+#define S_CURVE_JERK_TOLERANCE 1.05
+#define S_CURVE_END_TICKS 10
+
+static ProfileStats profile;
+
+// the acceleration is measured over a tick so a step in the rate shows in the two ticks either side of it
+static bool near_event(uint32_t tick, uint32_t event)
+{
+    return tick + 2 >= event && tick <= event + 2;
+}
+
+void sim_sample_profile(const Block *b, bool after_stop)
+{
+    double freq = THEKERNEL->step_ticker->get_frequency();
+    bool boundary = b != profile.block;
+    if(boundary) {
+        const Block *prev = profile.block;
+        if(prev != nullptr && !after_stop) {
+            // the ramp events are left unreachable when the block can not get from its entry to its exit speed
+            if(prev->accelerate_until > prev->total_move_ticks || prev->decelerate_after > prev->total_move_ticks) {
+                profile.unramped++;
+            } else if(prev->s_curve) {
+                profile.max_s_curve_exit_error = std::max(profile.max_s_curve_exit_error, fabs(profile.speed - prev->exit_speed));
+            }
+        }
+        profile.block = b;
+        profile.tick = 0;
+        profile.primary = 0;
+        for (uint8_t m = 1; m < Block::n_actuators; ++m) {
+            if(b->steps[m] > b->steps[profile.primary]) profile.primary = m;
+        }
+        if(after_stop) {
+            profile.speed = 0;
+            profile.accel = 0;
+        }
+    }
+
+    // each actuator's own acceleration, shaped ramps peak above it on purpose so they are left out
+    uint32_t accel_ticks = b->accelerate_until <= b->total_move_ticks ? b->accelerate_until : 0;
+    uint32_t decel_ticks = b->decelerate_after < b->total_move_ticks ? b->total_move_ticks - b->decelerate_after : 0;
+    bool long_ramps = (accel_ticks == 0 || accel_ticks >= ACTUATOR_ACCELERATION_MIN_RAMP) &&
+                      (decel_ticks == 0 || decel_ticks >= ACTUATOR_ACCELERATION_MIN_RAMP);
+    for (uint8_t m = 0; m < Block::n_actuators; ++m) {
+        double rate = (double)b->tick_info[m].steps_per_tick / STEPTICKER_FPSCALE * freq / THEROBOT->actuators[m]->get_steps_per_mm();
+        if(!boundary && !b->shaped && long_ramps && b->steps[m] >= ACTUATOR_ACCELERATION_MIN_STEPS) {
+            profile.actuator_max_accel[m] = std::max(profile.actuator_max_accel[m], fabs(rate - profile.actuator_rate[m]) * freq);
+        }
+        profile.actuator_rate[m] = rate;
+    }
+
+    double rate = (double)b->tick_info[profile.primary].steps_per_tick / STEPTICKER_FPSCALE;
+    double speed = rate * freq * b->millimeters / b->steps_event_count;
+    double accel = (speed - profile.speed) * freq;
+    double accel_step = fabs(accel - profile.accel);
+
+    if(boundary) {
+        if(!after_stop) {
+            profile.max_boundary_speed_step = std::max(profile.max_boundary_speed_step, fabs(speed - profile.speed));
+            profile.max_boundary_accel_step = std::max(profile.max_boundary_accel_step, accel_step);
+            profile.boundaries++;
+        }
+    } else {
+        profile.max_accel = std::max(profile.max_accel, fabs(accel));
+        profile.max_accel_step = std::max(profile.max_accel_step, accel_step);
+        // the rate is set to the plateau rate at the end of the acceleration ramp, which steps it by the rounding, the
+        // acceleration on the first tick is still the one from the boundary and the steps can run out a few ticks before
+        // the deceleration ramp does
+        if(b->s_curve && long_ramps && profile.tick > 1 && !near_event(profile.tick, b->accelerate_until) && !near_event(profile.tick, b->decelerate_after) &&
+           profile.tick + S_CURVE_END_TICKS < b->total_move_ticks) {
+            profile.max_s_curve_jerk = std::max(profile.max_s_curve_jerk, accel_step * freq);
+        }
+    }
+    profile.speed = speed;
+    profile.accel = accel;
+    profile.tick++;
+}
+
+bool sim_profile_report()
+{
+    printf("profile: %u block boundaries, speed step at boundaries max %1.4f mm/s, acceleration max %1.1f mm/s², acceleration step max %1.1f mm/s² within blocks, %1.1f mm/s² at boundaries\n",
+           profile.boundaries, profile.max_boundary_speed_step, profile.max_accel, profile.max_accel_step, profile.max_boundary_accel_step);
+    printf("profile: %u blocks could not ramp to their exit speed, S-curve exit speed error max %1.4f mm/s, jerk max %1.0f mm/s³\n",
+           profile.unramped, profile.max_s_curve_exit_error, profile.max_s_curve_jerk);
+    // only S-curve blocks are checked, trapezoid ones are just reported
+    bool ok = profile.max_s_curve_exit_error <= S_CURVE_SPEED_TOLERANCE;
+    ok = ok && profile.max_s_curve_jerk <= THEKERNEL->planner->get_max_jerk() * S_CURVE_JERK_TOLERANCE;
+
+    // and that no actuator with an acceleration of its own went over it
+    printf("profile: actuator acceleration max");
+    for (uint8_t m = 0; m < Block::n_actuators; ++m) {
+        float limit = THEROBOT->actuators[m]->get_acceleration();
+        if(m == A_AXIS) limit *= A_AXIS_COMBINED_ACCELERATION;
+        printf(" %u: %1.1f", (unsigned)m, profile.actuator_max_accel[m]);
+        if(!isnan(limit)) {
+            printf(" (limit %1.1f)", limit);
+            if(profile.actuator_max_accel[m] > limit * ACTUATOR_ACCELERATION_TOLERANCE) ok = false;
+        }
+    }
+    printf("\n");
+    printf("profile check: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
@@ -0,0 +1,75 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Host side motion pipeline simulator, see Readme.md
+
+// host wall clock in nanoseconds, used to time the real planner and step ticker code
+uint64_t sim_host_ns();
+
+// simulated timer, advances simulated time by running the step ticker ISR (and the unstep ISR when armed)
+void sim_run_ticks(uint32_t n);
+
+// load the config and bring up Conveyor, Robot, Planner and StepTicker like main() does
+// overrides are extra config lines which replace the ones in the file
+void sim_kernel_setup(const char *config_file, const char *overrides = nullptr);
+
+struct SimStats {
+    // simulated machine
+    uint64_t ticks;             // step ticker ISR calls
+    uint64_t idle_ticks;        // ISR calls with no block to run
+    uint32_t ticks_per_idle;    // ticks run per ON_IDLE, ie how much the ISR gets ahead of the main loop
+    bool check_profile;         // sample the speed every tick, slows the step ticker down
+    bool check_laser;           // compare the laser power with the speed at every step
+    bool laser_clustering;      // merge raster lines like Player does with laser_module_clustering
+    float arc_fit_tolerance;    // fit G1s into arcs like Player does with arc_fitting_tolerance
+
+    // host time
+    uint64_t tick_ns;           // spent in the step ticker ISR
+    uint64_t plan_ns;           // spent in the main loop minus the ISR
+
+    // blocks
+    uint32_t blocks;
+    uint64_t laser_values;      // laser powers the G1/G2/G3 blocks that ran carried, one for a plain S
+    uint64_t block_min_ns;
+    uint64_t block_max_ns;
+    uint64_t block_total_ns;
+    uint64_t block_mark_ns;     // start of the block currently being planned
+    uint64_t block_mark_tick_ns;// tick_ns at block_mark_ns
+};
+
+extern SimStats sim_stats;
+
+// start timing the next block planned (call before each line handed to the robot)
+void sim_mark_block_start();
+
+class Block;
+
+// the step ticker started running b, after_stop if it had run out of blocks before it
+void sim_record_block(const Block *b, bool after_stop);
+
+// replan the blocks that ran with unlimited look ahead and print how much of the machine time was spent at the
+// requested feed rates, how much was lost to acceleration and how much to the planner queue being too short
+void sim_planner_report(uint32_t queue_size);
+
+// the step ticker ran a tick of b, after_stop if it is the first tick of a block starting from a stop
+void sim_sample_profile(const Block *b, bool after_stop);
+
+// print how continuous the speed and acceleration the step ticker generated were, false if the speed jumped
+bool sim_profile_report();
+
+// read the laser settings the laser check needs, while the config is loaded
+void sim_laser_setup();
+
+// the step ticker ran a tick of b, checks the laser power set for it if the primary actuator stepped
+void sim_sample_laser(const Block *b);
+
+// print how far the laser power was from what the block asked for at the speed of each step, false if too far
+bool sim_laser_report();
@@ -1,6 +1,7 @@
 #include "utils.h"
 
 #include "Gcode.h"
+#include "us_ticker_api.h"
 
 #include <vector>
 #include <stdio.h>
@@ -60,3 +61,125 @@ TEST(GCodeTest,subcode)
     ASSERT_EQUALS_DELTA_V(2.3, gc4.get_value('Y'), 0.001);
 
 }
+
+TEST(GCodeTest,word_table)
+{
+    Gcode gc("G1 X1.5 Y-2 Z.5 F1200 S+3.", nullptr, false);
+
+    ASSERT_TRUE(gc.has_g);
+    ASSERT_EQUALS_V(1, gc.g);
+    ASSERT_EQUALS_V(5, gc.get_num_args());
+    ASSERT_TRUE(gc.has_letter('X'));
+    ASSERT_TRUE(!gc.has_letter('A'));
+    ASSERT_EQUALS_DELTA_V(1.5, gc.get_value('X'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(-2.0, gc.get_value('Y'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(0.5, gc.get_value('Z'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(1200.0, gc.get_value('F'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(3.0, gc.get_value('S'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(0.0, gc.get_value('A'), 0.0001);
+    ASSERT_EQUALS_V(1200, gc.get_int('F'));
+
+    std::map<char,float> args= gc.get_args();
+    ASSERT_EQUALS_V(5, (int)args.size());
+    ASSERT_EQUALS_DELTA_V(-2.0, args['Y'], 0.0001);
+
+    // exponents are not parsed, the E is a word of its own
+    Gcode gc2("G1 X1.5E2", nullptr, false);
+    ASSERT_EQUALS_DELTA_V(1.5, gc2.get_value('X'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(2.0, gc2.get_value('E'), 0.0001);
+}
+
+TEST(GCodeTest,expressions)
+{
+    // anything but a plain number is still evaluated
+    Gcode gc("G1 X[1+2] Y2 * 3 Z4", nullptr, false);
+    ASSERT_EQUALS_DELTA_V(3.0, gc.get_value('X'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(6.0, gc.get_value('Y'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(4.0, gc.get_value('Z'), 0.0001);
+}
+
+TEST(GCodeTest,long_command)
+{
+    // too long to be kept inline
+    std::string cmd= "G1 X1 Y2 Z3 A4 B5 F6000 S100";
+    while(cmd.size() < 2 * GCODE_INLINE_SIZE) cmd += " ";
+    cmd += "I7";
+    Gcode gc(cmd, nullptr);
+    ASSERT_EQUALS_V(1, gc.g);
+    ASSERT_EQUALS_DELTA_V(7.0, gc.get_value('I'), 0.0001);
+
+    Gcode gc2(gc);
+    Gcode gc3("G0", nullptr);
+    gc3= gc2;
+    ASSERT_TRUE(gc2.get_command() != gc.get_command());
+    ASSERT_TRUE(strcmp(gc3.get_command(), gc.get_command()) == 0);
+    ASSERT_EQUALS_DELTA_V(7.0, gc3.get_value('I'), 0.0001);
+    ASSERT_EQUALS_V(8, gc3.get_num_args());
+
+    gc3.strip_parameters();
+    ASSERT_TRUE(!gc3.has_letter('X'));
+    ASSERT_TRUE(!gc3.has_letter('I'));
+    ASSERT_EQUALS_DELTA_V(6000.0, gc3.get_value('F'), 0.0001);
+    ASSERT_EQUALS_V(4, gc3.get_num_args());
+}
+
+TEST(GCodeTest,pre_parsed)
+{
+    float values[]= {1.5, 2.5, 3.5};
+    Gcode gc(1, (1 << ('X' - 'A')) | (1 << ('Y' - 'A')) | (1 << ('Z' - 'A')), values, nullptr);
+    ASSERT_TRUE(gc.has_g);
+    ASSERT_TRUE(gc.has_letter('G'));
+    ASSERT_TRUE(gc.has_letter('Y'));
+    ASSERT_TRUE(!gc.has_letter('F'));
+    ASSERT_EQUALS_V(3, gc.get_num_args());
+    ASSERT_EQUALS_DELTA_V(2.5, gc.get_value('Y'), 0.0001);
+    ASSERT_EQUALS_V(1, gc.get_int('G'));
+    ASSERT_TRUE(strcmp(gc.get_command(), "") == 0);
+}
+
+// the command is in the Gcode's own buffer, not allocated
+static bool is_inline(const Gcode& gc)
+{
+    const char *c= gc.get_command();
+    return c >= (const char *)&gc && c < (const char *)(&gc + 1);
+}
+
+TEST(GCodeTest,parse_cost)
+{
+    // build a typical G1 and read all its words as Robot does, prints the time it takes
+    double sum= 0;
+    uint32_t start= us_ticker_read();
+    for (int i = 0; i < 1000; ++i) {
+        Gcode gc("G1 X12.345 Y-67.89 Z-1.5 F1200 S800", nullptr, false);
+        ASSERT_TRUE(is_inline(gc));
+        for (const char *c = "XYZABEFS"; *c; ++c) {
+            if(gc.has_letter(*c)) sum += gc.get_value(*c);
+        }
+    }
+    uint32_t us= us_ticker_read() - start;
+    printf("parse cost: %lu us per G1\n", (unsigned long)(us / 1000));
+    ASSERT_EQUALS_DELTA_V(1000 * (12.345 - 67.89 - 1.5 + 1200 + 800), sum, 1.0);
+}
+
+TEST(GCodeTest,long_line_on_heap)
+{
+    // a common command is kept in the Gcode, the longest line Player reads, 128 characters and the newline, goes on
+    // the heap and reads the same
+    Gcode gc1("G1 X123.4567 Y-234.5678 Z-12.3456 F1200 S800", nullptr);
+    ASSERT_TRUE(is_inline(gc1));
+
+    char line[130];
+    int n= snprintf(line, sizeof(line), "G1 X%.4f Y%.4f Z%.4f A%.4f B%.4f F1200 S800 ", 123.4567, -234.5678, -12.3456, 45.6789, 1.2345);
+    memset(line + n, ' ', 128 - n);
+    line[128]= '\n';
+    line[129]= '\0';
+    Gcode gc(line, nullptr);
+    ASSERT_TRUE(!is_inline(gc));
+    ASSERT_EQUALS_DELTA_V(-234.5678, gc.get_value('Y'), 0.0001);
+    ASSERT_EQUALS_DELTA_V(45.6789, gc.get_value('A'), 0.0001);
+
+    Gcode copy(gc);
+    ASSERT_TRUE(!is_inline(copy));
+    ASSERT_TRUE(copy.get_command() != gc.get_command());
+    ASSERT_EQUALS_DELTA_V(1.2345, copy.get_value('B'), 0.0001);
+}
@@ -0,0 +1,109 @@
+#include "ArcSegments.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "easyunit/test.h"
+
+#define ARC_PI 3.14159265358979F
+
+// cuts a full circle of radius r the way Robot::append_arc does and measures how far the segments get from it, drift
+// is how far the vertices get off the radius and error how far any point of a chord is from the arc. old steps with
+// the small angle approximation and the exact position every 5 segments it used before
+static int circle(float r, float length, bool old, float& drift, float& error)
+{
+    int segments = ceilf(2 * ARC_PI * r / length);
+    float theta = 2 * ARC_PI / segments;
+    float r0 = r, r1 = 0;
+    float p0 = r0, p1 = r1;
+    ArcRotation rotation(r0, r1, theta);
+    float cos_t = 1 - 0.5F * theta * theta, sin_t = theta;
+    int count = 0;
+
+    drift = error = 0;
+    for (int i = 1; i <= segments; ++i) {
+        if(i == segments) {
+            r0 = r;
+            r1 = 0;
+        } else if(!old) {
+            rotation.step(r0, r1);
+        } else if(count < 5) {
+            float t = r0 * sin_t + r1 * cos_t;
+            r0 = r0 * cos_t - r1 * sin_t;
+            r1 = t;
+            count++;
+        } else {
+            r0 = r * cosf(i * theta);
+            r1 = r * sinf(i * theta);
+            count = 0;
+        }
+        // in double so the measuring does not round as much as what it measures
+        float e = fabs(hypot((double)r0, (double)r1) - r);
+        float m = fabs(r - hypot(((double)r0 + p0) / 2, ((double)r1 + p1) / 2));
+        if(e > drift) drift = e;
+        if(e > error) error = e;
+        if(m > error) error = m;
+        p0 = r0;
+        p1 = r1;
+    }
+    return segments;
+}
+
+TEST(ArcSegments,rotation_does_not_drift)
+{
+    // a long way round a large radius in tiny steps
+    const float r = 200;
+    const int n = 50000;
+    float r0 = r, r1 = 0;
+    ArcRotation rotation(r0, r1, 8 * ARC_PI / n);
+    float worst = 0;
+    for (int i = 1; i <= n; ++i) {
+        rotation.step(r0, r1);
+        float e = fabsf(hypotf(r0, r1) - r);
+        if(e > worst) worst = e;
+    }
+    ASSERT_TRUE(worst < 0.0002F);
+    // four times round it is back where it started
+    ASSERT_TRUE(hypotf(r0 - r, r1) < 0.005F);
+}
+
+TEST(ArcSegments,segment_length)
+{
+    // chord error alone, the same as it always was
+    ASSERT_EQUALS_DELTA_V(2 * sqrtf(0.002F * (20 - 0.002F)), arc_segment_length(10, 0.002F, 0, 100, 1000, 0), 0.00001F);
+    // mm_per_arc_segment is still the shortest
+    ASSERT_EQUALS_DELTA_V(0.5F, arc_segment_length(1, 0.002F, 0.5F, 100, 1000, 0), 0.00001F);
+    // neither set
+    ASSERT_EQUALS_DELTA_V(0.5F, arc_segment_length(10, 0, 0, 100, 1000, 0), 0.00001F);
+    // at 100 mm/s on a large radius 200 segments a second are 0.5 mm
+    ASSERT_EQUALS_DELTA_V(0.5F, arc_segment_length(100, 0.0001F, 0, 100, 1000, 200), 0.00001F);
+    // on a small one acceleration keeps it slower than the feed rate
+    ASSERT_EQUALS_DELTA_V(sqrtf(1000 * 2.0F) / 200, arc_segment_length(2, 0.0001F, 0, 100, 1000, 200), 0.00001F);
+}
+
+// segment count and accuracy for typical arcs, before and with arc_segments_per_second, prints a table
+TEST(ArcSegments,benchmark)
+{
+    const float radii[] = {0.5F, 2, 10, 50, 200};
+    const float max_error = 0.002F, rate = 150, acceleration = 1000, sps = 150;
+    const float bound = acceleration / (8 * sps * sps);
+
+    printf("\nfull circles at %g mm/s, mm_max_arc_error %g, acceleration %g: segments, vertex drift, chord error\n", rate, max_error, acceleration);
+    printf("%8s %28s %28s %28s\n", "radius", "before", "exact rotation", "150 segments/s");
+    for (float r : radii) {
+        float d_old, e_old, d_new, e_new, d_sps, e_sps;
+        float length = arc_segment_length(r, max_error, 0, rate, acceleration, 0);
+        int n_old = circle(r, length, true, d_old, e_old);
+        int n_new = circle(r, length, false, d_new, e_new);
+        int n_sps = circle(r, arc_segment_length(r, max_error, 0, rate, acceleration, sps), false, d_sps, e_sps);
+        printf("%8g %8d %9.6f %9.6f %8d %9.6f %9.6f %8d %9.6f %9.6f\n", r, n_old, d_old, e_old, n_new, d_new, e_new, n_sps, d_sps, e_sps);
+
+        ASSERT_EQUALS_V(n_old, n_new);
+        ASSERT_TRUE(d_new <= 0.00002F * r + 0.000001F);
+        ASSERT_TRUE(d_new <= d_old + 0.000001F);
+        // plus where the vertices round to
+        ASSERT_TRUE(e_new <= max_error * 1.001F + d_new);
+        ASSERT_TRUE(n_sps <= n_new);
+        ASSERT_TRUE(e_sps <= fmaxf(max_error, bound) * 1.001F + d_sps);
+    }
+}
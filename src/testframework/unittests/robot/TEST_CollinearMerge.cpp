@@ -0,0 +1,90 @@
+#include "CollinearMerge.h"
+
+#include <math.h>
+
+#include "easyunit/test.h"
+
+// distance of p from the line through a and b
+static float off_line(const float a[3], const float b[3], const float p[3])
+{
+    float d[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float v[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+    float s = (v[0] * d[0] + v[1] * d[1] + v[2] * d[2]) / (d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    float e[3] = {v[0] - s * d[0], v[1] - s * d[1], v[2] - s * d[2]};
+    return sqrtf(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+}
+
+TEST(CollinearMerge,straight_line)
+{
+    CollinearMerge m;
+    float start[3] = {0, 0, 0};
+    float p[3] = {0.5F, 0.25F, -0.1F};
+    m.begin(start, p);
+    for (int i = 2; i <= MAX_MERGED_SEGMENTS; ++i) {
+        float q[3] = {0.5F * i, 0.25F * i, -0.1F * i};
+        ASSERT_TRUE(m.extend(q, 0.001F));
+    }
+    ASSERT_EQUALS_V(MAX_MERGED_SEGMENTS, m.get_count());
+
+    // no more than that in one block
+    const int n = MAX_MERGED_SEGMENTS + 1;
+    float q[3] = {0.5F * n, 0.25F * n, -0.1F * n};
+    ASSERT_TRUE(!m.extend(q, 0.001F));
+    ASSERT_EQUALS_DELTA_V(0.5F * (n - 1), m.last()[0], 0.0001F);
+}
+
+TEST(CollinearMerge,arc_within_tolerance)
+{
+    // 0.5mm segments around a 20mm radius, every point of a run has to stay within tolerance of where it is merged to
+    const float r = 20, step = 0.5F / r, tolerance = 0.01F;
+    float pts[200][3];
+    for (int i = 0; i < 200; ++i) {
+        pts[i][0] = r * sinf(i * step);
+        pts[i][1] = r - r * cosf(i * step);
+        pts[i][2] = 0;
+    }
+
+    CollinearMerge m;
+    int first = 0, runs = 1, worst_run = 0;
+    float worst = 0;
+    m.begin(pts[0], pts[1]);
+    for (int i = 2; i < 200; ++i) {
+        if(m.extend(pts[i], tolerance)) continue;
+        // the run from first to i - 1 is a block
+        for (int j = first + 1; j < i - 1; ++j) {
+            float e = off_line(pts[first], pts[i - 1], pts[j]);
+            if(e > worst) worst = e;
+        }
+        if(i - 1 - first > worst_run) worst_run = i - 1 - first;
+        first = i - 1;
+        m.begin(pts[first], pts[i]);
+        runs++;
+    }
+
+    ASSERT_TRUE(worst <= tolerance * 1.001F);
+    // a chord with a sagitta of 0.01 on a 20mm radius is about 1.26mm, 2 segments of 0.5
+    ASSERT_EQUALS_V(2, worst_run);
+    ASSERT_TRUE(runs < 199);
+}
+
+TEST(CollinearMerge,rejects)
+{
+    CollinearMerge m;
+    float start[3] = {0, 0, 0};
+    float p1[3] = {1, 0, 0};
+    m.begin(start, p1);
+
+    // a corner
+    float corner[3] = {1, 1, 0};
+    ASSERT_TRUE(!m.extend(corner, 0.01F));
+    // going back over itself
+    float back[3] = {0.5F, 0, 0};
+    ASSERT_TRUE(!m.extend(back, 0.01F));
+    // just off line by more than the tolerance at the middle point
+    float off[3] = {2, 0.03F, 0};
+    ASSERT_TRUE(!m.extend(off, 0.01F));
+    ASSERT_EQUALS_V(1, m.get_count());
+    float on[3] = {2, 0.01F, 0};
+    ASSERT_TRUE(m.extend(on, 0.01F));
+    ASSERT_EQUALS_V(2, m.get_count());
+}
@@ -0,0 +1,107 @@
+#include "CubicBezier.h"
+
+#include <math.h>
+
+#include "easyunit/test.h"
+
+// distance of p from the segment a to b
+static float off_segment(const float a[2], const float b[2], const float p[2])
+{
+    float d[2] = {b[0] - a[0], b[1] - a[1]};
+    float v[2] = {p[0] - a[0], p[1] - a[1]};
+    float l2 = d[0] * d[0] + d[1] * d[1];
+    float s = l2 > 0 ? (v[0] * d[0] + v[1] * d[1]) / l2 : 0;
+    if(s < 0) s = 0;
+    if(s > 1) s = 1;
+    return hypotf(v[0] - s * d[0], v[1] - s * d[1]);
+}
+
+// segments the curve and measures how far it gets from them, sampled finely between the ends of each
+static int segment(const CubicBezier& b, float tolerance, float min_length, float& worst, float& shortest)
+{
+    int n = 0;
+    worst = 0;
+    shortest = 1e9F;
+    float t = 0;
+    float a[2];
+    b.point(0, a);
+    while(t < 1 && n < 100000) {
+        float t1 = b.next(t, tolerance, min_length);
+        float e[2];
+        b.point(t1, e);
+        for (int i = 1; i < 50; ++i) {
+            float p[2];
+            b.point(t + (t1 - t) * i / 50, p);
+            float d = off_segment(a, e, p);
+            if(d > worst) worst = d;
+        }
+        if(t1 < 1 && hypotf(e[0] - a[0], e[1] - a[1]) < shortest) shortest = hypotf(e[0] - a[0], e[1] - a[1]);
+        a[0] = e[0];
+        a[1] = e[1];
+        t = t1;
+        n++;
+    }
+    return n;
+}
+
+TEST(CubicBezier,ends)
+{
+    float p0[2] = {1, 2}, p1[2] = {5, 10}, p2[2] = {20, -4}, p3[2] = {30, 3};
+    CubicBezier b(p0, p1, p2, p3);
+    float p[2];
+    b.point(0, p);
+    ASSERT_EQUALS_DELTA_V(1.0F, p[0], 0.0001F);
+    ASSERT_EQUALS_DELTA_V(2.0F, p[1], 0.0001F);
+    b.point(1, p);
+    ASSERT_EQUALS_DELTA_V(30.0F, p[0], 0.0001F);
+    ASSERT_EQUALS_DELTA_V(3.0F, p[1], 0.0001F);
+    // the de Casteljau midpoint
+    b.point(0.5F, p);
+    ASSERT_EQUALS_DELTA_V((1 + 3 * 5 + 3 * 20 + 30) / 8.0F, p[0], 0.0001F);
+    ASSERT_EQUALS_DELTA_V((2 + 3 * 10 + 3 * -4 + 3) / 8.0F, p[1], 0.0001F);
+}
+
+TEST(CubicBezier,straight_is_one_segment)
+{
+    float p0[2] = {0, 0}, p1[2] = {1, 1}, p2[2] = {2, 2}, p3[2] = {3, 3};
+    CubicBezier b(p0, p1, p2, p3);
+    ASSERT_EQUALS_DELTA_V(1.0F, b.next(0, 0.001F, 0), 0.00001F);
+}
+
+TEST(CubicBezier,within_tolerance)
+{
+    // an S curve with a tight end, like a CAM fillet into a sweep
+    float p0[2] = {0, 0}, p1[2] = {40, 0}, p2[2] = {-10, 30}, p3[2] = {30, 30};
+    CubicBezier b(p0, p1, p2, p3);
+
+    const float tolerances[] = {0.1F, 0.01F, 0.002F};
+    int last = 0;
+    for (float tolerance : tolerances) {
+        float worst, shortest;
+        int n = segment(b, tolerance, 0, worst, shortest);
+        ASSERT_TRUE(worst <= tolerance * 1.01F);
+        // not wasting segments, the bound is within a factor of the true error
+        ASSERT_TRUE(worst > tolerance * 0.3F);
+        // ten times tighter takes about sqrt(10) times as many
+        ASSERT_TRUE(n > last);
+        last = n;
+    }
+    ASSERT_TRUE(last < 400);
+}
+
+TEST(CubicBezier,min_length)
+{
+    float p0[2] = {0, 0}, p1[2] = {40, 0}, p2[2] = {-10, 30}, p3[2] = {30, 30};
+    CubicBezier b(p0, p1, p2, p3);
+
+    float worst, shortest;
+    int tight = segment(b, 0.0005F, 0, worst, shortest);
+    int n = segment(b, 0.0005F, 0.5F, worst, shortest);
+    ASSERT_TRUE(n < tight);
+    ASSERT_TRUE(shortest > 0.45F);
+
+    // no tolerance steps by the length alone
+    n = segment(b, 0, 2, worst, shortest);
+    ASSERT_TRUE(shortest > 1.8F);
+    ASSERT_TRUE(n > 20 && n < 60);
+}
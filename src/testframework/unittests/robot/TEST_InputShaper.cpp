@@ -0,0 +1,246 @@
+#include "InputShaper.h"
+#include "Kernel.h"
+#include "Test_kernel.h"
+#include "StepTicker.h"
+#include "StepperMotor.h"
+#include "Conveyor.h"
+#include "Planner.h"
+#include "Robot.h"
+#include "Block.h"
+#include "Gcode.h"
+#include "StreamOutput.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include "easyunit/test.h"
+
+#define TICK_FREQUENCY 100000.0F
+#define FPSCALE (1LL << 62)
+
+// how much of the vibration a step in acceleration starts is left once all the impulses are done, 1 unshaped
+static float residual(const InputShaper& s, float frequency, float damping)
+{
+    double w = 2 * M_PI * frequency, wd = w * sqrt(1 - damping * damping);
+    double end = s.get_offset(s.get_count() - 1) / TICK_FREQUENCY;
+    double c = 0, si = 0;
+    for (int i = 0; i < s.get_count(); ++i) {
+        double t = s.get_offset(i) / TICK_FREQUENCY;
+        double e = exp(-damping * w * (end - t));
+        c += s.get_amplitude(i) * e * cos(wd * t);
+        si += s.get_amplitude(i) * e * sin(wd * t);
+    }
+    return sqrt(c * c + si * si);
+}
+
+TEST(InputShaper,impulses)
+{
+    InputShaper s;
+    ASSERT_TRUE(!s.is_active());
+
+    // undamped ZV is two halves half a period apart
+    s.configure(InputShaper::ZV, 40, 0, TICK_FREQUENCY, 0.5F);
+    ASSERT_EQUALS_V(2, s.get_count());
+    ASSERT_EQUALS_DELTA_V(0.5F, s.get_amplitude(0), 0.0001F);
+    ASSERT_EQUALS_V(1250, (int)s.get_duration());
+    ASSERT_EQUALS_V(0, (int)s.get_delay());
+
+    // damped the later impulses are smaller, they all add up to one, ZVD and EI take a whole period
+    const InputShaper::TYPE types[] = {InputShaper::ZV, InputShaper::ZVD, InputShaper::EI};
+    for (InputShaper::TYPE t : types) {
+        s.configure(t, 40, 0.1F, TICK_FREQUENCY, 0.5F);
+        float sum = 0;
+        for (int i = 0; i < s.get_count(); ++i) sum += s.get_amplitude(i);
+        ASSERT_EQUALS_DELTA_V(1.0F, sum, 0.0001F);
+        ASSERT_TRUE(s.get_amplitude(s.get_count() - 1) < s.get_amplitude(0));
+        ASSERT_TRUE(s.get_delay() > 0);
+        ASSERT_EQUALS_V((t == InputShaper::ZV ? 1256 : 2513), (int)s.get_duration());
+    }
+
+    // off, or too fast to spread over ticks
+    s.configure(InputShaper::ZV, 0, 0.1F, TICK_FREQUENCY, 0.5F);
+    ASSERT_TRUE(!s.is_active());
+    s.configure(InputShaper::ZV, 200000, 0.1F, TICK_FREQUENCY, 0.5F);
+    ASSERT_TRUE(!s.is_active());
+    ASSERT_TRUE(!s.shapes(1000000));
+}
+
+TEST(InputShaper,residual_vibration)
+{
+    InputShaper zv, zvd, ei;
+    zv.configure(InputShaper::ZV, 40, 0.1F, TICK_FREQUENCY, 0.5F);
+    zvd.configure(InputShaper::ZVD, 40, 0.1F, TICK_FREQUENCY, 0.5F);
+    ei.configure(InputShaper::EI, 40, 0.1F, TICK_FREQUENCY, 0.5F);
+
+    // all but gone at the frequency they are tuned to, EI leaves its 5%
+    ASSERT_TRUE(residual(zv, 40, 0.1F) < 0.01F);
+    ASSERT_TRUE(residual(zvd, 40, 0.1F) < 0.01F);
+    ASSERT_TRUE(residual(ei, 40, 0.1F) < 0.06F);
+
+    // 15% off ZVD and EI still take most of it out, more than ZV does
+    ASSERT_TRUE(residual(zv, 34, 0.1F) > residual(zvd, 34, 0.1F));
+    ASSERT_TRUE(residual(ei, 34, 0.1F) < 0.1F);
+    ASSERT_TRUE(residual(ei, 46, 0.1F) < 0.1F);
+}
+
+TEST(InputShaper,ramp_levels)
+{
+    InputShaper s;
+    s.configure(InputShaper::ZV, 40, 0, TICK_FREQUENCY, 0.5F);
+
+    // a ramp of 5000 ticks, half the peak for the first 1250, all of it to 3750, then half to the end
+    uint8_t rise = 0, fall = 0;
+    uint32_t level;
+    ASSERT_EQUALS_V(1250, (int)s.advance(0, 0, 5000, rise, fall, level));
+    ASSERT_EQUALS_V(INPUT_SHAPER_ONE / 2, (int)level);
+    ASSERT_EQUALS_V(3750, (int)s.advance(1250, 0, 5000, rise, fall, level));
+    ASSERT_EQUALS_V(INPUT_SHAPER_ONE, (int)level);
+    ASSERT_EQUALS_V((int)UINT32_MAX, (int)s.advance(3750, 0, 5000, rise, fall, level));
+    ASSERT_EQUALS_V(INPUT_SHAPER_ONE / 2, (int)level);
+
+    // planned at half the acceleration the peak is within it from twice the duration, at three quarters from four times
+    ASSERT_TRUE(s.shapes(2500));
+    ASSERT_TRUE(!s.shapes(2499));
+    s.configure(InputShaper::ZV, 40, 0, TICK_FREQUENCY, 0.75F);
+    ASSERT_TRUE(s.shapes(5000));
+    ASSERT_TRUE(!s.shapes(4999));
+}
+
+// the motion pipeline as main() loads it, X at 100 steps/mm with 4000 mm/s² shaped at 40 Hz by type, planned at half
+// that, nothing else moves
+static void load_motion(const char *type)
+{
+    static std::string config;
+    config = std::string("\
+alpha_step_pin 1.28\n\
+alpha_dir_pin 1.29\n\
+beta_step_pin 1.26\n\
+beta_dir_pin 1.27\n\
+gamma_step_pin 1.24\n\
+gamma_dir_pin 1.25\n\
+alpha_steps_per_mm 100\n\
+gamma_steps_per_mm 100\n\
+alpha_max_rate 30000\n\
+x_axis_max_speed 30000\n\
+acceleration 4000\n\
+mm_per_line_segment 0\n\
+soft_endstop.enable false\n\
+input_shaper_acceleration_ratio 0.5\n\
+input_shaper_frequency_x 40\n\
+input_shaper_type ") + type + "\n";
+
+    if(THEKERNEL->config != nullptr) test_kernel_teardown();
+    test_kernel_setup_config(config.data(), config.data() + config.size());
+    if(THEROBOT == nullptr) {
+        THEKERNEL->base_stepping_frequency = TICK_FREQUENCY;
+        THEKERNEL->step_ticker = new StepTicker();
+        THEKERNEL->add_module(THEKERNEL->conveyor = new Conveyor());
+        THEKERNEL->add_module(THEKERNEL->robot = new Robot());
+        THEKERNEL->planner = new Planner();
+        THECONVEYOR->start(THEROBOT->get_number_registered_motors());
+    } else {
+        // only the planner reads the shaper settings
+        delete THEKERNEL->planner;
+        THEKERNEL->planner = new Planner();
+    }
+}
+
+static void send(const char *line)
+{
+    Gcode gc(line, &StreamOutput::NullStream);
+    THEKERNEL->call_event(ON_GCODE_RECEIVED, &gc);
+}
+
+// X moves steps/100 mm from a stop to a stop at rate steps/s, with the ramps shaped if shaped. The step ticker is
+// ticked here instead of by its timer, fills in the tick of each step, the peak acceleration Block::prepare() set for
+// the acceleration ramp in steps/s² and whether it is shaped, and returns the ticks taken
+static uint32_t move(bool shaped, uint32_t steps, float rate, uint32_t *step_ticks, float& peak, bool& ramp_shaped)
+{
+    char line[64];
+    send(shaped ? "M593 S1" : "M593 S0");
+    // unshaped at the acceleration the shaped ramps average
+    send(shaped ? "M204 S4000" : "M204 S2000");
+    snprintf(line, sizeof(line), "G1 X%g F%g", steps / 100.0F, rate / 100 * 60);
+    send("G91");
+    send(line);
+    send("G90");
+    THECONVEYOR->force_queue();
+
+    StepTicker *st = THEKERNEL->step_ticker;
+    StepperMotor *x = THEROBOT->actuators[X_AXIS];
+    int32_t from = x->get_current_step();
+    uint32_t step_count = 0, tick = 0;
+    peak = 0;
+    ramp_shaped = false;
+    for (tick = 0; ; ++tick) {
+        st->step_tick();
+        if(tick == 0 && st->get_current_block() != nullptr) {
+            const Block::tickinfo_t& ti = st->get_current_block()->tick_info[X_AXIS];
+            const Block::rampinfo_t& ri = st->get_current_block()->ramp_info[X_AXIS];
+            ramp_shaped = (ri.shape_ramps & Block::SHAPE_ACCEL) != 0;
+            peak = (ramp_shaped ? ri.accel_peak : ti.acceleration_change) / (double)FPSCALE * TICK_FREQUENCY * TICK_FREQUENCY;
+        }
+        while(step_count < (uint32_t)((int32_t)x->get_current_step() - from) && step_count < steps) step_ticks[step_count++] = tick;
+        if(st->is_idle()) break;
+    }
+    THECONVEYOR->wait_for_idle();
+    return tick + 1;
+}
+
+TEST(InputShaper,step_timing)
+{
+    // 16000 steps at 40000 steps/s with 200000 steps/s², 20000 tick ramps and a 20000 tick plateau, 60000 ticks in all
+    const uint32_t steps = 16000, ramp = 20000;
+    const float rate = 40000, acceleration = 200000, limit = 400000;
+    static uint32_t plain[steps], shaped[steps];
+
+    const InputShaper::TYPE types[] = {InputShaper::ZV, InputShaper::ZVD, InputShaper::EI};
+    const float dampings[] = {0, 0.1F};
+    for (InputShaper::TYPE t : types) {
+        load_motion(InputShaper::type_name(t));
+        float peak;
+        bool ramp_shaped;
+        uint32_t plain_ticks = move(false, steps, rate, plain, peak, ramp_shaped);
+        ASSERT_TRUE(!ramp_shaped);
+
+        for (float damping : dampings) {
+            char line[64];
+            snprintf(line, sizeof(line), "M593 X F40 D%g", damping);
+            send(line);
+            const InputShaper& s = THEKERNEL->planner->get_input_shaper(X_AXIS);
+            uint32_t shaped_ticks = move(true, steps, rate, shaped, peak, ramp_shaped);
+            ASSERT_TRUE(ramp_shaped);
+
+            // the staircase peaks within the acceleration the move is limited to
+            uint32_t n = ramp - s.get_delay() - s.get_duration();
+            ASSERT_EQUALS_DELTA_V(acceleration * ramp / n, peak, acceleration * 0.01F);
+            ASSERT_TRUE(peak <= limit);
+
+            // the first step waits for the staircase to start, then is where constant acceleration at the part of
+            // the peak the first impulse is would put it
+            float a0 = peak * s.get_amplitude(0);
+            float first = s.get_delay() + sqrtf(2 / a0) * TICK_FREQUENCY;
+            ASSERT_TRUE(fabsf(shaped[0] - first) < 2);
+
+            // steps in the middle of the plateau are where they would be without shaping and the move takes as long,
+            // give or take the last step. Coming to a stop at the last impulse's part of the peak deceleration, the
+            // half a step the impulses rounding to ticks can add up to moves it by a lot of ticks
+            float a_last = peak * s.get_amplitude(s.get_count() - 1);
+            uint32_t stop = sqrtf(2 * 0.5F / a_last) * TICK_FREQUENCY;
+            int32_t d = (int32_t)shaped[steps / 2] - (int32_t)plain[steps / 2];
+            printf("\n%s damping %g: %u impulses over %u ticks after %u, peak %1.0f steps/s², move takes %u ticks, %u unshaped, middle step %d ticks off",
+                   InputShaper::type_name(t), damping, s.get_count(), s.get_duration(), s.get_delay(), peak, shaped_ticks, plain_ticks, d);
+            ASSERT_TRUE(d >= -1 && d <= 1);
+            ASSERT_TRUE(shaped_ticks <= plain_ticks + stop && shaped_ticks + stop >= plain_ticks);
+        }
+
+        // a ramp too short for the staircase to stay within the limit is left at constant acceleration, 2000 ticks
+        uint32_t short_ticks = move(true, 800, 4000, shaped, peak, ramp_shaped);
+        ASSERT_TRUE(!ramp_shaped);
+        ASSERT_EQUALS_DELTA_V(acceleration, peak, acceleration * 0.01F);
+        ASSERT_TRUE(short_ticks > 0);
+    }
+    printf("\n");
+}
@@ -0,0 +1,196 @@
+#include "GridCoefficients.h"
+#include "us_ticker_api.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+#include "easyunit/test.h"
+
+#define NX 7
+#define NY 5
+
+// the bilinear interpolation CartGridStrategy::doCompensation did from the grid before it used the coefficients
+static float reference_offset(const float *grid, int nx, int ny, float x_start, float y_start, float x_size, float y_size, float x, float y)
+{
+    float min_x = std::min(x_start, x_start + x_size);
+    float max_x = std::max(x_start, x_start + x_size);
+    float min_y = std::min(y_start, y_start + y_size);
+    float max_y = std::max(y_start, y_start + y_size);
+    if (x < min_x - 0.001 || x > max_x + 0.001 || y < min_y - 0.001 || y > max_y + 0.001) return NAN;
+
+    float grid_x = std::max(0.001F, std::min(nx - 1.001F, (x - x_start) / (x_size / (nx - 1))));
+    float grid_y = std::max(0.001F, std::min(ny - 1.001F, (y - y_start) / (y_size / (ny - 1))));
+    int floor_x = floorf(grid_x);
+    int floor_y = floorf(grid_y);
+    float ratio_x = grid_x - floor_x;
+    float ratio_y = grid_y - floor_y;
+    float z1 = grid[(floor_x) + ((floor_y) * nx)];
+    float z2 = grid[(floor_x) + ((floor_y + 1) * nx)];
+    float z3 = grid[(floor_x + 1) + ((floor_y) * nx)];
+    float z4 = grid[(floor_x + 1) + ((floor_y + 1) * nx)];
+    float left = (1 - ratio_y) * z1 + ratio_y * z2;
+    float right = (1 - ratio_y) * z3 + ratio_y * z4;
+    return (1 - ratio_x) * left + ratio_x * right;
+}
+
+static void make_grid(float *grid)
+{
+    // a warped bed, up to about 0.3mm
+    for (int y = 0; y < NY; ++y) {
+        for (int x = 0; x < NX; ++x) {
+            grid[x + NX * y] = 0.2F * sinf(x * 0.9F) + 0.1F * cosf(y * 1.3F) - 0.01F * x * y;
+        }
+    }
+}
+
+// how many points over the grid and a bit past its edges the table gets a different offset for than the grid
+static int mismatches(float x_start, float y_start, float x_size, float y_size)
+{
+    float grid[NX * NY];
+    make_grid(grid);
+    GridCoefficients gc;
+    if(!gc.build(grid, NX, NY, x_start, y_start, x_size, y_size, false)) return -1;
+
+    int n = 0;
+    for (int i = -2; i <= 52; ++i) {
+        for (int j = -2; j <= 52; ++j) {
+            float x = x_start + x_size * i / 50.0F;
+            float y = y_start + y_size * j / 50.0F;
+            float expected = reference_offset(grid, NX, NY, x_start, y_start, x_size, y_size, x, y);
+            float got = gc.offset(x, y);
+            // out of bounds is NAN for both
+            if(isnan(expected) ? !isnan(got) : !(fabsf(expected - got) <= 0.00001F)) n++;
+        }
+    }
+    return n;
+}
+
+TEST(GridCoefficients,bilinear_matches_grid_interpolation)
+{
+    ASSERT_EQUALS_V(0, mismatches(0, 0, 300, 200));
+    ASSERT_EQUALS_V(0, mismatches(-10.5F, 20.25F, 120, 80));
+    // negative sizes, as the legacy grids allowed
+    ASSERT_EQUALS_V(0, mismatches(100, 50, -100, -50));
+}
+
+TEST(GridCoefficients,incomplete_grid)
+{
+    float grid[NX * NY];
+    make_grid(grid);
+    grid[3 + NX * 2] = NAN;
+    GridCoefficients gc;
+    ASSERT_TRUE(gc.build(grid, NX, NY, 0, 0, 60, 40, false));
+    ASSERT_TRUE(isnan(gc.offset(30, 20)));
+    ASSERT_TRUE(!isnan(gc.offset(1, 1)));
+}
+
+TEST(GridCoefficients,bicubic)
+{
+    float grid[NX * NY];
+    make_grid(grid);
+    GridCoefficients gc;
+    ASSERT_TRUE(gc.build(grid, NX, NY, 0, 0, 60, 40, true));
+    ASSERT_TRUE(gc.is_bicubic());
+
+    // goes through the grid points, away from the 0.001 kept off the outer edges
+    for (int y = 1; y < NY - 1; ++y) {
+        for (int x = 1; x < NX - 1; ++x) {
+            ASSERT_EQUALS_DELTA_V(grid[x + NX * y], gc.offset(x * 10.0F, y * 10.0F), 0.00001F);
+        }
+    }
+
+    // a tilted flat bed is followed exactly everywhere, including the edge cells
+    for (int y = 0; y < NY; ++y) {
+        for (int x = 0; x < NX; ++x) {
+            grid[x + NX * y] = 0.3F + 0.002F * x * 10 - 0.001F * y * 10;
+        }
+    }
+    ASSERT_TRUE(gc.build(grid, NX, NY, 0, 0, 60, 40, true));
+    for (float y = 0; y <= 40; y += 1.3F) {
+        for (float x = 0; x <= 60; x += 1.7F) {
+            float z = 0.3F + 0.002F * x - 0.001F * y;
+            ASSERT_EQUALS_DELTA_V(z, gc.offset(x, y), 0.0001F);
+        }
+    }
+    ASSERT_TRUE(isnan(gc.offset(61, 20)));
+}
+
+// how far straight segments between the splits of a line get from the surface under it, at most
+static float split_error(const GridCoefficients& gc, float x0, float y0, float x1, float y1, int& n)
+{
+    float t[64];
+    n = gc.splits(x0, y0, x1, y1, 0.001F, t, 64);
+    if(n < 0) return NAN;
+
+    float err = 0;
+    for (int i = 0; i <= n; ++i) {
+        float ta = i > 0 ? t[i - 1] : 0;
+        float tb = i < n ? t[i] : 1;
+        if(tb <= ta) return NAN;
+        float za = gc.offset(x0 + (x1 - x0) * ta, y0 + (y1 - y0) * ta);
+        float zb = gc.offset(x0 + (x1 - x0) * tb, y0 + (y1 - y0) * tb);
+        for (int j = 1; j < 20; ++j) {
+            float f = ta + (tb - ta) * j / 20;
+            float z = gc.offset(x0 + (x1 - x0) * f, y0 + (y1 - y0) * f);
+            err = std::max(err, fabsf(z - (za + (zb - za) * j / 20)));
+        }
+    }
+    return err;
+}
+
+TEST(GridCoefficients,splits)
+{
+    float grid[NX * NY];
+    make_grid(grid);
+    GridCoefficients gc;
+    ASSERT_TRUE(gc.build(grid, NX, NY, 0, 0, 60, 40, false));
+
+    // along X only the grid lines matter, 10 mm cells (off the edges, where the offset is taken 0.001 of a cell in)
+    int n;
+    float err = split_error(gc, 1, 5, 59, 5, n);
+    ASSERT_EQUALS_V(5, n);
+    ASSERT_TRUE(err < 0.00001F);
+
+    // diagonally the cells are twisted, it is split within them as well, the first goes through the grid point at 30,20
+    err = split_error(gc, 1, 2, 59, 38, n);
+    ASSERT_TRUE(n > 8);
+    ASSERT_TRUE(err <= 0.0011F);
+    err = split_error(gc, 55, 1, 3, 33, n);
+    ASSERT_TRUE(err <= 0.0011F);
+
+    // inside a cell nothing, a bicubic surface can not be followed by splitting
+    split_error(gc, 12, 12, 18, 12, n);
+    ASSERT_EQUALS_V(0, n);
+    ASSERT_TRUE(gc.build(grid, NX, NY, 0, 0, 60, 40, true));
+    float t[64];
+    ASSERT_EQUALS_V(-1, gc.splits(0, 5, 60, 5, 0.001F, t, 64));
+}
+
+TEST(GridCoefficients,speed)
+{
+    // calls/second of the old interpolation from the grid and of the coefficient table, for a pass over the grid
+    float grid[NX * NY];
+    make_grid(grid);
+    GridCoefficients bilinear, bicubic;
+    ASSERT_TRUE(bilinear.build(grid, NX, NY, 0, 0, 300, 200, false));
+    ASSERT_TRUE(bicubic.build(grid, NX, NY, 0, 0, 300, 200, true));
+
+    const int n = 10000;
+    float sum[3] = {0, 0, 0};
+    uint32_t us[3];
+    for (int k = 0; k < 3; ++k) {
+        uint32_t start = us_ticker_read();
+        for (int i = 0; i < n; ++i) {
+            float x = (i % 100) * 3.0F;
+            float y = (i / 100) * 2.0F;
+            if(k == 0) sum[k] += reference_offset(grid, NX, NY, 0, 0, 300, 200, x, y);
+            else if(k == 1) sum[k] += bilinear.offset(x, y);
+            else sum[k] += bicubic.offset(x, y);
+        }
+        us[k] = std::max(1UL, (unsigned long)(us_ticker_read() - start));
+    }
+    printf("grid compensation calls/s: from the grid %lu, bilinear coefficients %lu, bicubic coefficients %lu\n",
+           (unsigned long)(n * 1000000ULL / us[0]), (unsigned long)(n * 1000000ULL / us[1]), (unsigned long)(n * 1000000ULL / us[2]));
+    ASSERT_EQUALS_DELTA_V(sum[0], sum[1], 0.01F);
+}